@@ -0,0 +1,2106 @@
+/*
+** 2026 October 18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** This file contains code for the "colstore" virtual table module, which
+** stores the content of a table by column instead of by row, so that a
+** query that uses a few columns of a wide table reads only those columns.
+*/
+
+/*
+** Database Format of Colstore Tables
+** ----------------------------------
+**
+** The content of a single colstore table is stored in four native SQLite
+** tables declared as follows. In each case, the '%' character in the
+** table name is replaced with the user-supplied name of the table.
+**
+**   CREATE TABLE %_segment(segno INTEGER PRIMARY KEY, nrow INTEGER,
+**                          minrowid INTEGER, maxrowid INTEGER, zone BLOB)
+**   CREATE TABLE %_data(id INTEGER PRIMARY KEY, data BLOB)
+**   CREATE TABLE %_deleted(segno INTEGER, id INTEGER, PRIMARY KEY(segno, id))
+**   CREATE TABLE %_pending(id INTEGER PRIMARY KEY AUTOINCREMENT, c0, c1...)
+**
+** New rows are written to the %_pending table, one column per column of
+** the virtual table. Once it holds COLSTORE_SEGMENT_ROWS rows they are
+** moved, in rowid order, to a new segment. Each segment has a row in the
+** %_segment table giving the number of rows it holds, the smallest and
+** largest rowid among them and a zone map (see below). The rowids of
+** segment S are stored as a single blob in the %_data table with id
+** (S<<16), and the values of its Nth column (the leftmost is column 0)
+** in the blob with id (S<<16)+N+1.
+**
+** Segments are never modified. A row deleted from a segment is recorded
+** in the %_deleted table, and the segment is removed once all its rows
+** have been deleted. An UPDATE deletes the old row and writes the new
+** one to the %_pending table.
+**
+** Each value is serialized as a type byte followed by its content:
+**
+**     0x00   NULL, no content
+**     0x01   INTEGER, zig-zag encoded as a varint
+**     0x02   REAL, 8 byte big-endian IEEE double
+**     0x03   TEXT, varint byte count followed by the UTF-8 text
+**     0x04   BLOB, varint byte count followed by the blob
+**
+** Varints hold 7 bits per byte, least significant group first, with the
+** 0x80 bit set on every byte but the last. A column blob begins with a
+** byte identifying one of the following encodings:
+**
+**     0x00   PLAIN: one serialized value for each row.
+**     0x01   RLE: a run length varint followed by a serialized value,
+**            repeated until all rows are accounted for.
+**     0x02   DICT: a varint count of up to 256 dictionary entries, the
+**            serialized entries, then one byte for each row holding the
+**            index of the entry it uses.
+**     0x03   DELTA: for columns that hold only integers, the difference
+**            between each value and the one before it (or zero, for the
+**            first) zig-zag encoded as a varint.
+**
+** When a segment is written, each column is stored using whichever of
+** these encodings is smallest for its content.
+**
+** The zone field of the %_segment table holds an entry for each column
+** of the virtual table. Each is a byte that is 0x00 if the column holds
+** only NULL values in the segment, 0x01 if it is followed by the smallest
+** and largest non-NULL values of the column in the segment, or 0x02 if
+** there is no zone map for the column (because those values are larger
+** than COLSTORE_MAX_ZONE bytes).
+*/
+
+#if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_COLSTORE)
+
+#if !defined(NDEBUG) && !defined(SQLITE_DEBUG)
+# define NDEBUG 1
+#endif
+
+#ifndef SQLITE_CORE
+  #include "sqlite3ext.h"
+  SQLITE_EXTENSION_INIT1
+#else
+  #include "sqlite3.h"
+#endif
+
+#include <string.h>
+#include <assert.h>
+
+#ifndef SQLITE_AMALGAMATION
+typedef sqlite3_int64 i64;
+typedef sqlite3_uint64 u64;
+typedef unsigned char u8;
+#endif
+
+#ifndef LARGEST_INT64
+# define LARGEST_INT64  (0xffffffff|(((i64)0x7fffffff)<<32))
+# define SMALLEST_INT64 (((i64)-1) - LARGEST_INT64)
+#endif
+
+/*  The following macro is used to suppress compiler warnings.
+*/
+#ifndef UNUSED_PARAMETER
+# define UNUSED_PARAMETER(x) (void)(x)
+#endif
+
+/*
+** Number of rows collected in the %_pending table before they are moved
+** to a new segment.
+*/
+#ifndef COLSTORE_SEGMENT_ROWS
+# define COLSTORE_SEGMENT_ROWS 1024
+#endif
+
+/*
+** The largest number of columns a colstore table may have. Column
+** numbers are stored in the low 16 bits of %_data ids.
+*/
+#define COLSTORE_MAX_COLUMNS 2000
+
+/*
+** Text and blob values larger than this many bytes are not stored in
+** zone maps.
+*/
+#define COLSTORE_MAX_ZONE 64
+
+/* Serialized value types */
+#define COLSTORE_NULL 0
+#define COLSTORE_INT  1
+#define COLSTORE_REAL 2
+#define COLSTORE_TEXT 3
+#define COLSTORE_BLOB 4
+
+/* Column blob encodings */
+#define COLSTORE_ENC_PLAIN 0
+#define COLSTORE_ENC_RLE   1
+#define COLSTORE_ENC_DICT  2
+#define COLSTORE_ENC_DELTA 3
+
+/* Zone map entry types */
+#define COLSTORE_ZONE_EMPTY 0
+#define COLSTORE_ZONE_RANGE 1
+#define COLSTORE_ZONE_NONE  2
+
+/* Constraint operators, as they appear in idxStr */
+#define COLSTORE_EQ 'a'
+#define COLSTORE_GT 'b'
+#define COLSTORE_LE 'c'
+#define COLSTORE_LT 'd'
+#define COLSTORE_GE 'e'
+
+/* Values for ColstoreCursor.eState */
+#define COLSTORE_STATE_SEGMENT 0    /* Visiting the rows of segments */
+#define COLSTORE_STATE_PENDING 1    /* Visiting rows of %_pending */
+#define COLSTORE_STATE_EOF     2    /* No more rows */
+
+/* Indexes of statements in Colstore.aStmt[] */
+#define COLSTORE_READ_DATA       0
+#define COLSTORE_WRITE_DATA      1
+#define COLSTORE_DELETE_DATA     2
+#define COLSTORE_FIND_SEGMENT    3
+#define COLSTORE_WRITE_SEGMENT   4
+#define COLSTORE_DELETE_SEGMENT  5
+#define COLSTORE_READ_DELETED    6
+#define COLSTORE_TEST_DELETED    7
+#define COLSTORE_WRITE_DELETED   8
+#define COLSTORE_COUNT_DELETED   9
+#define COLSTORE_DELETE_DELETED 10
+#define COLSTORE_TEST_PENDING   11
+#define COLSTORE_DELETE_PENDING 12
+#define COLSTORE_COUNT_PENDING  13
+#define COLSTORE_WRITE_PENDING  14
+#define COLSTORE_N_STMT         15
+
+typedef struct Colstore Colstore;
+typedef struct ColstoreBuffer ColstoreBuffer;
+typedef struct ColstoreColumn ColstoreColumn;
+typedef struct ColstoreConstraint ColstoreConstraint;
+typedef struct ColstoreCursor ColstoreCursor;
+typedef struct ColstoreValue ColstoreValue;
+
+/*
+** An instance of this object represents a single colstore table.
+*/
+struct Colstore {
+  sqlite3_vtab base;          /* Base class.  Must be first */
+  sqlite3 *db;                /* Host database connection */
+  char *zDb;                  /* Name of database containing the table */
+  char *zName;                /* Name of the colstore table */
+  int nCol;                   /* Number of columns */
+  u8 *abBinary;               /* True for columns compared with BINARY */
+  int nPending;               /* Rows in %_pending, or -1 if not known */
+  sqlite3_stmt *aStmt[COLSTORE_N_STMT];  /* Statements on shadow tables */
+};
+
+/*
+** A single value, as read from a column blob or zone map. The z pointer
+** for TEXT and BLOB values points into the buffer it was read from.
+*/
+struct ColstoreValue {
+  u8 eType;                   /* One of the COLSTORE_NULL... values */
+  int n;                      /* Size of u.z in bytes, for TEXT and BLOB */
+  union {
+    i64 i;                    /* COLSTORE_INT value */
+    double r;                 /* COLSTORE_REAL value */
+    const u8 *z;              /* COLSTORE_TEXT or COLSTORE_BLOB value */
+  } u;
+};
+
+/*
+** A growable buffer of bytes.
+*/
+struct ColstoreBuffer {
+  u8 *a;                      /* Allocated buffer */
+  int n;                      /* Bytes of a[] in use */
+  int nAlloc;                 /* Allocated size of a[] */
+};
+
+/*
+** One column of the segment a cursor points to. A column is read, and
+** all its values decoded at once, the first time xColumn requests a
+** value from it.
+*/
+struct ColstoreColumn {
+  u8 *aBlob;                  /* Copy of the column blob */
+  ColstoreValue *aVal;        /* Decoded values, one per row, or NULL */
+};
+
+/*
+** A constraint on a column passed to xFilter, used to skip segments
+** whose zone map shows that none of their rows can match.
+*/
+struct ColstoreConstraint {
+  int iCol;                   /* Column constrained */
+  int op;                     /* One of COLSTORE_EQ, COLSTORE_GT etc. */
+  ColstoreValue val;          /* Right-hand side of the constraint */
+};
+
+/*
+** A cursor on a colstore table. Rows are visited segment by segment,
+** then the rows of the %_pending table.
+*/
+struct ColstoreCursor {
+  sqlite3_vtab_cursor base;   /* Base class.  Must be first */
+  int eState;                 /* One of the COLSTORE_STATE_* values */
+  sqlite3_stmt *pSegment;     /* Iterates through %_segment */
+  sqlite3_stmt *pPending;     /* Iterates through %_pending */
+  i64 iMinRowid;              /* Smallest rowid that may match */
+  i64 iMaxRowid;              /* Largest rowid that may match */
+  int nCons;                  /* Number of entries in aCons[] */
+  ColstoreConstraint *aCons;  /* Column constraints */
+  ColstoreBuffer cons;        /* Serialized right-hand sides of aCons[] */
+  i64 iSegno;                 /* Current segment */
+  int nRow;                   /* Number of rows in current segment */
+  int iRow;                   /* Current row of current segment */
+  i64 *aDeleted;              /* Sorted deleted rowids of the segment */
+  int nDeleted;               /* Number of entries in aDeleted[] */
+  int nDeletedAlloc;          /* Allocated size of aDeleted[] */
+  int iDeleted;               /* First aDeleted[] entry not below iRow */
+  ColstoreColumn *aCol;       /* Rowids, then one entry per column */
+  u8 *aZoneType;              /* Zone map entry type for each column */
+  ColstoreValue *aZone;       /* Zone map minimum and maximum values */
+};
+
+/*
+** Write the 64-bit unsigned integer v to a[] as a varint. Return the
+** number of bytes written, which is never more than 10.
+*/
+static int colstorePutVarint(u8 *a, u64 v){
+  int i = 0;
+  do{
+    a[i] = (u8)(v & 0x7f);
+    v >>= 7;
+    if( v ) a[i] |= 0x80;
+    i++;
+  }while( v );
+  return i;
+}
+
+/*
+** Return the number of bytes required to store v as a varint.
+*/
+static int colstoreVarintLen(u64 v){
+  int i = 1;
+  while( v>=0x80 ){
+    v >>= 7;
+    i++;
+  }
+  return i;
+}
+
+/*
+** Read a varint from the buffer that starts at a[] and ends at aEnd.
+** Return the number of bytes read, or 0 if the buffer does not begin with
+** a well-formed varint.
+*/
+static int colstoreGetVarint(const u8 *a, const u8 *aEnd, u64 *pv){
+  u64 v = 0;
+  int i;
+  for(i=0; i<10 && &a[i]<aEnd; i++){
+    v |= (u64)(a[i] & 0x7f) << (7*i);
+    if( (a[i] & 0x80)==0 ){
+      *pv = v;
+      return i+1;
+    }
+  }
+  return 0;
+}
+
+/*
+** Map signed integers to unsigned, so that integers close to zero become
+** small varints whatever their sign.
+*/
+static u64 colstoreZigzag(i64 i){
+  return (i<0) ? ((~(u64)i)<<1)|1 : ((u64)i)<<1;
+}
+static i64 colstoreUnzigzag(u64 v){
+  return (v & 1) ? (i64)~(v>>1) : (i64)(v>>1);
+}
+
+/*
+** Return the number of bytes required to serialize value *p.
+*/
+static int colstoreValueSize(const ColstoreValue *p){
+  switch( p->eType ){
+    case COLSTORE_INT:  return 1 + colstoreVarintLen(colstoreZigzag(p->u.i));
+    case COLSTORE_REAL: return 1 + 8;
+    case COLSTORE_TEXT:
+    case COLSTORE_BLOB: return 1 + colstoreVarintLen(p->n) + p->n;
+  }
+  return 1;
+}
+
+/*
+** Serialize value *p into buffer a[], which is at least
+** colstoreValueSize(p) bytes in size. Return the number of bytes written.
+*/
+static int colstorePutValue(u8 *a, const ColstoreValue *p){
+  int n = 1;
+  a[0] = p->eType;
+  switch( p->eType ){
+    case COLSTORE_INT:
+      n += colstorePutVarint(&a[1], colstoreZigzag(p->u.i));
+      break;
+    case COLSTORE_REAL: {
+      u64 v;
+      int i;
+      memcpy(&v, &p->u.r, 8);
+      for(i=8; i>0; i--){
+        a[i] = (u8)(v & 0xff);
+        v >>= 8;
+      }
+      n += 8;
+      break;
+    }
+    case COLSTORE_TEXT:
+    case COLSTORE_BLOB:
+      n += colstorePutVarint(&a[1], p->n);
+      if( p->n>0 ) memcpy(&a[n], p->u.z, p->n);
+      n += p->n;
+      break;
+  }
+  return n;
+}
+
+/*
+** Read a serialized value from the buffer that starts at a[] and ends at
+** aEnd into *p. Return the number of bytes read, or 0 if the buffer does
+** not begin with a well-formed value.
+*/
+static int colstoreGetValue(const u8 *a, const u8 *aEnd, ColstoreValue *p){
+  int n = 1;
+  u64 v;
+  if( a>=aEnd ) return 0;
+  p->eType = a[0];
+  switch( a[0] ){
+    case COLSTORE_NULL:
+      break;
+    case COLSTORE_INT: {
+      int nByte = colstoreGetVarint(&a[1], aEnd, &v);
+      if( nByte==0 ) return 0;
+      p->u.i = colstoreUnzigzag(v);
+      n += nByte;
+      break;
+    }
+    case COLSTORE_REAL: {
+      int i;
+      if( aEnd-a<9 ) return 0;
+      v = 0;
+      for(i=1; i<=8; i++){
+        v = (v<<8) | a[i];
+      }
+      memcpy(&p->u.r, &v, 8);
+      n += 8;
+      break;
+    }
+    case COLSTORE_TEXT:
+    case COLSTORE_BLOB: {
+      int nByte = colstoreGetVarint(&a[1], aEnd, &v);
+      if( nByte==0 || v>(u64)(aEnd-&a[1+nByte]) ) return 0;
+      n += nByte;
+      p->n = (int)v;
+      p->u.z = &a[n];
+      n += p->n;
+      break;
+    }
+    default:
+      return 0;
+  }
+  return n;
+}
+
+/*
+** Set *p to refer to the content of SQL value pVal. Any TEXT or BLOB
+** content remains owned by pVal.
+*/
+static void colstoreValueFromSql(sqlite3_value *pVal, ColstoreValue *p){
+  switch( sqlite3_value_type(pVal) ){
+    case SQLITE_INTEGER:
+      p->eType = COLSTORE_INT;
+      p->u.i = sqlite3_value_int64(pVal);
+      break;
+    case SQLITE_FLOAT:
+      p->eType = COLSTORE_REAL;
+      p->u.r = sqlite3_value_double(pVal);
+      break;
+    case SQLITE_TEXT:
+      p->eType = COLSTORE_TEXT;
+      p->u.z = sqlite3_value_text(pVal);
+      p->n = sqlite3_value_bytes(pVal);
+      break;
+    case SQLITE_BLOB:
+      p->eType = COLSTORE_BLOB;
+      p->u.z = (const u8 *)sqlite3_value_blob(pVal);
+      p->n = sqlite3_value_bytes(pVal);
+      break;
+    default:
+      p->eType = COLSTORE_NULL;
+      break;
+  }
+}
+
+/*
+** Set the result of user function context ctx to value *p.
+*/
+static void colstoreResultValue(sqlite3_context *ctx, const ColstoreValue *p){
+  switch( p->eType ){
+    case COLSTORE_INT:
+      sqlite3_result_int64(ctx, p->u.i);
+      break;
+    case COLSTORE_REAL:
+      sqlite3_result_double(ctx, p->u.r);
+      break;
+    case COLSTORE_TEXT:
+      sqlite3_result_text(ctx, (const char *)p->u.z, p->n, SQLITE_TRANSIENT);
+      break;
+    case COLSTORE_BLOB:
+      sqlite3_result_blob(ctx, p->u.z, p->n, SQLITE_TRANSIENT);
+      break;
+    default:
+      sqlite3_result_null(ctx);
+      break;
+  }
+}
+
+/*
+** Return true if *p1 and *p2 hold the same value of the same type.
+*/
+static int colstoreValueIdentical(
+  const ColstoreValue *p1,
+  const ColstoreValue *p2
+){
+  if( p1->eType!=p2->eType ) return 0;
+  switch( p1->eType ){
+    case COLSTORE_INT:  return p1->u.i==p2->u.i;
+    case COLSTORE_REAL: return memcmp(&p1->u.r, &p2->u.r, 8)==0;
+    case COLSTORE_TEXT:
+    case COLSTORE_BLOB:
+      return p1->n==p2->n && (p1->n==0 || memcmp(p1->u.z, p2->u.z, p1->n)==0);
+  }
+  return 1;
+}
+
+/*
+** Return the storage class of value *p: COLSTORE_NULL, COLSTORE_INT for
+** both integer and real values, COLSTORE_TEXT or COLSTORE_BLOB.
+*/
+static int colstoreClass(const ColstoreValue *p){
+  return p->eType==COLSTORE_REAL ? COLSTORE_INT : p->eType;
+}
+
+/*
+** Compare two values in the order SQLite sorts them with the BINARY
+** collating sequence. Return negative, zero or positive if *p1 is less
+** than, equal to or greater than *p2.
+*/
+static int colstoreCompare(const ColstoreValue *p1, const ColstoreValue *p2){
+  int c1 = colstoreClass(p1);
+  int c2 = colstoreClass(p2);
+  if( c1!=c2 ) return c1-c2;
+  if( c1==COLSTORE_INT ){
+    double r1, r2;
+    if( p1->eType==COLSTORE_INT && p2->eType==COLSTORE_INT ){
+      return (p1->u.i<p2->u.i) ? -1 : (p1->u.i>p2->u.i);
+    }
+    r1 = (p1->eType==COLSTORE_INT) ? (double)p1->u.i : p1->u.r;
+    r2 = (p2->eType==COLSTORE_INT) ? (double)p2->u.i : p2->u.r;
+    return (r1<r2) ? -1 : (r1>r2);
+  }
+  if( c1==COLSTORE_TEXT || c1==COLSTORE_BLOB ){
+    int n = (p1->n<p2->n) ? p1->n : p2->n;
+    int res = (n>0) ? memcmp(p1->u.z, p2->u.z, n) : 0;
+    return res ? res : p1->n-p2->n;
+  }
+  return 0;
+}
+
+/*
+** Make sure buffer p has space for at least nByte more bytes.
+*/
+static int colstoreBufferGrow(ColstoreBuffer *p, int nByte){
+  if( p->n+nByte>p->nAlloc ){
+    int nNew = p->nAlloc ? p->nAlloc*2 : 256;
+    u8 *aNew;
+    while( nNew<p->n+nByte ) nNew *= 2;
+    aNew = (u8 *)sqlite3_realloc(p->a, nNew);
+    if( !aNew ) return SQLITE_NOMEM;
+    p->a = aNew;
+    p->nAlloc = nNew;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Append the nByte bytes at a[] to buffer p. If *pRc is not SQLITE_OK
+** when this function is called, it is a no-op. If an OOM error occurs,
+** *pRc is set to SQLITE_NOMEM.
+*/
+static void colstoreBufferAppend(
+  int *pRc,
+  ColstoreBuffer *p,
+  const u8 *a,
+  int nByte
+){
+  if( *pRc==SQLITE_OK ){
+    *pRc = colstoreBufferGrow(p, nByte);
+    if( *pRc==SQLITE_OK ){
+      memcpy(&p->a[p->n], a, nByte);
+      p->n += nByte;
+    }
+  }
+}
+
+/*
+** Append a varint to buffer p. Errors are handled as for
+** colstoreBufferAppend().
+*/
+static void colstoreBufferAppendVarint(int *pRc, ColstoreBuffer *p, u64 v){
+  if( *pRc==SQLITE_OK ){
+    *pRc = colstoreBufferGrow(p, 10);
+    if( *pRc==SQLITE_OK ){
+      p->n += colstorePutVarint(&p->a[p->n], v);
+    }
+  }
+}
+
+/*
+** Append serialized value *pVal to buffer p. Errors are handled as for
+** colstoreBufferAppend().
+*/
+static void colstoreBufferAppendValue(
+  int *pRc,
+  ColstoreBuffer *p,
+  const ColstoreValue *pVal
+){
+  if( *pRc==SQLITE_OK ){
+    *pRc = colstoreBufferGrow(p, colstoreValueSize(pVal));
+    if( *pRc==SQLITE_OK ){
+      p->n += colstorePutValue(&p->a[p->n], pVal);
+    }
+  }
+}
+
+/*
+** Append a column blob holding the nVal values in aVal[] to buffer pOut,
+** using whichever encoding results in the smallest blob. Errors are
+** handled as for colstoreBufferAppend().
+*/
+static void colstoreEncode(
+  int *pRc,                       /* IN/OUT: Error code */
+  ColstoreBuffer *pOut,           /* Append the column blob here */
+  const ColstoreValue *aVal,      /* Values to encode */
+  int nVal                        /* Number of entries in aVal[] */
+){
+  int aDict[256];                 /* Index in aVal[] of each dict entry */
+  int nDict = 0;                  /* Number of entries in aDict[] */
+  u8 *aIdx;                       /* Dict entry used by each row */
+  int nPlain = 1;                 /* Size of PLAIN encoding */
+  int nRle = 1;                   /* Size of RLE encoding */
+  int nDictSize = 1 + nVal;       /* Size of DICT encoding */
+  int nDelta = 1;                 /* Size of DELTA encoding */
+  int bDict = 1;                  /* True if DICT encoding is possible */
+  int bDelta = 1;                 /* True if DELTA encoding is possible */
+  int eEnc = COLSTORE_ENC_PLAIN;
+  int nBest;
+  u8 aByte[1];
+  int i, j;
+
+  if( *pRc!=SQLITE_OK ) return;
+  aIdx = (u8 *)sqlite3_malloc(nVal>0 ? nVal : 1);
+  if( !aIdx ){
+    *pRc = SQLITE_NOMEM;
+    return;
+  }
+
+  for(i=0; i<nVal; i++){
+    const ColstoreValue *p = &aVal[i];
+    nPlain += colstoreValueSize(p);
+    if( bDelta ){
+      if( p->eType!=COLSTORE_INT ){
+        bDelta = 0;
+      }else{
+        u64 iDelta = (u64)p->u.i - (u64)(i>0 ? aVal[i-1].u.i : 0);
+        nDelta += colstoreVarintLen(colstoreZigzag((i64)iDelta));
+      }
+    }
+    if( bDict ){
+      for(j=0; j<nDict && !colstoreValueIdentical(p, &aVal[aDict[j]]); j++);
+      if( j==nDict ){
+        if( nDict==(int)(sizeof(aDict)/sizeof(aDict[0])) ){
+          bDict = 0;
+        }else{
+          aDict[nDict++] = i;
+          nDictSize += colstoreValueSize(p);
+        }
+      }
+      aIdx[i] = (u8)j;
+    }
+  }
+  for(i=0; i<nVal; i=j){
+    for(j=i+1; j<nVal && colstoreValueIdentical(&aVal[i], &aVal[j]); j++);
+    nRle += colstoreVarintLen(j-i) + colstoreValueSize(&aVal[i]);
+  }
+  nDictSize += colstoreVarintLen(nDict);
+
+  nBest = nPlain;
+  if( nRle<nBest ){ nBest = nRle; eEnc = COLSTORE_ENC_RLE; }
+  if( bDict && nDictSize<nBest ){ nBest = nDictSize; eEnc = COLSTORE_ENC_DICT; }
+  if( bDelta && nDelta<nBest ){ nBest = nDelta; eEnc = COLSTORE_ENC_DELTA; }
+
+  aByte[0] = (u8)eEnc;
+  colstoreBufferAppend(pRc, pOut, aByte, 1);
+  switch( eEnc ){
+    case COLSTORE_ENC_PLAIN:
+      for(i=0; i<nVal; i++){
+        colstoreBufferAppendValue(pRc, pOut, &aVal[i]);
+      }
+      break;
+    case COLSTORE_ENC_RLE:
+      for(i=0; i<nVal; i=j){
+        for(j=i+1; j<nVal && colstoreValueIdentical(&aVal[i], &aVal[j]); j++);
+        colstoreBufferAppendVarint(pRc, pOut, j-i);
+        colstoreBufferAppendValue(pRc, pOut, &aVal[i]);
+      }
+      break;
+    case COLSTORE_ENC_DICT:
+      colstoreBufferAppendVarint(pRc, pOut, nDict);
+      for(j=0; j<nDict; j++){
+        colstoreBufferAppendValue(pRc, pOut, &aVal[aDict[j]]);
+      }
+      colstoreBufferAppend(pRc, pOut, aIdx, nVal);
+      break;
+    default:
+      assert( eEnc==COLSTORE_ENC_DELTA );
+      for(i=0; i<nVal; i++){
+        u64 iDelta = (u64)aVal[i].u.i - (u64)(i>0 ? aVal[i-1].u.i : 0);
+        colstoreBufferAppendVarint(pRc, pOut, colstoreZigzag((i64)iDelta));
+      }
+      break;
+  }
+  sqlite3_free(aIdx);
+}
+
+/*
+** Decode the n byte column blob a[] into the nVal entries of aVal[].
+** Return SQLITE_OK if successful, or SQLITE_CORRUPT_VTAB if the blob is
+** not a well-formed column blob of exactly nVal values.
+*/
+static int colstoreDecode(const u8 *a, int n, ColstoreValue *aVal, int nVal){
+  const u8 *aEnd = &a[n];
+  const u8 *p = &a[1];
+  int nByte;
+  u64 v;
+  int i = 0;
+
+  if( n<1 ) return SQLITE_CORRUPT_VTAB;
+  switch( a[0] ){
+    case COLSTORE_ENC_PLAIN:
+      for(i=0; i<nVal; i++){
+        nByte = colstoreGetValue(p, aEnd, &aVal[i]);
+        if( nByte==0 ) return SQLITE_CORRUPT_VTAB;
+        p += nByte;
+      }
+      break;
+
+    case COLSTORE_ENC_RLE:
+      while( i<nVal ){
+        ColstoreValue val;
+        nByte = colstoreGetVarint(p, aEnd, &v);
+        if( nByte==0 || v==0 || v>(u64)(nVal-i) ) return SQLITE_CORRUPT_VTAB;
+        p += nByte;
+        nByte = colstoreGetValue(p, aEnd, &val);
+        if( nByte==0 ) return SQLITE_CORRUPT_VTAB;
+        p += nByte;
+        while( v-- ) aVal[i++] = val;
+      }
+      break;
+
+    case COLSTORE_ENC_DICT: {
+      ColstoreValue aDict[256];
+      int nDict;
+      nByte = colstoreGetVarint(p, aEnd, &v);
+      if( nByte==0 || v>256 ) return SQLITE_CORRUPT_VTAB;
+      p += nByte;
+      nDict = (int)v;
+      for(i=0; i<nDict; i++){
+        nByte = colstoreGetValue(p, aEnd, &aDict[i]);
+        if( nByte==0 ) return SQLITE_CORRUPT_VTAB;
+        p += nByte;
+      }
+      if( aEnd-p<nVal ) return SQLITE_CORRUPT_VTAB;
+      for(i=0; i<nVal; i++){
+        if( p[i]>=nDict ) return SQLITE_CORRUPT_VTAB;
+        aVal[i] = aDict[p[i]];
+      }
+      p += nVal;
+      break;
+    }
+
+    case COLSTORE_ENC_DELTA: {
+      u64 iVal = 0;
+      for(i=0; i<nVal; i++){
+        nByte = colstoreGetVarint(p, aEnd, &v);
+        if( nByte==0 ) return SQLITE_CORRUPT_VTAB;
+        p += nByte;
+        iVal += (u64)colstoreUnzigzag(v);
+        aVal[i].eType = COLSTORE_INT;
+        aVal[i].u.i = (i64)iVal;
+      }
+      break;
+    }
+
+    default:
+      return SQLITE_CORRUPT_VTAB;
+  }
+  return (p==aEnd) ? SQLITE_OK : SQLITE_CORRUPT_VTAB;
+}
+
+/*
+** Append the zone map entry for a column holding the nVal values in
+** aVal[] to buffer p. Errors are handled as for colstoreBufferAppend().
+*/
+static void colstoreZoneAppend(
+  int *pRc,
+  ColstoreBuffer *p,
+  const ColstoreValue *aVal,
+  int nVal
+){
+  const ColstoreValue *pMin = 0;
+  const ColstoreValue *pMax = 0;
+  u8 aByte[1];
+  int i;
+
+  for(i=0; i<nVal; i++){
+    if( aVal[i].eType==COLSTORE_NULL ) continue;
+    if( pMin==0 || colstoreCompare(&aVal[i], pMin)<0 ) pMin = &aVal[i];
+    if( pMax==0 || colstoreCompare(&aVal[i], pMax)>0 ) pMax = &aVal[i];
+  }
+  if( pMin==0 ){
+    aByte[0] = COLSTORE_ZONE_EMPTY;
+  }else if( colstoreValueSize(pMin)>COLSTORE_MAX_ZONE
+         || colstoreValueSize(pMax)>COLSTORE_MAX_ZONE
+  ){
+    aByte[0] = COLSTORE_ZONE_NONE;
+  }else{
+    aByte[0] = COLSTORE_ZONE_RANGE;
+  }
+  colstoreBufferAppend(pRc, p, aByte, 1);
+  if( aByte[0]==COLSTORE_ZONE_RANGE ){
+    colstoreBufferAppendValue(pRc, p, pMin);
+    colstoreBufferAppendValue(pRc, p, pMax);
+  }
+}
+
+/*
+** Parse the n byte zone map a[] of a table with nCol columns. The type
+** of the entry for each column is written to aType[] and, for entries of
+** type COLSTORE_ZONE_RANGE, the smallest and largest values to
+** aVal[iCol*2] and aVal[iCol*2+1].
+*/
+static int colstoreZoneParse(
+  const u8 *a,
+  int n,
+  int nCol,
+  u8 *aType,
+  ColstoreValue *aVal
+){
+  const u8 *p = a;
+  const u8 *aEnd = &a[n];
+  int i;
+  for(i=0; i<nCol; i++){
+    if( p>=aEnd ) return SQLITE_CORRUPT_VTAB;
+    aType[i] = *(p++);
+    if( aType[i]==COLSTORE_ZONE_RANGE ){
+      int nByte = colstoreGetValue(p, aEnd, &aVal[i*2]);
+      if( nByte==0 ) return SQLITE_CORRUPT_VTAB;
+      p += nByte;
+      nByte = colstoreGetValue(p, aEnd, &aVal[i*2+1]);
+      if( nByte==0 ) return SQLITE_CORRUPT_VTAB;
+      p += nByte;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Return true if the zone map entry eType/pMin/pMax for the column that
+** constraint pCons applies to shows that no row of the segment can match
+** the constraint.
+**
+** SQLite may apply the affinity of the column to the right-hand side of
+** the comparison, and compares text using the collation sequence of the
+** column. So a segment is only skipped when its values and the
+** right-hand side have the same storage class, and text is only compared
+** for columns that use the BINARY collation sequence.
+*/
+static int colstoreZoneExcludes(
+  Colstore *pTab,
+  ColstoreConstraint *pCons,
+  int eType,
+  const ColstoreValue *pMin,
+  const ColstoreValue *pMax
+){
+  int eClass;
+  if( eType==COLSTORE_ZONE_EMPTY ) return 1;
+  if( eType!=COLSTORE_ZONE_RANGE ) return 0;
+  eClass = colstoreClass(&pCons->val);
+  if( eClass!=colstoreClass(pMin) || eClass!=colstoreClass(pMax) ) return 0;
+  if( eClass==COLSTORE_TEXT && !pTab->abBinary[pCons->iCol] ) return 0;
+  switch( pCons->op ){
+    case COLSTORE_EQ:
+      return colstoreCompare(&pCons->val, pMin)<0
+          || colstoreCompare(&pCons->val, pMax)>0;
+    case COLSTORE_GT: return colstoreCompare(pMax, &pCons->val)<=0;
+    case COLSTORE_GE: return colstoreCompare(pMax, &pCons->val)<0;
+    case COLSTORE_LT: return colstoreCompare(pMin, &pCons->val)>=0;
+    default:
+      assert( pCons->op==COLSTORE_LE );
+      return colstoreCompare(pMin, &pCons->val)>0;
+  }
+}
+
+/*
+** Return the index of the first of the nVal integers in aVal[] that is
+** not less than iRowid, or nVal if there is no such entry. The values in
+** aVal[] must be sorted in ascending order.
+*/
+static int colstoreSeekRowid(const ColstoreValue *aVal, int nVal, i64 iRowid){
+  int iLo = 0;
+  int iHi = nVal;
+  while( iLo<iHi ){
+    int iMid = (iLo+iHi)/2;
+    if( aVal[iMid].u.i<iRowid ){
+      iLo = iMid+1;
+    }else{
+      iHi = iMid;
+    }
+  }
+  return iLo;
+}
+
+/*
+** Free the buffers held by *pCol.
+*/
+static void colstoreColumnClear(ColstoreColumn *pCol){
+  sqlite3_free(pCol->aBlob);
+  sqlite3_free(pCol->aVal);
+  pCol->aBlob = 0;
+  pCol->aVal = 0;
+}
+
+/*
+** Read and decode column iCol of segment iSegno, which holds nRow rows,
+** into *pCol. Column 0 is the rowids, column 1 the leftmost column of
+** the table and so on.
+*/
+static int colstoreReadColumn(
+  Colstore *pTab,
+  i64 iSegno,
+  int iCol,
+  int nRow,
+  ColstoreColumn *pCol
+){
+  sqlite3_stmt *pStmt = pTab->aStmt[COLSTORE_READ_DATA];
+  int rc = SQLITE_CORRUPT_VTAB;
+  int rc2;
+
+  assert( pCol->aBlob==0 && pCol->aVal==0 );
+  sqlite3_bind_int64(pStmt, 1, (iSegno<<16) + iCol);
+  if( SQLITE_ROW==sqlite3_step(pStmt) ){
+    const u8 *a = (const u8 *)sqlite3_column_blob(pStmt, 0);
+    int n = sqlite3_column_bytes(pStmt, 0);
+    pCol->aBlob = (u8 *)sqlite3_malloc(n>0 ? n : 1);
+    pCol->aVal = (ColstoreValue *)sqlite3_malloc(
+        sizeof(ColstoreValue) * (nRow>0 ? nRow : 1)
+    );
+    if( !pCol->aBlob || !pCol->aVal ){
+      rc = SQLITE_NOMEM;
+    }else{
+      if( n>0 ) memcpy(pCol->aBlob, a, n);
+      rc = colstoreDecode(pCol->aBlob, n, pCol->aVal, nRow);
+    }
+  }
+  rc2 = sqlite3_reset(pStmt);
+  if( rc2!=SQLITE_OK ) rc = rc2;
+  if( rc==SQLITE_OK && iCol==0 ){
+    int i;
+    for(i=0; i<nRow; i++){
+      if( pCol->aVal[i].eType!=COLSTORE_INT ) rc = SQLITE_CORRUPT_VTAB;
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    colstoreColumnClear(pCol);
+  }
+  return rc;
+}
+
+/*
+** Run statement pStmt, which returns no rows, and reset it.
+*/
+static int colstoreExec(sqlite3_stmt *pStmt){
+  sqlite3_step(pStmt);
+  return sqlite3_reset(pStmt);
+}
+
+/*
+** Find the row with rowid iRowid. If it is stored in the %_pending table,
+** set *pbPending. If it is stored in a segment, set *piSegno to the
+** segment number and *pnRow to the number of rows in the segment.
+** Otherwise, leave *pbPending and *piSegno set to zero.
+*/
+static int colstoreLocate(
+  Colstore *pTab,
+  i64 iRowid,
+  int *pbPending,
+  i64 *piSegno,
+  int *pnRow
+){
+  sqlite3_stmt *pStmt = pTab->aStmt[COLSTORE_TEST_PENDING];
+  int rc;
+
+  *pbPending = 0;
+  *piSegno = 0;
+  sqlite3_bind_int64(pStmt, 1, iRowid);
+  if( SQLITE_ROW==sqlite3_step(pStmt) ){
+    *pbPending = 1;
+  }
+  rc = sqlite3_reset(pStmt);
+
+  if( rc==SQLITE_OK && *pbPending==0 ){
+    sqlite3_stmt *pFind = pTab->aStmt[COLSTORE_FIND_SEGMENT];
+    int rc2;
+    sqlite3_bind_int64(pFind, 1, iRowid);
+    while( rc==SQLITE_OK && *piSegno==0 && SQLITE_ROW==sqlite3_step(pFind) ){
+      i64 iSegno = sqlite3_column_int64(pFind, 0);
+      int nRow = sqlite3_column_int(pFind, 1);
+      ColstoreColumn rowids = {0, 0};
+      int i;
+      rc = colstoreReadColumn(pTab, iSegno, 0, nRow, &rowids);
+      if( rc!=SQLITE_OK ) break;
+      i = colstoreSeekRowid(rowids.aVal, nRow, iRowid);
+      if( i<nRow && rowids.aVal[i].u.i==iRowid ){
+        pStmt = pTab->aStmt[COLSTORE_TEST_DELETED];
+        sqlite3_bind_int64(pStmt, 1, iSegno);
+        sqlite3_bind_int64(pStmt, 2, iRowid);
+        if( SQLITE_ROW!=sqlite3_step(pStmt) ){
+          *piSegno = iSegno;
+          *pnRow = nRow;
+        }
+        rc = sqlite3_reset(pStmt);
+      }
+      colstoreColumnClear(&rowids);
+    }
+    rc2 = sqlite3_reset(pFind);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  return rc;
+}
+
+/*
+** Remove segment iSegno and everything stored for it.
+*/
+static int colstoreDropSegment(Colstore *pTab, i64 iSegno){
+  sqlite3_stmt *pStmt;
+  int rc;
+
+  pStmt = pTab->aStmt[COLSTORE_DELETE_SEGMENT];
+  sqlite3_bind_int64(pStmt, 1, iSegno);
+  rc = colstoreExec(pStmt);
+  if( rc==SQLITE_OK ){
+    pStmt = pTab->aStmt[COLSTORE_DELETE_DATA];
+    sqlite3_bind_int64(pStmt, 1, iSegno<<16);
+    sqlite3_bind_int64(pStmt, 2, (iSegno<<16) + 0xffff);
+    rc = colstoreExec(pStmt);
+  }
+  if( rc==SQLITE_OK ){
+    pStmt = pTab->aStmt[COLSTORE_DELETE_DELETED];
+    sqlite3_bind_int64(pStmt, 1, iSegno);
+    rc = colstoreExec(pStmt);
+  }
+  return rc;
+}
+
+/*
+** Delete the row with rowid iRowid, if there is one.
+*/
+static int colstoreDeleteRowid(Colstore *pTab, i64 iRowid){
+  sqlite3_stmt *pStmt;
+  int bPending;
+  i64 iSegno;
+  int nRow;
+  int rc;
+
+  rc = colstoreLocate(pTab, iRowid, &bPending, &iSegno, &nRow);
+  if( rc==SQLITE_OK && bPending ){
+    pStmt = pTab->aStmt[COLSTORE_DELETE_PENDING];
+    sqlite3_bind_int64(pStmt, 1, iRowid);
+    rc = colstoreExec(pStmt);
+    if( pTab->nPending>0 ) pTab->nPending--;
+  }else if( rc==SQLITE_OK && iSegno ){
+    int nDeleted = 0;
+    pStmt = pTab->aStmt[COLSTORE_WRITE_DELETED];
+    sqlite3_bind_int64(pStmt, 1, iSegno);
+    sqlite3_bind_int64(pStmt, 2, iRowid);
+    rc = colstoreExec(pStmt);
+    if( rc==SQLITE_OK ){
+      pStmt = pTab->aStmt[COLSTORE_COUNT_DELETED];
+      sqlite3_bind_int64(pStmt, 1, iSegno);
+      if( SQLITE_ROW==sqlite3_step(pStmt) ){
+        nDeleted = sqlite3_column_int(pStmt, 0);
+      }
+      rc = sqlite3_reset(pStmt);
+    }
+    if( rc==SQLITE_OK && nDeleted>=nRow ){
+      rc = colstoreDropSegment(pTab, iSegno);
+    }
+  }
+  return rc;
+}
+
+/*
+** Move the rows of the %_pending table to a new segment.
+*/
+static int colstoreFlush(Colstore *pTab){
+  int nCol = pTab->nCol;
+  ColstoreBuffer *aBuf;           /* Rowids, then one buffer per column */
+  ColstoreBuffer out = {0, 0, 0}; /* Column blob being encoded */
+  ColstoreBuffer zone = {0, 0, 0};/* Zone map of new segment */
+  ColstoreValue *aVal = 0;        /* Decoded values of one column */
+  sqlite3_stmt *pStmt = 0;
+  i64 iMin = 0;                   /* Smallest rowid in segment */
+  i64 iMax = 0;                   /* Largest rowid in segment */
+  int nRow = 0;                   /* Rows in segment */
+  int rc = SQLITE_OK;
+  int rc2;
+  char *zSql;
+  int i;
+
+  aBuf = (ColstoreBuffer *)sqlite3_malloc(sizeof(ColstoreBuffer)*(nCol+1));
+  if( !aBuf ) return SQLITE_NOMEM;
+  memset(aBuf, 0, sizeof(ColstoreBuffer)*(nCol+1));
+
+  /* Copy the pending rows into one buffer of PLAIN encoded values for
+  ** each column. */
+  zSql = sqlite3_mprintf("SELECT * FROM '%q'.'%q_pending' ORDER BY id",
+      pTab->zDb, pTab->zName
+  );
+  if( !zSql ){
+    rc = SQLITE_NOMEM;
+  }else{
+    rc = sqlite3_prepare_v2(pTab->db, zSql, -1, &pStmt, 0);
+    sqlite3_free(zSql);
+  }
+  for(i=0; i<=nCol; i++){
+    u8 aByte[1];
+    aByte[0] = COLSTORE_ENC_PLAIN;
+    colstoreBufferAppend(&rc, &aBuf[i], aByte, 1);
+  }
+  while( rc==SQLITE_OK && SQLITE_ROW==sqlite3_step(pStmt) ){
+    for(i=0; i<=nCol; i++){
+      ColstoreValue val;
+      colstoreValueFromSql(sqlite3_column_value(pStmt, i), &val);
+      colstoreBufferAppendValue(&rc, &aBuf[i], &val);
+    }
+    nRow++;
+  }
+  rc2 = sqlite3_finalize(pStmt);
+  if( rc==SQLITE_OK ) rc = rc2;
+
+  /* Replace the content of each buffer with the column blob. */
+  if( rc==SQLITE_OK && nRow>0 ){
+    aVal = (ColstoreValue *)sqlite3_malloc(sizeof(ColstoreValue)*nRow);
+    if( !aVal ) rc = SQLITE_NOMEM;
+  }
+  for(i=0; rc==SQLITE_OK && nRow>0 && i<=nCol; i++){
+    ColstoreBuffer tmp;
+    rc = colstoreDecode(aBuf[i].a, aBuf[i].n, aVal, nRow);
+    if( rc!=SQLITE_OK ) break;
+    if( i==0 ){
+      iMin = aVal[0].u.i;
+      iMax = aVal[nRow-1].u.i;
+    }else{
+      colstoreZoneAppend(&rc, &zone, aVal, nRow);
+    }
+    out.n = 0;
+    colstoreEncode(&rc, &out, aVal, nRow);
+    tmp = aBuf[i];
+    aBuf[i] = out;
+    out = tmp;
+  }
+
+  /* Write the new segment and empty the %_pending table. */
+  if( rc==SQLITE_OK && nRow>0 ){
+    i64 iSegno;
+    pStmt = pTab->aStmt[COLSTORE_WRITE_SEGMENT];
+    sqlite3_bind_int(pStmt, 1, nRow);
+    sqlite3_bind_int64(pStmt, 2, iMin);
+    sqlite3_bind_int64(pStmt, 3, iMax);
+    sqlite3_bind_blob(pStmt, 4, zone.a, zone.n, SQLITE_STATIC);
+    rc = colstoreExec(pStmt);
+    iSegno = sqlite3_last_insert_rowid(pTab->db);
+    pStmt = pTab->aStmt[COLSTORE_WRITE_DATA];
+    for(i=0; rc==SQLITE_OK && i<=nCol; i++){
+      sqlite3_bind_int64(pStmt, 1, (iSegno<<16) + i);
+      sqlite3_bind_blob(pStmt, 2, aBuf[i].a, aBuf[i].n, SQLITE_STATIC);
+      rc = colstoreExec(pStmt);
+    }
+    if( rc==SQLITE_OK ){
+      zSql = sqlite3_mprintf("DELETE FROM '%q'.'%q_pending'",
+          pTab->zDb, pTab->zName
+      );
+      if( !zSql ){
+        rc = SQLITE_NOMEM;
+      }else{
+        rc = sqlite3_exec(pTab->db, zSql, 0, 0, 0);
+        sqlite3_free(zSql);
+      }
+    }
+  }
+  if( rc==SQLITE_OK ){
+    pTab->nPending = 0;
+  }
+
+  for(i=0; i<=nCol; i++){
+    sqlite3_free(aBuf[i].a);
+  }
+  sqlite3_free(aBuf);
+  sqlite3_free(out.a);
+  sqlite3_free(zone.a);
+  sqlite3_free(aVal);
+  return rc;
+}
+
+/*
+** Insert a new row into the %_pending table, with rowid pRowid (or a new
+** rowid, if it is NULL) and the column values in apVal[]. Set *piRowid to
+** the rowid of the new row.
+*/
+static int colstoreInsert(
+  Colstore *pTab,
+  sqlite3_value *pRowid,
+  sqlite3_value **apVal,
+  sqlite3_int64 *piRowid
+){
+  sqlite3_stmt *pStmt = pTab->aStmt[COLSTORE_WRITE_PENDING];
+  int rc;
+  int i;
+
+  if( sqlite3_value_type(pRowid)==SQLITE_NULL ){
+    sqlite3_bind_null(pStmt, 1);
+  }else{
+    sqlite3_bind_int64(pStmt, 1, sqlite3_value_int64(pRowid));
+  }
+  for(i=0; i<pTab->nCol; i++){
+    sqlite3_bind_value(pStmt, i+2, apVal[i]);
+  }
+  rc = colstoreExec(pStmt);
+  if( rc!=SQLITE_OK ) return rc;
+  *piRowid = sqlite3_last_insert_rowid(pTab->db);
+
+  if( pTab->nPending<0 ){
+    pStmt = pTab->aStmt[COLSTORE_COUNT_PENDING];
+    if( SQLITE_ROW==sqlite3_step(pStmt) ){
+      pTab->nPending = sqlite3_column_int(pStmt, 0);
+    }
+    rc = sqlite3_reset(pStmt);
+  }else{
+    pTab->nPending++;
+  }
+  if( rc==SQLITE_OK && pTab->nPending>=COLSTORE_SEGMENT_ROWS ){
+    rc = colstoreFlush(pTab);
+  }
+  return rc;
+}
+
+/*
+** The xUpdate method for colstore module virtual tables.
+*/
+static int colstoreUpdate(
+  sqlite3_vtab *pVtab,
+  int nData,
+  sqlite3_value **azData,
+  sqlite_int64 *pRowid
+){
+  Colstore *pTab = (Colstore *)pVtab;
+  int rc = SQLITE_OK;
+
+  assert( nData==1 || nData==pTab->nCol+2 );
+
+  /* If a rowid value was supplied for the new row, check that it is not
+  ** already present in the table. If it is, either delete the existing
+  ** row (if the conflict-handling mode is REPLACE) or fail.
+  */
+  if( nData>1 && sqlite3_value_type(azData[1])!=SQLITE_NULL ){
+    i64 iRowid = sqlite3_value_int64(azData[1]);
+    if( sqlite3_value_type(azData[0])==SQLITE_NULL
+     || sqlite3_value_int64(azData[0])!=iRowid
+    ){
+      int bPending;
+      i64 iSegno;
+      int nRow;
+      rc = colstoreLocate(pTab, iRowid, &bPending, &iSegno, &nRow);
+      if( rc==SQLITE_OK && (bPending || iSegno) ){
+        if( sqlite3_vtab_on_conflict(pTab->db)==SQLITE_REPLACE ){
+          rc = colstoreDeleteRowid(pTab, iRowid);
+        }else{
+          rc = SQLITE_CONSTRAINT;
+        }
+      }
+    }
+  }
+
+  /* If azData[0] is not an SQL NULL value, it is the rowid of a row to
+  ** delete. */
+  if( rc==SQLITE_OK && sqlite3_value_type(azData[0])!=SQLITE_NULL ){
+    rc = colstoreDeleteRowid(pTab, sqlite3_value_int64(azData[0]));
+  }
+
+  /* If there is more than one element in azData[], elements azData[2]
+  ** onwards are the values of a new row to insert. */
+  if( rc==SQLITE_OK && nData>1 ){
+    rc = colstoreInsert(pTab, azData[1], &azData[2], pRowid);
+  }
+  return rc;
+}
+
+/*
+** The xBegin method for colstore module virtual tables. Another
+** connection may have written to the table since the last transaction,
+** so forget the number of rows in the %_pending table.
+*/
+static int colstoreBegin(sqlite3_vtab *pVtab){
+  ((Colstore *)pVtab)->nPending = -1;
+  return SQLITE_OK;
+}
+
+/*
+** Free the current segment of cursor pCsr.
+*/
+static void colstoreSegmentClear(ColstoreCursor *pCsr){
+  Colstore *pTab = (Colstore *)pCsr->base.pVtab;
+  int i;
+  for(i=0; i<=pTab->nCol; i++){
+    colstoreColumnClear(&pCsr->aCol[i]);
+  }
+  pCsr->nRow = 0;
+  pCsr->iRow = 0;
+  pCsr->nDeleted = 0;
+  pCsr->iDeleted = 0;
+}
+
+/*
+** Advance pCsr->iRow until it refers to a row of the current segment
+** that has not been deleted and is within the range of rowids the cursor
+** visits. Set it to pCsr->nRow if there is no such row.
+*/
+static void colstoreSegmentSkip(ColstoreCursor *pCsr){
+  ColstoreValue *aRowid = pCsr->aCol[0].aVal;
+  while( pCsr->iRow<pCsr->nRow ){
+    i64 iRowid = aRowid[pCsr->iRow].u.i;
+    if( iRowid>pCsr->iMaxRowid ){
+      pCsr->iRow = pCsr->nRow;
+      break;
+    }
+    while( pCsr->iDeleted<pCsr->nDeleted
+        && pCsr->aDeleted[pCsr->iDeleted]<iRowid
+    ){
+      pCsr->iDeleted++;
+    }
+    if( pCsr->iDeleted>=pCsr->nDeleted
+     || pCsr->aDeleted[pCsr->iDeleted]!=iRowid
+    ){
+      break;
+    }
+    pCsr->iRow++;
+  }
+}
+
+/*
+** Set *pbExclude if the zone map of the segment pCsr->pSegment points to
+** shows that none of its rows can match the constraints of the cursor.
+*/
+static int colstoreSegmentExcluded(ColstoreCursor *pCsr, int *pbExclude){
+  Colstore *pTab = (Colstore *)pCsr->base.pVtab;
+  const u8 *a;
+  int n;
+  int rc;
+  int i;
+
+  *pbExclude = 0;
+  if( pCsr->nCons==0 ) return SQLITE_OK;
+  a = (const u8 *)sqlite3_column_blob(pCsr->pSegment, 2);
+  n = sqlite3_column_bytes(pCsr->pSegment, 2);
+  rc = colstoreZoneParse(a, n, pTab->nCol, pCsr->aZoneType, pCsr->aZone);
+  for(i=0; rc==SQLITE_OK && i<pCsr->nCons && *pbExclude==0; i++){
+    int iCol = pCsr->aCons[i].iCol;
+    *pbExclude = colstoreZoneExcludes(pTab, &pCsr->aCons[i],
+        pCsr->aZoneType[iCol], &pCsr->aZone[iCol*2], &pCsr->aZone[iCol*2+1]
+    );
+  }
+  return rc;
+}
+
+/*
+** Load the rowids and deleted rows of the segment pCsr->pSegment points
+** to, and point the cursor at its first visible row.
+*/
+static int colstoreSegmentLoad(ColstoreCursor *pCsr){
+  Colstore *pTab = (Colstore *)pCsr->base.pVtab;
+  sqlite3_stmt *pStmt = pTab->aStmt[COLSTORE_READ_DELETED];
+  int rc;
+  int rc2;
+
+  pCsr->iSegno = sqlite3_column_int64(pCsr->pSegment, 0);
+  pCsr->nRow = sqlite3_column_int(pCsr->pSegment, 1);
+  rc = colstoreReadColumn(pTab, pCsr->iSegno, 0, pCsr->nRow, &pCsr->aCol[0]);
+  if( rc!=SQLITE_OK ){
+    pCsr->nRow = 0;
+    return rc;
+  }
+
+  sqlite3_bind_int64(pStmt, 1, pCsr->iSegno);
+  while( rc==SQLITE_OK && SQLITE_ROW==sqlite3_step(pStmt) ){
+    if( pCsr->nDeleted==pCsr->nDeletedAlloc ){
+      int nNew = pCsr->nDeletedAlloc ? pCsr->nDeletedAlloc*2 : 64;
+      i64 *aNew = (i64 *)sqlite3_realloc(pCsr->aDeleted, nNew*sizeof(i64));
+      if( !aNew ){
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      pCsr->aDeleted = aNew;
+      pCsr->nDeletedAlloc = nNew;
+    }
+    pCsr->aDeleted[pCsr->nDeleted++] = sqlite3_column_int64(pStmt, 0);
+  }
+  rc2 = sqlite3_reset(pStmt);
+  if( rc==SQLITE_OK ) rc = rc2;
+
+  pCsr->iRow = colstoreSeekRowid(pCsr->aCol[0].aVal, pCsr->nRow,
+                                 pCsr->iMinRowid);
+  colstoreSegmentSkip(pCsr);
+  return rc;
+}
+
+/*
+** Advance cursor pCsr to the next row of the %_pending table.
+*/
+static int colstoreStepPending(ColstoreCursor *pCsr){
+  int rc = SQLITE_OK;
+  assert( pCsr->eState==COLSTORE_STATE_PENDING );
+  if( SQLITE_ROW!=sqlite3_step(pCsr->pPending) ){
+    pCsr->eState = COLSTORE_STATE_EOF;
+    rc = sqlite3_reset(pCsr->pPending);
+  }
+  return rc;
+}
+
+/*
+** Advance cursor pCsr to the first visible row of the next segment that
+** its zone map does not exclude, or to the rows of the %_pending table
+** once there are no more segments.
+*/
+static int colstoreNextSegment(ColstoreCursor *pCsr){
+  int rc = SQLITE_OK;
+  while( rc==SQLITE_OK ){
+    int bExclude;
+    colstoreSegmentClear(pCsr);
+    if( SQLITE_ROW!=sqlite3_step(pCsr->pSegment) ){
+      rc = sqlite3_reset(pCsr->pSegment);
+      if( rc==SQLITE_OK ){
+        pCsr->eState = COLSTORE_STATE_PENDING;
+        rc = colstoreStepPending(pCsr);
+      }
+      break;
+    }
+    rc = colstoreSegmentExcluded(pCsr, &bExclude);
+    if( rc==SQLITE_OK && !bExclude ){
+      rc = colstoreSegmentLoad(pCsr);
+      if( pCsr->iRow<pCsr->nRow ) break;
+    }
+  }
+  return rc;
+}
+
+/*
+** Narrow the range of rowids cursor pCsr visits to satisfy the rowid
+** constraint "rowid <op> pVal". Constraints whose right-hand side is not
+** an integer are left for SQLite to test. Set *pbEmpty if no row can
+** match.
+*/
+static void colstoreRowidConstraint(
+  ColstoreCursor *pCsr,
+  int op,
+  sqlite3_value *pVal,
+  int *pbEmpty
+){
+  i64 iVal;
+  int eType = sqlite3_value_type(pVal);
+  if( eType==SQLITE_NULL ){
+    *pbEmpty = 1;
+    return;
+  }
+  if( eType!=SQLITE_INTEGER ) return;
+  iVal = sqlite3_value_int64(pVal);
+  switch( op ){
+    case COLSTORE_EQ:
+      if( iVal>pCsr->iMinRowid ) pCsr->iMinRowid = iVal;
+      if( iVal<pCsr->iMaxRowid ) pCsr->iMaxRowid = iVal;
+      break;
+    case COLSTORE_GT:
+      if( iVal==LARGEST_INT64 ){
+        *pbEmpty = 1;
+      }else if( iVal>=pCsr->iMinRowid ){
+        pCsr->iMinRowid = iVal+1;
+      }
+      break;
+    case COLSTORE_GE:
+      if( iVal>pCsr->iMinRowid ) pCsr->iMinRowid = iVal;
+      break;
+    case COLSTORE_LT:
+      if( iVal==SMALLEST_INT64 ){
+        *pbEmpty = 1;
+      }else if( iVal<=pCsr->iMaxRowid ){
+        pCsr->iMaxRowid = iVal-1;
+      }
+      break;
+    default:
+      assert( op==COLSTORE_LE );
+      if( iVal<pCsr->iMaxRowid ) pCsr->iMaxRowid = iVal;
+      break;
+  }
+  if( pCsr->iMinRowid>pCsr->iMaxRowid ) *pbEmpty = 1;
+}
+
+/*
+** Colstore virtual table module xFilter method.
+**
+** The idxStr argument is a list of constraints, one for each entry in
+** argv[], generated by colstoreBestIndex(). Each is an operator character
+** (COLSTORE_EQ, COLSTORE_GT etc.) followed by the column number, or -1
+** for the rowid, and a comma.
+*/
+static int colstoreFilter(
+  sqlite3_vtab_cursor *pVtabCursor,
+  int idxNum, const char *idxStr,
+  int argc, sqlite3_value **argv
+){
+  ColstoreCursor *pCsr = (ColstoreCursor *)pVtabCursor;
+  const char *z = idxStr;
+  const u8 *p;
+  int bEmpty = 0;
+  int rc = SQLITE_OK;
+  int i;
+
+  UNUSED_PARAMETER(idxNum);
+  colstoreSegmentClear(pCsr);
+  sqlite3_reset(pCsr->pSegment);
+  sqlite3_reset(pCsr->pPending);
+  sqlite3_free(pCsr->aCons);
+  pCsr->aCons = 0;
+  pCsr->nCons = 0;
+  pCsr->cons.n = 0;
+  pCsr->iMinRowid = SMALLEST_INT64;
+  pCsr->iMaxRowid = LARGEST_INT64;
+
+  if( argc>0 ){
+    pCsr->aCons = (ColstoreConstraint *)sqlite3_malloc(
+        sizeof(ColstoreConstraint)*argc
+    );
+    if( !pCsr->aCons ) return SQLITE_NOMEM;
+  }
+  for(i=0; rc==SQLITE_OK && i<argc; i++){
+    int op = *(z++);
+    int iCol = 0;
+    if( *z=='-' ){
+      iCol = -1;
+      z += 2;
+    }else{
+      while( *z>='0' && *z<='9' ) iCol = iCol*10 + *(z++) - '0';
+    }
+    assert( *z==',' );
+    z++;
+    if( iCol<0 ){
+      colstoreRowidConstraint(pCsr, op, argv[i], &bEmpty);
+    }else if( sqlite3_value_type(argv[i])==SQLITE_NULL ){
+      bEmpty = 1;
+    }else{
+      ColstoreValue val;
+      colstoreValueFromSql(argv[i], &val);
+      colstoreBufferAppendValue(&rc, &pCsr->cons, &val);
+      pCsr->aCons[pCsr->nCons].iCol = iCol;
+      pCsr->aCons[pCsr->nCons].op = op;
+      pCsr->nCons++;
+    }
+  }
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* Point each constraint at its copy of the right-hand side. */
+  p = pCsr->cons.a;
+  for(i=0; i<pCsr->nCons; i++){
+    p += colstoreGetValue(p, &pCsr->cons.a[pCsr->cons.n], &pCsr->aCons[i].val);
+  }
+
+  if( bEmpty ){
+    pCsr->eState = COLSTORE_STATE_EOF;
+  }else{
+    sqlite3_bind_int64(pCsr->pSegment, 1, pCsr->iMinRowid);
+    sqlite3_bind_int64(pCsr->pSegment, 2, pCsr->iMaxRowid);
+    sqlite3_bind_int64(pCsr->pPending, 1, pCsr->iMinRowid);
+    sqlite3_bind_int64(pCsr->pPending, 2, pCsr->iMaxRowid);
+    pCsr->eState = COLSTORE_STATE_SEGMENT;
+    rc = colstoreNextSegment(pCsr);
+  }
+  return rc;
+}
+
+/*
+** Colstore virtual table module xNext method.
+*/
+static int colstoreNext(sqlite3_vtab_cursor *pVtabCursor){
+  ColstoreCursor *pCsr = (ColstoreCursor *)pVtabCursor;
+  int rc = SQLITE_OK;
+  if( pCsr->eState==COLSTORE_STATE_SEGMENT ){
+    pCsr->iRow++;
+    colstoreSegmentSkip(pCsr);
+    if( pCsr->iRow>=pCsr->nRow ){
+      rc = colstoreNextSegment(pCsr);
+    }
+  }else if( pCsr->eState==COLSTORE_STATE_PENDING ){
+    rc = colstoreStepPending(pCsr);
+  }
+  return rc;
+}
+
+/*
+** Colstore virtual table module xEof method.
+*/
+static int colstoreEof(sqlite3_vtab_cursor *pVtabCursor){
+  ColstoreCursor *pCsr = (ColstoreCursor *)pVtabCursor;
+  return pCsr->eState==COLSTORE_STATE_EOF;
+}
+
+/*
+** Colstore virtual table module xColumn method. The first value requested
+** from a column of a segment reads and decodes the values of the column
+** for all rows of the segment, so that the rest are returned without
+** further I/O.
+*/
+static int colstoreColumn(
+  sqlite3_vtab_cursor *pVtabCursor,
+  sqlite3_context *ctx,
+  int i
+){
+  ColstoreCursor *pCsr = (ColstoreCursor *)pVtabCursor;
+  Colstore *pTab = (Colstore *)pVtabCursor->pVtab;
+  ColstoreColumn *pCol;
+
+  if( pCsr->eState==COLSTORE_STATE_PENDING ){
+    sqlite3_result_value(ctx, sqlite3_column_value(pCsr->pPending, i+1));
+    return SQLITE_OK;
+  }
+  assert( pCsr->eState==COLSTORE_STATE_SEGMENT );
+  pCol = &pCsr->aCol[i+1];
+  if( pCol->aVal==0 ){
+    int rc = colstoreReadColumn(pTab, pCsr->iSegno, i+1, pCsr->nRow, pCol);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  colstoreResultValue(ctx, &pCol->aVal[pCsr->iRow]);
+  return SQLITE_OK;
+}
+
+/*
+** Colstore virtual table module xRowid method.
+*/
+static int colstoreRowid(
+  sqlite3_vtab_cursor *pVtabCursor,
+  sqlite_int64 *pRowid
+){
+  ColstoreCursor *pCsr = (ColstoreCursor *)pVtabCursor;
+  if( pCsr->eState==COLSTORE_STATE_PENDING ){
+    *pRowid = sqlite3_column_int64(pCsr->pPending, 0);
+  }else{
+    assert( pCsr->eState==COLSTORE_STATE_SEGMENT );
+    *pRowid = pCsr->aCol[0].aVal[pCsr->iRow].u.i;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Colstore virtual table module xBestIndex method. Every usable
+** comparison on the rowid or a column is passed to xFilter, which uses
+** rowid constraints to limit the segments and rows visited, and column
+** constraints to skip segments using their zone maps. SQLite still tests
+** all constraints on the rows returned.
+*/
+static int colstoreBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo){
+  char *zIdxStr;
+  int nIdxStr = 0;
+  int nArg = 0;
+  int bRowidEq = 0;
+  int bRowidRange = 0;
+  int nColumn = 0;
+  int ii;
+
+  UNUSED_PARAMETER(tab);
+  zIdxStr = (char *)sqlite3_malloc(pIdxInfo->nConstraint*8 + 1);
+  if( !zIdxStr ) return SQLITE_NOMEM;
+  zIdxStr[0] = '\0';
+
+  for(ii=0; ii<pIdxInfo->nConstraint; ii++){
+    struct sqlite3_index_constraint *p = &pIdxInfo->aConstraint[ii];
+    int op;
+    if( !p->usable ) continue;
+    switch( p->op ){
+      case SQLITE_INDEX_CONSTRAINT_EQ: op = COLSTORE_EQ; break;
+      case SQLITE_INDEX_CONSTRAINT_GT: op = COLSTORE_GT; break;
+      case SQLITE_INDEX_CONSTRAINT_LE: op = COLSTORE_LE; break;
+      case SQLITE_INDEX_CONSTRAINT_LT: op = COLSTORE_LT; break;
+      case SQLITE_INDEX_CONSTRAINT_GE: op = COLSTORE_GE; break;
+      default: continue;
+    }
+    sqlite3_snprintf(8, &zIdxStr[nIdxStr], "%c%d,", op, p->iColumn);
+    nIdxStr += (int)strlen(&zIdxStr[nIdxStr]);
+    pIdxInfo->aConstraintUsage[ii].argvIndex = ++nArg;
+    if( p->iColumn>=0 ){
+      nColumn++;
+    }else if( op==COLSTORE_EQ ){
+      bRowidEq = 1;
+    }else{
+      bRowidRange = 1;
+    }
+  }
+
+  if( nArg==0 ){
+    sqlite3_free(zIdxStr);
+    zIdxStr = 0;
+  }
+  pIdxInfo->idxStr = zIdxStr;
+  pIdxInfo->needToFreeIdxStr = 1;
+
+  /* A rowid lookup reads one segment at most. Otherwise, guess that each
+  ** constraint lets a scan skip part of the table. */
+  if( bRowidEq ){
+    pIdxInfo->estimatedCost = 10.0;
+  }else{
+    pIdxInfo->estimatedCost = 2000000.0 / (double)(nColumn+1);
+    if( bRowidRange ) pIdxInfo->estimatedCost /= 4.0;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Colstore virtual table module xOpen method.
+*/
+static int colstoreOpen(sqlite3_vtab *pVTab, sqlite3_vtab_cursor **ppCursor){
+  Colstore *pTab = (Colstore *)pVTab;
+  ColstoreCursor *pCsr;
+  int nByte;
+  int rc = SQLITE_OK;
+  char *zSql;
+
+  nByte = sizeof(ColstoreCursor)
+        + sizeof(ColstoreValue)*pTab->nCol*2
+        + sizeof(ColstoreColumn)*(pTab->nCol+1)
+        + pTab->nCol;
+  pCsr = (ColstoreCursor *)sqlite3_malloc(nByte);
+  if( !pCsr ) return SQLITE_NOMEM;
+  memset(pCsr, 0, nByte);
+  pCsr->base.pVtab = pVTab;
+  pCsr->eState = COLSTORE_STATE_EOF;
+  pCsr->aZone = (ColstoreValue *)&pCsr[1];
+  pCsr->aCol = (ColstoreColumn *)&pCsr->aZone[pTab->nCol*2];
+  pCsr->aZoneType = (u8 *)&pCsr->aCol[pTab->nCol+1];
+
+  zSql = sqlite3_mprintf(
+      "SELECT segno, nrow, zone FROM '%q'.'%q_segment' "
+      "WHERE maxrowid>=?1 AND minrowid<=?2", pTab->zDb, pTab->zName
+  );
+  if( !zSql ){
+    rc = SQLITE_NOMEM;
+  }else{
+    rc = sqlite3_prepare_v2(pTab->db, zSql, -1, &pCsr->pSegment, 0);
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK ){
+    zSql = sqlite3_mprintf(
+        "SELECT * FROM '%q'.'%q_pending' WHERE id>=?1 AND id<=?2",
+        pTab->zDb, pTab->zName
+    );
+    if( !zSql ){
+      rc = SQLITE_NOMEM;
+    }else{
+      rc = sqlite3_prepare_v2(pTab->db, zSql, -1, &pCsr->pPending, 0);
+      sqlite3_free(zSql);
+    }
+  }
+
+  if( rc!=SQLITE_OK ){
+    sqlite3_finalize(pCsr->pSegment);
+    sqlite3_finalize(pCsr->pPending);
+    sqlite3_free(pCsr);
+    return rc;
+  }
+  *ppCursor = &pCsr->base;
+  return SQLITE_OK;
+}
+
+/*
+** Colstore virtual table module xClose method.
+*/
+static int colstoreClose(sqlite3_vtab_cursor *pVtabCursor){
+  ColstoreCursor *pCsr = (ColstoreCursor *)pVtabCursor;
+  colstoreSegmentClear(pCsr);
+  sqlite3_finalize(pCsr->pSegment);
+  sqlite3_finalize(pCsr->pPending);
+  sqlite3_free(pCsr->aCons);
+  sqlite3_free(pCsr->cons.a);
+  sqlite3_free(pCsr->aDeleted);
+  sqlite3_free(pCsr);
+  return SQLITE_OK;
+}
+
+/*
+** Free a Colstore object and the statements it holds.
+*/
+static void colstoreFree(Colstore *pTab){
+  int i;
+  for(i=0; i<COLSTORE_N_STMT; i++){
+    sqlite3_finalize(pTab->aStmt[i]);
+  }
+  sqlite3_free(pTab);
+}
+
+/*
+** Colstore virtual table module xDisconnect method.
+*/
+static int colstoreDisconnect(sqlite3_vtab *pVtab){
+  colstoreFree((Colstore *)pVtab);
+  return SQLITE_OK;
+}
+
+/*
+** Colstore virtual table module xDestroy method.
+*/
+static int colstoreDestroy(sqlite3_vtab *pVtab){
+  Colstore *pTab = (Colstore *)pVtab;
+  int rc;
+  char *zSql = sqlite3_mprintf(
+    "DROP TABLE '%q'.'%q_segment';"
+    "DROP TABLE '%q'.'%q_data';"
+    "DROP TABLE '%q'.'%q_deleted';"
+    "DROP TABLE '%q'.'%q_pending';",
+    pTab->zDb, pTab->zName,
+    pTab->zDb, pTab->zName,
+    pTab->zDb, pTab->zName,
+    pTab->zDb, pTab->zName
+  );
+  if( !zSql ){
+    rc = SQLITE_NOMEM;
+  }else{
+    rc = sqlite3_exec(pTab->db, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK ){
+    colstoreFree(pTab);
+  }
+  return rc;
+}
+
+/*
+** The xRename method for colstore module virtual tables.
+*/
+static int colstoreRename(sqlite3_vtab *pVtab, const char *zNewName){
+  Colstore *pTab = (Colstore *)pVtab;
+  int rc = SQLITE_NOMEM;
+  char *zSql = sqlite3_mprintf(
+    "ALTER TABLE %Q.'%q_segment' RENAME TO \"%w_segment\";"
+    "ALTER TABLE %Q.'%q_data'    RENAME TO \"%w_data\";"
+    "ALTER TABLE %Q.'%q_deleted' RENAME TO \"%w_deleted\";"
+    "ALTER TABLE %Q.'%q_pending' RENAME TO \"%w_pending\";"
+    , pTab->zDb, pTab->zName, zNewName
+    , pTab->zDb, pTab->zName, zNewName
+    , pTab->zDb, pTab->zName, zNewName
+    , pTab->zDb, pTab->zName, zNewName
+  );
+  if( zSql ){
+    rc = sqlite3_exec(pTab->db, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+  }
+  return rc;
+}
+
+static int colstoreInit(
+  sqlite3 *, void *, int, const char *const*, sqlite3_vtab **, char **, int
+);
+
+/*
+** Colstore virtual table module xCreate method.
+*/
+static int colstoreCreate(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  return colstoreInit(db, pAux, argc, argv, ppVtab, pzErr, 1);
+}
+
+/*
+** Colstore virtual table module xConnect method.
+*/
+static int colstoreConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  return colstoreInit(db, pAux, argc, argv, ppVtab, pzErr, 0);
+}
+
+static sqlite3_module colstoreModule = {
+  0,                          /* iVersion */
+  colstoreCreate,             /* xCreate - create a table */
+  colstoreConnect,            /* xConnect - connect to an existing table */
+  colstoreBestIndex,          /* xBestIndex - Determine search strategy */
+  colstoreDisconnect,         /* xDisconnect - Disconnect from a table */
+  colstoreDestroy,            /* xDestroy - Drop a table */
+  colstoreOpen,               /* xOpen - open a cursor */
+  colstoreClose,              /* xClose - close a cursor */
+  colstoreFilter,             /* xFilter - configure scan constraints */
+  colstoreNext,               /* xNext - advance a cursor */
+  colstoreEof,                /* xEof */
+  colstoreColumn,             /* xColumn - read data */
+  colstoreRowid,              /* xRowid - read data */
+  colstoreUpdate,             /* xUpdate - write data */
+  colstoreBegin,              /* xBegin - begin transaction */
+  0,                          /* xSync - sync transaction */
+  0,                          /* xCommit - commit transaction */
+  0,                          /* xRollback - rollback transaction */
+  0,                          /* xFindFunction - function overloading */
+  colstoreRename,             /* xRename - rename the table */
+  0,                          /* xSavepoint */
+  0,                          /* xRelease */
+  0                           /* xRollbackTo */
+};
+
+/*
+** Create the shadow tables of a new colstore table, if isCreate is true,
+** and prepare the statements used to access them.
+*/
+static int colstoreSqlInit(Colstore *pTab, int isCreate){
+  static const char *azSql[COLSTORE_N_STMT-1] = {
+    /* Read and write the xxx_data table */
+    "SELECT data FROM '%q'.'%q_data' WHERE id=?1",
+    "INSERT INTO '%q'.'%q_data' VALUES(?1, ?2)",
+    "DELETE FROM '%q'.'%q_data' WHERE id>=?1 AND id<=?2",
+
+    /* Read and write the xxx_segment table */
+    "SELECT segno, nrow FROM '%q'.'%q_segment' "
+        "WHERE minrowid<=?1 AND maxrowid>=?1",
+    "INSERT INTO '%q'.'%q_segment' VALUES(NULL, ?1, ?2, ?3, ?4)",
+    "DELETE FROM '%q'.'%q_segment' WHERE segno=?1",
+
+    /* Read and write the xxx_deleted table */
+    "SELECT id FROM '%q'.'%q_deleted' WHERE segno=?1 ORDER BY id",
+    "SELECT 1 FROM '%q'.'%q_deleted' WHERE segno=?1 AND id=?2",
+    "INSERT INTO '%q'.'%q_deleted' VALUES(?1, ?2)",
+    "SELECT count(*) FROM '%q'.'%q_deleted' WHERE segno=?1",
+    "DELETE FROM '%q'.'%q_deleted' WHERE segno=?1",
+
+    /* Read and write the xxx_pending table */
+    "SELECT 1 FROM '%q'.'%q_pending' WHERE id=?1",
+    "DELETE FROM '%q'.'%q_pending' WHERE id=?1",
+    "SELECT count(*) FROM '%q'.'%q_pending'"
+  };
+  const char *zDb = pTab->zDb;
+  const char *zName = pTab->zName;
+  char *zCols = 0;                /* ", c0, c1..." */
+  char *zVals = 0;                /* ", ?2, ?3..." */
+  char *zSql;
+  int rc = SQLITE_OK;
+  int i;
+
+  zCols = sqlite3_mprintf("");
+  zVals = sqlite3_mprintf("");
+  for(i=0; zCols && zVals && i<pTab->nCol; i++){
+    char *zTmp = zCols;
+    zCols = sqlite3_mprintf("%s, c%d", zTmp, i);
+    sqlite3_free(zTmp);
+    zTmp = zVals;
+    zVals = sqlite3_mprintf("%s, ?%d", zTmp, i+2);
+    sqlite3_free(zTmp);
+  }
+  if( !zCols || !zVals ){
+    rc = SQLITE_NOMEM;
+  }
+
+  if( rc==SQLITE_OK && isCreate ){
+    zSql = sqlite3_mprintf(
+        "CREATE TABLE \"%w\".\"%w_segment\"(segno INTEGER PRIMARY KEY,"
+        " nrow INTEGER, minrowid INTEGER, maxrowid INTEGER, zone BLOB);"
+        "CREATE TABLE \"%w\".\"%w_data\"(id INTEGER PRIMARY KEY, data BLOB);"
+        "CREATE TABLE \"%w\".\"%w_deleted\"(segno INTEGER, id INTEGER,"
+        " PRIMARY KEY(segno, id));"
+        "CREATE TABLE \"%w\".\"%w_pending\"("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT%s);",
+        zDb, zName, zDb, zName, zDb, zName, zDb, zName, zCols
+    );
+    if( !zSql ){
+      rc = SQLITE_NOMEM;
+    }else{
+      rc = sqlite3_exec(pTab->db, zSql, 0, 0, 0);
+      sqlite3_free(zSql);
+    }
+  }
+
+  for(i=0; i<COLSTORE_N_STMT && rc==SQLITE_OK; i++){
+    if( i==COLSTORE_WRITE_PENDING ){
+      zSql = sqlite3_mprintf("INSERT INTO '%q'.'%q_pending' VALUES(?1%s)",
+          zDb, zName, zVals
+      );
+    }else{
+      zSql = sqlite3_mprintf(azSql[i], zDb, zName);
+    }
+    if( zSql ){
+      rc = sqlite3_prepare_v2(pTab->db, zSql, -1, &pTab->aStmt[i], 0);
+    }else{
+      rc = SQLITE_NOMEM;
+    }
+    sqlite3_free(zSql);
+  }
+
+  sqlite3_free(zCols);
+  sqlite3_free(zVals);
+  return rc;
+}
+
+/*
+** Return true if column declaration zDecl specifies a collation
+** sequence. Text values of such columns are not compared against zone
+** maps.
+*/
+static int colstoreHasCollate(const char *zDecl){
+  const char *z;
+  for(z=zDecl; *z; z++){
+    if( sqlite3_strnicmp(z, "collate", 7)==0 ) return 1;
+  }
+  return 0;
+}
+
+/*
+** This function is the implementation of both the xConnect and xCreate
+** methods of the colstore virtual table.
+**
+**   argv[0]   -> module name
+**   argv[1]   -> database name
+**   argv[2]   -> table name
+**   argv[...] -> column declarations...
+*/
+static int colstoreInit(
+  sqlite3 *db,                        /* Database connection */
+  void *pAux,                         /* Unused */
+  int argc, const char *const*argv,   /* Parameters to CREATE TABLE statement */
+  sqlite3_vtab **ppVtab,              /* OUT: New virtual table */
+  char **pzErr,                       /* OUT: Error message, if any */
+  int isCreate                        /* True for xCreate, false for xConnect */
+){
+  int rc = SQLITE_OK;
+  Colstore *pTab;
+  int nCol = argc-3;    /* Number of columns */
+  int nDb;              /* Length of string argv[1] */
+  int nName;            /* Length of string argv[2] */
+  int i;
+
+  UNUSED_PARAMETER(pAux);
+  if( nCol<1 || nCol>COLSTORE_MAX_COLUMNS ){
+    *pzErr = sqlite3_mprintf("%s", nCol<1 ?
+        "Too few columns for a colstore table" :
+        "Too many columns for a colstore table"
+    );
+    return SQLITE_ERROR;
+  }
+
+  sqlite3_vtab_config(db, SQLITE_VTAB_CONSTRAINT_SUPPORT, 1);
+
+  /* Allocate the sqlite3_vtab structure */
+  nDb = (int)strlen(argv[1]);
+  nName = (int)strlen(argv[2]);
+  pTab = (Colstore *)sqlite3_malloc(sizeof(Colstore)+nCol+nDb+nName+2);
+  if( !pTab ){
+    return SQLITE_NOMEM;
+  }
+  memset(pTab, 0, sizeof(Colstore)+nCol+nDb+nName+2);
+  pTab->base.pModule = &colstoreModule;
+  pTab->db = db;
+  pTab->nCol = nCol;
+  pTab->nPending = -1;
+  pTab->abBinary = (u8 *)&pTab[1];
+  pTab->zDb = (char *)&pTab->abBinary[nCol];
+  pTab->zName = &pTab->zDb[nDb+1];
+  memcpy(pTab->zDb, argv[1], nDb);
+  memcpy(pTab->zName, argv[2], nName);
+  for(i=0; i<nCol; i++){
+    pTab->abBinary[i] = !colstoreHasCollate(argv[i+3]);
+  }
+
+  /* Create/Connect to the underlying relational database schema. If
+  ** that is successful, call sqlite3_declare_vtab() to configure
+  ** the colstore table schema.
+  */
+  if( (rc = colstoreSqlInit(pTab, isCreate)) ){
+    *pzErr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  }else{
+    char *zSql = sqlite3_mprintf("CREATE TABLE x(%s", argv[3]);
+    char *zTmp;
+    for(i=4; zSql && i<argc; i++){
+      zTmp = zSql;
+      zSql = sqlite3_mprintf("%s, %s", zTmp, argv[i]);
+      sqlite3_free(zTmp);
+    }
+    if( zSql ){
+      zTmp = zSql;
+      zSql = sqlite3_mprintf("%s);", zTmp);
+      sqlite3_free(zTmp);
+    }
+    if( !zSql ){
+      rc = SQLITE_NOMEM;
+    }else if( SQLITE_OK!=(rc = sqlite3_declare_vtab(db, zSql)) ){
+      *pzErr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+    }
+    sqlite3_free(zSql);
+  }
+
+  if( rc==SQLITE_OK ){
+    *ppVtab = (sqlite3_vtab *)pTab;
+  }else{
+    colstoreFree(pTab);
+  }
+  return rc;
+}
+
+/*
+** Register the colstore module with database handle db.
+*/
+int sqlite3ColstoreInit(sqlite3 *db){
+  return sqlite3_create_module_v2(db, "colstore", &colstoreModule, 0, 0);
+}
+
+#if !SQLITE_CORE
+int sqlite3_extension_init(
+  sqlite3 *db,
+  char **pzErrMsg,
+  const sqlite3_api_routines *pApi
+){
+  SQLITE_EXTENSION_INIT2(pApi)
+  return sqlite3ColstoreInit(db);
+}
+#endif
+
+#endif
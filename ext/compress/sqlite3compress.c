@@ -0,0 +1,1551 @@
+/*
+** 2026 October 18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains a VFS "shim" - a layer that sits in between the
+** pager and the real VFS - that stores each page of a database file
+** compressed.  Pages are compressed with a fast LZ77 codec that writes
+** the LZ4 block format, and stored in variable size extents located by
+** an indirection map.  The pager continues to see a file of fixed size
+** pages, and pages are decompressed straight into its page buffers.
+**
+** USAGE:
+**
+** Compile this source file and link it with your application.  Then
+** at start-time, invoke the following procedure:
+**
+**   int sqlite3_compress_initialize(
+**      const char *zOrigVfsName,    // The underlying real VFS
+**      int makeDefault              // True to make compress the default VFS
+**   );
+**
+** The procedure call above will create and register a new VFS shim named
+** "compress".  Use it by specifying "compress" as the 4th parameter to
+** sqlite3_open_v2(), by adding "vfs=compress" to a URI filename, or by
+** making it the default VFS.  The "compress=0" URI parameter disables
+** compression for a database file that does not exist yet.
+**
+** FILE FORMAT:
+**
+** The file starts with a 64KiB header.  The first 64 bytes are:
+**
+**     0   16   Magic string "SQLite compress" followed by a nul
+**    16    4   Page size of the database (the logical page size)
+**    20    4   Size of the database in pages
+**    24    4   Generation counter, incremented by each write transaction
+**    28   36   Reserved, zero
+**
+** followed by the locations of up to CMP_MAX_MAPBLOCK map blocks.  Map
+** block i holds the locations of pages i*CMP_MAP_ENTRIES through
+** (i+1)*CMP_MAP_ENTRIES-1 as 8 bytes each: the offset of the extent
+** holding the page, and its size in bytes.  A size of zero means the page
+** is all zeros.  A size equal to the page size means the page is stored
+** uncompressed.  All offsets are in units of CMP_UNIT bytes, and all
+** integers are big-endian.
+**
+** CRASH SAFETY AND CONCURRENCY:
+**
+** A page that fits in its current extent is overwritten in place.  A page
+** that does not is written to a new extent before its map entry is
+** updated, and the old extent is not reused until the next xSync.  So,
+** as with an uncompressed database file, a crash can only damage pages
+** written since the last sync, which the rollback journal or WAL file
+** restores.  Map entries are written individually, which relies on the
+** underlying file system having the "powersafe overwrite" property that
+** SQLite assumes by default.
+**
+** Each connection caches the map.  Whenever it takes a lock it compares
+** the generation counter with the value it cached and reloads the map if
+** another connection has written the file since.
+*/
+#include "sqlite3.h"
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "sqlite3compress.h"
+
+#ifndef SQLITE_AMALGAMATION
+typedef sqlite3_int64 i64;
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+#endif
+
+#define UNUSED_PARAMETER(x) (void)(x)
+
+/************************ Shim Definitions ******************************/
+
+#ifndef SQLITE_COMPRESS_VFS_NAME
+# define SQLITE_COMPRESS_VFS_NAME "compress"
+#endif
+
+#define CMP_MAGIC         "SQLite compress"   /* Plus nul terminator */
+#define CMP_HDR_SIZE      65536               /* Size of file header */
+#define CMP_HDR_FIXED     64                  /* Fixed part of the header */
+#define CMP_MAX_MAPBLOCK  ((CMP_HDR_SIZE-CMP_HDR_FIXED)/4)
+#define CMP_MAP_ENTRIES   4096                /* Entries per map block */
+#define CMP_MAP_SIZE      (CMP_MAP_ENTRIES*8) /* Size of a map block */
+#define CMP_UNIT          128                 /* Allocation unit in bytes */
+#define CMP_MAX_PAGE_SIZE 65536
+#define CMP_MAX_UNITS     (CMP_MAX_PAGE_SIZE/CMP_UNIT)
+
+/* Parameters of the LZ77 codec.  These match the LZ4 block format. */
+#define CMP_HASH_BITS     12
+#define CMP_HASH_SIZE     (1<<CMP_HASH_BITS)
+#define CMP_MINMATCH      4                   /* Shortest match encoded */
+#define CMP_MFLIMIT       12                  /* No match starts after this */
+#define CMP_LASTLITERALS  5                   /* Trailing literal bytes */
+
+/************************ Object Definitions ******************************/
+
+typedef struct CmpFile CmpFile;
+typedef struct CmpExtent CmpExtent;
+typedef struct CmpBucket CmpBucket;
+typedef struct CmpMove CmpMove;
+
+/*
+** A contiguous run of nUnit allocation units starting at iUnit.
+*/
+struct CmpExtent {
+  u32 iUnit;
+  u32 nUnit;
+};
+
+/*
+** The free extents of one particular size.
+*/
+struct CmpBucket {
+  u32 *aUnit;                     /* Offset of each free extent */
+  int nUnit;                      /* Number of entries in aUnit[] */
+  int nAlloc;                     /* Allocated size of aUnit[] */
+};
+
+/*
+** A page moved by cmpCompact() from the extent at iFrom to that at iTo.
+*/
+struct CmpMove {
+  u32 iPg;
+  u32 iFrom;
+  u32 iTo;
+};
+
+/*
+** An open file.  The sqlite3_file object for the underlying VFS is
+** allocated directly after this object.
+*/
+struct CmpFile {
+  sqlite3_file base;              /* Base class - must be first */
+  sqlite3_file *pReal;            /* The real underlying file */
+  int bCompress;                  /* True if the file is stored compressed */
+
+  /* Cached copy of the header */
+  u8 bHdr;                        /* True once the header has been written */
+  u8 bHdrDirty;                   /* True if szPage or nPage need writing */
+  u8 bCheck;                      /* Check iGen before the next I/O */
+  u8 bWritten;                    /* True if iGen bumped since last check */
+  int szPage;                     /* Logical page size, or 0 if unknown */
+  u32 nPage;                      /* Logical size of the file in pages */
+  u32 iGen;                       /* Generation counter */
+  u32 *aMapBlk;                   /* Location of each map block, or 0 */
+
+  /* Cached copy of the map */
+  u32 *aMap;                      /* Unit offset and size of each page */
+  u32 nMapBlk;                    /* Number of map blocks aMap[] can hold */
+  u8 *aMapValid;                  /* True for each map block loaded */
+
+  /* Free space */
+  int bFreeValid;                 /* True if aBucket[] and iEnd are valid */
+  int bShrink;                    /* Rebuild free space at next xSync */
+  u32 iEnd;                       /* End of allocated space in units */
+  CmpBucket *aBucket;             /* Free extents by size in units */
+  CmpExtent *aPend;               /* Extents freed since the last xSync */
+  int nPend;                      /* Number of entries in aPend[] */
+  int nPendAlloc;                 /* Allocated size of aPend[] */
+
+  /* Buffers */
+  u8 *aBuf;                       /* CMP_HDR_SIZE bytes of scratch space */
+  u8 *aPage;                      /* szPage bytes of scratch space */
+  u16 *aHash;                     /* Hash table used by cmpCompress() */
+};
+
+/************************* Global Variables **********************************/
+/*
+** All global variables used by this file are contained within the following
+** gCompress structure.
+*/
+static struct {
+  /* The pOrigVfs is the real, original underlying VFS implementation.
+  ** Most operations pass-through to the real VFS.  This value is read-only
+  ** during operation.  It is only modified at start-time and thus does not
+  ** require a mutex.
+  */
+  sqlite3_vfs *pOrigVfs;
+
+  /* The sThisVfs is the VFS structure used by this shim.  It is initialized
+  ** at start-time and thus does not require a mutex
+  */
+  sqlite3_vfs sThisVfs;
+
+  /* The sIoMethods defines the methods used by sqlite3_file objects
+  ** associated with this shim.  It is initialized at start-time and does
+  ** not require a mutex.
+  **
+  ** When the underlying VFS is called to open a file, it might return
+  ** either a version 1 or a version 2 sqlite3_file object.  This shim
+  ** has to create a wrapper sqlite3_file of the same version.  Hence
+  ** there are two I/O method structures, one for version 1 and the other
+  ** for version 2.
+  */
+  sqlite3_io_methods sIoMethodsV1;
+  sqlite3_io_methods sIoMethodsV2;
+
+  /* True when this shim has been initialized.
+  */
+  int isInitialized;
+} gCompress;
+
+/************************* Utility Routines *********************************/
+
+static u32 cmpGet4(const u8 *a){
+  return ((u32)a[0]<<24) | ((u32)a[1]<<16) | ((u32)a[2]<<8) | (u32)a[3];
+}
+static void cmpPut4(u8 *a, u32 v){
+  a[0] = (u8)(v>>24);
+  a[1] = (u8)(v>>16);
+  a[2] = (u8)(v>>8);
+  a[3] = (u8)v;
+}
+
+/*
+** Return the number of allocation units needed to store nByte bytes.
+*/
+static u32 cmpUnits(u32 nByte){
+  return (nByte + CMP_UNIT - 1) / CMP_UNIT;
+}
+
+/*
+** Return true if n is a valid database page size.
+*/
+static int cmpIsPageSize(int n){
+  return n>=512 && n<=CMP_MAX_PAGE_SIZE && ((n-1)&n)==0;
+}
+
+/************************* The Codec ****************************************/
+
+static u32 cmpRead32(const u8 *a){
+  u32 v;
+  memcpy(&v, a, 4);
+  return v;
+}
+
+/*
+** Append one sequence - nLit literal bytes followed by a match of nMatch
+** bytes at distance iDist - to the compressed data in aOut[].  If nMatch
+** is zero, this is the final sequence and only the literals are written.
+**
+** Return the new size of the compressed data, or -1 if it does not fit
+** in the nOut byte buffer.
+*/
+static int cmpPutSequence(
+  u8 *aOut, int nOut, int iOut,   /* Output buffer and bytes used so far */
+  const u8 *aLit, int nLit,       /* Literals */
+  int iDist, int nMatch           /* Match, or 0 for the final sequence */
+){
+  int nMl = nMatch ? nMatch-CMP_MINMATCH : 0;
+  int n;
+  u8 *pToken;
+
+  if( iOut + 1 + nLit/255+1 + nLit + 2 + nMl/255+1 > nOut ) return -1;
+  pToken = &aOut[iOut++];
+  *pToken = (u8)(((nLit<15 ? nLit : 15)<<4) | (nMl<15 ? nMl : 15));
+  if( nLit>=15 ){
+    for(n=nLit-15; n>=255; n-=255) aOut[iOut++] = 255;
+    aOut[iOut++] = (u8)n;
+  }
+  memcpy(&aOut[iOut], aLit, nLit);
+  iOut += nLit;
+  if( nMatch ){
+    aOut[iOut++] = (u8)(iDist & 0xff);
+    aOut[iOut++] = (u8)(iDist >> 8);
+    if( nMl>=15 ){
+      for(n=nMl-15; n>=255; n-=255) aOut[iOut++] = 255;
+      aOut[iOut++] = (u8)n;
+    }
+  }
+  return iOut;
+}
+
+/*
+** Compress the nIn byte page aIn[] into buffer aOut[], which is nOut bytes
+** in size.  aHash[] is CMP_HASH_SIZE entries of workspace.  Return the
+** size of the compressed data, or 0 if it does not fit in aOut[].
+**
+** This is a single pass greedy compressor: each 4-byte sequence is looked
+** up in a hash table of recent positions and the first match found is
+** used.  Since pages are at most 64KiB, every match distance fits in the
+** 16 bits the format allows.
+*/
+static int cmpCompress(
+  const u8 *aIn, int nIn,         /* Page to compress */
+  u8 *aOut, int nOut,             /* Output buffer */
+  u16 *aHash                      /* Hash table workspace */
+){
+  int iIn = 0;                    /* Next input byte to consider */
+  int iLit = 0;                   /* First byte of pending literals */
+  int iOut = 0;                   /* Bytes written to aOut[] */
+  int mxMatch = nIn - CMP_LASTLITERALS;
+
+  assert( nIn<=CMP_MAX_PAGE_SIZE );
+  memset(aHash, 0, sizeof(u16)*CMP_HASH_SIZE);
+  while( iIn<nIn-CMP_MFLIMIT ){
+    u32 v = cmpRead32(&aIn[iIn]);
+    int h = (int)((v*2654435761U) >> (32-CMP_HASH_BITS));
+    int iRef = aHash[h];
+    aHash[h] = (u16)iIn;
+    if( iRef<iIn && cmpRead32(&aIn[iRef])==v ){
+      int nMatch = CMP_MINMATCH;
+      while( iIn+nMatch<mxMatch && aIn[iRef+nMatch]==aIn[iIn+nMatch] ){
+        nMatch++;
+      }
+      iOut = cmpPutSequence(aOut, nOut, iOut,
+          &aIn[iLit], iIn-iLit, iIn-iRef, nMatch
+      );
+      if( iOut<0 ) return 0;
+      iIn += nMatch;
+      iLit = iIn;
+    }else{
+      iIn++;
+    }
+  }
+  iOut = cmpPutSequence(aOut, nOut, iOut, &aIn[iLit], nIn-iLit, 0, 0);
+  return iOut<0 ? 0 : iOut;
+}
+
+/*
+** Decompress the nIn bytes of aIn[] into the nOut byte buffer aOut[].
+** Return SQLITE_OK if this produces exactly nOut bytes, or SQLITE_CORRUPT
+** if the compressed data is malformed.
+*/
+static int cmpDecompress(const u8 *aIn, int nIn, u8 *aOut, int nOut){
+  int iIn = 0;
+  int iOut = 0;
+  while( iIn<nIn ){
+    int iToken = aIn[iIn++];
+    int n = iToken >> 4;
+    int iDist;
+    if( n==15 ){
+      int c;
+      do{
+        if( iIn>=nIn ) return SQLITE_CORRUPT;
+        c = aIn[iIn++];
+        n += c;
+      }while( c==255 );
+    }
+    if( n>nIn-iIn || n>nOut-iOut ) return SQLITE_CORRUPT;
+    memcpy(&aOut[iOut], &aIn[iIn], n);
+    iIn += n;
+    iOut += n;
+    if( iIn==nIn ) break;
+
+    if( iIn+2>nIn ) return SQLITE_CORRUPT;
+    iDist = aIn[iIn] | (aIn[iIn+1]<<8);
+    iIn += 2;
+    if( iDist==0 || iDist>iOut ) return SQLITE_CORRUPT;
+    n = iToken & 0x0f;
+    if( n==15 ){
+      int c;
+      do{
+        if( iIn>=nIn ) return SQLITE_CORRUPT;
+        c = aIn[iIn++];
+        n += c;
+      }while( c==255 );
+    }
+    n += CMP_MINMATCH;
+    if( n>nOut-iOut ) return SQLITE_CORRUPT;
+    /* The source and destination overlap if iDist<n, so copy bytewise */
+    while( n-- ){
+      aOut[iOut] = aOut[iOut-iDist];
+      iOut++;
+    }
+  }
+  return iOut==nOut ? SQLITE_OK : SQLITE_CORRUPT;
+}
+
+/************************* The Map and Header *******************************/
+
+/*
+** Make sure the map buffers are large enough for map block iBlk.
+*/
+static int cmpMapGrow(CmpFile *p, u32 iBlk){
+  if( iBlk>=CMP_MAX_MAPBLOCK ) return SQLITE_FULL;
+  if( iBlk>=p->nMapBlk ){
+    u32 nNew = p->nMapBlk*2;
+    u32 *aNew;
+    if( nNew<=iBlk ) nNew = iBlk+1;
+    if( nNew>CMP_MAX_MAPBLOCK ) nNew = CMP_MAX_MAPBLOCK;
+    aNew = sqlite3_realloc(p->aMap, nNew*CMP_MAP_ENTRIES*2*sizeof(u32));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    p->aMap = aNew;
+    p->nMapBlk = nNew;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Load map block iBlk into p->aMap[], if it is not already loaded.
+** This uses p->aBuf.
+*/
+static int cmpMapLoad(CmpFile *p, u32 iBlk){
+  int rc;
+  if( iBlk<p->nMapBlk && p->aMapValid[iBlk] ) return SQLITE_OK;
+  rc = cmpMapGrow(p, iBlk);
+  if( rc==SQLITE_OK ){
+    u32 *aEntry = &p->aMap[iBlk*CMP_MAP_ENTRIES*2];
+    if( p->aMapBlk[iBlk]==0 ){
+      memset(aEntry, 0, CMP_MAP_ENTRIES*2*sizeof(u32));
+    }else{
+      i64 iOff = (i64)p->aMapBlk[iBlk]*CMP_UNIT;
+      rc = p->pReal->pMethods->xRead(p->pReal, p->aBuf, CMP_MAP_SIZE, iOff);
+      if( rc==SQLITE_IOERR_SHORT_READ ) rc = SQLITE_CORRUPT;
+      if( rc==SQLITE_OK ){
+        int i;
+        for(i=0; i<CMP_MAP_ENTRIES*2; i++){
+          aEntry[i] = cmpGet4(&p->aBuf[i*4]);
+        }
+      }
+    }
+    if( rc==SQLITE_OK ) p->aMapValid[iBlk] = 1;
+  }
+  return rc;
+}
+
+/*
+** Allocate the scratch buffers that depend on the page size.
+*/
+static int cmpSetPageSize(CmpFile *p, int szPage){
+  u8 *aNew = sqlite3_realloc(p->aPage, szPage);
+  if( aNew==0 ) return SQLITE_NOMEM;
+  p->aPage = aNew;
+  p->szPage = szPage;
+  if( p->bHdr ) p->bHdrDirty = 1;
+  return SQLITE_OK;
+}
+
+/*
+** Forget the cached header and map and reread the header from the file.
+** This is called when another connection has written the file.
+*/
+static int cmpReload(CmpFile *p, const u8 *aFixed){
+  int rc;
+  int i;
+  int szPage = (int)cmpGet4(&aFixed[16]);
+  p->nPage = cmpGet4(&aFixed[20]);
+  p->iGen = cmpGet4(&aFixed[24]);
+  if( szPage!=0 ){
+    if( !cmpIsPageSize(szPage) ) return SQLITE_CORRUPT;
+    rc = cmpSetPageSize(p, szPage);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  rc = p->pReal->pMethods->xRead(p->pReal, p->aBuf,
+      CMP_HDR_SIZE-CMP_HDR_FIXED, CMP_HDR_FIXED
+  );
+  if( rc==SQLITE_IOERR_SHORT_READ ) rc = SQLITE_CORRUPT;
+  if( rc!=SQLITE_OK ) return rc;
+  for(i=0; i<CMP_MAX_MAPBLOCK; i++){
+    p->aMapBlk[i] = cmpGet4(&p->aBuf[i*4]);
+  }
+  p->bHdr = 1;
+  return SQLITE_OK;
+}
+
+/*
+** If a lock has been taken since the header was last checked, reread
+** the generation counter.  If another connection has written to the
+** file since this one last read or wrote it, reload the header and
+** discard the cached map and free space.
+*/
+static int cmpCheck(CmpFile *p){
+  u8 aFixed[CMP_HDR_FIXED];
+  int rc;
+
+  if( p->bCheck==0 ) return SQLITE_OK;
+  p->bCheck = 0;
+  p->bWritten = 0;
+  rc = p->pReal->pMethods->xRead(p->pReal, aFixed, CMP_HDR_FIXED, 0);
+  if( rc==SQLITE_IOERR_SHORT_READ
+   || (rc==SQLITE_OK && aFixed[0]==0 && memcmp(aFixed, &aFixed[1], 15)==0)
+  ){
+    /* An empty file.  Or a file whose header was never completely
+    ** written, which means that no transaction was ever committed. */
+    if( p->bHdr ){
+      memset(p->aMapBlk, 0, CMP_MAX_MAPBLOCK*sizeof(u32));
+      p->bHdr = 0;
+      p->szPage = 0;
+      p->nPage = 0;
+      p->iGen = 0;
+    }
+    rc = SQLITE_OK;
+  }else if( rc==SQLITE_OK ){
+    if( memcmp(aFixed, CMP_MAGIC, 16)!=0 ) return SQLITE_NOTADB;
+    if( p->bHdr && cmpGet4(&aFixed[24])==p->iGen ) return SQLITE_OK;
+    rc = cmpReload(p, aFixed);
+  }else{
+    p->bCheck = 1;
+    return rc;
+  }
+  memset(p->aMapValid, 0, CMP_MAX_MAPBLOCK);
+  p->bFreeValid = 0;
+  p->nPend = 0;
+  p->bHdrDirty = 0;
+  return rc;
+}
+
+/*
+** Called before the first change to the file made by a transaction.
+** Create the header if it does not exist yet.  Otherwise, increment the
+** generation counter, so that other connections know to reload their
+** cached copies of the map.
+*/
+static int cmpBeginWrite(CmpFile *p){
+  int rc = cmpCheck(p);
+  if( rc==SQLITE_OK && p->bWritten==0 ){
+    sqlite3_file *pReal = p->pReal;
+    u8 aGen[4];
+    p->iGen++;
+    cmpPut4(aGen, p->iGen);
+    if( p->bHdr ){
+      rc = pReal->pMethods->xWrite(pReal, aGen, 4, 24);
+    }else{
+      memset(p->aBuf, 0, CMP_HDR_SIZE);
+      memcpy(p->aBuf, CMP_MAGIC, 16);
+      cmpPut4(&p->aBuf[16], (u32)p->szPage);
+      cmpPut4(&p->aBuf[20], p->nPage);
+      memcpy(&p->aBuf[24], aGen, 4);
+      rc = pReal->pMethods->xWrite(pReal, p->aBuf, CMP_HDR_SIZE, 0);
+      if( rc==SQLITE_OK ) p->bHdr = 1;
+    }
+    if( rc==SQLITE_OK ) p->bWritten = 1;
+  }
+  return rc;
+}
+
+/*
+** Write the page size and database size to the header, if they have
+** changed.
+*/
+static int cmpFlushHeader(CmpFile *p){
+  int rc = SQLITE_OK;
+  if( p->bHdrDirty ){
+    u8 a[8];
+    assert( p->bHdr );
+    cmpPut4(&a[0], (u32)p->szPage);
+    cmpPut4(&a[4], p->nPage);
+    rc = p->pReal->pMethods->xWrite(p->pReal, a, 8, 16);
+    if( rc==SQLITE_OK ) p->bHdrDirty = 0;
+  }
+  return rc;
+}
+
+/************************* Free Space ***************************************/
+
+/*
+** Add the extent at iUnit to the free list for extents of nUnit units.
+** Each free list is a binary min-heap ordered by offset, so that space
+** near the start of the file is reused first.
+*/
+static int cmpBucketPush(CmpFile *p, u32 iUnit, u32 nUnit){
+  CmpBucket *pBucket = &p->aBucket[nUnit];
+  u32 *a;
+  int i;
+  assert( nUnit>0 && nUnit<=CMP_MAX_UNITS );
+  if( pBucket->nUnit>=pBucket->nAlloc ){
+    int nNew = pBucket->nAlloc ? pBucket->nAlloc*2 : 16;
+    u32 *aNew = sqlite3_realloc(pBucket->aUnit, nNew*sizeof(u32));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    pBucket->aUnit = aNew;
+    pBucket->nAlloc = nNew;
+  }
+  a = pBucket->aUnit;
+  for(i=pBucket->nUnit++; i>0 && a[(i-1)/2]>iUnit; i=(i-1)/2){
+    a[i] = a[(i-1)/2];
+  }
+  a[i] = iUnit;
+  return SQLITE_OK;
+}
+
+/*
+** Remove and return the lowest offset from a non-empty free list.
+*/
+static u32 cmpBucketPop(CmpBucket *pBucket){
+  u32 *a = pBucket->aUnit;
+  u32 iRet = a[0];
+  u32 iLast = a[--pBucket->nUnit];
+  int n = pBucket->nUnit;
+  int i = 0;
+  while( i*2+1<n ){
+    int iChild = i*2+1;
+    if( iChild+1<n && a[iChild+1]<a[iChild] ) iChild++;
+    if( a[iChild]>=iLast ) break;
+    a[i] = a[iChild];
+    i = iChild;
+  }
+  if( n>0 ) a[i] = iLast;
+  return iRet;
+}
+
+/*
+** Add a free region of any size to the free lists.
+*/
+static int cmpAddFree(CmpFile *p, u32 iUnit, u32 nUnit){
+  int rc = SQLITE_OK;
+  while( rc==SQLITE_OK && nUnit>0 ){
+    u32 n = nUnit<CMP_MAX_UNITS ? nUnit : CMP_MAX_UNITS;
+    rc = cmpBucketPush(p, iUnit, n);
+    iUnit += n;
+    nUnit -= n;
+  }
+  return rc;
+}
+
+/*
+** Compare two CmpExtent objects by offset.  Used with qsort().
+*/
+static int cmpExtentCompare(const void *pA, const void *pB){
+  const CmpExtent *a = (const CmpExtent*)pA;
+  const CmpExtent *b = (const CmpExtent*)pB;
+  return (a->iUnit<b->iUnit) ? -1 : (a->iUnit>b->iUnit);
+}
+
+/*
+** Rebuild the free lists from the map.  Everything not used by the
+** header, a map block, a page, or an extent freed since the last sync is
+** free.  If bTruncate is true, also truncate the underlying file to the
+** end of the last extent in use.
+*/
+static int cmpRebuild(CmpFile *p, int bTruncate){
+  CmpExtent *aExt;
+  int nExt = 0;
+  int nAlloc;
+  int rc = SQLITE_OK;
+  u32 iBlk;
+  u32 nBlk = (p->nPage + CMP_MAP_ENTRIES - 1) / CMP_MAP_ENTRIES;
+  u32 i;
+  u32 iEnd = 0;
+
+  if( p->aBucket==0 ){
+    p->aBucket = sqlite3_malloc((CMP_MAX_UNITS+1)*sizeof(CmpBucket));
+    if( p->aBucket==0 ) return SQLITE_NOMEM;
+    memset(p->aBucket, 0, (CMP_MAX_UNITS+1)*sizeof(CmpBucket));
+  }
+  for(i=0; i<=CMP_MAX_UNITS; i++) p->aBucket[i].nUnit = 0;
+
+  for(iBlk=0; rc==SQLITE_OK && iBlk<nBlk; iBlk++){
+    rc = cmpMapLoad(p, iBlk);
+  }
+  if( rc!=SQLITE_OK ) return rc;
+
+  nAlloc = 1 + p->nPage + p->nPend;
+  for(iBlk=0; iBlk<CMP_MAX_MAPBLOCK; iBlk++){
+    if( p->aMapBlk[iBlk] ) nAlloc++;
+  }
+  aExt = sqlite3_malloc(nAlloc*sizeof(CmpExtent));
+  if( aExt==0 ) return SQLITE_NOMEM;
+
+  if( p->bHdr ){
+    aExt[nExt].iUnit = 0;
+    aExt[nExt].nUnit = CMP_HDR_SIZE/CMP_UNIT;
+    nExt++;
+  }
+  for(iBlk=0; iBlk<CMP_MAX_MAPBLOCK; iBlk++){
+    if( p->aMapBlk[iBlk] ){
+      aExt[nExt].iUnit = p->aMapBlk[iBlk];
+      aExt[nExt].nUnit = CMP_MAP_SIZE/CMP_UNIT;
+      nExt++;
+    }
+  }
+  for(i=0; i<p->nPage; i++){
+    if( p->aMap[i*2+1] ){
+      aExt[nExt].iUnit = p->aMap[i*2];
+      aExt[nExt].nUnit = cmpUnits(p->aMap[i*2+1]);
+      nExt++;
+    }
+  }
+  for(i=0; i<(u32)p->nPend; i++){
+    aExt[nExt++] = p->aPend[i];
+  }
+  assert( nExt<=nAlloc );
+  qsort(aExt, nExt, sizeof(CmpExtent), cmpExtentCompare);
+
+  for(i=0; rc==SQLITE_OK && i<(u32)nExt; i++){
+    if( aExt[i].iUnit<iEnd ){
+      rc = SQLITE_CORRUPT;
+    }else{
+      rc = cmpAddFree(p, iEnd, aExt[i].iUnit - iEnd);
+      iEnd = aExt[i].iUnit + aExt[i].nUnit;
+    }
+  }
+  sqlite3_free(aExt);
+
+  if( rc==SQLITE_OK ){
+    p->iEnd = iEnd;
+    p->bFreeValid = 1;
+    if( bTruncate ){
+      sqlite3_file *pReal = p->pReal;
+      i64 sz;
+      rc = pReal->pMethods->xFileSize(pReal, &sz);
+      if( rc==SQLITE_OK && sz>(i64)iEnd*CMP_UNIT ){
+        rc = pReal->pMethods->xTruncate(pReal, (i64)iEnd*CMP_UNIT);
+      }
+    }
+  }
+  return rc;
+}
+
+/*
+** Allocate an extent of nUnit units.  Return its offset in *piUnit.
+**
+** This is an address-ordered first fit: the free extent large enough
+** with the lowest offset is used.  That keeps the file compact and lets
+** cmpCompact() empty the end of the file.
+*/
+static int cmpAlloc(CmpFile *p, u32 nUnit, u32 *piUnit){
+  CmpBucket *pBest = 0;
+  u32 i;
+  if( p->bFreeValid==0 ){
+    int rc = cmpRebuild(p, 0);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  for(i=nUnit; i<=CMP_MAX_UNITS; i++){
+    CmpBucket *pBucket = &p->aBucket[i];
+    if( pBucket->nUnit>0
+     && (pBest==0 || pBucket->aUnit[0]<pBest->aUnit[0])
+    ){
+      pBest = pBucket;
+    }
+  }
+  if( pBest ){
+    u32 nBest = (u32)(pBest - p->aBucket);
+    *piUnit = cmpBucketPop(pBest);
+    if( nBest>nUnit ) return cmpBucketPush(p, *piUnit+nUnit, nBest-nUnit);
+    return SQLITE_OK;
+  }
+  if( p->iEnd>0xffffffff-nUnit ) return SQLITE_FULL;
+  *piUnit = p->iEnd;
+  p->iEnd += nUnit;
+  return SQLITE_OK;
+}
+
+/*
+** Free an extent.  It may not be reused until after the next xSync, as
+** until then a crash might leave a map entry that still refers to it.
+*/
+static int cmpFree(CmpFile *p, u32 iUnit, u32 nUnit){
+  if( p->nPend>=p->nPendAlloc ){
+    int nNew = p->nPendAlloc ? p->nPendAlloc*2 : 64;
+    CmpExtent *aNew = sqlite3_realloc(p->aPend, nNew*sizeof(CmpExtent));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    p->aPend = aNew;
+    p->nPendAlloc = nNew;
+  }
+  p->aPend[p->nPend].iUnit = iUnit;
+  p->aPend[p->nPend].nUnit = nUnit;
+  p->nPend++;
+  return SQLITE_OK;
+}
+
+/************************* Pages ********************************************/
+
+/*
+** Write the map entry for page iPg, both to the cache and to the file.
+*/
+static int cmpMapWrite(CmpFile *p, u32 iPg, u32 iUnit, u32 nByte){
+  u32 iBlk = iPg / CMP_MAP_ENTRIES;
+  u32 iEntry = iPg % CMP_MAP_ENTRIES;
+  u8 a[8];
+  int rc;
+  cmpPut4(&a[0], iUnit);
+  cmpPut4(&a[4], nByte);
+  rc = p->pReal->pMethods->xWrite(p->pReal, a, 8,
+      (i64)p->aMapBlk[iBlk]*CMP_UNIT + iEntry*8
+  );
+  if( rc==SQLITE_OK ){
+    p->aMap[iPg*2] = iUnit;
+    p->aMap[iPg*2+1] = nByte;
+  }
+  return rc;
+}
+
+/*
+** Load the map entry for page iPg, creating its map block first if
+** bCreate is true and it does not exist.  This uses p->aBuf.
+*/
+static int cmpMapPrepare(CmpFile *p, u32 iPg, int bCreate){
+  u32 iBlk = iPg / CMP_MAP_ENTRIES;
+  int rc = cmpMapLoad(p, iBlk);
+  if( rc==SQLITE_OK && bCreate && p->aMapBlk[iBlk]==0 ){
+    sqlite3_file *pReal = p->pReal;
+    u32 iUnit;
+    rc = cmpAlloc(p, CMP_MAP_SIZE/CMP_UNIT, &iUnit);
+    if( rc==SQLITE_OK ){
+      memset(p->aBuf, 0, CMP_MAP_SIZE);
+      rc = pReal->pMethods->xWrite(pReal, p->aBuf, CMP_MAP_SIZE,
+          (i64)iUnit*CMP_UNIT
+      );
+    }
+    if( rc==SQLITE_OK ){
+      u8 a[4];
+      cmpPut4(a, iUnit);
+      rc = pReal->pMethods->xWrite(pReal, a, 4, CMP_HDR_FIXED + iBlk*4);
+      if( rc==SQLITE_OK ) p->aMapBlk[iBlk] = iUnit;
+    }
+  }
+  return rc;
+}
+
+/*
+** Read page iPg, which must be less than p->nPage, into aOut[].
+*/
+static int cmpReadPage(CmpFile *p, u32 iPg, u8 *aOut){
+  int rc = cmpMapPrepare(p, iPg, 0);
+  if( rc==SQLITE_OK ){
+    u32 iUnit = p->aMap[iPg*2];
+    u32 nByte = p->aMap[iPg*2+1];
+    i64 iOff = (i64)iUnit*CMP_UNIT;
+    sqlite3_file *pReal = p->pReal;
+    if( nByte==0 ){
+      memset(aOut, 0, p->szPage);
+    }else if( nByte==(u32)p->szPage ){
+      rc = pReal->pMethods->xRead(pReal, aOut, p->szPage, iOff);
+    }else if( nByte>(u32)p->szPage ){
+      rc = SQLITE_CORRUPT;
+    }else{
+      rc = pReal->pMethods->xRead(pReal, p->aBuf, (int)nByte, iOff);
+      if( rc==SQLITE_OK ){
+        rc = cmpDecompress(p->aBuf, (int)nByte, aOut, p->szPage);
+      }
+    }
+    if( rc==SQLITE_IOERR_SHORT_READ ) rc = SQLITE_CORRUPT;
+  }
+  return rc;
+}
+
+/*
+** Write page iPg from aData[].  If the page fits in the extent it already
+** occupies it is overwritten in place, just as an uncompressed database
+** page would be.  Otherwise it is written to a new extent.
+*/
+static int cmpWritePage(CmpFile *p, u32 iPg, const u8 *aData){
+  sqlite3_file *pReal = p->pReal;
+  const u8 *aOut = p->aBuf;
+  u32 iUnit;
+  u32 nOld;
+  u32 nUnit;
+  int nByte;
+  int rc = SQLITE_OK;
+
+  /* Both of these use p->aBuf, so must happen before the page is
+  ** compressed into it. */
+  if( p->bFreeValid==0 ) rc = cmpRebuild(p, 0);
+  if( rc==SQLITE_OK ) rc = cmpMapPrepare(p, iPg, 1);
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* Store the page uncompressed unless that saves at least one unit */
+  nByte = cmpCompress(aData, p->szPage, p->aBuf, p->szPage-CMP_UNIT, p->aHash);
+  if( nByte==0 ){
+    nByte = p->szPage;
+    aOut = aData;
+  }
+  nUnit = cmpUnits((u32)nByte);
+  iUnit = p->aMap[iPg*2];
+  nOld = cmpUnits(p->aMap[iPg*2+1]);
+
+  if( nOld>=nUnit ){
+    if( nOld>nUnit ) rc = cmpFree(p, iUnit+nUnit, nOld-nUnit);
+  }else{
+    rc = cmpAlloc(p, nUnit, &iUnit);
+    if( rc==SQLITE_OK && nOld>0 ){
+      rc = cmpFree(p, p->aMap[iPg*2], nOld);
+    }
+  }
+  if( rc==SQLITE_OK ){
+    rc = pReal->pMethods->xWrite(pReal, aOut, nByte, (i64)iUnit*CMP_UNIT);
+  }
+  if( rc==SQLITE_OK ){
+    rc = cmpMapWrite(p, iPg, iUnit, (u32)nByte);
+  }
+  return rc;
+}
+
+/*
+** Compare two CmpMove objects by source offset, highest first.  Used with
+** qsort().
+*/
+static int cmpMoveCompare(const void *pA, const void *pB){
+  const CmpMove *a = (const CmpMove*)pA;
+  const CmpMove *b = (const CmpMove*)pB;
+  return (a->iFrom>b->iFrom) ? -1 : (a->iFrom<b->iFrom);
+}
+
+/*
+** Move pages stored near the end of the file into free space closer to
+** its start, then truncate the underlying file.  This is called by xSync
+** after the database has been truncated (by VACUUM or auto-vacuum, for
+** example), once the file has been synced and all free space may be
+** reused.
+**
+** The pages are copied to their new locations and the file synced before
+** any map entry is changed, and the file is synced again before the old
+** locations become free.  So a crash at any point leaves every map entry
+** pointing at a complete copy of its page.
+*/
+static int cmpCompact(CmpFile *p, int flags){
+  sqlite3_file *pReal = p->pReal;
+  CmpMove *aMove;
+  int nMove = 0;
+  int n = 0;
+  u32 nFree = 0;
+  u32 i;
+  int rc;
+
+  rc = cmpRebuild(p, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* Do not bother unless at least an eighth of the file is free */
+  for(i=1; i<=CMP_MAX_UNITS; i++) nFree += i*p->aBucket[i].nUnit;
+  if( nFree<p->iEnd/8 ) return cmpRebuild(p, 1);
+
+  aMove = sqlite3_malloc(p->nPage*sizeof(CmpMove) + 1);
+  if( aMove==0 ) return SQLITE_NOMEM;
+  for(i=0; i<p->nPage; i++){
+    if( p->aMap[i*2+1] ){
+      aMove[nMove].iPg = i;
+      aMove[nMove].iFrom = p->aMap[i*2];
+      nMove++;
+    }
+  }
+  qsort(aMove, nMove, sizeof(CmpMove), cmpMoveCompare);
+
+  for(i=0; rc==SQLITE_OK && i<(u32)nMove; i++){
+    u32 nByte = p->aMap[aMove[i].iPg*2+1];
+    u32 nUnit = cmpUnits(nByte);
+    u32 iTo;
+    rc = cmpAlloc(p, nUnit, &iTo);
+    if( rc!=SQLITE_OK ) break;
+    if( iTo>aMove[i].iFrom ){
+      /* No free space below this page.  Give the extent back. */
+      if( iTo+nUnit==p->iEnd ){
+        p->iEnd = iTo;
+      }else{
+        rc = cmpBucketPush(p, iTo, nUnit);
+      }
+      continue;
+    }
+    rc = pReal->pMethods->xRead(pReal, p->aBuf, (int)nByte,
+        (i64)aMove[i].iFrom*CMP_UNIT
+    );
+    if( rc==SQLITE_OK ){
+      rc = pReal->pMethods->xWrite(pReal, p->aBuf, (int)nByte,
+          (i64)iTo*CMP_UNIT
+      );
+    }
+    aMove[n] = aMove[i];
+    aMove[n].iTo = iTo;
+    n++;
+  }
+
+  if( rc==SQLITE_OK && n>0 ){
+    if( flags ) rc = pReal->pMethods->xSync(pReal, flags);
+    for(i=0; rc==SQLITE_OK && i<(u32)n; i++){
+      u32 iPg = aMove[i].iPg;
+      rc = cmpMapWrite(p, iPg, aMove[i].iTo, p->aMap[iPg*2+1]);
+    }
+    if( rc==SQLITE_OK && flags ) rc = pReal->pMethods->xSync(pReal, flags);
+  }
+  sqlite3_free(aMove);
+  if( rc==SQLITE_OK ){
+    rc = cmpRebuild(p, 1);
+  }else{
+    p->bFreeValid = 0;
+  }
+  return rc;
+}
+
+/*
+** Called once the file has been synced with the flags passed, or once a
+** sync has been omitted if flags is zero.  Extents freed since the last
+** sync may now be reused.
+*/
+static int cmpReleasePending(CmpFile *p, int flags){
+  int rc = SQLITE_OK;
+  if( p->bShrink ){
+    p->nPend = 0;
+    p->bShrink = 0;
+    rc = cmpCompact(p, flags);
+  }else if( p->bFreeValid ){
+    int i;
+    for(i=0; rc==SQLITE_OK && i<p->nPend; i++){
+      rc = cmpAddFree(p, p->aPend[i].iUnit, p->aPend[i].nUnit);
+    }
+    p->nPend = 0;
+  }else{
+    p->nPend = 0;
+  }
+  return rc;
+}
+
+/************************* I/O Methods **************************************/
+
+/*
+** Close a file.
+*/
+static int cmpClose(sqlite3_file *pFile){
+  CmpFile *p = (CmpFile*)pFile;
+  int rc = SQLITE_OK;
+  if( p->bCompress ){
+    int i;
+    rc = cmpFlushHeader(p);
+    if( rc==SQLITE_OK && p->bShrink ){
+      /* The file was truncated after the last sync, as VACUUM does.  Sync
+      ** and compact it now rather than leave it larger than it needs to be
+      ** until the next connection writes to it. */
+      rc = p->pReal->pMethods->xSync(p->pReal, SQLITE_SYNC_NORMAL);
+      if( rc==SQLITE_OK ) rc = cmpReleasePending(p, SQLITE_SYNC_NORMAL);
+    }
+    if( p->aBucket ){
+      for(i=0; i<=CMP_MAX_UNITS; i++) sqlite3_free(p->aBucket[i].aUnit);
+      sqlite3_free(p->aBucket);
+    }
+    sqlite3_free(p->aPend);
+    sqlite3_free(p->aMap);
+    sqlite3_free(p->aMapBlk);
+    sqlite3_free(p->aBuf);
+    sqlite3_free(p->aPage);
+  }
+  if( p->pReal->pMethods ){
+    int rc2 = p->pReal->pMethods->xClose(p->pReal);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  return rc;
+}
+
+/*
+** Read data from a file.
+*/
+static int cmpRead(
+  sqlite3_file *pFile,
+  void *zBuf,
+  int iAmt,
+  sqlite3_int64 iOfst
+){
+  CmpFile *p = (CmpFile*)pFile;
+  u8 *z = (u8*)zBuf;
+  int rc;
+
+  if( !p->bCompress ){
+    return p->pReal->pMethods->xRead(p->pReal, zBuf, iAmt, iOfst);
+  }
+  rc = cmpCheck(p);
+  while( rc==SQLITE_OK && iAmt>0 ){
+    i64 iPg = p->szPage ? iOfst/p->szPage : 0;
+    int iIn;
+    int n;
+    if( iPg>=p->nPage ){
+      memset(z, 0, iAmt);
+      return SQLITE_IOERR_SHORT_READ;
+    }
+    iIn = (int)(iOfst - iPg*p->szPage);
+    n = p->szPage - iIn;
+    if( n>iAmt ) n = iAmt;
+    if( n==p->szPage ){
+      rc = cmpReadPage(p, (u32)iPg, z);
+    }else{
+      rc = cmpReadPage(p, (u32)iPg, p->aPage);
+      if( rc==SQLITE_OK ) memcpy(z, &p->aPage[iIn], n);
+    }
+    z += n;
+    iOfst += n;
+    iAmt -= n;
+  }
+  return rc;
+}
+
+/*
+** Write data to a file.  The pager always writes whole pages.  Other
+** writes are handled by reading, modifying and rewriting each page.
+*/
+static int cmpWrite(
+  sqlite3_file *pFile,
+  const void *zBuf,
+  int iAmt,
+  sqlite3_int64 iOfst
+){
+  CmpFile *p = (CmpFile*)pFile;
+  const u8 *z = (const u8*)zBuf;
+  int rc;
+
+  if( !p->bCompress ){
+    return p->pReal->pMethods->xWrite(p->pReal, zBuf, iAmt, iOfst);
+  }
+  rc = cmpCheck(p);
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* The first write to an empty file determines the page size */
+  if( p->nPage==0 ){
+    int szPage = p->szPage;
+    if( iOfst==0 && cmpIsPageSize(iAmt) ) szPage = iAmt;
+    if( szPage==0 ) szPage = 4096;
+    if( szPage!=p->szPage ){
+      rc = cmpSetPageSize(p, szPage);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+  }
+  rc = cmpBeginWrite(p);
+
+  while( rc==SQLITE_OK && iAmt>0 ){
+    i64 iPg = iOfst/p->szPage;
+    int iIn = (int)(iOfst - iPg*p->szPage);
+    int n = p->szPage - iIn;
+    if( n>iAmt ) n = iAmt;
+    if( iPg>=(i64)CMP_MAX_MAPBLOCK*CMP_MAP_ENTRIES ) return SQLITE_FULL;
+    if( n==p->szPage ){
+      rc = cmpWritePage(p, (u32)iPg, z);
+    }else{
+      if( iPg<p->nPage ){
+        rc = cmpReadPage(p, (u32)iPg, p->aPage);
+      }else{
+        memset(p->aPage, 0, p->szPage);
+      }
+      if( rc==SQLITE_OK ){
+        memcpy(&p->aPage[iIn], z, n);
+        rc = cmpWritePage(p, (u32)iPg, p->aPage);
+      }
+    }
+    if( rc==SQLITE_OK && iPg>=p->nPage ){
+      p->nPage = (u32)iPg+1;
+      p->bHdrDirty = 1;
+    }
+    z += n;
+    iOfst += n;
+    iAmt -= n;
+  }
+  return rc;
+}
+
+/*
+** Truncate a file.  Extents used by pages beyond the new end of the file
+** are freed and their map entries cleared.  The underlying file is made
+** smaller at the next xSync.
+*/
+static int cmpTruncate(sqlite3_file *pFile, sqlite3_int64 size){
+  CmpFile *p = (CmpFile*)pFile;
+  i64 nNew;
+  int rc;
+
+  if( !p->bCompress ){
+    return p->pReal->pMethods->xTruncate(p->pReal, size);
+  }
+  rc = cmpCheck(p);
+  if( rc!=SQLITE_OK || p->szPage==0 ) return rc;
+  nNew = (size + p->szPage - 1) / p->szPage;
+  if( nNew==p->nPage ) return SQLITE_OK;
+  if( nNew>(i64)CMP_MAX_MAPBLOCK*CMP_MAP_ENTRIES ) return SQLITE_FULL;
+
+  rc = cmpBeginWrite(p);
+  if( rc==SQLITE_OK && nNew<p->nPage ){
+    u32 iPg = (u32)nNew;
+    while( rc==SQLITE_OK && iPg<p->nPage ){
+      u32 iBlk = iPg / CMP_MAP_ENTRIES;
+      u32 iFirst = iPg;
+      u32 iLast = (iBlk+1)*CMP_MAP_ENTRIES;
+      if( iLast>p->nPage ) iLast = p->nPage;
+      rc = cmpMapLoad(p, iBlk);
+      for(; rc==SQLITE_OK && iPg<iLast; iPg++){
+        if( p->aMap[iPg*2+1] ){
+          rc = cmpFree(p, p->aMap[iPg*2], cmpUnits(p->aMap[iPg*2+1]));
+          p->aMap[iPg*2] = 0;
+          p->aMap[iPg*2+1] = 0;
+        }
+      }
+      if( rc==SQLITE_OK && p->aMapBlk[iBlk] ){
+        i64 iOff = (i64)p->aMapBlk[iBlk]*CMP_UNIT;
+        iOff += (iFirst % CMP_MAP_ENTRIES)*8;
+        memset(p->aBuf, 0, (iLast-iFirst)*8);
+        rc = p->pReal->pMethods->xWrite(p->pReal,
+            p->aBuf, (iLast-iFirst)*8, iOff
+        );
+      }
+    }
+    p->bShrink = 1;
+  }
+  if( rc==SQLITE_OK ){
+    p->nPage = (u32)nNew;
+    p->bHdrDirty = 1;
+  }
+  return rc;
+}
+
+/*
+** Sync a file.  Once the data is on persistent storage, the extents freed
+** since the last sync may be reused.
+*/
+static int cmpSync(sqlite3_file *pFile, int flags){
+  CmpFile *p = (CmpFile*)pFile;
+  int rc = SQLITE_OK;
+  if( p->bCompress ) rc = cmpFlushHeader(p);
+  if( rc==SQLITE_OK ) rc = p->pReal->pMethods->xSync(p->pReal, flags);
+  if( rc==SQLITE_OK && p->bCompress ) rc = cmpReleasePending(p, flags);
+  return rc;
+}
+
+/*
+** Return the current file-size of a file.
+*/
+static int cmpFileSize(sqlite3_file *pFile, sqlite3_int64 *pSize){
+  CmpFile *p = (CmpFile*)pFile;
+  int rc;
+  if( !p->bCompress ){
+    return p->pReal->pMethods->xFileSize(p->pReal, pSize);
+  }
+  rc = cmpCheck(p);
+  *pSize = (i64)p->nPage * p->szPage;
+  return rc;
+}
+
+/*
+** Lock a file.  Taking a SHARED lock means that another connection may
+** have written the file, so the header is checked before the next I/O.
+*/
+static int cmpLock(sqlite3_file *pFile, int eLock){
+  CmpFile *p = (CmpFile*)pFile;
+  int rc = p->pReal->pMethods->xLock(p->pReal, eLock);
+  if( rc==SQLITE_OK && eLock==SQLITE_LOCK_SHARED ) p->bCheck = 1;
+  return rc;
+}
+
+/*
+** Unlock a file.  Other connections read the database size from the
+** header once this connection no longer holds its lock.
+*/
+static int cmpUnlock(sqlite3_file *pFile, int eLock){
+  CmpFile *p = (CmpFile*)pFile;
+  if( p->bCompress ){
+    int rc = cmpFlushHeader(p);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  return p->pReal->pMethods->xUnlock(p->pReal, eLock);
+}
+
+/* Pass xCheckReservedLock requests through to the original VFS unchanged.
+*/
+static int cmpCheckReservedLock(sqlite3_file *pFile, int *pResOut){
+  CmpFile *p = (CmpFile*)pFile;
+  return p->pReal->pMethods->xCheckReservedLock(p->pReal, pResOut);
+}
+
+/*
+** File control method.  The size hints and chunk size are for the logical
+** file, so they are not passed to the underlying file.  Everything else
+** is.
+*/
+static int cmpFileControl(sqlite3_file *pFile, int op, void *pArg){
+  CmpFile *p = (CmpFile*)pFile;
+  int rc;
+  if( p->bCompress ){
+    switch( op ){
+      case SQLITE_FCNTL_SIZE_HINT:
+      case SQLITE_FCNTL_CHUNK_SIZE:
+        return SQLITE_OK;
+      case SQLITE_FCNTL_SYNC_OMITTED:
+        /* With "PRAGMA synchronous=OFF" there is no durability to protect,
+        ** so treat the omitted sync as a sync point. */
+        rc = cmpReleasePending(p, 0);
+        if( rc!=SQLITE_OK ) return rc;
+        break;
+    }
+  }
+  rc = p->pReal->pMethods->xFileControl(p->pReal, op, pArg);
+  if( op==SQLITE_FCNTL_VFSNAME && rc==SQLITE_OK ){
+    *(char**)pArg = sqlite3_mprintf("compress/%z", *(char**)pArg);
+  }
+  return rc;
+}
+
+/* Pass xSectorSize requests through to the original VFS unchanged.
+*/
+static int cmpSectorSize(sqlite3_file *pFile){
+  CmpFile *p = (CmpFile*)pFile;
+  return p->pReal->pMethods->xSectorSize(p->pReal);
+}
+
+/*
+** Writing a page is not a single write to the underlying file, so a
+** compressed file never offers atomic writes or safe appends.
+*/
+static int cmpDeviceCharacteristics(sqlite3_file *pFile){
+  CmpFile *p = (CmpFile*)pFile;
+  int iDC = p->pReal->pMethods->xDeviceCharacteristics(p->pReal);
+  if( p->bCompress ){
+    iDC &= ~(SQLITE_IOCAP_ATOMIC|SQLITE_IOCAP_ATOMIC512|SQLITE_IOCAP_ATOMIC1K
+            |SQLITE_IOCAP_ATOMIC2K|SQLITE_IOCAP_ATOMIC4K|SQLITE_IOCAP_ATOMIC8K
+            |SQLITE_IOCAP_ATOMIC16K|SQLITE_IOCAP_ATOMIC32K
+            |SQLITE_IOCAP_ATOMIC64K|SQLITE_IOCAP_SAFE_APPEND);
+  }
+  return iDC;
+}
+
+/* Pass xShmMap requests through to the original VFS unchanged.
+*/
+static int cmpShmMap(
+  sqlite3_file *pFile,            /* Handle open on database file */
+  int iRegion,                    /* Region to retrieve */
+  int szRegion,                   /* Size of regions */
+  int bExtend,                    /* True to extend file if necessary */
+  void volatile **pp              /* OUT: Mapped memory */
+){
+  CmpFile *p = (CmpFile*)pFile;
+  return p->pReal->pMethods->xShmMap(p->pReal, iRegion, szRegion, bExtend,pp);
+}
+
+/*
+** Pass xShmLock requests through to the original VFS.  In WAL mode a
+** connection holds a SHARED lock on the database file for as long as it
+** is open, so the header is checked whenever a WAL lock is taken instead.
+*/
+static int cmpShmLock(sqlite3_file *pFile, int ofst, int n, int flags){
+  CmpFile *p = (CmpFile*)pFile;
+  int rc = p->pReal->pMethods->xShmLock(p->pReal, ofst, n, flags);
+  if( rc==SQLITE_OK && (flags & SQLITE_SHM_LOCK) ) p->bCheck = 1;
+  return rc;
+}
+
+/* Pass xShmBarrier requests through to the original VFS unchanged.
+*/
+static void cmpShmBarrier(sqlite3_file *pFile){
+  CmpFile *p = (CmpFile*)pFile;
+  p->pReal->pMethods->xShmBarrier(p->pReal);
+}
+
+/* Pass xShmUnmap requests through to the original VFS unchanged.
+*/
+static int cmpShmUnmap(sqlite3_file *pFile, int deleteFlag){
+  CmpFile *p = (CmpFile*)pFile;
+  return p->pReal->pMethods->xShmUnmap(p->pReal, deleteFlag);
+}
+
+/************************* VFS Methods **************************************/
+
+/*
+** Open a file.  Main database files are stored compressed if they are
+** created by this VFS, or were created by it earlier.
+*/
+static int cmpOpen(
+  sqlite3_vfs *pVfs,              /* The compress VFS */
+  const char *zName,              /* Name of file to be opened */
+  sqlite3_file *pFile,            /* Fill in this file descriptor */
+  int flags,                      /* Flags to control the opening */
+  int *pOutFlags                  /* Flags showing results of opening */
+){
+  CmpFile *p = (CmpFile*)pFile;
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  int rc;
+
+  memset(p, 0, pVfs->szOsFile);
+  p->pReal = (sqlite3_file*)&p[1];
+  rc = pOrigVfs->xOpen(pOrigVfs, zName, p->pReal, flags, pOutFlags);
+  if( rc!=SQLITE_OK ) return rc;
+
+  if( (flags & SQLITE_OPEN_MAIN_DB)!=0 ){
+    u8 aMagic[16];
+    rc = p->pReal->pMethods->xRead(p->pReal, aMagic, 16, 0);
+    if( rc==SQLITE_IOERR_SHORT_READ ){
+      p->bCompress = sqlite3_uri_boolean(zName, "compress", 1);
+      rc = SQLITE_OK;
+    }else if( rc==SQLITE_OK ){
+      p->bCompress = memcmp(aMagic, CMP_MAGIC, 16)==0;
+    }
+  }
+  if( rc==SQLITE_OK && p->bCompress ){
+    p->bCheck = 1;
+    p->aMapBlk = sqlite3_malloc(CMP_MAX_MAPBLOCK*(sizeof(u32)+1));
+    p->aBuf = sqlite3_malloc(CMP_HDR_SIZE);
+    p->aHash = sqlite3_malloc(CMP_HASH_SIZE*sizeof(u16));
+    if( p->aMapBlk==0 || p->aBuf==0 || p->aHash==0 ){
+      rc = SQLITE_NOMEM;
+    }else{
+      memset(p->aMapBlk, 0, CMP_MAX_MAPBLOCK*(sizeof(u32)+1));
+      p->aMapValid = (u8*)&p->aMapBlk[CMP_MAX_MAPBLOCK];
+    }
+  }
+
+  if( p->pReal->pMethods->iVersion==1 ){
+    p->base.pMethods = &gCompress.sIoMethodsV1;
+  }else{
+    p->base.pMethods = &gCompress.sIoMethodsV2;
+  }
+  if( rc!=SQLITE_OK ){
+    cmpClose(pFile);
+    p->base.pMethods = 0;
+  }
+  return rc;
+}
+
+/*
+** All other VFS methods are pass-thrus.
+*/
+static int cmpDelete(sqlite3_vfs *pVfs, const char *zName, int syncDir){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xDelete(pOrigVfs, zName, syncDir);
+}
+static int cmpAccess(
+  sqlite3_vfs *pVfs,
+  const char *zName,
+  int flags,
+  int *pOut
+){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xAccess(pOrigVfs, zName, flags, pOut);
+}
+static int cmpFullPathname(
+  sqlite3_vfs *pVfs,
+  const char *zName,
+  int nOut,
+  char *zOut
+){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xFullPathname(pOrigVfs, zName, nOut, zOut);
+}
+static void *cmpDlOpen(sqlite3_vfs *pVfs, const char *zFilename){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xDlOpen(pOrigVfs, zFilename);
+}
+static void cmpDlError(sqlite3_vfs *pVfs, int nByte, char *zErrMsg){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  pOrigVfs->xDlError(pOrigVfs, nByte, zErrMsg);
+}
+static void (*cmpDlSym(sqlite3_vfs *pVfs, void *p, const char *zSym))(void){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xDlSym(pOrigVfs, p, zSym);
+}
+static void cmpDlClose(sqlite3_vfs *pVfs, void *pHandle){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  pOrigVfs->xDlClose(pOrigVfs, pHandle);
+}
+static int cmpRandomness(sqlite3_vfs *pVfs, int nByte, char *zBufOut){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xRandomness(pOrigVfs, nByte, zBufOut);
+}
+static int cmpSleep(sqlite3_vfs *pVfs, int nMicro){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xSleep(pOrigVfs, nMicro);
+}
+static int cmpCurrentTime(sqlite3_vfs *pVfs, double *pTimeOut){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xCurrentTime(pOrigVfs, pTimeOut);
+}
+static int cmpGetLastError(sqlite3_vfs *pVfs, int a, char *b){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xGetLastError(pOrigVfs, a, b);
+}
+static int cmpCurrentTimeInt64(sqlite3_vfs *pVfs, sqlite3_int64 *pTimeOut){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  UNUSED_PARAMETER(pVfs);
+  return pOrigVfs->xCurrentTimeInt64(pOrigVfs, pTimeOut);
+}
+
+/************************** Public Interfaces *****************************/
+
+/*
+** CAPI: Initialize the compress VFS shim - sqlite3_compress_initialize()
+**
+** Use the VFS named zOrigVfsName as the VFS that does the actual work.
+** Use the default if zOrigVfsName==NULL.
+**
+** The compress VFS shim is named "compress".  It will become the default
+** VFS if makeDefault is non-zero.
+**
+** THIS ROUTINE IS NOT THREADSAFE.  Call this routine exactly once
+** during start-up.
+*/
+int sqlite3_compress_initialize(const char *zOrigVfsName, int makeDefault){
+  sqlite3_vfs *pOrigVfs;
+  if( gCompress.isInitialized ) return SQLITE_MISUSE;
+  pOrigVfs = sqlite3_vfs_find(zOrigVfsName);
+  if( pOrigVfs==0 ) return SQLITE_ERROR;
+  assert( pOrigVfs!=&gCompress.sThisVfs );
+  gCompress.isInitialized = 1;
+  gCompress.pOrigVfs = pOrigVfs;
+  gCompress.sThisVfs = *pOrigVfs;
+  if( gCompress.sThisVfs.iVersion>2 ) gCompress.sThisVfs.iVersion = 2;
+  gCompress.sThisVfs.szOsFile += sizeof(CmpFile);
+  gCompress.sThisVfs.zName = SQLITE_COMPRESS_VFS_NAME;
+  gCompress.sThisVfs.xOpen = cmpOpen;
+  gCompress.sThisVfs.xDelete = cmpDelete;
+  gCompress.sThisVfs.xAccess = cmpAccess;
+  gCompress.sThisVfs.xFullPathname = cmpFullPathname;
+  gCompress.sThisVfs.xDlOpen = cmpDlOpen;
+  gCompress.sThisVfs.xDlError = cmpDlError;
+  gCompress.sThisVfs.xDlSym = cmpDlSym;
+  gCompress.sThisVfs.xDlClose = cmpDlClose;
+  gCompress.sThisVfs.xRandomness = cmpRandomness;
+  gCompress.sThisVfs.xSleep = cmpSleep;
+  gCompress.sThisVfs.xCurrentTime = cmpCurrentTime;
+  gCompress.sThisVfs.xGetLastError = cmpGetLastError;
+  if( pOrigVfs->iVersion>=2 ){
+    gCompress.sThisVfs.xCurrentTimeInt64 = cmpCurrentTimeInt64;
+  }
+
+  gCompress.sIoMethodsV1.iVersion = 1;
+  gCompress.sIoMethodsV1.xClose = cmpClose;
+  gCompress.sIoMethodsV1.xRead = cmpRead;
+  gCompress.sIoMethodsV1.xWrite = cmpWrite;
+  gCompress.sIoMethodsV1.xTruncate = cmpTruncate;
+  gCompress.sIoMethodsV1.xSync = cmpSync;
+  gCompress.sIoMethodsV1.xFileSize = cmpFileSize;
+  gCompress.sIoMethodsV1.xLock = cmpLock;
+  gCompress.sIoMethodsV1.xUnlock = cmpUnlock;
+  gCompress.sIoMethodsV1.xCheckReservedLock = cmpCheckReservedLock;
+  gCompress.sIoMethodsV1.xFileControl = cmpFileControl;
+  gCompress.sIoMethodsV1.xSectorSize = cmpSectorSize;
+  gCompress.sIoMethodsV1.xDeviceCharacteristics = cmpDeviceCharacteristics;
+  gCompress.sIoMethodsV2 = gCompress.sIoMethodsV1;
+  gCompress.sIoMethodsV2.iVersion = 2;
+  gCompress.sIoMethodsV2.xShmMap = cmpShmMap;
+  gCompress.sIoMethodsV2.xShmLock = cmpShmLock;
+  gCompress.sIoMethodsV2.xShmBarrier = cmpShmBarrier;
+  gCompress.sIoMethodsV2.xShmUnmap = cmpShmUnmap;
+  return sqlite3_vfs_register(&gCompress.sThisVfs, makeDefault);
+}
+
+/*
+** CAPI: Shutdown the compress VFS shim - sqlite3_compress_shutdown()
+**
+** All SQLite database connections that use the compress VFS must be
+** closed before calling this routine.
+**
+** THIS ROUTINE IS NOT THREADSAFE.
+*/
+int sqlite3_compress_shutdown(void){
+  if( gCompress.isInitialized==0 ) return SQLITE_MISUSE;
+  sqlite3_vfs_unregister(&gCompress.sThisVfs);
+  memset(&gCompress, 0, sizeof(gCompress));
+  return SQLITE_OK;
+}
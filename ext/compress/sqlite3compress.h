@@ -0,0 +1,57 @@
+/*
+** 2026 October 18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains the public interface to the "compress" VFS shim, a
+** layer between the pager and the real VFS that stores each page of a
+** database file compressed.  See README.txt in this directory for details.
+*/
+
+#ifndef _SQLITE3COMPRESS_H
+#define _SQLITE3COMPRESS_H
+
+#include "sqlite3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+** CAPI: Initialize the compress VFS shim - sqlite3_compress_initialize()
+**
+** Register a new VFS named "compress" that uses the VFS named zOrigVfsName
+** to do the actual I/O, or the default VFS if zOrigVfsName is NULL.  The
+** new VFS becomes the default VFS if makeDefault is non-zero.
+**
+** Database files created through the compress VFS are stored compressed.
+** Database files that already exist and were not created by it, and all
+** journal, WAL and temporary files, are accessed unchanged.
+**
+** THIS ROUTINE IS NOT THREADSAFE.  Call this routine exactly once during
+** start-up.
+*/
+int sqlite3_compress_initialize(const char *zOrigVfsName, int makeDefault);
+
+/*
+** CAPI: Shutdown the compress VFS shim - sqlite3_compress_shutdown()
+**
+** Unregister the "compress" VFS.  All database connections that use it
+** must be closed before calling this routine.
+**
+** THIS ROUTINE IS NOT THREADSAFE.
+*/
+int sqlite3_compress_shutdown(void);
+
+#ifdef __cplusplus
+}  /* End of the 'extern "C"' block */
+#endif
+
+#endif /* ifndef _SQLITE3COMPRESS_H */
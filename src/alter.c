@@ -666,8 +666,9 @@ exit_rename_table:
   sqlite3DbFree(db, zName);
   db->flags = savedDbFlags;
 }
+#endif  /* SQLITE_ALTER_TABLE */
 
-
+#if !defined(SQLITE_OMIT_ALTERTABLE) || defined(SQLITE_ENABLE_BRIN)
 /*
 ** Generate code to make sure the file format number is at least minFormat.
 ** The generated code will increase the file format number if necessary.
@@ -697,7 +698,9 @@ void sqlite3MinimumFileFormat(Parse *pParse, int iDb, int minFormat){
     sqlite3ReleaseTempReg(pParse, r2);
   }
 }
+#endif
 
+#ifndef SQLITE_OMIT_ALTERTABLE
 /*
 ** This function is called after an "ALTER TABLE ... ADD" statement
 ** has been parsed. Argument pColDef contains the text of the new
@@ -561,6 +561,7 @@ static void analyzeOneTable(
     int *aChngAddr;              /* Array of jump instruction addresses */
 
     if( pOnlyIdx && pOnlyIdx!=pIdx ) continue;
+    if( IsBrinIndex(pIdx) ) continue;  /* BRIN indices have no statistics */
     VdbeNoopComment((v, "Begin analysis of %s", pIdx->zName));
     nCol = pIdx->nColumn;
     aChngAddr = sqlite3DbMallocRaw(db, sizeof(int)*nCol);
@@ -774,12 +775,14 @@ static void analyzeOneTable(
 
   /* If the table has no indices, create a single sqlite_stat1 entry
   ** containing NULL as the index name and the row count as the content.
+  ** The same is done if all of its indices are BRIN indices, unless only
+  ** a BRIN index was to be analyzed.
   */
 
   /* 如果表没有索引, 穿件一个 sqlite_stat1 条目
   ** 包含NULL 作为索引名 并且行记录作为内容.
   */
-  if( pTab->pIndex==0 ){
+  if( jZeroRows<0 && pOnlyIdx==0 ){
     sqlite3VdbeAddOp3(v, OP_OpenRead, iIdxCur, pTab->tnum, iDb);
     VdbeComment((v, "%s", pTab->zName));
     sqlite3VdbeAddOp2(v, OP_Count, iIdxCur, regStat1);
@@ -810,6 +813,9 @@ static void loadAnalysis(Parse *pParse, int iDb){
   if( v ){
     sqlite3VdbeAddOp1(v, OP_LoadAnalysis, iDb);
   }
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+  pParse->schemaMask |= ((yDbMask)1)<<iDb;
+#endif
 }
 
 /*
@@ -150,17 +150,19 @@ static int hasSharedCacheTableLock(
   /* Figure out the root-page that the lock should be held on. For table
   ** b-trees, this is just the root page of the b-tree being read or
   ** written. For index b-trees, it is the root page of the associated
-  ** table.  */
-  if( isIndex ){
+  ** table. The same goes for the table b-tree of a block range (BRIN)
+  ** index.  */
+  if( !isIndex ){
+    iTab = iRoot;
+  }
+  if( isIndex || (pSchema && (pSchema->flags&DB_SchemaLoaded)) ){
     HashElem *p;
     for(p=sqliteHashFirst(&pSchema->idxHash); p; p=sqliteHashNext(p)){
       Index *pIdx = (Index *)sqliteHashData(p);
-      if( pIdx->tnum==(int)iRoot ){
+      if( pIdx->tnum==(int)iRoot && IsBrinIndex(pIdx)==!isIndex ){
         iTab = pIdx->pTable->tnum;
       }
     }
-  }else{
-    iTab = iRoot;
   }
 
   /* Search for the required lock. Either a write-lock on root-page iTab, a 
@@ -429,25 +431,154 @@ static int cursorHoldsMutex(BtCursor *p){
 
 
 #ifndef SQLITE_OMIT_INCRBLOB
+/*
+** Free all entries on the BtShared.pOvflChain list.
+*/
+static void ovflChainClear(BtShared *pBt){
+  while( pBt->pOvflChain ){
+    BtOvflChain *p = pBt->pOvflChain;
+    pBt->pOvflChain = p->pNext;
+    sqlite3_free(p->aPgno);
+    sqlite3_free(p);
+  }
+}
+
+/*
+** If the pager has discarded its cache since the BtShared.pOvflChain
+** entries were made, they may no longer be accurate.  Free them.
+*/
+static void ovflChainCheck(BtShared *pBt){
+  u32 iVersion = sqlite3PagerDataVersion(pBt->pPager);
+  if( pBt->iOvflVersion!=iVersion ){
+    ovflChainClear(pBt);
+    pBt->iOvflVersion = iVersion;
+  }
+}
+
+/*
+** Remove the entry for the overflow chain that begins on page pgnoFirst
+** from the BtShared.pOvflChain list and return its page list, or return
+** NULL if there is no such entry.  The caller takes ownership of the
+** returned array, which has nOvfl entries.
+*/
+static Pgno *ovflChainTake(BtShared *pBt, Pgno pgnoFirst, int nOvfl){
+  BtOvflChain **pp;
+  ovflChainCheck(pBt);
+  for(pp=&pBt->pOvflChain; *pp; pp=&(*pp)->pNext){
+    BtOvflChain *p = *pp;
+    if( p->pgnoFirst==pgnoFirst ){
+      Pgno *aPgno = 0;
+      *pp = p->pNext;
+      if( p->nOvfl==nOvfl ){
+        aPgno = p->aPgno;
+      }else{
+        sqlite3_free(p->aPgno);
+      }
+      sqlite3_free(p);
+      return aPgno;
+    }
+  }
+  return 0;
+}
+
+/*
+** Add the overflow page list aPgno[], which has nOvfl entries, to the
+** front of the BtShared.pOvflChain list.  The list takes ownership of
+** the aPgno[] array.  If the list is full, the least recently added
+** entries are discarded until there are no more than BTREE_OVFL_CHAIN_MAX
+** of them, describing no more than BTREE_OVFL_CHAIN_MAXPAGE pages.  A
+** page list longer than that on its own is not kept at all.
+*/
+static void ovflChainAdd(BtShared *pBt, Pgno *aPgno, int nOvfl){
+  BtOvflChain *p;
+  BtOvflChain **pp;
+  int n = 0;
+  int nPage = nOvfl;
+
+  ovflChainCheck(pBt);
+  p = nOvfl>BTREE_OVFL_CHAIN_MAXPAGE ? 0 :
+      (BtOvflChain *)sqlite3Malloc(sizeof(BtOvflChain));
+  if( p==0 ){
+    sqlite3_free(aPgno);
+    return;
+  }
+  p->pgnoFirst = aPgno[0];
+  p->nOvfl = nOvfl;
+  p->aPgno = aPgno;
+  p->pNext = pBt->pOvflChain;
+  pBt->pOvflChain = p;
+  pp = &p->pNext;
+  while( *pp ){
+    BtOvflChain *pDel = *pp;
+    if( pDel->pgnoFirst==p->pgnoFirst || ++n>=BTREE_OVFL_CHAIN_MAX
+     || (nPage += pDel->nOvfl)>BTREE_OVFL_CHAIN_MAXPAGE
+    ){
+      *pp = pDel->pNext;
+      sqlite3_free(pDel->aPgno);
+      sqlite3_free(pDel);
+    }else{
+      pp = &pDel->pNext;
+    }
+  }
+}
+
+/*
+** The overflow chain beginning at page pgnoFirst is about to be freed.
+** Discard any page lists that describe it.
+*/
+static void ovflChainDrop(BtShared *pBt, Pgno pgnoFirst){
+  BtOvflChain **pp;
+  BtCursor *p;
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  for(pp=&pBt->pOvflChain; *pp; pp=&(*pp)->pNext){
+    if( (*pp)->pgnoFirst==pgnoFirst ){
+      BtOvflChain *pDel = *pp;
+      *pp = pDel->pNext;
+      sqlite3_free(pDel->aPgno);
+      sqlite3_free(pDel);
+      break;
+    }
+  }
+  for(p=pBt->pCursor; p; p=p->pNext){
+    if( p->aOverflow && p->aOverflow[0]==pgnoFirst ){
+      sqlite3_free(p->aOverflow);
+      p->aOverflow = 0;
+    }
+  }
+}
+
 /*
 ** Invalidate the overflow page-list cache for cursor pCur, if any.
+** If the cursor is still positioned on the cell the list describes, the
+** list is kept on the BtShared.pOvflChain list for later cursors.
 */
 static void invalidateOverflowCache(BtCursor *pCur){
   assert( cursorHoldsMutex(pCur) );
-  sqlite3_free(pCur->aOverflow);
-  pCur->aOverflow = 0;
+  if( pCur->aOverflow ){
+    if( pCur->aOverflow[0]
+     && (pCur->eState==CURSOR_VALID || pCur->eState==CURSOR_REQUIRESEEK)
+    ){
+      ovflChainAdd(pCur->pBt, pCur->aOverflow, pCur->nOvfl);
+    }else{
+      sqlite3_free(pCur->aOverflow);
+    }
+    pCur->aOverflow = 0;
+  }
 }
 
 /*
 ** Invalidate the overflow page-list cache for all cursors opened
-** on the shared btree structure pBt.
+** on the shared btree structure pBt, and the BtShared.pOvflChain list.
+** This is called when overflow pages may be about to move.
 */
 static void invalidateAllOverflowCache(BtShared *pBt){
   BtCursor *p;
   assert( sqlite3_mutex_held(pBt->mutex) );
   for(p=pBt->pCursor; p; p=p->pNext){
-    invalidateOverflowCache(p);
+    sqlite3_free(p->aOverflow);
+    p->aOverflow = 0;
   }
+  ovflChainClear(pBt);
 }
 
 /*
@@ -482,6 +613,7 @@ static void invalidateIncrblobCursors(
   /* Stub functions when INCRBLOB is omitted */
   #define invalidateOverflowCache(x)
   #define invalidateAllOverflowCache(x)
+  #define ovflChainDrop(x,y)
   #define invalidateIncrblobCursors(x,y,z)
 #endif /* SQLITE_OMIT_INCRBLOB */
 
@@ -2068,6 +2200,9 @@ int sqlite3BtreeClose(Btree *p){
     }
     sqlite3DbFree(0, pBt->pSchema);
     freeTempSpace(pBt);
+#ifndef SQLITE_OMIT_INCRBLOB
+    ovflChainClear(pBt);
+#endif
     sqlite3_free(pBt);
   }
 
@@ -3333,6 +3468,7 @@ int sqlite3BtreeRollback(Btree *p, int tripCode){
     if( rc2!=SQLITE_OK ){
       rc = rc2;
     }
+    invalidateAllOverflowCache(pBt);
 
     /* The rollback may have destroyed the pPage1->aData value.  So
     ** call btreeGetPage() on page 1 again to make
@@ -3411,6 +3547,9 @@ int sqlite3BtreeSavepoint(Btree *p, int op, int iSavepoint){
     assert( iSavepoint>=0 || (iSavepoint==-1 && op==SAVEPOINT_ROLLBACK) );
     sqlite3BtreeEnter(p);
     rc = sqlite3PagerSavepoint(pBt->pPager, op, iSavepoint);
+    if( op==SAVEPOINT_ROLLBACK ){
+      invalidateAllOverflowCache(pBt);
+    }
     if( rc==SQLITE_OK ){
       if( iSavepoint<0 && (pBt->btsFlags & BTS_INITIALLY_EMPTY)!=0 ){
         pBt->nPage = 0;
@@ -3587,6 +3726,7 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
     int i;
     BtShared *pBt = pCur->pBt;
     sqlite3BtreeEnter(pBtree);
+    invalidateOverflowCache(pCur);
     sqlite3BtreeClearCursor(pCur);
     if( pCur->pPrev ){
       pCur->pPrev->pNext = pCur->pNext;
@@ -3599,8 +3739,12 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
     for(i=0; i<=pCur->iPage; i++){
       releasePage(pCur->apPage[i]);
     }
+#ifndef SQLITE_OMIT_INCRBLOB
+    /* The page lists are only kept for other cursors open at the same
+    ** time.  Do not hold on to them once the last cursor is closed. */
+    if( pBt->pCursor==0 ) ovflChainClear(pBt);
+#endif
     unlockBtreeIfUnused(pBt);
-    invalidateOverflowCache(pCur);
     /* sqlite3_free(pCur); */
     sqlite3BtreeLeave(pBtree);
   }
@@ -3907,7 +4051,11 @@ static int accessPayload(
     */
     if( pCur->isIncrblobHandle && !pCur->aOverflow ){
       int nOvfl = (pCur->info.nPayload-pCur->info.nLocal+ovflSize-1)/ovflSize;
-      pCur->aOverflow = (Pgno *)sqlite3MallocZero(sizeof(Pgno)*nOvfl);
+      pCur->nOvfl = nOvfl;
+      pCur->aOverflow = ovflChainTake(pBt, nextPage, nOvfl);
+      if( pCur->aOverflow==0 ){
+        pCur->aOverflow = (Pgno *)sqlite3MallocZero(sizeof(Pgno)*nOvfl);
+      }
       /* nOvfl is always positive.  If it were zero, fetchPayload would have
       ** been used instead of this routine. */
       if( ALWAYS(nOvfl) && !pCur->aOverflow ){
@@ -4450,6 +4598,159 @@ int sqlite3BtreeLast(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** The number of consecutive seeks that must fail to start from the
+** cursor's current position before sqlite3BtreeMovetoUnpacked() stops
+** trying to on every seek.
+*/
+#define BTREE_FINGER_MISS 4
+
+/*
+** Compare the key of cell idx on the page the cursor currently points
+** into with the key pIdxKey (for index b-trees) or intKey (for table
+** b-trees), and write the result to *pRes.  *pRes is negative, zero or
+** positive if the cell key is smaller than, equal to or larger than the
+** key searched for.  The cursor is left pointing at cell idx.
+**
+** SQLITE_OK is returned if successful, or an error code if an overflow
+** page cannot be read or memory cannot be allocated.
+*/
+static int btreeCellCompare(
+  BtCursor *pCur,          /* Cursor pointing into the page to search */
+  int idx,                 /* Index of the cell to compare */
+  UnpackedRecord *pIdxKey, /* Unpacked index key */
+  i64 intKey,              /* The table key */
+  int *pRes                /* Write the comparison result here */
+){
+  MemPage *pPage = pCur->apPage[pCur->iPage];
+  u8 *pCell;               /* Pointer to cell idx in pPage */
+  int c = 0;               /* Comparison result */
+  int rc = SQLITE_OK;      /* Return code */
+
+  pCur->aiIdx[pCur->iPage] = (u16)idx;
+  pCur->info.nSize = 0;
+  pCell = findCell(pPage, idx) + pPage->childPtrSize;
+  if( pPage->intKey ){
+    i64 nCellKey;
+    if( pPage->hasData ){
+      u32 dummy;
+      pCell += getVarint32(pCell, dummy);
+    }
+    getVarint(pCell, (u64*)&nCellKey);
+    if( nCellKey==intKey ){
+      c = 0;
+    }else if( nCellKey<intKey ){
+      c = -1;
+    }else{
+      assert( nCellKey>intKey );
+      c = +1;
+    }
+    pCur->validNKey = 1;
+    pCur->info.nKey = nCellKey;
+  }else{
+    /* The maximum supported page-size is 65536 bytes. This means that
+    ** the maximum number of record bytes stored on an index B-Tree
+    ** page is less than 16384 bytes and may be stored as a 2-byte
+    ** varint. This information is used to attempt to avoid parsing 
+    ** the entire cell by checking for the cases where the record is 
+    ** stored entirely within the b-tree page by inspecting the first 
+    ** 2 bytes of the cell.
+    */
+    int nCell = pCell[0];
+    if( nCell<=pPage->max1bytePayload
+     /* && (pCell+nCell)<pPage->aDataEnd */
+    ){
+      /* This branch runs if the record-size field of the cell is a
+      ** single byte varint and the record fits entirely on the main
+      ** b-tree page.  */
+      testcase( pCell+nCell+1==pPage->aDataEnd );
+      c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[1], pIdxKey);
+    }else if( !(pCell[1] & 0x80) 
+      && (nCell = ((nCell&0x7f)<<7) + pCell[1])<=pPage->maxLocal
+      /* && (pCell+nCell+2)<=pPage->aDataEnd */
+    ){
+      /* The record-size field is a 2 byte varint and the record 
+      ** fits entirely on the main b-tree page.  */
+      testcase( pCell+nCell+2==pPage->aDataEnd );
+      c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[2], pIdxKey);
+    }else{
+      /* The record flows over onto one or more overflow pages. In
+      ** this case the whole cell needs to be parsed, a buffer allocated
+      ** and accessPayload() used to retrieve the record into the
+      ** buffer before VdbeRecordCompare() can be called. */
+      void *pCellKey;
+      u8 * const pCellBody = pCell - pPage->childPtrSize;
+      btreeParseCellPtr(pPage, pCellBody, &pCur->info);
+      nCell = (int)pCur->info.nKey;
+      pCellKey = sqlite3Malloc( nCell );
+      if( pCellKey==0 ){
+        return SQLITE_NOMEM;
+      }
+      rc = accessPayload(pCur, 0, nCell, (unsigned char*)pCellKey, 0);
+      if( rc==SQLITE_OK ){
+        c = sqlite3VdbeRecordCompare(nCell, pCellKey, pIdxKey);
+      }
+      sqlite3_free(pCellKey);
+    }
+  }
+  *pRes = c;
+  return rc;
+}
+
+/*
+** The cursor is valid and is about to be moved to the entry for key
+** pIdxKey or intKey.  Check whether that key lies between the first and
+** last cells of the page the cursor points into, or failing that of the
+** parent of that page.  If it does, the search may start from there
+** rather than from the root page, since every path from the root to the
+** entry passes through that page.  This saves the interior page visits
+** made by repeated seeks with sorted or clustered keys, as are made by
+** a nested loop join probing an index.
+**
+** If the cursor has the BTREE_SEEK_ORDERED hint, the ancestors of the
+** current page are checked all the way up to the child of the root page.
+** A sequence of seeks in ascending order then walks the tree much as a
+** merge against the index would, descending only from the lowest page
+** that spans both the previous and the next key.
+**
+** If the search may start from the page the cursor is left pointing
+** into, *pbFound is set to true.  Otherwise it is set to false and the
+** caller must start from the root page instead.
+*/
+static int moveToFinger(
+  BtCursor *pCur,          /* The cursor to be moved */
+  UnpackedRecord *pIdxKey, /* Unpacked index key */
+  i64 intKey,              /* The table key */
+  int *pbFound             /* OUT: True if the search may start here */
+){
+  int iMin = pCur->iPage - 1;       /* Shallowest page to try */
+  int rc;
+  int c;
+
+  assert( pCur->eState==CURSOR_VALID );
+  assert( pCur->iPage>0 );
+  *pbFound = 0;
+  if( iMin<1 || (pCur->hints & BTREE_SEEK_ORDERED) ) iMin = 1;
+  for(;;){
+    MemPage *pPage = pCur->apPage[pCur->iPage];
+    if( pPage->nCell>0 ){
+      rc = btreeCellCompare(pCur, 0, pIdxKey, intKey, &c);
+      if( rc ) return rc;
+      if( c<=0 ){
+        rc = btreeCellCompare(pCur, pPage->nCell-1, pIdxKey, intKey, &c);
+        if( rc ) return rc;
+        if( c>=0 ){
+          *pbFound = 1;
+          return SQLITE_OK;
+        }
+      }
+    }
+    if( pCur->iPage<=iMin ) break;
+    moveToParent(pCur);
+  }
+  return SQLITE_OK;
+}
+
 /* Move the cursor so that it points to an entry near the key 
 ** specified by pIdxKey or intKey.   Return a success code.
 **
@@ -4507,6 +4808,33 @@ int sqlite3BtreeMovetoUnpacked(
     }
   }
 
+  /* If the key is near the entry the cursor points to, the search may be
+  ** able to start from the current leaf or its parent instead of from
+  ** the root page.  This is not attempted for searches biased to the high
+  ** end (appends), nor for UNPACKED_PREFIX_SEARCH keys, which are modified
+  ** by the comparisons made.  Once BTREE_FINGER_MISS consecutive seeks
+  ** have had to start from the root, as happens when the keys sought are
+  ** random, only every 16th seek tries the finger, unless the cursor has
+  ** the BTREE_SEEK_ORDERED hint.  */
+  if( pCur->eState==CURSOR_VALID && pCur->iPage>0 && !biasRight
+   && (pIdxKey==0 || (pIdxKey->flags & UNPACKED_PREFIX_SEARCH)==0)
+   && ((pCur->hints & BTREE_SEEK_ORDERED)
+    || pCur->nFingerMiss<BTREE_FINGER_MISS || ++pCur->nFingerSkip>=16)
+  ){
+    int bFound = 0;
+    pCur->nFingerSkip = 0;
+    rc = moveToFinger(pCur, pIdxKey, intKey, &bFound);
+    if( rc ){
+      return rc;
+    }
+    if( bFound ){
+      pCur->nFingerMiss = 0;
+      pCur->atLast = 0;
+      goto moveto_search;
+    }
+    if( pCur->nFingerMiss<BTREE_FINGER_MISS ) pCur->nFingerMiss++;
+  }
+
   rc = moveToRoot(pCur);
   if( rc ){
     return rc;
@@ -4519,6 +4847,7 @@ int sqlite3BtreeMovetoUnpacked(
     assert( pCur->pgnoRoot==0 || pCur->apPage[pCur->iPage]->nCell==0 );
     return SQLITE_OK;
   }
+moveto_search:
   assert( pCur->apPage[0]->intKey || pIdxKey );
   for(;;){
     int lwr, upr, idx;
@@ -4542,77 +4871,9 @@ int sqlite3BtreeMovetoUnpacked(
       pCur->aiIdx[pCur->iPage] = (u16)(idx = (upr+lwr)/2);
     }
     for(;;){
-      u8 *pCell;                          /* Pointer to current cell in pPage */
-
       assert( idx==pCur->aiIdx[pCur->iPage] );
-      pCur->info.nSize = 0;
-      pCell = findCell(pPage, idx) + pPage->childPtrSize;
-      if( pPage->intKey ){
-        i64 nCellKey;
-        if( pPage->hasData ){
-          u32 dummy;
-          pCell += getVarint32(pCell, dummy);
-        }
-        getVarint(pCell, (u64*)&nCellKey);
-        if( nCellKey==intKey ){
-          c = 0;
-        }else if( nCellKey<intKey ){
-          c = -1;
-        }else{
-          assert( nCellKey>intKey );
-          c = +1;
-        }
-        pCur->validNKey = 1;
-        pCur->info.nKey = nCellKey;
-      }else{
-        /* The maximum supported page-size is 65536 bytes. This means that
-        ** the maximum number of record bytes stored on an index B-Tree
-        ** page is less than 16384 bytes and may be stored as a 2-byte
-        ** varint. This information is used to attempt to avoid parsing 
-        ** the entire cell by checking for the cases where the record is 
-        ** stored entirely within the b-tree page by inspecting the first 
-        ** 2 bytes of the cell.
-        */
-        int nCell = pCell[0];
-        if( nCell<=pPage->max1bytePayload
-         /* && (pCell+nCell)<pPage->aDataEnd */
-        ){
-          /* This branch runs if the record-size field of the cell is a
-          ** single byte varint and the record fits entirely on the main
-          ** b-tree page.  */
-          testcase( pCell+nCell+1==pPage->aDataEnd );
-          c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[1], pIdxKey);
-        }else if( !(pCell[1] & 0x80) 
-          && (nCell = ((nCell&0x7f)<<7) + pCell[1])<=pPage->maxLocal
-          /* && (pCell+nCell+2)<=pPage->aDataEnd */
-        ){
-          /* The record-size field is a 2 byte varint and the record 
-          ** fits entirely on the main b-tree page.  */
-          testcase( pCell+nCell+2==pPage->aDataEnd );
-          c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[2], pIdxKey);
-        }else{
-          /* The record flows over onto one or more overflow pages. In
-          ** this case the whole cell needs to be parsed, a buffer allocated
-          ** and accessPayload() used to retrieve the record into the
-          ** buffer before VdbeRecordCompare() can be called. */
-          void *pCellKey;
-          u8 * const pCellBody = pCell - pPage->childPtrSize;
-          btreeParseCellPtr(pPage, pCellBody, &pCur->info);
-          nCell = (int)pCur->info.nKey;
-          pCellKey = sqlite3Malloc( nCell );
-          if( pCellKey==0 ){
-            rc = SQLITE_NOMEM;
-            goto moveto_finish;
-          }
-          rc = accessPayload(pCur, 0, nCell, (unsigned char*)pCellKey, 0);
-          if( rc ){
-            sqlite3_free(pCellKey);
-            goto moveto_finish;
-          }
-          c = sqlite3VdbeRecordCompare(nCell, pCellKey, pIdxKey);
-          sqlite3_free(pCellKey);
-        }
-      }
+      rc = btreeCellCompare(pCur, idx, pIdxKey, intKey, &c);
+      if( rc ) goto moveto_finish;
       if( c==0 ){
         if( pPage->intKey && !pPage->leaf ){
           lwr = idx;
@@ -4809,6 +5070,21 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** Return a measure of how far free page iPage is from page nearby, for
+** use by allocateBtreePage() when choosing which free page to reuse.
+**
+** Pages that follow nearby count as closer than pages the same distance
+** before it.  A b-tree leaf or overflow page allocated this way usually
+** ends up directly after the page it is read after, so that a scan of
+** the table reads the file forwards in long runs of adjacent pages.
+*/
+static u32 freePageDistance(Pgno iPage, Pgno nearby){
+  if( iPage>nearby ) return iPage - nearby;
+  if( (nearby - iPage)>0x7fffffff ) return 0xffffffff;
+  return (nearby - iPage)*2;
+}
+
 /*
 ** Allocate a new page from the database file.
 **
@@ -4994,11 +5270,10 @@ static int allocateBtreePage(
         unsigned char *aData = pTrunk->aData;
         if( nearby>0 ){
           u32 i;
-          int dist;
+          u32 dist = 0xffffffff;
           closest = 0;
-          dist = sqlite3AbsInt32(get4byte(&aData[8]) - nearby);
-          for(i=1; i<k; i++){
-            int d2 = sqlite3AbsInt32(get4byte(&aData[8+i*4]) - nearby);
+          for(i=0; i<k && dist>0; i++){
+            u32 d2 = freePageDistance(get4byte(&aData[8+i*4]), nearby);
             if( d2<dist ){
               closest = i;
               dist = d2;
@@ -5259,6 +5534,7 @@ static int clearCell(MemPage *pPage, unsigned char *pCell){
     return SQLITE_CORRUPT;  /* Cell extends past end of page */
   }
   ovflPgno = get4byte(&pCell[info.iOverflow]);
+  ovflChainDrop(pBt, ovflPgno);
   assert( pBt->usableSize > 4 );
   ovflPageSize = pBt->usableSize - 4;
   nOvfl = (info.nPayload - info.nLocal + ovflPageSize - 1)/ovflPageSize;
@@ -5391,7 +5667,8 @@ static int fillInCell(
         );
       }
 #endif
-      rc = allocateBtreePage(pBt, &pOvfl, &pgnoOvfl, pgnoOvfl, 0);
+      rc = allocateBtreePage(pBt, &pOvfl, &pgnoOvfl,
+                             pgnoOvfl ? pgnoOvfl : pPage->pgno, 0);
 #ifndef SQLITE_OMIT_AUTOVACUUM
       /* If the database supports auto-vacuum, and the second or subsequent
       ** overflow page is being allocated, add an entry to the pointer-map
@@ -5466,6 +5743,113 @@ static int fillInCell(
   return SQLITE_OK;
 }
 
+/*
+** Return true if the n bytes at a[] differ from bytes iOff through
+** iOff+n-1 of a payload that consists of the nData bytes of pData
+** followed by zeros.
+*/
+static int payloadDiffers(
+  const u8 *a,                   /* Bytes to compare */
+  const u8 *pData, int nData,    /* Payload data, before any zero bytes */
+  u32 iOff,                      /* Offset within the payload */
+  u32 n                          /* Number of bytes to compare */
+){
+  u32 i;
+  if( iOff<(u32)nData ){
+    u32 nCmp = (u32)nData - iOff;
+    if( nCmp>n ) nCmp = n;
+    if( memcmp(a, &pData[iOff], nCmp) ) return 1;
+    a += nCmp;
+    n -= nCmp;
+  }
+  for(i=0; i<n; i++){
+    if( a[i] ) return 1;
+  }
+  return 0;
+}
+
+/*
+** The cursor points to an entry on an intkey leaf page that is about
+** to be overwritten by an entry with the same key and nData bytes of
+** data followed by nZero zero bytes.  If the old entry has overflow pages
+** and the new entry would store exactly the same bytes in them, build the
+** new cell in pCell[] so that it uses the existing overflow chain and
+** set *pnSize to the size of the cell.  Otherwise set *pnSize to 0.
+**
+** The local part of a cell and the way the rest of the payload is spread
+** over overflow pages depend only on the size of the payload, so the
+** chain can be reused whenever the payload size is unchanged and the
+** bytes past the local part are identical.  This is the usual case for
+** an UPDATE that modifies small columns of a row that also holds a large
+** BLOB or TEXT value.  Reading the chain to compare it is much cheaper
+** than freeing it, allocating a new one and journalling and writing
+** every page of both.
+*/
+static int reuseOverflowChain(
+  BtCursor *pCur,                /* Cursor pointing at the entry */
+  unsigned char *pCell,          /* Write the new cell here */
+  const u8 *pData, int nData,    /* The data of the new entry */
+  int nZero,                     /* Extra zero bytes to append to pData */
+  int *pnSize                    /* Write cell size here, or 0 */
+){
+  MemPage *pPage = pCur->apPage[pCur->iPage];
+  BtShared *pBt = pPage->pBt;
+  unsigned char *pOld;
+  CellInfo info;
+  u32 ovflSize = pBt->usableSize - 4;
+  u32 iOff;
+  Pgno ovfl;
+
+  assert( pPage->intKey && pPage->leaf && pPage->hasData );
+  assert( pCur->eState==CURSOR_VALID );
+  *pnSize = 0;
+  pOld = findCell(pPage, pCur->aiIdx[pCur->iPage]);
+  btreeParseCellPtr(pPage, pOld, &info);
+  if( info.iOverflow==0 || info.nData!=(u32)(nData+nZero) ){
+    return SQLITE_OK;
+  }
+  if( pOld+info.iOverflow+3 > pPage->aData+pPage->maskPage ){
+    return SQLITE_CORRUPT_BKPT;
+  }
+
+  ovfl = get4byte(&pOld[info.iOverflow]);
+  for(iOff=info.nLocal; iOff<info.nPayload; iOff+=ovflSize){
+    MemPage *pOvfl = 0;
+    Pgno iNext = 0;
+    u32 n = info.nPayload - iOff;
+    int bDiff;
+    int rc;
+    if( n>ovflSize ) n = ovflSize;
+    if( ovfl<2 || ovfl>btreePagecount(pBt) ){
+      return SQLITE_CORRUPT_BKPT;
+    }
+    rc = getOverflowPage(pBt, ovfl, &pOvfl, &iNext);
+    if( rc==SQLITE_OK && pOvfl==0 ){
+      /* The next page number came from the pointer-map.  Load the page. */
+      rc = btreeGetPage(pBt, ovfl, &pOvfl, 0);
+    }
+    if( rc ) return rc;
+    bDiff = payloadDiffers(&pOvfl->aData[4], pData, nData, iOff, n);
+    releasePage(pOvfl);
+    if( bDiff ) return SQLITE_OK;
+    ovfl = iNext;
+  }
+
+  /* The header (data size and key) is unchanged.  Copy it, then the new
+  ** local part of the payload, then the pointer to the first overflow
+  ** page. */
+  memcpy(pCell, pOld, info.nHeader);
+  if( nData>info.nLocal ){
+    memcpy(&pCell[info.nHeader], pData, info.nLocal);
+  }else{
+    memcpy(&pCell[info.nHeader], pData, nData);
+    memset(&pCell[info.nHeader+nData], 0, info.nLocal-nData);
+  }
+  memcpy(&pCell[info.iOverflow], &pOld[info.iOverflow], 4);
+  *pnSize = info.nSize;
+  return SQLITE_OK;
+}
+
 /*
 ** Remove the i-th cell from pPage.  This routine effects pPage only.
 ** The cell content is not freed or deallocated.  It is assumed that
@@ -6228,6 +6612,63 @@ static int balance_nonroot(
     szNew[i-1] = szLeft;
   }
 
+  /*
+  ** In an index b-tree the divider between two siblings is a complete
+  ** cell, copied up into the parent.  Since any cell near the boundary
+  ** computed above will do, slide each boundary by a few cells in either
+  ** direction if that finds a shorter divider.  Shorter dividers mean more
+  ** cells on each interior page and a shallower tree, which matters for
+  ** indexes on long values with long common prefixes (URLs, paths).  The
+  ** boundary only moves while neither sibling overflows and no more than
+  ** 1/8th of a page worth of cells changes sides.
+  **
+  ** This does not apply to leaf-data trees, where the divider is an
+  ** integer key, nor to bulk loads that deliberately pack left siblings.
+  */
+  if( !leafData && !bBulk ){
+    int nSlack = usableSpace/8;   /* Maximum bytes moved between siblings */
+    for(i=0; i<k-1; i++){
+      int iFirst = (i==0 ? 0 : cntNew[i-1]+1);  /* First cell on page i */
+      int iLast = cntNew[i+1]-1;                /* Last cell on page i+1 */
+      int iBest = cntNew[i];                    /* Best divider so far */
+      int szLeft = szNew[i];
+      int szRight = szNew[i+1];
+      int szBestLeft = szLeft;
+      int szBestRight = szRight;
+      int d;
+
+      /* Try moving the boundary to the right */
+      for(d=cntNew[i]; d+1<iLast; d++){
+        szLeft += szCell[d] + 2;
+        szRight -= szCell[d+1] + 2;
+        if( szLeft>usableSpace || szLeft-szNew[i]>nSlack ) break;
+        if( szCell[d+1]<szCell[iBest] ){
+          iBest = d+1;
+          szBestLeft = szLeft;
+          szBestRight = szRight;
+        }
+      }
+
+      /* And to the left */
+      szLeft = szNew[i];
+      szRight = szNew[i+1];
+      for(d=cntNew[i]; d-1>iFirst; d--){
+        szLeft -= szCell[d-1] + 2;
+        szRight += szCell[d] + 2;
+        if( szRight>usableSpace || szRight-szNew[i+1]>nSlack ) break;
+        if( szCell[d-1]<szCell[iBest] ){
+          iBest = d-1;
+          szBestLeft = szLeft;
+          szBestRight = szRight;
+        }
+      }
+
+      cntNew[i] = iBest;
+      szNew[i] = szBestLeft;
+      szNew[i+1] = szBestRight;
+    }
+  }
+
   /* Either we found one or more cells (cntnew[0])>0) or pPage is
   ** a virtual root page.  A virtual root page is when the real root
   ** page is page 1 and we are the only child of that page.
@@ -6263,8 +6704,10 @@ static int balance_nonroot(
       nNew++;
       if( rc ) goto balance_cleanup;
     }else{
+      Pgno pgnoNear;
       assert( i>0 );
-      rc = allocateBtreePage(pBt, &pNew, &pgno, (bBulk ? 1 : pgno), 0);
+      pgnoNear = (bBulk ? 1 : apNew[i-1]->pgno);
+      rc = allocateBtreePage(pBt, &pNew, &pgno, pgnoNear, 0);
       if( rc ) goto balance_cleanup;
       apNew[i] = pNew;
       nNew++;
@@ -6718,7 +7161,8 @@ static int balance(BtCursor *pCur){
           ** pSpace buffer passed to the latter call to balance_nonroot().
           */
           u8 *pSpace = sqlite3PageMalloc(pCur->pBt->pageSize);
-          rc = balance_nonroot(pParent, iIdx, pSpace, iPage==1, pCur->hints);
+          rc = balance_nonroot(pParent, iIdx, pSpace, iPage==1,
+                               (pCur->hints & BTREE_BULKLOAD));
           if( pFree ){
             /* If pFree is not NULL, it points to the pSpace buffer used 
             ** by a previous call to balance_nonroot(). Its contents are
@@ -6788,6 +7232,7 @@ int sqlite3BtreeInsert(
   BtShared *pBt = p->pBt;
   unsigned char *oldCell;
   unsigned char *newCell = 0;
+  int bReuse = 0;                /* True to keep the old overflow chain */
 
   if( pCur->eState==CURSOR_FAULT ){
     assert( pCur->skipNext!=SQLITE_OK );
@@ -6844,8 +7289,15 @@ int sqlite3BtreeInsert(
   allocateTempSpace(pBt);
   newCell = pBt->pTmpSpace;
   if( newCell==0 ) return SQLITE_NOMEM;
-  rc = fillInCell(pPage, newCell, pKey, nKey, pData, nData, nZero, &szNew);
-  if( rc ) goto end_insert;
+  if( loc==0 && pPage->intKey && nData+nZero>0 ){
+    rc = reuseOverflowChain(pCur, newCell, pData, nData, nZero, &szNew);
+    if( rc ) goto end_insert;
+    bReuse = (szNew>0);
+  }
+  if( !bReuse ){
+    rc = fillInCell(pPage, newCell, pKey, nKey, pData, nData, nZero, &szNew);
+    if( rc ) goto end_insert;
+  }
   assert( szNew==cellSizePtr(pPage, newCell) );
   assert( szNew <= MX_CELL_SIZE(pBt) );
   idx = pCur->aiIdx[pCur->iPage];
@@ -6861,7 +7313,9 @@ int sqlite3BtreeInsert(
       memcpy(newCell, oldCell, 4);
     }
     szOld = cellSizePtr(pPage, oldCell);
-    rc = clearCell(pPage, oldCell);
+    if( !bReuse ){
+      rc = clearCell(pPage, oldCell);
+    }
     dropCell(pPage, idx, szOld, &rc);
     if( rc ) goto end_insert;
   }else if( loc<0 && pPage->nCell>0 ){
@@ -7446,6 +7900,11 @@ int sqlite3BtreeUpdateMeta(Btree *p, int idx, u32 iMeta){
   rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
   if( rc==SQLITE_OK ){
     put4byte(&pP1[36 + idx*4], iMeta);
+    if( idx==BTREE_SCHEMA_VERSION ){
+      /* The whole database may have been replaced, as it is by VACUUM
+      ** and the backup API, without any cells being cleared. */
+      invalidateAllOverflowCache(pBt);
+    }
 #ifndef SQLITE_OMIT_AUTOVACUUM
     if( idx==BTREE_INCR_VACUUM ){
       assert( pBt->autoVacuum || iMeta==0 );
@@ -8307,10 +8766,22 @@ int sqlite3BtreeSetVersion(Btree *pBtree, int iVersion){
 }
 
 /*
-** set the mask of hint flags for cursor pCsr. Currently the only valid
-** values are 0 and BTREE_BULKLOAD.
+** set the mask of hint flags for cursor pCsr. The valid flags are
+** BTREE_BULKLOAD and BTREE_SEEK_ORDERED.
 */
 void sqlite3BtreeCursorHints(BtCursor *pCsr, unsigned int mask){
-  assert( mask==BTREE_BULKLOAD || mask==0 );
+  assert( (mask & ~(BTREE_BULKLOAD|BTREE_SEEK_ORDERED))==0 );
   pCsr->hints = mask;
 }
+
+#ifndef SQLITE_OMIT_SHARED_CACHE
+/*
+** Return the number of connections to the BtShared object accessed by
+** the Btree handle passed as the only argument. For private caches
+** this is always 1. For shared caches it may be 1 or greater.
+*/
+int sqlite3BtreeConnectionCount(Btree *p){
+  testcase( p->sharable );
+  return p->pBt->nRef;
+}
+#endif
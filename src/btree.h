@@ -86,6 +86,11 @@ int sqlite3BtreeIsInBackup(Btree*);
 void *sqlite3BtreeSchema(Btree *, int, void(*)(void *));
 int sqlite3BtreeSchemaLocked(Btree *pBtree);
 int sqlite3BtreeLockTable(Btree *pBtree, int iTab, u8 isWriteLock);
+#ifndef SQLITE_OMIT_SHARED_CACHE
+int sqlite3BtreeConnectionCount(Btree*);
+#else
+# define sqlite3BtreeConnectionCount(X) 1
+#endif
 int sqlite3BtreeSavepoint(Btree *, int, int);
 
 const char *sqlite3BtreeGetFilename(Btree *);
@@ -140,6 +145,7 @@ int sqlite3BtreeUpdateMeta(Btree*, int idx, u32 value);
 ** sqlite3BtreeCursorHints() call.
 */
 #define BTREE_BULKLOAD 0x00000001
+#define BTREE_SEEK_ORDERED 0x00000004
 
 int sqlite3BtreeCursor(
   Btree*,                              /* BTree containing table to open */
@@ -230,6 +230,7 @@
 /* Forward declarations */
 typedef struct MemPage MemPage;
 typedef struct BtLock BtLock;
+typedef struct BtOvflChain BtOvflChain;
 
 /*
 ** This is a magic string that appears at the beginning of every
@@ -320,6 +321,36 @@ struct BtLock {
 #define READ_LOCK     1
 #define WRITE_LOCK    2
 
+/*
+** When an incremental blob cursor moves away from a large cell, the list
+** of overflow pages it has built up in BtCursor.aOverflow[] is kept in
+** a BtOvflChain object on the BtShared.pOvflChain list.  The next blob
+** cursor opened on the same cell takes the list over, so that it does not
+** have to walk the overflow chain again to reach a large offset.
+**
+** The list is discarded when the overflow chain is freed or may have
+** been moved, whenever the pager discards its cache because another
+** connection has written to the database file, and when the last cursor
+** on the BtShared is closed.
+*/
+struct BtOvflChain {
+  Pgno pgnoFirst;       /* First page of the overflow chain */
+  int nOvfl;            /* Number of entries in aPgno[] */
+  Pgno *aPgno;          /* Overflow pages.  0 means "not yet known" */
+  BtOvflChain *pNext;   /* Next on the BtShared.pOvflChain list */
+};
+
+/*
+** Maximum number of entries on the BtShared.pOvflChain list, and the
+** maximum number of overflow pages that they may describe between them.
+** The second limit bounds the memory used by the list to 4 bytes per
+** page, 128KiB by default.
+*/
+#define BTREE_OVFL_CHAIN_MAX 16
+#ifndef BTREE_OVFL_CHAIN_MAXPAGE
+# define BTREE_OVFL_CHAIN_MAXPAGE 32768
+#endif
+
 /* A Btree handle
 **
 ** A database connection contains a pointer to an instance of
@@ -434,6 +465,10 @@ struct BtShared {
   Btree *pWriter;       /* Btree with currently open write transaction */
 #endif
   u8 *pTmpSpace;        /* BtShared.pageSize bytes of space for tmp use */
+#ifndef SQLITE_OMIT_INCRBLOB
+  BtOvflChain *pOvflChain;  /* Overflow page lists of recent blob cursors */
+  u32 iOvflVersion;     /* Pager data version of pOvflChain entries */
+#endif
 };
 
 /*
@@ -496,6 +531,7 @@ struct BtCursor {
   struct KeyInfo *pKeyInfo; /* Argument passed to comparison function */
 #ifndef SQLITE_OMIT_INCRBLOB
   Pgno *aOverflow;          /* Cache of overflow page locations */
+  int nOvfl;                /* Number of entries in aOverflow[] */
 #endif
   Pgno pgnoRoot;            /* The root page of this tree */
   sqlite3_int64 cachedRowid; /* Next rowid cache.  0 means not valid */
@@ -511,6 +547,8 @@ struct BtCursor {
   u8 isIncrblobHandle;      /* True if this cursor is an incr. io handle */
 #endif
   u8 hints;                             /* As configured by CursorSetHints() */
+  u8 nFingerMiss;           /* Consecutive seeks not started at the finger */
+  u8 nFingerSkip;           /* Seeks since moveToFinger() was last tried */
   i16 iPage;                            /* Index of current page in apPage */
   u16 aiIdx[BTCURSOR_MAX_DEPTH];        /* Current index in apPage[i] */
   MemPage *apPage[BTCURSOR_MAX_DEPTH];  /* Pages from root to current page */
@@ -436,6 +436,7 @@ void sqlite3ResetOneSchema(sqlite3 *db, int iDb){
   pDb = &db->aDb[iDb];
   assert( sqlite3SchemaMutexHeld(db, iDb, 0) );
   assert( pDb->pSchema!=0 );
+  sqlite3SchemaShareRelease(db, iDb);
   sqlite3SchemaClear(pDb->pSchema);
 
   /* If any database other than TEMP is reset, then also reset TEMP
@@ -460,6 +461,7 @@ void sqlite3ResetAllSchemasOfConnection(sqlite3 *db){
   for(i=0; i<db->nDb; i++){
     Db *pDb = &db->aDb[i];
     if( pDb->pSchema ){
+      sqlite3SchemaShareRelease(db, i);
       sqlite3SchemaClear(pDb->pSchema);
     }
   }
@@ -1199,7 +1201,8 @@ void sqlite3AddPrimaryKey(
 #endif
   }else{
     Index *p;
-    p = sqlite3CreateIndex(pParse, 0, 0, 0, pList, onError, 0, 0, sortOrder, 0);
+    p = sqlite3CreateIndex(pParse, 0, 0, 0, pList, onError, 0, 0, sortOrder, 0,
+                           0);
     if( p ){
       p->autoIndex = 2;
     }
@@ -1326,6 +1329,9 @@ void sqlite3ChangeCookie(Parse *pParse, int iDb){
   sqlite3 *db = pParse->db;
   Vdbe *v = pParse->pVdbe;
   assert( sqlite3SchemaMutexHeld(db, iDb, 0) );
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+  sqlite3ParseToplevel(pParse)->schemaMask |= ((yDbMask)1)<<iDb;
+#endif
   sqlite3VdbeAddOp2(v, OP_Integer, db->aDb[iDb].pSchema->schema_cookie+1, r1);
   sqlite3VdbeAddOp3(v, OP_SetCookie, iDb, BTREE_SCHEMA_VERSION, r1);
   sqlite3ReleaseTempReg(pParse, r1);
@@ -1839,7 +1845,12 @@ int sqlite3ViewGetColumnNames(Parse *pParse, Table *pTable){
       pSelTab->aCol = 0;
       sqlite3DeleteTable(db, pSelTab);
       assert( sqlite3SchemaMutexHeld(db, 0, pTable->pSchema) );
-      pTable->pSchema->flags |= DB_UnresetViews;
+      /* A shared schema is never changed in place, so its views never
+      ** need resetting.  Leaving its flags alone also allows connections
+      ** to test DB_Shared and DB_SchemaLoaded without holding its mutex. */
+      if( (pTable->pSchema->flags & DB_Shared)==0 ){
+        pTable->pSchema->flags |= DB_UnresetViews;
+      }
     }else{
       pTable->nCol = 0;
       nErr++;
@@ -2394,6 +2405,26 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
     tnum = pIndex->tnum;
     sqlite3VdbeAddOp2(v, OP_Clear, tnum, iDb);
   }
+
+  /* A BRIN index is summarized by scanning the table in rowid order and
+  ** widening the entry for the block of each row in turn. */
+  if( IsBrinIndex(pIndex) ){
+    int regRowid = ++pParse->nMem;
+    int regVal = ++pParse->nMem;
+    sqlite3VdbeAddOp4Int(v, OP_OpenWrite, iIdx, tnum, iDb, 2);
+    if( memRootPage>=0 ) sqlite3VdbeChangeP5(v, OPFLAG_P2ISREG);
+    sqlite3OpenTable(pParse, iTab, iDb, pTab, OP_OpenRead);
+    addr1 = sqlite3VdbeAddOp2(v, OP_Rewind, iTab, 0);
+    sqlite3VdbeAddOp2(v, OP_Rowid, iTab, regRowid);
+    sqlite3ExprCodeGetColumnOfTable(v, pTab, iTab, pIndex->aiColumn[0], regVal);
+    sqlite3GenerateBrinUpdate(pParse, pIndex, iIdx, regRowid, regVal);
+    sqlite3VdbeAddOp2(v, OP_Next, iTab, addr1+1);
+    sqlite3VdbeJumpHere(v, addr1);
+    sqlite3VdbeAddOp1(v, OP_Close, iTab);
+    sqlite3VdbeAddOp1(v, OP_Close, iIdx);
+    return;
+  }
+
   pKey = sqlite3IndexKeyinfo(pParse, pIndex);
   sqlite3VdbeAddOp4(v, OP_OpenWrite, iIdx, tnum, iDb, 
                     (char *)pKey, P4_KEYINFO_HANDOFF);
@@ -2478,6 +2509,11 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
 ** is a primary key or unique-constraint on the most recent column added
 ** to the table currently under construction.  
 **
+** pType is the name that follows USING in a CREATE INDEX statement.  It
+** is NULL, empty or "btree" for an ordinary b-tree index.  The only other
+** index type is "brin", a block range index (see the comments on the Index
+** object), which is only available if SQLITE_ENABLE_BRIN is defined.
+**
 ** If the index is created successfully, return a pointer to the new Index
 ** structure. This is used by sqlite3AddPrimaryKey() to mark the index
 ** as the tables primary key (Index.autoIndex==2).
@@ -2492,7 +2528,8 @@ Index *sqlite3CreateIndex(
   Token *pStart,     /* The CREATE token that begins this statement */
   Token *pEnd,       /* The ")" that closes the CREATE INDEX statement */
   int sortOrder,     /* Sort order of primary key when pList==NULL */
-  int ifNotExist     /* Omit error if index already exists */
+  int ifNotExist,    /* Omit error if index already exists */
+  Token *pType       /* Index type named by a USING clause.  May be NULL */
 ){
   Index *pRet = 0;     /* Pointer to return */
   Table *pTab = 0;     /* Table to be indexed */
@@ -2511,6 +2548,7 @@ Index *sqlite3CreateIndex(
   int nCol;
   int nExtra = 0;
   char *zExtra;
+  int isBrin = 0;      /* True for a BRIN index */
 
   assert( pStart==0 || pEnd!=0 ); /* pEnd must be non-NULL if pStart is */
   assert( pParse->nErr==0 );      /* Never called with prior errors */
@@ -2588,6 +2626,28 @@ Index *sqlite3CreateIndex(
   }
 #endif
 
+  /* Check the index type named by the USING clause, if any.  BRIN
+  ** indices are only available if SQLITE_ENABLE_BRIN is defined.
+  */
+  if( pType && pType->n ){
+    char *zType = sqlite3NameFromToken(db, pType);
+    if( zType==0 ) goto exit_create_index;
+#ifdef SQLITE_ENABLE_BRIN
+    isBrin = (sqlite3StrICmp(zType, "brin")==0);
+#endif
+    if( isBrin==0 ){
+      if( sqlite3StrICmp(zType, "btree") ){
+        sqlite3ErrorMsg(pParse, "unknown index type: %s", zType);
+      }
+    }else if( onError!=OE_None ){
+      sqlite3ErrorMsg(pParse, "a BRIN index may not be UNIQUE");
+    }else if( pList->nExpr!=1 ){
+      sqlite3ErrorMsg(pParse, "a BRIN index must have exactly one column");
+    }
+    sqlite3DbFree(db, zType);
+    if( pParse->nErr ) goto exit_create_index;
+  }
+
   /*
   ** Find the name of the index.  Make sure there is not already another
   ** index or table with the same name.  
@@ -2709,6 +2769,7 @@ Index *sqlite3CreateIndex(
   pIndex->nColumn = pList->nExpr;
   pIndex->onError = (u8)onError;
   pIndex->autoIndex = (u8)(pName==0);
+  pIndex->bBrin = (u8)isBrin;
   pIndex->pSchema = db->aDb[iDb].pSchema;
   assert( sqlite3SchemaMutexHeld(db, iDb, 0) );
 
@@ -2879,20 +2940,29 @@ Index *sqlite3CreateIndex(
     if( v==0 ) goto exit_create_index;
 
 
-    /* Create the rootpage for the index
+    /* Create the rootpage for the index.  A BRIN index is stored in a
+    ** table b-tree keyed by block number.
     */
     sqlite3BeginWriteOperation(pParse, 1, iDb);
-    sqlite3VdbeAddOp2(v, OP_CreateIndex, iDb, iMem);
+    sqlite3VdbeAddOp2(v, isBrin ? OP_CreateTable : OP_CreateIndex, iDb, iMem);
+#ifdef SQLITE_ENABLE_BRIN
+    if( isBrin ){
+      sqlite3MinimumFileFormat(pParse, iDb, SQLITE_BRIN_FILE_FORMAT);
+    }
+#endif
 
     /* Gather the complete text of the CREATE INDEX statement into
     ** the zStmt variable
     */
     if( pStart ){
       assert( pEnd!=0 );
-      /* A named index with an explicit CREATE INDEX statement */
+      /* A named index with an explicit CREATE INDEX statement.  It ends
+      ** with the ")", or with the index type of a BRIN index.  "USING
+      ** btree" is left out so that other builds can read the schema. */
+      if( isBrin ) pEnd = pType;
       zStmt = sqlite3MPrintf(db, "CREATE%s INDEX %.*s",
         onError==OE_None ? "" : " UNIQUE",
-        (int)(pEnd->z - pName->z) + 1,
+        (int)(pEnd->z - pName->z) + pEnd->n,
         pName->z);
     }else{
       /* An automatic index created by a PRIMARY KEY or UNIQUE constraint */
@@ -349,18 +349,17 @@ FuncDef *sqlite3FindFunction(
   u8 createFlag      /* Create new entry if true and does not otherwise exist */
 ){
   FuncDef *p;         /* Iterator variable */
+  FuncDef *pFirst;    /* First application-defined function named zName */
   FuncDef *pBest = 0; /* Best match found so far */
   int bestScore = 0;  /* Score of best match */
-  int h;              /* Hash value */
 
   assert( nArg>=(-2) );
   assert( nArg>=(-1) || createFlag==0 );
   assert( enc==SQLITE_UTF8 || enc==SQLITE_UTF16LE || enc==SQLITE_UTF16BE );
-  h = (sqlite3UpperToLower[(u8)zName[0]] + nName) % ArraySize(db->aFunc.a);
 
   /* First search for a match amongst the application-defined functions.
   */
-  p = functionSearch(&db->aFunc, h, zName, nName);
+  p = pFirst = (FuncDef*)sqlite3HashFind(&db->aFunc, zName, nName);
   while( p ){
     int score = matchQuality(p, nArg, enc);
     if( score>bestScore ){
@@ -384,6 +383,7 @@ FuncDef *sqlite3FindFunction(
   */ 
   if( !createFlag && (pBest==0 || (db->flags & SQLITE_PreferBuiltin)!=0) ){
     FuncDefHash *pHash = &GLOBAL(FuncDefHash, sqlite3GlobalFunctions);
+    int h = (sqlite3UpperToLower[(u8)zName[0]] + nName) % ArraySize(pHash->a);
     bestScore = 0;
     p = functionSearch(pHash, h, zName, nName);
     while( p ){
@@ -398,7 +398,9 @@ FuncDef *sqlite3FindFunction(
 
   /* If the createFlag parameter is true and the search did not reveal an
   ** exact match for the name, number of arguments and encoding, then add a
-  ** new entry to the hash table and return it.
+  ** new entry to the hash table and return it.  Functions that share a
+  ** name are linked from the first one through FuncDef.pNext, so only
+  ** the first function with a given name is entered into db->aFunc.
   */
   if( createFlag && bestScore<FUNC_PERFECT_MATCH && 
       (pBest = sqlite3DbMallocZero(db, sizeof(*pBest)+nName+1))!=0 ){
@@ -407,7 +409,14 @@ FuncDef *sqlite3FindFunction(
     pBest->iPrefEnc = enc;
     memcpy(pBest->zName, zName, nName);
     pBest->zName[nName] = 0;
-    sqlite3FuncDefInsert(&db->aFunc, pBest);
+    if( pFirst ){
+      pBest->pNext = pFirst->pNext;
+      pFirst->pNext = pBest;
+    }else if( sqlite3HashInsert(&db->aFunc, pBest->zName, nName, pBest) ){
+      db->mallocFailed = 1;
+      sqlite3DbFree(db, pBest);
+      return 0;
+    }
   }
 
   if( pBest && (pBest->xStep || pBest->xFunc || createFlag) ){
@@ -474,3 +483,348 @@ Schema *sqlite3SchemaGet(sqlite3 *db, Btree *pBt){
   }
   return p;
 }
+
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+/*
+** Schemas shared between database connections.
+**
+** When SQLITE_CONFIG_SHARED_SCHEMA is enabled, the first connection to
+** load a particular version of the schema of a database file publishes
+** it on the schemaShareList.  Other connections that later open the same
+** file and find the same schema cookie, text encoding and file format
+** use the published Schema object instead of parsing sqlite_master
+** themselves.  Files are identified by their VFS together with the value
+** returned by the SQLITE_FCNTL_FILE_ID file-control (the device and inode
+** numbers on unix).  An entry only exists while some connection is using
+** it, and each such connection holds the file open, so the identifier
+** cannot be reused by a different file in the meantime.
+**
+** A shared Schema is only modified while statements are being compiled
+** (view column names, affinity strings, Table.nRef).  Each SchemaShare
+** therefore has a mutex of its own, which a connection holds from the
+** time sqlite3ReadSchema() finds its schemas loaded until the parser
+** returns.  The other interfaces that look up tables and columns take
+** the same mutexes.  They are never held while a schema is being loaded
+** or while a database lock is awaited, so a connection that is waiting
+** on the busy-handler does not stall the other users of the schema.
+** A connection that is about to change a schema (DDL or ANALYZE)
+** switches to a private copy first.  See sqlite3SchemaShareUnshare().
+**
+** The schemaShareList and the SchemaShare.nRef counters are protected
+** by the SQLITE_MUTEX_STATIC_MASTER mutex.
+*/
+typedef struct SchemaShare SchemaShare;
+struct SchemaShare {
+  const sqlite3_vfs *pVfs;  /* VFS used to open the database file */
+  sqlite3_uint64 aId[2];    /* File identifier reported by the VFS */
+  int nRef;                 /* Number of connections using sSchema */
+  sqlite3_mutex *mutex;     /* Held while compiling against sSchema */
+  SchemaShare *pNext;       /* Next entry on schemaShareList */
+  Schema sSchema;           /* The shared schema */
+};
+static SchemaShare *SQLITE_WSD schemaShareList = 0;
+static int SQLITE_WSD schemaShareGen = 0;
+
+/*
+** Return the SchemaShare object that contains the shared Schema pSchema.
+*/
+#define SCHEMA_TO_SHARE(pSchema) \
+  ((SchemaShare*)&((u8*)(pSchema))[-(int)offsetof(SchemaShare,sSchema)])
+
+/*
+** Obtain the mutexes of all shared schemas used by connection db, unless
+** it already holds them.  They are taken in order of address, so that two
+** connections that attached the same files in a different order cannot
+** deadlock.
+*/
+void sqlite3SchemaShareEnter(sqlite3 *db){
+  sqlite3_mutex *aMutex[SQLITE_MAX_ATTACHED+2];
+  int nMutex = 0;
+  int i, j;
+
+  if( db->bSharedSchema==0 || db->bSchemaShareHeld ) return;
+  for(i=0; i<db->nDb; i++){
+    Schema *pSchema = db->aDb[i].pSchema;
+    if( pSchema && (pSchema->flags & DB_Shared)!=0 ){
+      sqlite3_mutex *pMutex = SCHEMA_TO_SHARE(pSchema)->mutex;
+      for(j=nMutex; j>0 && aMutex[j-1]>pMutex; j--){
+        aMutex[j] = aMutex[j-1];
+      }
+      aMutex[j] = pMutex;
+      nMutex++;
+    }
+  }
+  for(i=0; i<nMutex; i++){
+    sqlite3_mutex_enter(aMutex[i]);
+  }
+  db->bSchemaShareHeld = 1;
+}
+
+/*
+** Release the mutexes obtained by sqlite3SchemaShareEnter(), if held.
+*/
+void sqlite3SchemaShareLeave(sqlite3 *db){
+  int i;
+  if( db->bSchemaShareHeld==0 ) return;
+  for(i=0; i<db->nDb; i++){
+    Schema *pSchema = db->aDb[i].pSchema;
+    if( pSchema && (pSchema->flags & DB_Shared)!=0 ){
+      sqlite3_mutex_leave(SCHEMA_TO_SHARE(pSchema)->mutex);
+    }
+  }
+  db->bSchemaShareHeld = 0;
+}
+
+/*
+** If database iDb of connection db is allowed to use a shared schema,
+** set *ppVfs and aId[] to identify the database file and return non-zero.
+** Otherwise return zero.
+*/
+static int schemaShareKey(
+  sqlite3 *db,                  /* Database connection */
+  int iDb,                      /* Index of database in db->aDb[] */
+  const sqlite3_vfs **ppVfs,    /* OUT: VFS used by the database */
+  sqlite3_uint64 *aId           /* OUT: File identifier */
+){
+  Db *pDb = &db->aDb[iDb];
+  Pager *pPager;
+  sqlite3_file *fd;
+
+  if( db->bSharedSchema==0 || iDb==1 || pDb->bNoShare || pDb->pBt==0 ){
+    return 0;
+  }
+  if( db->flags & (SQLITE_WriteSchema|SQLITE_RecoveryMode) ) return 0;
+  if( sqlite3BtreeConnectionCount(pDb->pBt)>1 ) return 0;
+  if( sqlite3BtreeGetFilename(pDb->pBt)[0]==0 ) return 0;
+  pPager = sqlite3BtreePager(pDb->pBt);
+  fd = sqlite3PagerFile(pPager);
+  if( fd->pMethods==0
+   || sqlite3OsFileControl(fd, SQLITE_FCNTL_FILE_ID, (void*)aId)!=SQLITE_OK
+  ){
+    return 0;
+  }
+  *ppVfs = sqlite3PagerVfs(pPager);
+  return 1;
+}
+
+/*
+** Search the schemaShareList for a schema of the file identified by pVfs
+** and aId[] that matches the meta values stored in pKey.  The caller must
+** hold the STATIC_MASTER mutex.
+*/
+static SchemaShare *schemaShareFind(
+  const sqlite3_vfs *pVfs,
+  sqlite3_uint64 *aId,
+  Schema *pKey
+){
+  SchemaShare *p;
+  for(p=schemaShareList; p; p=p->pNext){
+    if( p->pVfs==pVfs && p->aId[0]==aId[0] && p->aId[1]==aId[1]
+     && p->sSchema.schema_cookie==pKey->schema_cookie
+     && p->sSchema.enc==pKey->enc
+     && p->sSchema.file_format==pKey->file_format
+    ){
+      break;
+    }
+  }
+  return p;
+}
+
+/*
+** Make database iDb use schema pTo in place of pFrom.  TEMP triggers
+** attached to tables in pFrom are updated to refer to pTo.
+*/
+static void schemaShareSwitch(sqlite3 *db, int iDb, Schema *pFrom, Schema *pTo){
+  Schema *pTemp = db->aDb[1].pSchema;
+  db->aDb[iDb].pSchema = pTo;
+  if( pTemp ){
+    HashElem *pElem;
+    for(pElem=sqliteHashFirst(&pTemp->trigHash); pElem;
+        pElem=sqliteHashNext(pElem)){
+      Trigger *pTrig = (Trigger*)sqliteHashData(pElem);
+      if( pTrig->pTabSchema==pFrom ) pTrig->pTabSchema = pTo;
+    }
+  }
+}
+
+/*
+** This routine is called by sqlite3InitOne() after the meta values of
+** database iDb have been read into its otherwise empty schema.  If another
+** connection has published a matching schema, discard the private schema,
+** use the shared one instead and return non-zero.  Zero is returned if
+** the schema must be loaded from the database file in the usual way.
+*/
+int sqlite3SchemaShareAttach(sqlite3 *db, int iDb){
+  Schema *pPriv = db->aDb[iDb].pSchema;
+  const sqlite3_vfs *pVfs;
+  sqlite3_uint64 aId[2];
+  sqlite3_mutex *pMaster;
+  SchemaShare *p;
+  int i;
+
+  if( !schemaShareKey(db, iDb, &pVfs, aId) ) return 0;
+  pMaster = sqlite3MutexAlloc(SQLITE_MUTEX_STATIC_MASTER);
+  sqlite3_mutex_enter(pMaster);
+  p = schemaShareFind(pVfs, aId, pPriv);
+  for(i=0; p && i<db->nDb; i++){
+    /* A schema cannot be used by two databases of the same connection,
+    ** as sqlite3SchemaToIndex() would not be able to tell them apart. */
+    if( db->aDb[i].pSchema==&p->sSchema ) p = 0;
+  }
+  if( p ) p->nRef++;
+  sqlite3_mutex_leave(pMaster);
+  if( p==0 ) return 0;
+
+  /* Statements compiled against the private schema must not match the
+  ** generation of the shared one (which is always negative), nor that of
+  ** the private schema when it is next loaded. */
+  sqlite3SchemaClear(pPriv);
+  pPriv->iGeneration++;
+  schemaShareSwitch(db, iDb, pPriv, &p->sSchema);
+  return 1;
+}
+
+/*
+** This routine is called by sqlite3InitOne() after the schema of database
+** iDb has been loaded successfully.  If the schema may be shared, move its
+** contents into a new SchemaShare object, publish that and have database
+** iDb use it.  Failures are harmless: the schema simply stays private.
+*/
+void sqlite3SchemaSharePublish(sqlite3 *db, int iDb){
+  Schema *pPriv = db->aDb[iDb].pSchema;
+  Schema *pShared;
+  const sqlite3_vfs *pVfs;
+  sqlite3_uint64 aId[2];
+  sqlite3_mutex *pMaster;
+  SchemaShare *pNew;
+  HashElem *pElem;
+
+  if( !schemaShareKey(db, iDb, &pVfs, aId) ) return;
+  for(pElem=sqliteHashFirst(&pPriv->tblHash); pElem;
+      pElem=sqliteHashNext(pElem)){
+    /* Virtual tables are connected to a single database connection */
+    if( IsVirtual((Table*)sqliteHashData(pElem)) ) return;
+  }
+  sqlite3BeginBenignMalloc();
+  pNew = (SchemaShare*)sqlite3MallocZero(sizeof(SchemaShare));
+  sqlite3EndBenignMalloc();
+  if( pNew==0 ) return;
+  pNew->pVfs = pVfs;
+  pNew->aId[0] = aId[0];
+  pNew->aId[1] = aId[1];
+  pNew->nRef = 1;
+  pShared = &pNew->sSchema;
+  if( sqlite3GlobalConfig.bCoreMutex ){
+    pNew->mutex = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
+    if( pNew->mutex==0 ){
+      sqlite3_free(pNew);
+      return;
+    }
+  }
+
+  pMaster = sqlite3MutexAlloc(SQLITE_MUTEX_STATIC_MASTER);
+  sqlite3_mutex_enter(pMaster);
+  if( schemaShareFind(pVfs, aId, pPriv) ){
+    /* Another connection published the same schema first */
+    sqlite3_mutex_leave(pMaster);
+    sqlite3_mutex_free(pNew->mutex);
+    sqlite3_free(pNew);
+    return;
+  }
+
+  /* Move the tables, indices and triggers into the new Schema object. The
+  ** hash tables are copied by value, so reinitialize the private ones. */
+  memcpy(pShared, pPriv, sizeof(Schema));
+  pShared->iGeneration = --schemaShareGen;
+  pShared->flags |= DB_Shared;
+  sqlite3HashInit(&pPriv->tblHash);
+  sqlite3HashInit(&pPriv->idxHash);
+  sqlite3HashInit(&pPriv->trigHash);
+  sqlite3HashInit(&pPriv->fkeyHash);
+  pPriv->pSeqTab = 0;
+  pPriv->flags &= ~(DB_SchemaLoaded|DB_UnresetViews);
+  pPriv->iGeneration++;
+  for(pElem=sqliteHashFirst(&pShared->tblHash); pElem;
+      pElem=sqliteHashNext(pElem)){
+    Table *pTab = (Table*)sqliteHashData(pElem);
+    Index *pIdx;
+    pTab->pSchema = pShared;
+    for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+      pIdx->pSchema = pShared;
+    }
+  }
+  for(pElem=sqliteHashFirst(&pShared->trigHash); pElem;
+      pElem=sqliteHashNext(pElem)){
+    Trigger *pTrig = (Trigger*)sqliteHashData(pElem);
+    pTrig->pSchema = pShared;
+    if( pTrig->pTabSchema==pPriv ) pTrig->pTabSchema = pShared;
+  }
+  pNew->pNext = schemaShareList;
+  schemaShareList = pNew;
+  sqlite3_mutex_leave(pMaster);
+
+  schemaShareSwitch(db, iDb, pPriv, pShared);
+}
+
+/*
+** If database iDb of connection db is using a shared schema, stop doing
+** so and switch back to the (empty) private schema that belongs to its
+** b-tree.  The shared schema is freed when its last user releases it.
+*/
+void sqlite3SchemaShareRelease(sqlite3 *db, int iDb){
+  Db *pDb = &db->aDb[iDb];
+  Schema *pShared = pDb->pSchema;
+  sqlite3_mutex *pMaster;
+  SchemaShare *p;
+  SchemaShare **pp;
+
+  if( pShared==0 || (pShared->flags & DB_Shared)==0 ) return;
+  assert( pDb->pBt );
+  sqlite3SchemaShareLeave(db);
+  schemaShareSwitch(db, iDb, pShared, sqlite3SchemaGet(db, pDb->pBt));
+
+  pMaster = sqlite3MutexAlloc(SQLITE_MUTEX_STATIC_MASTER);
+  sqlite3_mutex_enter(pMaster);
+  for(pp=&schemaShareList; (p = *pp)!=0; pp=&p->pNext){
+    if( &p->sSchema==pShared ){
+      if( (--p->nRef)==0 ){
+        *pp = p->pNext;
+      }else{
+        p = 0;
+      }
+      break;
+    }
+  }
+  sqlite3_mutex_leave(pMaster);
+  if( p ){
+    sqlite3SchemaClear(&p->sSchema);
+    sqlite3_mutex_free(p->mutex);
+    sqlite3_free(p);
+  }
+}
+
+/*
+** This routine is called at the end of sqlite3_prepare() for a statement
+** that changes the in-memory schema of the databases in
+** pParse->schemaMask.  Each of those that is using a shared schema is
+** switched to a private one, which it keeps until it is detached.  Return
+** non-zero if this happened, in which case the statement must be compiled
+** again.
+*/
+int sqlite3SchemaShareUnshare(Parse *pParse){
+  sqlite3 *db = pParse->db;
+  int bUnshared = 0;
+  int i;
+  for(i=0; i<db->nDb; i++){
+    Schema *pSchema = db->aDb[i].pSchema;
+    if( (pParse->schemaMask & (((yDbMask)1)<<i))!=0
+     && pSchema && (pSchema->flags & DB_Shared)!=0
+    ){
+      db->aDb[i].bNoShare = 1;
+      sqlite3ResetOneSchema(db, i);
+      bUnshared = 1;
+    }
+  }
+  return bUnshared;
+}
+#endif /* SQLITE_ENABLE_SHARED_SCHEMA */
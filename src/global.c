@@ -159,6 +159,7 @@ SQLITE_WSD struct Sqlite3Config sqlite3Config = {
    0,                         /* nPage */
    0,                         /* mxParserStack */
    0,                         /* sharedCacheEnabled */
+   0,                         /* bSharedSchema */
    /* All the rest should always be initialized to zero */
    0,                         /* isInit */
    0,                         /* inProgress */
@@ -50,51 +50,45 @@ void sqlite3HashClear(Hash *pH){
 }
 
 /*
-** The hashing function.
+** The hashing function.  This is FNV-1a applied to the key after
+** folding it to lower case, so that keys that differ only in case
+** have the same hash.
 */
 static unsigned int strHash(const char *z, int nKey){
-  int h = 0;
+  unsigned int h = 0x811c9dc5;
   assert( nKey>=0 );
   while( nKey > 0  ){
-    h = (h<<3) ^ h ^ sqlite3UpperToLower[(unsigned char)*z++];
+    h = (h ^ sqlite3UpperToLower[(unsigned char)*z++]) * 0x01000193;
     nKey--;
   }
   return h;
 }
 
 
-/* Link pNew element into the hash table pH.  If pEntry!=0 then also
-** insert pNew into the pEntry hash bucket.
+/* Link pNew element into the hash table pH.  The element is added to
+** the head of the global list and, if pH->ht exists, to the first free
+** slot in the probe sequence for its hash.
 */
 static void insertElement(
   Hash *pH,              /* The complete hash table */
-  struct _ht *pEntry,    /* The entry into which pNew is inserted */
   HashElem *pNew         /* The element to be inserted */
 ){
-  HashElem *pHead;       /* First element already in pEntry */
-  if( pEntry ){
-    pHead = pEntry->count ? pEntry->chain : 0;
-    pEntry->count++;
-    pEntry->chain = pNew;
-  }else{
-    pHead = 0;
-  }
-  if( pHead ){
-    pNew->next = pHead;
-    pNew->prev = pHead->prev;
-    if( pHead->prev ){ pHead->prev->next = pNew; }
-    else             { pH->first = pNew; }
-    pHead->prev = pNew;
-  }else{
-    pNew->next = pH->first;
-    if( pH->first ){ pH->first->prev = pNew; }
-    pNew->prev = 0;
-    pH->first = pNew;
+  pNew->next = pH->first;
+  if( pH->first ){ pH->first->prev = pNew; }
+  pNew->prev = 0;
+  pH->first = pNew;
+  if( pH->ht ){
+    unsigned int mask = pH->htsize-1;
+    unsigned int i = pNew->h & mask;
+    while( pH->ht[i].elem ){ i = (i+1) & mask; }
+    pH->ht[i].h = pNew->h;
+    pH->ht[i].elem = pNew;
   }
 }
 
 
-/* Resize the hash table so that it cantains "new_size" buckets.
+/* Resize the hash table so that it cantains "new_size" slots.  The
+** new_size must be a power of two.
 **
 ** The hash table might fail to resize if sqlite3_malloc() fails or
 ** if the new size is the same as the prior size.
@@ -102,36 +96,35 @@ static void insertElement(
 */
 static int rehash(Hash *pH, unsigned int new_size){
   struct _ht *new_ht;            /* The new hash table */
-  HashElem *elem, *next_elem;    /* For looping over existing elements */
+  HashElem *elem;                /* For looping over existing elements */
+  unsigned int mask;             /* new_size-1 */
 
+  assert( new_size>0 && (new_size & (new_size-1))==0 );
 #if SQLITE_MALLOC_SOFT_LIMIT>0
-  if( new_size*sizeof(struct _ht)>SQLITE_MALLOC_SOFT_LIMIT ){
-    new_size = SQLITE_MALLOC_SOFT_LIMIT/sizeof(struct _ht);
+  while( new_size*sizeof(struct _ht)>SQLITE_MALLOC_SOFT_LIMIT ){
+    new_size /= 2;
   }
-  if( new_size==pH->htsize ) return 0;
+  if( new_size==pH->htsize || new_size<=pH->count ) return 0;
 #endif
 
   /* The inability to allocates space for a larger hash table is
   ** a performance hit but it is not a fatal error.  So mark the
-  ** allocation as a benign. Use sqlite3Malloc()/memset(0) instead of 
-  ** sqlite3MallocZero() to make the allocation, as sqlite3MallocZero()
-  ** only zeroes the requested number of bytes whereas this module will
-  ** use the actual amount of space allocated for the hash table (which
-  ** may be larger than the requested amount).
+  ** allocation as a benign.
   */
   sqlite3BeginBenignMalloc();
-  new_ht = (struct _ht *)sqlite3Malloc( new_size*sizeof(struct _ht) );
+  new_ht = (struct _ht *)sqlite3MallocZero( new_size*sizeof(struct _ht) );
   sqlite3EndBenignMalloc();
 
   if( new_ht==0 ) return 0;
   sqlite3_free(pH->ht);
   pH->ht = new_ht;
-  pH->htsize = new_size = sqlite3MallocSize(new_ht)/sizeof(struct _ht);
-  memset(new_ht, 0, new_size*sizeof(struct _ht));
-  for(elem=pH->first, pH->first=0; elem; elem = next_elem){
-    unsigned int h = strHash(elem->pKey, elem->nKey) % new_size;
-    next_elem = elem->next;
-    insertElement(pH, &new_ht[h], elem);
+  pH->htsize = new_size;
+  mask = new_size-1;
+  for(elem=pH->first; elem; elem=elem->next){
+    unsigned int i = elem->h & mask;
+    while( new_ht[i].elem ){ i = (i+1) & mask; }
+    new_ht[i].h = elem->h;
+    new_ht[i].elem = elem;
   }
   return 1;
 }
@@ -147,34 +140,38 @@ static HashElem *findElementGivenHash(
   unsigned int h      /* The hash for this key. */
 ){
   HashElem *elem;                /* Used to loop thru the element list */
-  int count;                     /* Number of elements left to test */
 
   if( pH->ht ){
-    struct _ht *pEntry = &pH->ht[h];
-    elem = pEntry->chain;
-    count = pEntry->count;
+    unsigned int mask = pH->htsize-1;
+    unsigned int i;
+    for(i=h&mask; (elem = pH->ht[i].elem)!=0; i=(i+1)&mask){
+      if( pH->ht[i].h==h && elem->nKey==nKey
+       && sqlite3StrNICmp(elem->pKey,pKey,nKey)==0 ){
+        return elem;
+      }
+    }
   }else{
-    elem = pH->first;
-    count = pH->count;
-  }
-  while( count-- && ALWAYS(elem) ){
-    if( elem->nKey==nKey && sqlite3StrNICmp(elem->pKey,pKey,nKey)==0 ){ 
-      return elem;
+    for(elem=pH->first; elem; elem=elem->next){
+      if( elem->h==h && elem->nKey==nKey
+       && sqlite3StrNICmp(elem->pKey,pKey,nKey)==0 ){
+        return elem;
+      }
     }
-    elem = elem->next;
   }
   return 0;
 }
 
 /* Remove a single entry from the hash table given a pointer to that
-** element and a hash on the element's key.
+** element.
+**
+** The slot vacated in pH->ht is filled by moving later entries of the
+** same probe sequence backwards, so that no "deleted" markers are
+** needed and lookups never have to step over dead slots.
 */
-static void removeElementGivenHash(
+static void removeElement(
   Hash *pH,         /* The pH containing "elem" */
-  HashElem* elem,   /* The element to be removed from the pH */
-  unsigned int h    /* Hash value for the element */
+  HashElem* elem    /* The element to be removed from the pH */
 ){
-  struct _ht *pEntry;
   if( elem->prev ){
     elem->prev->next = elem->next; 
   }else{
@@ -184,12 +181,22 @@ static void removeElementGivenHash(
     elem->next->prev = elem->prev;
   }
   if( pH->ht ){
-    pEntry = &pH->ht[h];
-    if( pEntry->chain==elem ){
-      pEntry->chain = elem->next;
+    struct _ht *ht = pH->ht;
+    unsigned int mask = pH->htsize-1;
+    unsigned int i, j, k;
+    for(i=elem->h & mask; ht[i].elem!=elem; i=(i+1)&mask){
+      assert( ht[i].elem!=0 );
     }
-    pEntry->count--;
-    assert( pEntry->count>=0 );
+    for(j=(i+1)&mask; ht[j].elem; j=(j+1)&mask){
+      /* Slot j may move into the gap at slot i unless its home slot k
+      ** lies cyclically within the range (i..j] */
+      k = ht[j].h & mask;
+      if( i<=j ? (k<=i || k>j) : (k<=i && k>j) ){
+        ht[i] = ht[j];
+        i = j;
+      }
+    }
+    ht[i].elem = 0;
   }
   sqlite3_free( elem );
   pH->count--;
@@ -206,17 +213,11 @@ static void removeElementGivenHash(
 */
 void *sqlite3HashFind(const Hash *pH, const char *pKey, int nKey){
   HashElem *elem;    /* The element that matches key */
-  unsigned int h;    /* A hash on key */
 
   assert( pH!=0 );
   assert( pKey!=0 );
   assert( nKey>=0 );
-  if( pH->ht ){
-    h = strHash(pKey, nKey) % pH->htsize;
-  }else{
-    h = 0;
-  }
-  elem = findElementGivenHash(pH, pKey, nKey, h);
+  elem = findElementGivenHash(pH, pKey, nKey, strHash(pKey, nKey));
   return elem ? elem->data : 0;
 }
 
@@ -235,23 +236,19 @@ void *sqlite3HashFind(const Hash *pH, const char *pKey, int nKey){
 ** element corresponding to "key" is removed from the hash table.
 */
 void *sqlite3HashInsert(Hash *pH, const char *pKey, int nKey, void *data){
-  unsigned int h;       /* the hash of the key modulo hash table size */
+  unsigned int h;       /* the hash of the key */
   HashElem *elem;       /* Used to loop thru the element list */
   HashElem *new_elem;   /* New element added to the pH */
 
   assert( pH!=0 );
   assert( pKey!=0 );
   assert( nKey>=0 );
-  if( pH->htsize ){
-    h = strHash(pKey, nKey) % pH->htsize;
-  }else{
-    h = 0;
-  }
+  h = strHash(pKey, nKey);
   elem = findElementGivenHash(pH,pKey,nKey,h);
   if( elem ){
     void *old_data = elem->data;
     if( data==0 ){
-      removeElementGivenHash(pH,elem,h);
+      removeElement(pH,elem);
     }else{
       elem->data = data;
       elem->pKey = pKey;
@@ -264,18 +261,22 @@ void *sqlite3HashInsert(Hash *pH, const char *pKey, int nKey, void *data){
   if( new_elem==0 ) return data;
   new_elem->pKey = pKey;
   new_elem->nKey = nKey;
+  new_elem->h = h;
   new_elem->data = data;
   pH->count++;
-  if( pH->count>=10 && pH->count > 2*pH->htsize ){
-    if( rehash(pH, pH->count*2) ){
-      assert( pH->htsize>0 );
-      h = strHash(pKey, nKey) % pH->htsize;
+
+  /* Keep the table at most half full.  If it cannot be enlarged and
+  ** has no free slot left, discard it and fall back to a linear
+  ** search of the element list. */
+  if( pH->count>=10 && pH->count*2>pH->htsize ){
+    unsigned int new_size = 16;
+    while( new_size<pH->count*4 ) new_size *= 2;
+    if( rehash(pH, new_size)==0 && pH->count>=pH->htsize ){
+      sqlite3_free(pH->ht);
+      pH->ht = 0;
+      pH->htsize = 0;
     }
   }
-  if( pH->ht ){
-    insertElement(pH, &pH->ht[h], new_elem);
-  }else{
-    insertElement(pH, 0, new_elem);
-  }
+  insertElement(pH, new_elem);
   return 0;
 }
@@ -30,9 +30,13 @@ typedef struct HashElem HashElem;
 ** All elements of the hash table are on a single doubly-linked list.
 ** Hash.first points to the head of this list.
 **
-** There are Hash.htsize buckets.  Each bucket points to a spot in
-** the global doubly-linked list.  The contents of the bucket are the
-** element pointed to plus the next _ht.count-1 elements in the list.
+** Hash.ht is an open-addressing table of Hash.htsize slots, where
+** Hash.htsize is a power of two, that is searched using linear probing.
+** Each slot holds a pointer to an element together with the full hash
+** of that element's key, so that most non-matching slots are rejected
+** without visiting the element or comparing key text.  Keys are
+** compared without regard to case, so the hash is computed over the
+** case-folded key.
 **
 ** Hash.htsize and Hash.ht may be zero.  In that case lookup is done
 ** by a linear search of the global list.  For small tables, the 
@@ -41,12 +45,12 @@ typedef struct HashElem HashElem;
 ** the hash table.
 */
 struct Hash {
-  unsigned int htsize;      /* Number of buckets in the hash table */
+  unsigned int htsize;      /* Number of slots in the hash table */
   unsigned int count;       /* Number of entries in this table */
   HashElem *first;          /* The first element of the array */
   struct _ht {              /* the hash table */
-    int count;                 /* Number of entries with this hash */
-    HashElem *chain;           /* Pointer to first entry with this hash */
+    unsigned int h;            /* Hash of the key of elem */
+    HashElem *elem;            /* Element in this slot or NULL if empty */
   } *ht;
 };
 
@@ -60,6 +64,7 @@ struct HashElem {
   HashElem *next, *prev;       /* Next and previous elements in the table */
   void *data;                  /* Data associated with this element */
   const char *pKey; int nKey;  /* Key associated with this element */
+  unsigned int h;              /* Hash of pKey, computed by strHash() */
 };
 
 /*
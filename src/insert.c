@@ -34,6 +34,30 @@ void sqlite3OpenTable(
   VdbeComment((v, "%s", pTab->zName));
 }
 
+/*
+** Generate code that will open cursor iCur on index pIdx.  A BRIN index
+** is stored in a table b-tree of two-column records, so it is opened
+** without a KeyInfo.
+*/
+void sqlite3OpenIndex(
+  Parse *p,       /* Generate code into this VDBE */
+  int iCur,       /* The cursor number of the index */
+  int iDb,        /* The database index in sqlite3.aDb[] */
+  Index *pIdx,    /* The index to be opened */
+  int opcode      /* OP_OpenRead or OP_OpenWrite */
+){
+  Vdbe *v = sqlite3GetVdbe(p);
+  assert( opcode==OP_OpenWrite || opcode==OP_OpenRead );
+  if( IsBrinIndex(pIdx) ){
+    sqlite3VdbeAddOp4Int(v, opcode, iCur, pIdx->tnum, iDb, 2);
+  }else{
+    KeyInfo *pKey = sqlite3IndexKeyinfo(p, pIdx);
+    sqlite3VdbeAddOp4(v, opcode, iCur, pIdx->tnum, iDb,
+                      (char*)pKey, P4_KEYINFO_HANDOFF);
+  }
+  VdbeComment((v, "%s", pIdx->zName));
+}
+
 /*
 ** Return a pointer to the column affinity string associated with index
 ** pIdx. A column affinity string has one character for each column in 
@@ -329,6 +353,49 @@ static int xferOptimization(
   int iDbDest           /* The database of pDest */
 );
 
+#ifndef SQLITE_OMIT_MERGE_SORT
+/*
+** Return true if an INSERT ... SELECT into pTab may collect the entries
+** for the non-UNIQUE indices of pTab in sorters and only write them to
+** the indices, in key order, after the last row has been inserted.  This
+** turns one random insert into each index per row into a single ordered
+** pass over each index, which touches far fewer index pages when the
+** rows do not arrive in index order.
+**
+** This is only safe if nothing reads those indices before the statement
+** has finished and no row inserted by the statement can be deleted again
+** before then.  So there must be no triggers or foreign key processing on
+** pTab and no constraint may be resolved using REPLACE.  A FAIL
+** constraint ends the statement without running the code that writes
+** out the sorters, so that is ruled out too.
+**
+** The same conditions allow a single-row INSERT ... VALUES to leave its
+** entries for those indices with the connection, where they are batched
+** with the entries of later INSERT statements in the same transaction.
+*/
+static int insertCanDeferIndices(Parse *pParse, Table *pTab, int onError){
+  Index *pIdx;
+  int nDefer = 0;
+
+  if( onError==OE_Replace || onError==OE_Fail ) return 0;
+  if( sqlite3FkRequired(pParse, pTab, 0, 0) ) return 0;
+  if( onError==OE_Default ){
+    int i;
+    if( pTab->keyConf==OE_Replace || pTab->keyConf==OE_Fail ) return 0;
+    for(i=0; i<pTab->nCol; i++){
+      if( pTab->aCol[i].notNull==OE_Fail ) return 0;
+    }
+    for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+      if( pIdx->onError==OE_Replace || pIdx->onError==OE_Fail ) return 0;
+    }
+  }
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+    if( pIdx->onError==OE_None && !IsBrinIndex(pIdx) ) nDefer++;
+  }
+  return nDefer>0;
+}
+#endif /* SQLITE_OMIT_MERGE_SORT */
+
 /*
 ** This routine is call to handle SQL of the following forms:
 **
@@ -470,6 +537,8 @@ void sqlite3Insert(
   int regData;          /* register holding first column to insert */
   int regEof = 0;       /* Register recording end of SELECT data */
   int *aRegIdx = 0;     /* One register allocated to each index */
+  int *aSorter = 0;     /* Sorter cursor for each deferred index, or 0 */
+  int deferIdx = 0;     /* True to defer entries past the end of statement */
 
 #ifndef SQLITE_OMIT_TRIGGER
   int isView;                 /* True if attempting to insert into a view */
@@ -764,6 +833,45 @@ void sqlite3Insert(
     for(i=0; i<nIdx; i++){
       aRegIdx[i] = ++pParse->nMem;
     }
+#ifndef SQLITE_OMIT_MERGE_SORT
+    /* If the rows come from a SELECT, collect the entries for non-UNIQUE
+    ** indices in sorters.  They are written to the indices after the
+    ** loop below. */
+    if( pSelect && !pTrigger && !IsVirtual(pTab)
+     && insertCanDeferIndices(pParse, pTab, onError)
+    ){
+      aSorter = sqlite3DbMallocZero(db, sizeof(int)*(nIdx+1));
+      if( aSorter==0 ){
+        goto insert_cleanup;
+      }
+      for(i=0, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, i++){
+        if( pIdx->onError==OE_None && !IsBrinIndex(pIdx) ){
+          KeyInfo *pKey = sqlite3IndexKeyinfo(pParse, pIdx);
+          aSorter[i] = pParse->nTab++;
+          sqlite3VdbeAddOp4(v, OP_SorterOpen, aSorter[i], 0, 0,
+                            (char*)pKey, P4_KEYINFO_HANDOFF);
+        }
+      }
+    }
+
+    /* A single row from a VALUES clause may leave the entries for
+    ** non-UNIQUE indices with the connection, to be written out in
+    ** key order together with those of later INSERT statements in the
+    ** same transaction.  The statement must not read any index itself,
+    ** so the VALUES clause may not contain a subquery.  Nor may the
+    ** statement be part of a trigger program. */
+    if( pSelect==0 && !pTrigger && !IsVirtual(pTab)
+     && pParse->nested==0 && pParse->pToplevel==0
+     && insertCanDeferIndices(pParse, pTab, onError)
+    ){
+      deferIdx = 1;
+      for(i=0; pList && i<pList->nExpr; i++){
+        if( !sqlite3ExprIsConstantOrFunction(pList->a[i].pExpr) ){
+          deferIdx = 0;
+        }
+      }
+    }
+#endif
   }
 
   /* This is the top of the main insertion loop */
@@ -980,8 +1088,8 @@ void sqlite3Insert(
           keyColumn>=0, 0, onError, endOfLoop, &isReplace
       );
       sqlite3FkCheck(pParse, pTab, 0, regIns);
-      sqlite3CompleteInsertion(
-          pParse, pTab, baseCur, regIns, aRegIdx, 0, appendFlag, isReplace==0
+      sqlite3CompleteInsertion(pParse, pTab, baseCur, regIns, aRegIdx,
+          aSorter, 0, appendFlag, isReplace==0, deferIdx
       );
     }
   }
@@ -1011,6 +1119,23 @@ void sqlite3Insert(
     sqlite3VdbeJumpHere(v, addrInsTop);
   }
 
+  /* Write the entries collected in sorters to their indices, in key
+  ** order. */
+  if( aSorter ){
+    int regRec = sqlite3GetTempReg(pParse);
+    for(idx=0, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, idx++){
+      int addr;
+      if( aSorter[idx]==0 ) continue;
+      addr = sqlite3VdbeAddOp2(v, OP_SorterSort, aSorter[idx], 0);
+      sqlite3VdbeAddOp2(v, OP_SorterData, aSorter[idx], regRec);
+      sqlite3VdbeAddOp3(v, OP_IdxInsert, baseCur+idx+1, regRec, 1);
+      sqlite3VdbeAddOp2(v, OP_SorterNext, aSorter[idx], addr+1);
+      sqlite3VdbeJumpHere(v, addr);
+      sqlite3VdbeAddOp1(v, OP_Close, aSorter[idx]);
+    }
+    sqlite3ReleaseTempReg(pParse, regRec);
+  }
+
   if( !IsVirtual(pTab) && !isView ){
     /* Close all tables opened */
     sqlite3VdbeAddOp1(v, OP_Close, baseCur);
@@ -1045,6 +1170,7 @@ insert_cleanup:
   sqlite3SelectDelete(db, pSelect);
   sqlite3IdListDelete(db, pColumn);
   sqlite3DbFree(db, aRegIdx);
+  sqlite3DbFree(db, aSorter);
 }
 
 /* Make sure "isView" and other macros defined above are undefined. Otherwise
@@ -1328,6 +1454,7 @@ void sqlite3GenerateConstraintChecks(
     int regR;
 
     if( aRegIdx[iCur]==0 ) continue;  /* Skip unused indices */
+    if( IsBrinIndex(pIdx) ) continue;  /* Updated by CompleteInsertion() */
 
     /* Create a key for accessing the index entry */
     regIdx = sqlite3GetTempRange(pParse, pIdx->nColumn+1);
@@ -1430,8 +1557,21 @@ void sqlite3GenerateConstraintChecks(
 ** A consecutive range of registers starting at regRowid contains the
 ** rowid and the content to be inserted.
 **
-** The arguments to this routine should be the same as the first six
-** arguments to sqlite3GenerateConstraintChecks.
+** The first five arguments to this routine should be the same as the
+** first five arguments to sqlite3GenerateConstraintChecks.
+**
+** If aSorter is not NULL and aSorter[i] is not zero, the entry for the
+** i-th index is written to the sorter opened on cursor aSorter[i] instead
+** of to the index itself.  The caller is responsible for copying the
+** content of the sorter into the index later.
+**
+** If deferIdx is true, the OP_IdxInsert for each index without a
+** uniqueness constraint is marked with OPFLAG_DEFERRED, which allows it
+** to leave the entry with the connection until the end of the
+** transaction or the next statement that might read the index.
+**
+** BRIN indices need no entry from sqlite3GenerateConstraintChecks.  The
+** entry for the block of the row is widened after the row is written.
 */
 void sqlite3CompleteInsertion(
   Parse *pParse,      /* The parser context */
@@ -1439,13 +1579,14 @@ void sqlite3CompleteInsertion(
   int baseCur,        /* Index of a read/write cursor pointing at pTab */
   int regRowid,       /* Range of content */
   int *aRegIdx,       /* Register used by each index.  0 for unused indices */
+  int *aSorter,       /* Sorter cursor used by each index, or NULL */
   int isUpdate,       /* True for UPDATE, False for INSERT */
   int appendBias,     /* True if this is likely to be an append */
-  int useSeekResult   /* True to set the USESEEKRESULT flag on OP_[Idx]Insert */
+  int useSeekResult,  /* True to set the USESEEKRESULT flag on OP_[Idx]Insert */
+  int deferIdx        /* True to set the DEFERRED flag on OP_IdxInsert */
 ){
   int i;
   Vdbe *v;
-  int nIdx;
   Index *pIdx;
   u8 pik_flags;
   int regData;
@@ -1454,13 +1595,22 @@ void sqlite3CompleteInsertion(
   v = sqlite3GetVdbe(pParse);
   assert( v!=0 );
   assert( pTab->pSelect==0 );  /* This table is not a VIEW */
-  for(nIdx=0, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, nIdx++){}
-  for(i=nIdx-1; i>=0; i--){
-    if( aRegIdx[i]==0 ) continue;
+  for(i=0, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, i++){
+    if( aRegIdx[i]==0 || IsBrinIndex(pIdx) ) continue;
+    if( aSorter && aSorter[i] ){
+      sqlite3VdbeAddOp2(v, OP_SorterInsert, aSorter[i], aRegIdx[i]);
+      continue;
+    }
     sqlite3VdbeAddOp2(v, OP_IdxInsert, baseCur+i+1, aRegIdx[i]);
+    pik_flags = 0;
     if( useSeekResult ){
-      sqlite3VdbeChangeP5(v, OPFLAG_USESEEKRESULT);
+      pik_flags |= OPFLAG_USESEEKRESULT;
+    }
+    if( deferIdx && pIdx->onError==OE_None ){
+      sqlite3VdbeChangeP4(v, -1, SQLITE_INT_TO_PTR(pIdx->tnum), P4_INT32);
+      pik_flags |= OPFLAG_DEFERRED;
     }
+    sqlite3VdbeChangeP5(v, pik_flags);
   }
   regData = regRowid + 1;
   regRec = sqlite3GetTempReg(pParse);
@@ -1484,6 +1634,69 @@ void sqlite3CompleteInsertion(
     sqlite3VdbeChangeP4(v, -1, pTab->zName, P4_TRANSIENT);
   }
   sqlite3VdbeChangeP5(v, pik_flags);
+
+  /* Widen the BRIN index entries.  This is done once the OP_MakeRecord
+  ** above has applied the column affinities to the new values. */
+  for(i=0, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, i++){
+    int iCol;
+    if( aRegIdx[i]==0 || !IsBrinIndex(pIdx) ) continue;
+    iCol = pIdx->aiColumn[0];
+    sqlite3GenerateBrinUpdate(pParse, pIdx, baseCur+i+1, regRowid,
+        iCol==pTab->iPKey ? regRowid : regData+iCol);
+  }
+}
+
+/*
+** Generate code that widens the entry of BRIN index pIdx for the block
+** of a new or updated row, so that it covers the value of the indexed
+** column of the row.  Register regRowid holds the rowid of the row and
+** register regVal the value.  Cursor iCur is open for writing on the
+** index.
+**
+** An entry is created if the block does not have one yet.  Existing
+** entries are only rewritten if the value lies outside of the range they
+** record, which is rarely the case when rows are appended in the order
+** of the indexed column.  NULL values are not recorded.
+*/
+void sqlite3GenerateBrinUpdate(
+  Parse *pParse,     /* Parsing context */
+  Index *pIdx,       /* The BRIN index */
+  int iCur,          /* Write cursor open on the index */
+  int regRowid,      /* Register holding the rowid of the row */
+  int regVal         /* Register holding the value of the indexed column */
+){
+  Vdbe *v = pParse->pVdbe;
+  CollSeq *pColl = sqlite3LocateCollSeq(pParse, pIdx->azColl[0]);
+  int regBlk;        /* Block number.  Followed by min, max and record */
+  int addrDone;      /* Jump here if the entry needs no change */
+  int addrNew;       /* OP_NotExists that jumps if there is no entry */
+  int addrLow;       /* OP_Lt that jumps if the value is below the min */
+  int addrWrite;     /* OP_Goto that jumps to write the new max */
+
+  assert( IsBrinIndex(pIdx) && pIdx->nColumn==1 );
+  regBlk = sqlite3GetTempRange(pParse, 4);
+  addrDone = sqlite3VdbeMakeLabel(v);
+  sqlite3VdbeAddOp2(v, OP_IsNull, regVal, addrDone);
+  sqlite3VdbeAddOp2(v, OP_Integer, SQLITE_BRIN_SHIFT, regBlk+3);
+  sqlite3VdbeAddOp3(v, OP_ShiftRight, regBlk+3, regRowid, regBlk);
+  addrNew = sqlite3VdbeAddOp3(v, OP_NotExists, iCur, 0, regBlk);
+  sqlite3VdbeAddOp3(v, OP_Column, iCur, 0, regBlk+1);
+  sqlite3VdbeAddOp3(v, OP_Column, iCur, 1, regBlk+2);
+  addrLow = sqlite3VdbeAddOp4(v, OP_Lt, regBlk+1, 0, regVal,
+                              (char*)pColl, P4_COLLSEQ);
+  sqlite3VdbeAddOp4(v, OP_Le, regBlk+2, addrDone, regVal,
+                    (char*)pColl, P4_COLLSEQ);
+  sqlite3VdbeAddOp2(v, OP_SCopy, regVal, regBlk+2);
+  addrWrite = sqlite3VdbeAddOp0(v, OP_Goto);
+  sqlite3VdbeJumpHere(v, addrNew);
+  sqlite3VdbeAddOp2(v, OP_SCopy, regVal, regBlk+2);
+  sqlite3VdbeJumpHere(v, addrLow);
+  sqlite3VdbeAddOp2(v, OP_SCopy, regVal, regBlk+1);
+  sqlite3VdbeJumpHere(v, addrWrite);
+  sqlite3VdbeAddOp3(v, OP_MakeRecord, regBlk+1, 2, regBlk+3);
+  sqlite3VdbeAddOp3(v, OP_Insert, iCur, regBlk+3, regBlk);
+  sqlite3VdbeResolveLabel(v, addrDone);
+  sqlite3ReleaseTempRange(pParse, regBlk, 4);
 }
 
 /*
@@ -1502,19 +1715,14 @@ int sqlite3OpenTableAndIndices(
   int i;
   int iDb;
   Index *pIdx;
-  Vdbe *v;
 
   if( IsVirtual(pTab) ) return 0;
   iDb = sqlite3SchemaToIndex(pParse->db, pTab->pSchema);
-  v = sqlite3GetVdbe(pParse);
-  assert( v!=0 );
+  assert( sqlite3GetVdbe(pParse)!=0 );
   sqlite3OpenTable(pParse, baseCur, iDb, pTab, op);
   for(i=1, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, i++){
-    KeyInfo *pKey = sqlite3IndexKeyinfo(pParse, pIdx);
     assert( pIdx->pSchema==pTab->pSchema );
-    sqlite3VdbeAddOp4(v, op, i+baseCur, pIdx->tnum, iDb,
-                      (char*)pKey, P4_KEYINFO_HANDOFF);
-    VdbeComment((v, "%s", pIdx->zName));
+    sqlite3OpenIndex(pParse, i+baseCur, iDb, pIdx, op);
   }
   if( pParse->nTab<baseCur+i ){
     pParse->nTab = baseCur+i;
@@ -1569,6 +1777,9 @@ static int xferCompatibleIndex(Index *pDest, Index *pSrc){
   if( pDest->onError!=pSrc->onError ){
     return 0;   /* Different conflict resolution strategies */
   }
+  if( pDest->bBrin!=pSrc->bBrin ){
+    return 0;   /* Different index types */
+  }
   for(i=0; i<pSrc->nColumn; i++){
     if( pSrc->aiColumn[i]!=pDest->aiColumn[i] ){
       return 0;   /* Different columns indexed */
@@ -1631,6 +1842,7 @@ static int xferOptimization(
   KeyInfo *pKey;                   /* Key information for an index */
   int regAutoinc;                  /* Memory register used by AUTOINC */
   int destHasUniqueIdx = 0;        /* True if pDest has a UNIQUE index */
+  int destHasBrinIdx = 0;          /* True if pDest has a BRIN index */
   int regData, regRowid;           /* Registers holding data and rowid */
 
   if( pSelect==0 ){
@@ -1727,6 +1939,9 @@ static int xferOptimization(
     if( pDestIdx->onError!=OE_None ){
       destHasUniqueIdx = 1;
     }
+    if( IsBrinIndex(pDestIdx) ){
+      destHasBrinIdx = 1;
+    }
     for(pSrcIdx=pSrc->pIndex; pSrcIdx; pSrcIdx=pSrcIdx->pNext){
       if( xferCompatibleIndex(pDestIdx, pSrcIdx) ) break;
     }
@@ -1772,6 +1987,7 @@ static int xferOptimization(
   if( (pDest->iPKey<0 && pDest->pIndex!=0)          /* (1) */
    || destHasUniqueIdx                              /* (2) */
    || (onError!=OE_Abort && onError!=OE_Rollback)   /* (3) */
+   || destHasBrinIdx                                /* (4) */
   ){
     /* In some circumstances, we are able to run the xfer optimization
     ** only if the destination table is initially empty.  This code makes
@@ -1786,6 +2002,9 @@ static int xferOptimization(
     **     is unable to test uniqueness.)
     **
     ** (3) onError is something other than OE_Abort and OE_Rollback.
+    **
+    ** (4) The destination has a BRIN index.  (Its entries are copied
+    **     from the source, replacing any entries for the same blocks.)
     */
     addr1 = sqlite3VdbeAddOp2(v, OP_Rewind, iDest, 0);
     emptyDestTest = sqlite3VdbeAddOp2(v, OP_Goto, 0, 0);
@@ -1822,6 +2041,20 @@ static int xferOptimization(
     assert( pSrcIdx );
     sqlite3VdbeAddOp2(v, OP_Close, iSrc, 0);
     sqlite3VdbeAddOp2(v, OP_Close, iDest, 0);
+    if( IsBrinIndex(pDestIdx) ){
+      /* The rows keep their rowids, so the block summaries of the source
+      ** index are valid for the destination. */
+      sqlite3OpenIndex(pParse, iSrc, iDbSrc, pSrcIdx, OP_OpenRead);
+      sqlite3OpenIndex(pParse, iDest, iDbDest, pDestIdx, OP_OpenWrite);
+      addr1 = sqlite3VdbeAddOp2(v, OP_Rewind, iSrc, 0);
+      sqlite3VdbeAddOp2(v, OP_Rowid, iSrc, regRowid);
+      sqlite3VdbeAddOp2(v, OP_RowData, iSrc, regData);
+      sqlite3VdbeAddOp3(v, OP_Insert, iDest, regData, regRowid);
+      sqlite3VdbeChangeP5(v, OPFLAG_APPEND);
+      sqlite3VdbeAddOp2(v, OP_Next, iSrc, addr1+1);
+      sqlite3VdbeJumpHere(v, addr1);
+      continue;
+    }
     pKey = sqlite3IndexKeyinfo(pParse, pSrcIdx);
     sqlite3VdbeAddOp4(v, OP_OpenRead, iSrc, pSrcIdx->tnum, iDbSrc,
                       (char*)pKey, P4_KEYINFO_HANDOFF);
@@ -22,6 +22,9 @@
 #ifdef SQLITE_ENABLE_RTREE
 # include "rtree.h"
 #endif
+#ifdef SQLITE_ENABLE_COLSTORE
+# include "colstore.h"
+#endif
 #ifdef SQLITE_ENABLE_ICU
 # include "sqliteicu.h"
 #endif
@@ -475,6 +478,13 @@ int sqlite3_config(int op, ...){
       break;
     }
 
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+    case SQLITE_CONFIG_SHARED_SCHEMA: {
+      sqlite3GlobalConfig.bSharedSchema = va_arg(ap, int);
+      break;
+    }
+#endif
+
     default: {
       rc = SQLITE_ERROR;
       break;
@@ -861,13 +871,16 @@ void sqlite3LeaveMutexAndCloseZombie(sqlite3 *db){
   ** go ahead and free all resources.
   */
 
-  /* Free any outstanding Savepoint structures. */
+  /* Free any outstanding Savepoint structures and any index entries
+  ** that were never written because the transaction did not commit. */
   sqlite3CloseSavepoints(db);
+  sqlite3VdbeIdxDeferDiscard(db);
 
   /* Close all database connections */
   for(j=0; j<db->nDb; j++){
     struct Db *pDb = &db->aDb[j];
     if( pDb->pBt ){
+      sqlite3SchemaShareRelease(db, j);
       sqlite3BtreeClose(pDb->pBt);
       pDb->pBt = 0;
       if( j!=1 ){
@@ -891,18 +904,17 @@ void sqlite3LeaveMutexAndCloseZombie(sqlite3 *db){
   */
   sqlite3ConnectionClosed(db);
 
-  for(j=0; j<ArraySize(db->aFunc.a); j++){
-    FuncDef *pNext, *pHash, *p;
-    for(p=db->aFunc.a[j]; p; p=pHash){
-      pHash = p->pHash;
-      while( p ){
-        functionDestroy(db, p);
-        pNext = p->pNext;
-        sqlite3DbFree(db, p);
-        p = pNext;
-      }
+  for(i=sqliteHashFirst(&db->aFunc); i; i=sqliteHashNext(i)){
+    FuncDef *pNext, *p;
+    p = (FuncDef*)sqliteHashData(i);
+    while( p ){
+      functionDestroy(db, p);
+      pNext = p->pNext;
+      sqlite3DbFree(db, p);
+      p = pNext;
     }
   }
+  sqlite3HashClear(&db->aFunc);
   for(i=sqliteHashFirst(&db->aCollSeq); i; i=sqliteHashNext(i)){
     CollSeq *pColl = (CollSeq *)sqliteHashData(i);
     /* Invoke any destructors registered for collation sequence user data. */
@@ -972,6 +984,7 @@ void sqlite3RollbackAll(sqlite3 *db, int tripCode){
     }
   }
   sqlite3VtabRollback(db);
+  sqlite3VdbeIdxDeferDiscard(db);
   sqlite3EndBenignMalloc();
 
   if( db->flags&SQLITE_InternChanges ){
@@ -1592,6 +1605,110 @@ int sqlite3_wal_checkpoint(sqlite3 *db, const char *zDb){
   return sqlite3_wal_checkpoint_v2(db, zDb, SQLITE_CHECKPOINT_PASSIVE, 0, 0);
 }
 
+/*
+** Sync the WAL file of database zDb, or of all attached databases if zDb
+** is NULL or a zero-length string, so that every transaction committed
+** by db is durable.
+*/
+int sqlite3_wal_sync(sqlite3 *db, const char *zDb){
+#ifdef SQLITE_OMIT_WAL
+  return SQLITE_OK;
+#else
+  int rc = SQLITE_OK;             /* Return code */
+  int iDb = SQLITE_MAX_ATTACHED;  /* sqlite3.aDb[] index of db to sync */
+  int i;                          /* Used to iterate through attached dbs */
+
+  sqlite3_mutex_enter(db->mutex);
+  if( zDb && zDb[0] ){
+    iDb = sqlite3FindDbName(db, zDb);
+  }
+  if( iDb<0 ){
+    rc = SQLITE_ERROR;
+    sqlite3Error(db, SQLITE_ERROR, "unknown database: %s", zDb);
+  }else{
+    for(i=0; i<db->nDb && rc==SQLITE_OK; i++){
+      Btree *pBt = db->aDb[i].pBt;
+      if( pBt && (i==iDb || iDb==SQLITE_MAX_ATTACHED) ){
+        sqlite3BtreeEnter(pBt);
+        rc = sqlite3PagerWalSync(sqlite3BtreePager(pBt));
+        sqlite3BtreeLeave(pBt);
+      }
+    }
+    sqlite3Error(db, rc, 0);
+  }
+  rc = sqlite3ApiExit(db, rc);
+  sqlite3_mutex_leave(db->mutex);
+  return rc;
+#endif
+}
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+/*
+** Obtain a snapshot handle for the snapshot of database zDb currently
+** being read by handle db.
+*/
+int sqlite3_snapshot_get(
+  sqlite3 *db,
+  const char *zDb,
+  sqlite3_snapshot **ppSnapshot
+){
+  int rc = SQLITE_ERROR;
+#ifndef SQLITE_OMIT_WAL
+  int iDb;
+
+  sqlite3_mutex_enter(db->mutex);
+  iDb = sqlite3FindDbName(db, zDb);
+  if( db->autoCommit==0 && (iDb==0 || iDb>1) ){
+    Btree *pBt = db->aDb[iDb].pBt;
+    if( 0==sqlite3BtreeIsInTrans(pBt) ){
+      rc = sqlite3BtreeBeginTrans(pBt, 0);
+      if( rc==SQLITE_OK ){
+        rc = sqlite3PagerSnapshotGet(sqlite3BtreePager(pBt), ppSnapshot);
+      }
+    }
+  }
+  sqlite3_mutex_leave(db->mutex);
+#endif   /* SQLITE_OMIT_WAL */
+  return rc;
+}
+
+/*
+** Open a read-transaction on the snapshot identified by pSnapshot.
+*/
+int sqlite3_snapshot_open(
+  sqlite3 *db,
+  const char *zDb,
+  sqlite3_snapshot *pSnapshot
+){
+  int rc = SQLITE_ERROR;
+#ifndef SQLITE_OMIT_WAL
+  int iDb;
+
+  sqlite3_mutex_enter(db->mutex);
+  iDb = sqlite3FindDbName(db, zDb);
+  if( db->autoCommit==0 && (iDb==0 || iDb>1) ){
+    Btree *pBt = db->aDb[iDb].pBt;
+    if( 0==sqlite3BtreeIsInReadTrans(pBt) ){
+      rc = sqlite3PagerSnapshotOpen(sqlite3BtreePager(pBt), pSnapshot);
+      if( rc==SQLITE_OK ){
+        rc = sqlite3BtreeBeginTrans(pBt, 0);
+        sqlite3PagerSnapshotOpen(sqlite3BtreePager(pBt), 0);
+      }
+    }
+  }
+  sqlite3_mutex_leave(db->mutex);
+#endif   /* SQLITE_OMIT_WAL */
+  return rc;
+}
+
+/*
+** Free a snapshot handle obtained from sqlite3_snapshot_get().
+*/
+void sqlite3_snapshot_free(sqlite3_snapshot *pSnapshot){
+  sqlite3_free(pSnapshot);
+}
+#endif /* SQLITE_ENABLE_SNAPSHOT */
+
 #ifndef SQLITE_OMIT_WAL
 /*
 ** Run a checkpoint on database iDb. This is a no-op if database iDb is
@@ -1805,11 +1922,19 @@ static int createCollation(
   */
   pColl = sqlite3FindCollSeq(db, (u8)enc2, zName, 0);
   if( pColl && pColl->xCmp ){
+    int rc;
     if( db->activeVdbeCnt ){
       sqlite3Error(db, SQLITE_BUSY, 
         "unable to delete/modify collation sequence due to active statements");
       return SQLITE_BUSY;
     }
+
+    /* Deferred index entries are sorted using the old collation. */
+    rc = sqlite3VdbeIdxDeferFlush(db);
+    if( rc!=SQLITE_OK ){
+      sqlite3Error(db, rc, 0);
+      return rc;
+    }
     sqlite3ExpirePreparedStatements(db);
 
     /* If collation sequence pColl was created directly by a call to
@@ -2293,10 +2418,12 @@ static int openDatabase(
                  | SQLITE_ForeignKeys
 #endif
       ;
+  sqlite3HashInit(&db->aFunc);
   sqlite3HashInit(&db->aCollSeq);
 #ifndef SQLITE_OMIT_VIRTUALTABLE
   sqlite3HashInit(&db->aModule);
 #endif
+  db->bSharedSchema = (u8)sqlite3GlobalConfig.bSharedSchema;
 
   /* Add the default collation sequence BINARY. BINARY works for both UTF-8
   ** and UTF-16, so add a version for each to avoid any unnecessary
@@ -2403,6 +2530,12 @@ static int openDatabase(
   }
 #endif
 
+#ifdef SQLITE_ENABLE_COLSTORE
+  if( !db->mallocFailed && rc==SQLITE_OK ){
+    rc = sqlite3ColstoreInit(db);
+  }
+#endif
+
   sqlite3Error(db, rc, 0);
 
   /* -DSQLITE_DEFAULT_LOCKING_MODE=1 makes EXCLUSIVE the default locking
@@ -2700,6 +2833,7 @@ int sqlite3_table_column_metadata(
   if( SQLITE_OK!=rc ){
     goto error_out;
   }
+  sqlite3SchemaShareEnter(db);
 
   /* Locate the table in question */
   pTab = sqlite3FindTable(db, zTableName, zDbName);
@@ -2752,6 +2886,7 @@ int sqlite3_table_column_metadata(
   }
 
 error_out:
+  sqlite3SchemaShareLeave(db);
   sqlite3BtreeLeaveAll(db);
 
   /* Whether the function call succeeded or failed, set the output parameters
@@ -253,6 +253,11 @@ int sqlite3OsCheckReservedLock(sqlite3_file *id, int *pResOut);
 int sqlite3OsFileControl(sqlite3_file*,int,void*);
 void sqlite3OsFileControlHint(sqlite3_file*,int,void*);
 #define SQLITE_FCNTL_DB_UNCHANGED 0xca093fa0
+#define SQLITE_FCNTL_FILE_ID      0xca093fa1
+#define SQLITE_FCNTL_BEGIN_BATCH  0xca093fa2
+#define SQLITE_FCNTL_END_BATCH    0xca093fa3
+#define SQLITE_FCNTL_DIRECT_IO    0xca093fa4
+#define SQLITE_FCNTL_GET_CHUNK    0xca093fa5
 int sqlite3OsSectorSize(sqlite3_file *id);
 int sqlite3OsDeviceCharacteristics(sqlite3_file *id);
 int sqlite3OsShmMap(sqlite3_file *,int,int,int,void volatile **);
@@ -123,6 +123,24 @@
 #include <sys/mman.h>
 #endif
 
+/*
+** The "unix-uring" VFS is only available on Linux builds that define
+** SQLITE_ENABLE_IO_URING and whose kernel headers know about io_uring.
+** It talks to the kernel through the raw system calls so that no extra
+** library is required.
+*/
+#if defined(SQLITE_ENABLE_IO_URING) && defined(__linux__)
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+# if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#  define SQLITE_UNIX_URING 1
+# endif
+#endif
+#ifndef SQLITE_UNIX_URING
+# define SQLITE_UNIX_URING 0
+#endif
+
 
 #if SQLITE_ENABLE_LOCKING_STYLE
 # include <sys/ioctl.h>
@@ -171,6 +189,16 @@
 # define SQLITE_DEFAULT_PROXYDIR_PERMISSIONS 0755
 #endif
 
+/*
+** Default chunk size (see SQLITE_FCNTL_CHUNK_SIZE) for database files, in
+** bytes.  If this is greater than zero, database files, and the WAL files
+** that follow them, grow by preallocated extents of this size instead of
+** one page or frame at a time.  Zero disables preallocation.
+*/
+#ifndef SQLITE_DEFAULT_CHUNK_SIZE
+# define SQLITE_DEFAULT_CHUNK_SIZE 0
+#endif
+
 /*
 ** Maximum supported path-length.
 */
@@ -187,6 +215,12 @@ typedef struct unixShm unixShm;               /* Connection shared memory */
 typedef struct unixShmNode unixShmNode;       /* Shared memory instance */
 typedef struct unixInodeInfo unixInodeInfo;   /* An i-node */
 typedef struct UnixUnusedFd UnixUnusedFd;     /* An unused file descriptor */
+#if SQLITE_UNIX_URING
+typedef struct UnixUring UnixUring;           /* An io_uring instance */
+#endif
+#ifdef O_DIRECT
+typedef struct UnixDirect UnixDirect;         /* O_DIRECT state */
+#endif
 
 /*
 ** Sometimes, after a file handle is closed by SQLite, the file descriptor
@@ -200,6 +234,46 @@ struct UnixUnusedFd {
   UnixUnusedFd *pNext;      /* Next unused file descriptor on same file */
 };
 
+#ifdef O_DIRECT
+/*
+** A database opened with the "direct=1" URI parameter, and the WAL file
+** that goes with it, use O_DIRECT so that their contents are cached by
+** the SQLite page cache only, and not by the operating system as well.
+**
+** O_DIRECT requires the offset, the size and the memory address of every
+** read() and write() to be a multiple of the device block size.  The
+** value returned by unixSectorSize() is used for this.  Requests that
+** are already aligned are passed straight through.  Others go through an
+** aligned bounce buffer.  Of an unaligned write, only the partial blocks
+** at either end are read back and written through the bounce buffer.
+** The whole blocks in between are written straight from the caller's
+** buffer if it is suitably aligned, and bounced along with the partial
+** blocks if not.  If the last block written extends past the end of the
+** data, the file is truncated back to size.  The read of that block
+** shows where the data ends, so the file size is never needed.
+**
+** Every WAL frame is unaligned and shares a block with the frame before
+** it.  So between SQLITE_FCNTL_BEGIN_BATCH and SQLITE_FCNTL_END_BATCH the
+** last block written is kept in memory, and appending the next frame
+** does not have to read it back.  The file is truncated, if need be, only
+** once, at the end of the batch.  A connection only writes a batch while
+** it holds the write lock, so no other connection can modify the file in
+** the meantime.
+*/
+struct UnixDirect {
+  int szAlign;                /* Alignment required by O_DIRECT */
+  int bBatch;                 /* True between BEGIN_BATCH and END_BATCH */
+  u8 *aBuf;                   /* Aligned bounce buffer */
+  int nBuf;                   /* Size of aBuf[] in bytes */
+  void *pBufAlloc;            /* Allocation containing aBuf[] */
+  i64 iSize;                  /* End of data written in a batch, or -1 */
+  int bTrunc;                 /* True if file must be truncated to iSize */
+  i64 iBlk;                   /* Offset of block in aBlk[], or -1 */
+  int nBlk;                   /* Bytes of file data in aBlk[] */
+  u8 *aBlk;                   /* Copy of the block at offset iBlk */
+};
+#endif
+
 /*
 ** The unixFile structure is subclass of sqlite3_file specific to the unix
 ** VFS implementations.
@@ -218,6 +292,12 @@ struct unixFile {
   const char *zPath;                  /* Name of the file */
   unixShm *pShm;                      /* Shared memory segment information */
   int szChunk;                        /* Configured by FCNTL_CHUNK_SIZE */
+#if SQLITE_UNIX_URING
+  UnixUring *pUring;                  /* io_uring state for "unix-uring" */
+#endif
+#ifdef O_DIRECT
+  UnixDirect *pDirect;                /* O_DIRECT state, if enabled */
+#endif
 #if SQLITE_ENABLE_LOCKING_STYLE
   int openFlags;                      /* The flags specified at open() */
 #endif
@@ -262,6 +342,7 @@ struct unixFile {
 #define UNIXFILE_DELETE      0x20     /* Delete on close */
 #define UNIXFILE_URI         0x40     /* Filename might have query parameters */
 #define UNIXFILE_NOLOCK      0x80     /* Do no file locking */
+#define UNIXFILE_NOURING     0x100    /* io_uring could not be set up */
 
 /*
 ** Include code that is common to all os_*.c files
@@ -1826,6 +1907,12 @@ static int closeUnixFile(sqlite3_file *id){
   OSTRACE(("CLOSE   %-3d\n", pFile->h));
   OpenCounter(-1);
   sqlite3_free(pFile->pUnused);
+#ifdef O_DIRECT
+  if( pFile->pDirect ){
+    sqlite3_free(pFile->pDirect->pBufAlloc);
+    sqlite3_free(pFile->pDirect);
+  }
+#endif
   memset(pFile, 0, sizeof(unixFile));
   return SQLITE_OK;
 }
@@ -3049,6 +3136,261 @@ static int seekAndRead(unixFile *id, sqlite3_int64 offset, void *pBuf, int cnt){
   return got+prior;
 }
 
+#ifdef O_DIRECT
+/*
+** True if buffer pBuf, size nByte and offset iOff all meet the alignment
+** requirements of O_DIRECT state p.
+*/
+#define unixDirectAligned(p, pBuf, nByte, iOff) \
+  ((((size_t)(pBuf)|(size_t)(nByte)|(size_t)(iOff)) & ((p)->szAlign-1))==0)
+
+/* Forward references */
+static int seekAndWrite(unixFile*, i64, const void*, int);
+static int unixSectorSize(sqlite3_file*);
+
+/*
+** Switch pFile to O_DIRECT.  If the file-system does not allow it, or if
+** a malloc fails, the file is quietly left as it is.
+*/
+static void unixDirectEnable(unixFile *pFile){
+  UnixDirect *p;
+  int szAlign = unixSectorSize((sqlite3_file*)pFile);
+  int flags;
+
+  if( pFile->pDirect ) return;
+  if( szAlign<512 || (szAlign & (szAlign-1))!=0 ) return;
+  p = (UnixDirect*)sqlite3_malloc(sizeof(UnixDirect) + szAlign);
+  if( p==0 ) return;
+  flags = osFcntl(pFile->h, F_GETFL);
+  if( flags<0 || osFcntl(pFile->h, F_SETFL, flags|O_DIRECT)!=0 ){
+    OSTRACE(("DIRECT  %-3d unsupported\n", pFile->h));
+    sqlite3_free(p);
+    return;
+  }
+  memset(p, 0, sizeof(UnixDirect));
+  p->szAlign = szAlign;
+  p->iSize = -1;
+  p->iBlk = -1;
+  p->aBlk = (u8*)&p[1];
+  pFile->pDirect = p;
+  OSTRACE(("DIRECT  %-3d align=%d\n", pFile->h, szAlign));
+}
+
+/*
+** Return a pointer to an aligned buffer of at least nByte bytes, or NULL
+** if a malloc fails.
+*/
+static u8 *unixDirectBuffer(UnixDirect *p, int nByte){
+  if( p->nBuf<nByte ){
+    void *pNew = sqlite3_malloc(nByte + p->szAlign);
+    if( pNew==0 ) return 0;
+    sqlite3_free(p->pBufAlloc);
+    p->pBufAlloc = pNew;
+    p->aBuf = (u8*)(((size_t)pNew + p->szAlign - 1) & ~(size_t)(p->szAlign-1));
+    p->nBuf = nByte;
+  }
+  return p->aBuf;
+}
+
+/*
+** Carry out any truncation deferred until the end of a batch.
+*/
+static int unixDirectSettle(unixFile *pFile){
+  UnixDirect *p = pFile->pDirect;
+  if( p && p->bTrunc ){
+    p->bTrunc = 0;
+    if( robust_ftruncate(pFile->h, p->iSize) ){
+      pFile->lastErrno = errno;
+      return unixLogError(SQLITE_IOERR_TRUNCATE, "ftruncate", pFile->zPath);
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Begin or end a batch of writes on a file using O_DIRECT.
+*/
+static int unixDirectBatch(unixFile *pFile, int bBegin){
+  UnixDirect *p = pFile->pDirect;
+  int rc = SQLITE_OK;
+  if( p ){
+    rc = unixDirectSettle(pFile);
+    p->bBatch = bBegin;
+    p->iSize = -1;
+    p->iBlk = -1;
+  }
+  return rc;
+}
+
+/*
+** An aligned write of nByte bytes at offset iOff has been made without
+** the bounce buffer.  Keep the state used within a batch up to date.
+*/
+static void unixDirectNoteWrite(unixFile *pFile, int nByte, i64 iOff){
+  UnixDirect *p = pFile->pDirect;
+  if( p->iBlk>=iOff && p->iBlk<iOff+nByte ) p->iBlk = -1;
+  if( p->iSize<iOff+nByte ) p->iSize = iOff+nByte;
+}
+
+/*
+** Read cnt bytes from offset iOff of a file using O_DIRECT via the bounce
+** buffer.  Return the number of bytes read, or -1 if an error occurs.
+*/
+static int unixDirectRead(unixFile *pFile, i64 iOff, void *pBuf, int cnt){
+  UnixDirect *p = pFile->pDirect;
+  i64 mask = p->szAlign-1;
+  i64 iFirst = iOff & ~mask;
+  int nSpan = (int)(((iOff+cnt+mask) & ~mask) - iFirst);
+  int iSkip = (int)(iOff - iFirst);
+  u8 *aBuf;
+  int got;
+
+  if( unixDirectSettle(pFile) ) return -1;
+  aBuf = unixDirectBuffer(p, nSpan);
+  if( aBuf==0 ){
+    pFile->lastErrno = ENOMEM;
+    return -1;
+  }
+  got = seekAndRead(pFile, iFirst, aBuf, nSpan);
+  if( got<0 ) return -1;
+  got -= iSkip;
+  if( got<0 ) got = 0;
+  if( got>cnt ) got = cnt;
+  memcpy(pBuf, &aBuf[iSkip], got);
+  return got;
+}
+
+/*
+** Load the block at offset iBlk of a file using O_DIRECT into aBlk[], and
+** set *pnData to the number of bytes of it that lie within the file.  The
+** rest of the block is zeroed.  Return SQLITE_OK, or an error code if the
+** read fails.
+*/
+static int unixDirectLoad(unixFile *pFile, i64 iBlk, u8 *aBlk, int *pnData){
+  UnixDirect *p = pFile->pDirect;
+  int got;
+  if( p->bBatch && iBlk==p->iBlk ){
+    memcpy(aBlk, p->aBlk, p->szAlign);
+    *pnData = p->nBlk;
+    return SQLITE_OK;
+  }
+  got = seekAndRead(pFile, iBlk, aBlk, p->szAlign);
+  if( got<0 ) return SQLITE_IOERR_READ;
+  memset(&aBlk[got], 0, p->szAlign-got);
+  *pnData = got;
+  return SQLITE_OK;
+}
+
+/*
+** Write amt bytes to offset iOff of a file using O_DIRECT via the bounce
+** buffer.  Return SQLITE_OK or an error code.
+*/
+static int unixDirectBounce(
+  unixFile *pFile,                /* File to write to */
+  i64 iOff,                       /* Offset to write at */
+  const void *pBuf,               /* Data to write */
+  int amt                         /* Size of pBuf in bytes */
+){
+  UnixDirect *p = pFile->pDirect;
+  int szAlign = p->szAlign;
+  i64 mask = szAlign-1;
+  i64 iFirst = iOff & ~mask;      /* Offset of first block written */
+  i64 iLast = (iOff+amt+mask) & ~mask;  /* Offset of end of last block */
+  int nSpan = (int)(iLast-iFirst);
+  int nData = szAlign;            /* Bytes of file data in last block */
+  i64 iEnd;                       /* End of file data after the write */
+  int rc = SQLITE_OK;
+  int wrote;
+  u8 *aBuf;
+
+  aBuf = unixDirectBuffer(p, nSpan);
+  if( aBuf==0 ) return SQLITE_IOERR_NOMEM;
+
+  /* Fill in the parts of the first and last blocks not being written */
+  if( iOff>iFirst ){
+    int nHead;
+    rc = unixDirectLoad(pFile, iFirst, aBuf, &nHead);
+    if( iLast-szAlign==iFirst ) nData = nHead;
+  }
+  if( rc==SQLITE_OK && iOff+amt<iLast
+   && (iLast-szAlign>iFirst || iOff==iFirst)
+  ){
+    rc = unixDirectLoad(pFile, iLast-szAlign, &aBuf[nSpan-szAlign], &nData);
+  }
+  if( rc!=SQLITE_OK ) return rc;
+  memcpy(&aBuf[iOff-iFirst], pBuf, amt);
+
+  wrote = seekAndWrite(pFile, iFirst, aBuf, nSpan);
+  if( wrote!=nSpan ){
+    if( wrote<0 && pFile->lastErrno!=ENOSPC ) return SQLITE_IOERR_WRITE;
+    pFile->lastErrno = 0;
+    return SQLITE_FULL;
+  }
+
+  /* Whole blocks were written, so the file may now extend past the end
+  ** of the data.  Truncate it back, now or at the end of the batch. */
+  iEnd = iLast - szAlign + nData;
+  if( iEnd<iOff+amt ) iEnd = iOff+amt;
+  if( p->bBatch ){
+    memcpy(p->aBlk, &aBuf[nSpan-szAlign], szAlign);
+    p->iBlk = iLast-szAlign;
+    p->nBlk = (int)(iEnd-p->iBlk);
+    if( p->iSize<iEnd ) p->iSize = iEnd;
+    if( iLast>iEnd ) p->bTrunc = 1;
+  }else if( iLast>iEnd ){
+    if( robust_ftruncate(pFile->h, iEnd) ){
+      pFile->lastErrno = errno;
+      return unixLogError(SQLITE_IOERR_TRUNCATE, "ftruncate", pFile->zPath);
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Write amt bytes to offset iOff of a file using O_DIRECT, where the
+** write is not aligned.  If the whole blocks it covers are at an aligned
+** address in pBuf, write them directly, and use the bounce buffer only
+** for the partial blocks at either end.  Otherwise bounce all of it.
+** Return SQLITE_OK or an error code.
+*/
+static int unixDirectWrite(
+  unixFile *pFile,                /* File to write to */
+  i64 iOff,                       /* Offset to write at */
+  const void *pBuf,               /* Data to write */
+  int amt                         /* Size of pBuf in bytes */
+){
+  UnixDirect *p = pFile->pDirect;
+  i64 mask = p->szAlign-1;
+  i64 iHead = (iOff+mask) & ~mask;      /* Start of first whole block */
+  i64 iTail = (iOff+amt) & ~mask;       /* End of last whole block */
+  const u8 *aWhole = &((const u8*)pBuf)[iHead-iOff];
+  int nWhole = (int)(iTail-iHead);
+  int rc = SQLITE_OK;
+  int wrote;
+
+  if( iTail<=iHead || ((size_t)aWhole & mask)!=0 ){
+    return unixDirectBounce(pFile, iOff, pBuf, amt);
+  }
+
+  /* Write the whole blocks first, so that the file already extends past
+  ** the first block when it is written, and does not need truncating. */
+  wrote = seekAndWrite(pFile, iHead, aWhole, nWhole);
+  if( wrote!=nWhole ){
+    if( wrote<0 && pFile->lastErrno!=ENOSPC ) return SQLITE_IOERR_WRITE;
+    pFile->lastErrno = 0;
+    return SQLITE_FULL;
+  }
+  unixDirectNoteWrite(pFile, nWhole, iHead);
+  if( iHead>iOff ){
+    rc = unixDirectBounce(pFile, iOff, pBuf, (int)(iHead-iOff));
+  }
+  if( rc==SQLITE_OK && iTail<iOff+amt ){
+    rc = unixDirectBounce(pFile, iTail, &aWhole[nWhole], (int)(iOff+amt-iTail));
+  }
+  return rc;
+}
+#endif /* O_DIRECT */
+
 /*
 ** Read data from a file into a buffer.  Return SQLITE_OK if all
 ** bytes were read successfully and SQLITE_IOERR if anything goes
@@ -3073,6 +3415,11 @@ static int unixRead(
   );
 #endif
 
+#ifdef O_DIRECT
+  if( pFile->pDirect && !unixDirectAligned(pFile->pDirect, pBuf, amt, offset) ){
+    got = unixDirectRead(pFile, offset, pBuf, amt);
+  }else
+#endif
   got = seekAndRead(pFile, offset, pBuf, amt);
   if( got==amt ){
     return SQLITE_OK;
@@ -3129,6 +3476,36 @@ static int seekAndWrite(unixFile *id, i64 offset, const void *pBuf, int cnt){
 }
 
 
+#ifdef SQLITE_DEBUG
+/*
+** If we are doing a normal write to a database file (as opposed to
+** doing a hot-journal rollback or a write to some file other than a
+** normal database file) then record the fact that the database
+** has changed.  If the transaction counter is modified, record that
+** fact too.
+*/
+static void unixRecordDbWrite(
+  unixFile *pFile,
+  const void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  if( pFile->inNormalWrite ){
+    pFile->dbUpdate = 1;  /* The database has been modified */
+    if( offset<=24 && offset+amt>=27 ){
+      int rc;
+      char oldCntr[4];
+      SimulateIOErrorBenign(1);
+      rc = seekAndRead(pFile, 24, oldCntr, 4);
+      SimulateIOErrorBenign(0);
+      if( rc!=4 || memcmp(oldCntr, &((char*)pBuf)[24-offset], 4)!=0 ){
+        pFile->transCntrChng = 1;  /* The transaction counter has changed */
+      }
+    }
+  }
+}
+#endif
+
 /*
 ** Write data from a buffer into a file.  Return SQLITE_OK on success
 ** or some other error code on failure.
@@ -3154,24 +3531,15 @@ static int unixWrite(
 #endif
 
 #ifdef SQLITE_DEBUG
-  /* If we are doing a normal write to a database file (as opposed to
-  ** doing a hot-journal rollback or a write to some file other than a
-  ** normal database file) then record the fact that the database
-  ** has changed.  If the transaction counter is modified, record that
-  ** fact too.
-  */
-  if( pFile->inNormalWrite ){
-    pFile->dbUpdate = 1;  /* The database has been modified */
-    if( offset<=24 && offset+amt>=27 ){
-      int rc;
-      char oldCntr[4];
-      SimulateIOErrorBenign(1);
-      rc = seekAndRead(pFile, 24, oldCntr, 4);
-      SimulateIOErrorBenign(0);
-      if( rc!=4 || memcmp(oldCntr, &((char*)pBuf)[24-offset], 4)!=0 ){
-        pFile->transCntrChng = 1;  /* The transaction counter has changed */
-      }
+  unixRecordDbWrite(pFile, pBuf, amt, offset);
+#endif
+
+#ifdef O_DIRECT
+  if( pFile->pDirect ){
+    if( !unixDirectAligned(pFile->pDirect, pBuf, amt, offset) ){
+      return unixDirectWrite(pFile, offset, pBuf, amt);
     }
+    unixDirectNoteWrite(pFile, amt, offset);
   }
 #endif
 
@@ -3393,6 +3761,10 @@ static int unixSync(sqlite3_file *id, int flags){
   SimulateDiskfullError( return SQLITE_FULL );
 
   assert( pFile );
+#ifdef O_DIRECT
+  rc = unixDirectSettle(pFile);
+  if( rc ) return rc;
+#endif
   OSTRACE(("SYNC    %-3d\n", pFile->h));
   rc = full_fsync(pFile->h, isFullsync, isDataOnly);
   SimulateIOError( rc=1 );
@@ -3439,6 +3811,13 @@ static int unixTruncate(sqlite3_file *id, i64 nByte){
     nByte = ((nByte + pFile->szChunk - 1)/pFile->szChunk) * pFile->szChunk;
   }
 
+#ifdef O_DIRECT
+  if( pFile->pDirect ){
+    pFile->pDirect->bTrunc = 0;
+    pFile->pDirect->iSize = nByte;
+    pFile->pDirect->iBlk = -1;
+  }
+#endif
   rc = robust_ftruncate(pFile->h, (off_t)nByte);
   if( rc ){
     pFile->lastErrno = errno;
@@ -3468,6 +3847,10 @@ static int unixFileSize(sqlite3_file *id, i64 *pSize){
   int rc;
   struct stat buf;
   assert( id );
+#ifdef O_DIRECT
+  rc = unixDirectSettle((unixFile*)id);
+  if( rc ) return rc;
+#endif
   rc = osFstat(((unixFile*)id)->h, &buf);
   SimulateIOError( rc=1 );
   if( rc!=0 ){
@@ -3537,7 +3920,13 @@ static int fcntlSizeHint(unixFile *pFile, i64 nByte){
       }
       iWrite = ((buf.st_size + 2*nBlk - 1)/nBlk)*nBlk-1;
       while( iWrite<nSize ){
-        int nWrite = seekAndWrite(pFile, iWrite, "", 1);
+        int nWrite;
+#ifdef O_DIRECT
+        if( pFile->pDirect ){
+          nWrite = unixDirectWrite(pFile, iWrite, "", 1)==SQLITE_OK;
+        }else
+#endif
+        nWrite = seekAndWrite(pFile, iWrite, "", 1);
         if( nWrite!=1 ) return SQLITE_IOERR_WRITE;
         iWrite += nBlk;
       }
@@ -3582,6 +3971,10 @@ static int unixFileControl(sqlite3_file *id, int op, void *pArg){
       pFile->szChunk = *(int *)pArg;
       return SQLITE_OK;
     }
+    case SQLITE_FCNTL_GET_CHUNK: {
+      *(int*)pArg = pFile->szChunk;
+      return SQLITE_OK;
+    }
     case SQLITE_FCNTL_SIZE_HINT: {
       int rc;
       SimulateIOErrorBenign(1);
@@ -3601,6 +3994,34 @@ static int unixFileControl(sqlite3_file *id, int op, void *pArg){
       *(char**)pArg = sqlite3_mprintf("%s", pFile->pVfs->zName);
       return SQLITE_OK;
     }
+#ifdef O_DIRECT
+    /* If the argument is positive, switch the file to O_DIRECT.  Either
+    ** way, report whether or not it now uses O_DIRECT.
+    */
+    case SQLITE_FCNTL_DIRECT_IO: {
+      if( *(int*)pArg>0 ) unixDirectEnable(pFile);
+      *(int*)pArg = pFile->pDirect!=0;
+      return SQLITE_OK;
+    }
+    case SQLITE_FCNTL_BEGIN_BATCH:
+    case SQLITE_FCNTL_END_BATCH: {
+      return unixDirectBatch(pFile, op==SQLITE_FCNTL_BEGIN_BATCH);
+    }
+#endif
+#if defined(SQLITE_ENABLE_SHARED_SCHEMA) && !OS_VXWORKS
+    /* Report the device and inode numbers of the file.  These identify
+    ** the file for as long as it remains open.
+    */
+    case SQLITE_FCNTL_FILE_ID: {
+      if( pFile->pInode ){
+        sqlite3_uint64 *aId = (sqlite3_uint64*)pArg;
+        aId[0] = (sqlite3_uint64)pFile->pInode->fileId.dev;
+        aId[1] = (sqlite3_uint64)pFile->pInode->fileId.ino;
+        return SQLITE_OK;
+      }
+      break;
+    }
+#endif
 #ifdef SQLITE_DEBUG
     /* The pager calls this method to signal that it has done
     ** a rollback and that the database is therefore unchanged and
@@ -4309,6 +4730,669 @@ static int unixShmUnmap(
 # define unixShmUnmap   0
 #endif /* #ifndef SQLITE_OMIT_WAL */
 
+#if SQLITE_UNIX_URING
+/*
+******************************************************************************
+************************* Begin io_uring I/O methods *************************
+**
+** The "unix-uring" VFS uses the same POSIX advisory locks and the same
+** shared-memory wal-index as "unix".  Only the xRead, xWrite and xSync
+** methods differ.
+**
+** Outside of a write batch every method behaves exactly like its "unix"
+** counterpart.  The pager and the WAL layer bracket the loops that
+** write many pages at once (pager_write_pagelist() and sqlite3WalFrames())
+** with the SQLITE_FCNTL_BEGIN_BATCH and SQLITE_FCNTL_END_BATCH
+** file-controls.  Between the two:
+**
+**   *  xWrite copies the buffer and queues an IORING_OP_WRITE request
+**      instead of calling pwrite().  Requests are handed to the kernel in
+**      groups of up to SQLITE_URING_ENTRIES with a single io_uring_enter()
+**      call, so the writes proceed in parallel.
+**
+**   *  xSync queues an IORING_OP_FSYNC with the IOSQE_IO_DRAIN flag, so
+**      that the kernel does not start it until every write queued before
+**      it has completed.  The remaining writes and the sync are handed
+**      to the kernel with a single io_uring_enter() call, and xSync then
+**      waits for the sync to finish.  Because it waits, a write made
+**      after xSync returns, to this file or to any other, can never
+**      reach the disk ahead of the writes that the sync covers.
+**
+**   *  Any other method, and SQLITE_FCNTL_END_BATCH, waits for every
+**      queued request first.  Errors from queued requests are reported
+**      by SQLITE_FCNTL_END_BATCH, or by whichever method had to wait.
+**
+** Reads are always synchronous.  But when xRead notices that it is being
+** called on consecutive ranges of the file, it queues an IORING_OP_FADVISE
+** request that asks the kernel to start reading the next
+** SQLITE_URING_PREFETCH bytes in the background, and does not wait for it.
+**
+** The io_uring instance is created the first time a file needs it.  If
+** that fails, for example because the kernel is too old or because
+** io_uring is disabled, the file silently falls back to synchronous I/O.
+*/
+#ifndef SQLITE_URING_ENTRIES
+# define SQLITE_URING_ENTRIES 64
+#endif
+#ifndef SQLITE_URING_PREFETCH
+# define SQLITE_URING_PREFETCH (256*1024)
+#endif
+
+/*
+** Values for UringSlot.eOp
+*/
+#define URING_OP_WRITE   1        /* A queued write */
+#define URING_OP_FSYNC   2        /* A queued fsync */
+#define URING_OP_ADVISE  3        /* A read-ahead hint.  Errors ignored */
+
+/*
+** One of these is allocated for each request queued on the ring.  The
+** index of the slot is used as the io_uring user_data value.
+*/
+typedef struct UringSlot UringSlot;
+struct UringSlot {
+  u8 eOp;                     /* One of the URING_OP_* values */
+  int nByte;                  /* Size of write in bytes */
+  i64 iOff;                   /* Offset of write */
+  u8 *aBuf;                   /* Allocation holding aData[] */
+  u8 *aData;                  /* Copy of data to write */
+};
+
+/*
+** An instance of this structure is attached to each unixFile opened by
+** the "unix-uring" VFS, once it has been needed.
+*/
+struct UnixUring {
+  int fd;                     /* File descriptor of the io_uring instance */
+  u32 nEntry;                 /* Number of submission queue entries */
+  u8 *pRing;                  /* Mapping of the SQ and CQ rings */
+  size_t szRing;              /* Size of mapping pRing in bytes */
+  struct io_uring_sqe *aSqe;  /* Mapping of the SQE array */
+  size_t szSqe;               /* Size of mapping aSqe in bytes */
+  u32 *pSqTail;               /* Submission queue tail */
+  u32 sqMask;                 /* Submission queue index mask */
+  u32 *aSqArray;              /* Submission queue index array */
+  u32 *pCqHead;               /* Completion queue head */
+  u32 *pCqTail;               /* Completion queue tail */
+  u32 cqMask;                 /* Completion queue index mask */
+  struct io_uring_cqe *aCqe;  /* Completion queue entries */
+  UringSlot *aSlot;           /* Array of nEntry request slots */
+  u32 nSlot;                  /* Slots used since the last uringWait() */
+  u32 nPending;               /* Requests queued but not yet submitted */
+  u32 nInflight;              /* Requests submitted but not yet completed */
+  int bBatch;                 /* True between BEGIN_BATCH and END_BATCH */
+  int bDirty;                 /* True if writes or syncs are outstanding */
+  int bResync;                /* A write was finished after a sync began */
+  int rc;                     /* First error from a queued request */
+  int errNo;                  /* errno value associated with rc */
+  i64 iReadNext;              /* Offset following the most recent xRead */
+  i64 iPrefetch;              /* Read-ahead has been requested up to here */
+};
+
+/*
+** Wrappers around the io_uring system calls.
+*/
+static int uringSetup(u32 nEntry, struct io_uring_params *pParam){
+  return (int)syscall(__NR_io_uring_setup, nEntry, pParam);
+}
+static int uringEnter(int fd, u32 nSubmit, u32 nWait){
+  return (int)syscall(__NR_io_uring_enter, fd, nSubmit, nWait,
+                      nWait ? IORING_ENTER_GETEVENTS : 0, (void*)0, 0);
+}
+
+/*
+** Release all resources held by io_uring instance p.  Any requests still
+** in flight are abandoned, so the caller should normally use uringWait()
+** first.
+*/
+static void uringFree(UnixUring *p){
+  u32 i;
+  for(i=0; i<p->nSlot; i++) sqlite3_free(p->aSlot[i].aBuf);
+  if( p->aSqe ) munmap((void*)p->aSqe, p->szSqe);
+  if( p->pRing ) munmap((void*)p->pRing, p->szRing);
+  if( p->fd>=0 ) osClose(p->fd);
+  sqlite3_free(p->aSlot);
+  sqlite3_free(p);
+}
+
+/*
+** Make sure pFile->pUring is set up.  Return non-zero if it is, or zero
+** if io_uring is not usable for this file, in which case the caller
+** should do its I/O synchronously.
+*/
+static int uringInit(unixFile *pFile){
+  struct io_uring_params prm;
+  UnixUring *p;
+  u8 *pRing;
+  size_t szSq, szCq;
+
+  if( pFile->pUring ) return 1;
+  if( pFile->ctrlFlags & UNIXFILE_NOURING ) return 0;
+  pFile->ctrlFlags |= UNIXFILE_NOURING;
+
+  p = sqlite3_malloc(sizeof(UnixUring));
+  if( p==0 ) return 0;
+  memset(p, 0, sizeof(UnixUring));
+  p->aSlot = sqlite3_malloc(sizeof(UringSlot)*SQLITE_URING_ENTRIES);
+  memset(&prm, 0, sizeof(prm));
+  p->fd = p->aSlot ? uringSetup(SQLITE_URING_ENTRIES, &prm) : -1;
+
+  /* IORING_FEAT_RW_CUR_POS first appeared in the same kernel release as
+  ** IORING_OP_WRITE and IORING_OP_FADVISE, so it is used to decide whether
+  ** or not those requests are supported. */
+  if( p->fd<0
+   || (prm.features & IORING_FEAT_SINGLE_MMAP)==0
+   || (prm.features & IORING_FEAT_RW_CUR_POS)==0
+  ){
+    OSTRACE(("URING   %-3d unavailable\n", pFile->h));
+    uringFree(p);
+    return 0;
+  }
+
+  /* The SQ and CQ rings share a single mapping */
+  szSq = prm.sq_off.array + prm.sq_entries*sizeof(u32);
+  szCq = prm.cq_off.cqes + prm.cq_entries*sizeof(struct io_uring_cqe);
+  p->szRing = szSq>szCq ? szSq : szCq;
+  pRing = (u8*)mmap(0, p->szRing, PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE, p->fd, IORING_OFF_SQ_RING);
+  if( pRing==MAP_FAILED ){
+    uringFree(p);
+    return 0;
+  }
+  p->pRing = pRing;
+  p->szSqe = prm.sq_entries*sizeof(struct io_uring_sqe);
+  p->aSqe = (struct io_uring_sqe*)mmap(0, p->szSqe, PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE, p->fd, IORING_OFF_SQES);
+  if( p->aSqe==MAP_FAILED ){
+    p->aSqe = 0;
+    uringFree(p);
+    return 0;
+  }
+
+  p->nEntry = prm.sq_entries<SQLITE_URING_ENTRIES ?
+                 prm.sq_entries : SQLITE_URING_ENTRIES;
+  p->pSqTail = (u32*)&pRing[prm.sq_off.tail];
+  p->sqMask = *(u32*)&pRing[prm.sq_off.ring_mask];
+  p->aSqArray = (u32*)&pRing[prm.sq_off.array];
+  p->pCqHead = (u32*)&pRing[prm.cq_off.head];
+  p->pCqTail = (u32*)&pRing[prm.cq_off.tail];
+  p->cqMask = *(u32*)&pRing[prm.cq_off.ring_mask];
+  p->aCqe = (struct io_uring_cqe*)&pRing[prm.cq_off.cqes];
+
+  OSTRACE(("URING   %-3d entries=%d\n", pFile->h, p->nEntry));
+  pFile->ctrlFlags &= ~UNIXFILE_NOURING;
+  pFile->pUring = p;
+  return 1;
+}
+
+/*
+** Record error rc, with errno value errNo, against the current batch.
+** Only the first error is kept.
+*/
+static void uringSetError(UnixUring *p, int rc, int errNo){
+  if( p->rc==SQLITE_OK ){
+    p->rc = rc;
+    p->errNo = errNo;
+  }
+}
+
+/*
+** Process the result of the request that used slot iSlot.  A write that
+** completed only partially is finished synchronously.
+*/
+static void uringComplete(unixFile *pFile, u32 iSlot, int res){
+  UnixUring *p = pFile->pUring;
+  UringSlot *pSlot = &p->aSlot[iSlot];
+  switch( pSlot->eOp ){
+    case URING_OP_WRITE: {
+      int nDone = res;
+      if( nDone>0 && nDone<pSlot->nByte ) p->bResync = 1;
+      while( nDone>0 && nDone<pSlot->nByte ){
+        int n = seekAndWrite(pFile, pSlot->iOff+nDone, &pSlot->aData[nDone],
+                             pSlot->nByte-nDone);
+        if( n<=0 ){
+          res = n<0 ? -pFile->lastErrno : 0;
+          break;
+        }
+        nDone += n;
+      }
+      if( res<0 && res!=-ENOSPC ){
+        uringSetError(p, SQLITE_IOERR_WRITE, -res);
+      }else if( nDone<pSlot->nByte ){
+        uringSetError(p, SQLITE_FULL, 0);
+      }
+      sqlite3_free(pSlot->aBuf);
+      pSlot->aBuf = 0;
+      break;
+    }
+    case URING_OP_FSYNC: {
+      if( res<0 ) uringSetError(p, SQLITE_IOERR_FSYNC, -res);
+      break;
+    }
+    default: {
+      assert( pSlot->eOp==URING_OP_ADVISE );
+      break;
+    }
+  }
+}
+
+/*
+** Process every completion that the kernel has posted so far.
+*/
+static void uringReap(unixFile *pFile){
+  UnixUring *p = pFile->pUring;
+  u32 iHead = *p->pCqHead;
+  u32 iTail = __atomic_load_n(p->pCqTail, __ATOMIC_ACQUIRE);
+  while( iHead!=iTail ){
+    struct io_uring_cqe *pCqe = &p->aCqe[iHead & p->cqMask];
+    assert( p->nInflight>0 && pCqe->user_data<p->nSlot );
+    uringComplete(pFile, (u32)pCqe->user_data, pCqe->res);
+    p->nInflight--;
+    iHead++;
+  }
+  __atomic_store_n(p->pCqHead, iHead, __ATOMIC_RELEASE);
+}
+
+/*
+** The kernel has refused to accept the p->nPending requests at the end
+** of the submission queue.  Take them back and record an error, unless
+** they were only read-ahead hints.
+*/
+static void uringWithdraw(UnixUring *p, int errNo){
+  __atomic_store_n(p->pSqTail, *p->pSqTail - p->nPending, __ATOMIC_RELEASE);
+  while( p->nPending>0 ){
+    UringSlot *pSlot = &p->aSlot[--p->nSlot];
+    if( pSlot->eOp==URING_OP_WRITE ){
+      uringSetError(p, SQLITE_IOERR_WRITE, errNo);
+    }else if( pSlot->eOp==URING_OP_FSYNC ){
+      uringSetError(p, SQLITE_IOERR_FSYNC, errNo);
+    }
+    sqlite3_free(pSlot->aBuf);
+    pSlot->aBuf = 0;
+    p->nPending--;
+  }
+}
+
+/*
+** Pass all queued requests to the kernel.  If bWait is true, also wait
+** for every request in flight to complete.
+*/
+static void uringSubmit(unixFile *pFile, int bWait){
+  UnixUring *p = pFile->pUring;
+  while( 1 ){
+    u32 nWait;
+    int n;
+    uringReap(pFile);
+    nWait = bWait ? p->nInflight + p->nPending : 0;
+    if( p->nPending==0 && nWait==0 ) break;
+    n = uringEnter(p->fd, p->nPending, nWait);
+    if( n<0 && errno==EINTR ) continue;
+    if( n<0 || (n==0 && p->nPending>0) ){
+      int errNo = n<0 ? errno : EAGAIN;
+      OSTRACE(("URING   %-3d enter failed errno=%d\n", pFile->h, errNo));
+      if( p->nPending==0 ){
+        /* Waiting for requests already in flight failed. They will
+        ** be reaped by some later call. */
+        uringSetError(p, SQLITE_IOERR_WRITE, errNo);
+        break;
+      }
+      uringWithdraw(p, errNo);
+      continue;
+    }
+    assert( (u32)n<=p->nPending );
+    p->nPending -= n;
+    p->nInflight += n;
+  }
+}
+
+/*
+** Submit all queued requests and wait for them, and for any others still
+** in flight, to complete.
+*/
+static void uringWait(unixFile *pFile){
+  UnixUring *p = pFile->pUring;
+  uringSubmit(pFile, 1);
+  if( p->nInflight==0 ){
+    p->nSlot = 0;
+    p->bDirty = 0;
+  }
+}
+
+/*
+** Wait for all outstanding writes and syncs on pFile to complete.  Return
+** SQLITE_OK if they all succeeded, or the error code for the first one
+** that failed otherwise.
+*/
+static int uringFlush(unixFile *pFile){
+  UnixUring *p = pFile->pUring;
+  int rc = SQLITE_OK;
+  if( p ){
+    if( p->bDirty ) uringWait(pFile);
+    rc = p->rc;
+    if( rc!=SQLITE_OK ){
+      pFile->lastErrno = p->errNo;
+      p->rc = SQLITE_OK;
+    }
+  }
+  return rc;
+}
+
+/*
+** Add a request of type eOp to the submission queue of pFile.  For
+** URING_OP_WRITE requests, nByte bytes of data at aData are written, and
+** ownership of allocation aBuf, which contains aData, passes to the queue.
+** For URING_OP_ADVISE requests, iOff and nByte identify the range that
+** will soon be read.
+**
+** The request is not passed to the kernel until uringSubmit() is next
+** called.  Return non-zero if the request was queued, or zero if there
+** is no room for it, in which case the caller must deal with it some
+** other way.
+*/
+static int uringQueue(
+  unixFile *pFile,                /* File to queue request for */
+  int eOp,                        /* URING_OP_* value */
+  u8 *aBuf,                       /* Allocation to free, or NULL */
+  u8 *aData,                      /* Data to write, or NULL */
+  int nByte,                      /* Size of request in bytes */
+  i64 iOff                        /* Offset of request */
+){
+  UnixUring *p = pFile->pUring;
+  UringSlot *pSlot;
+  struct io_uring_sqe *pSqe;
+  u32 iTail;
+  u32 iSlot;
+
+  if( p->nSlot>=p->nEntry ){
+    uringWait(pFile);
+    if( p->nSlot>=p->nEntry ) return 0;
+  }
+  iSlot = p->nSlot++;
+  pSlot = &p->aSlot[iSlot];
+  pSlot->eOp = (u8)eOp;
+  pSlot->nByte = nByte;
+  pSlot->iOff = iOff;
+  pSlot->aBuf = aBuf;
+  pSlot->aData = aData;
+
+  iTail = *p->pSqTail;
+  pSqe = &p->aSqe[iTail & p->sqMask];
+  memset(pSqe, 0, sizeof(*pSqe));
+  pSqe->fd = pFile->h;
+  pSqe->user_data = iSlot;
+  switch( eOp ){
+    case URING_OP_WRITE:
+      pSqe->opcode = IORING_OP_WRITE;
+      pSqe->addr = (u64)(size_t)aData;
+      pSqe->len = (u32)nByte;
+      pSqe->off = (u64)iOff;
+      break;
+    case URING_OP_FSYNC:
+      pSqe->opcode = IORING_OP_FSYNC;
+      pSqe->flags = IOSQE_IO_DRAIN;
+      break;
+    default:
+      assert( eOp==URING_OP_ADVISE );
+      pSqe->opcode = IORING_OP_FADVISE;
+      pSqe->len = (u32)nByte;
+      pSqe->off = (u64)iOff;
+      pSqe->fadvise_advice = POSIX_FADV_WILLNEED;
+      break;
+  }
+  p->aSqArray[iTail & p->sqMask] = iTail & p->sqMask;
+  __atomic_store_n(p->pSqTail, iTail+1, __ATOMIC_RELEASE);
+  p->nPending++;
+  return 1;
+}
+
+/*
+** Wait for outstanding requests and release the io_uring instance, if
+** any, belonging to pFile.
+*/
+static void uringRelease(unixFile *pFile){
+  if( pFile->pUring ){
+    uringFlush(pFile);
+    uringFree(pFile->pUring);
+    pFile->pUring = 0;
+  }
+}
+
+/*
+** Close a file opened by the "unix-uring" VFS.  There are two versions,
+** one for files that use POSIX advisory locks and one for files, such as
+** journals and WAL files, that do no locking.
+*/
+static int uringClose(sqlite3_file *id){
+  uringRelease((unixFile*)id);
+  return unixClose(id);
+}
+static int uringNolockClose(sqlite3_file *id){
+  uringRelease((unixFile*)id);
+  return nolockClose(id);
+}
+
+/*
+** Read data from a file.  If this read continues on from where the
+** previous one left off, ask the kernel to start reading ahead.
+*/
+static int uringRead(
+  sqlite3_file *id,
+  void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  UnixUring *p;
+  int rc;
+
+  rc = uringFlush(pFile);
+  if( rc==SQLITE_OK ){
+    rc = unixRead(id, pBuf, amt, offset);
+  }
+  if( rc==SQLITE_OK && SQLITE_URING_PREFETCH>0 && uringInit(pFile)
+#ifdef O_DIRECT
+   && pFile->pDirect==0
+#endif
+  ){
+    i64 iEnd = offset + amt;
+    p = pFile->pUring;
+    if( offset==p->iReadNext && iEnd+SQLITE_URING_PREFETCH/2>p->iPrefetch ){
+      i64 iStart = iEnd>p->iPrefetch ? iEnd : p->iPrefetch;
+      i64 iLimit = iEnd + SQLITE_URING_PREFETCH;
+      int nAdvise = (int)(iLimit-iStart);
+      if( uringQueue(pFile, URING_OP_ADVISE, 0, 0, nAdvise, iStart) ){
+        uringSubmit(pFile, 0);
+        p->iPrefetch = iLimit;
+      }
+    }
+    p->iReadNext = iEnd;
+  }
+  return rc;
+}
+
+/*
+** Write data to a file.  Within a batch the write is queued and this
+** routine returns without waiting for it.
+*/
+static int uringWrite(
+  sqlite3_file *id,
+  const void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  UnixUring *p = pFile->pUring;
+  size_t szAlign = 1;             /* Required alignment of copy */
+  u8 *aBuf;
+  u8 *aData;
+
+  assert( amt>0 );
+  if( p==0 || p->bBatch==0 ){
+    return unixWrite(id, pBuf, amt, offset);
+  }
+  SimulateIOError( return SQLITE_IOERR_WRITE );
+  SimulateDiskfullError( return SQLITE_FULL );
+
+#ifdef O_DIRECT
+  /* With O_DIRECT, only aligned writes can be queued.  Others are a
+  ** read-modify-write, which must see all earlier writes. */
+  if( pFile->pDirect ){
+    if( !unixDirectAligned(pFile->pDirect, 0, amt, offset) ){
+      int rc = uringFlush(pFile);
+      return rc ? rc : unixWrite(id, pBuf, amt, offset);
+    }
+    szAlign = pFile->pDirect->szAlign;
+  }
+#endif
+
+  aBuf = (u8*)sqlite3_malloc(amt + (int)szAlign - 1);
+  if( aBuf==0 ){
+    return unixWrite(id, pBuf, amt, offset);
+  }
+  aData = (u8*)(((size_t)aBuf + szAlign - 1) & ~(szAlign - 1));
+  memcpy(aData, pBuf, amt);
+#ifdef SQLITE_DEBUG
+  unixRecordDbWrite(pFile, pBuf, amt, offset);
+#endif
+  if( uringQueue(pFile, URING_OP_WRITE, aBuf, aData, amt, offset)==0 ){
+    sqlite3_free(aBuf);
+    return unixWrite(id, pBuf, amt, offset);
+  }
+#ifdef O_DIRECT
+  if( pFile->pDirect ) unixDirectNoteWrite(pFile, amt, offset);
+#endif
+  p->bDirty = 1;
+  OSTRACE(("QWRITE  %-3d %5d %7lld\n", pFile->h, amt, offset));
+
+  /* Hand requests to the kernel in groups so that it can start on them
+  ** while the caller prepares the rest. */
+  if( p->nPending>=p->nEntry/4 ){
+    uringSubmit(pFile, 0);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Make all prior writes to a file durable.  Within a batch, the sync is
+** queued behind the outstanding writes and submitted together with them,
+** and this routine waits for it to complete.
+*/
+static int uringSync(sqlite3_file *id, int flags){
+  unixFile *pFile = (unixFile*)id;
+  UnixUring *p = pFile->pUring;
+  int rc;
+
+#ifndef SQLITE_NO_SYNC
+  /* A sync that must also sync the directory is done synchronously. */
+  if( p && p->bBatch && (pFile->ctrlFlags & UNIXFILE_DIRSYNC)==0 ){
+    SimulateDiskfullError( return SQLITE_FULL );
+    SimulateIOError( return SQLITE_IOERR_FSYNC );
+#ifdef O_DIRECT
+    /* A deferred truncation must wait for the writes before it */
+    if( pFile->pDirect && pFile->pDirect->bTrunc ){
+      uringWait(pFile);
+      rc = unixDirectSettle(pFile);
+      if( rc ) return rc;
+    }
+#endif
+    if( uringQueue(pFile, URING_OP_FSYNC, 0, 0, 0, 0) ){
+#ifdef SQLITE_TEST
+      if( (flags&0x0F)==SQLITE_SYNC_FULL ) sqlite3_fullsync_count++;
+      sqlite3_sync_count++;
+#endif
+      OSTRACE(("QSYNC   %-3d\n", pFile->h));
+      p->bDirty = 1;
+      rc = uringFlush(pFile);
+
+      /* If part of a write had to be retried with pwrite(), the retry
+      ** may have happened after the fsync, so sync once more. */
+      if( p->bResync ){
+        p->bResync = 0;
+        if( rc==SQLITE_OK ) rc = unixSync(id, flags);
+      }
+      return rc;
+    }
+  }
+#endif
+
+  rc = uringFlush(pFile);
+  if( rc==SQLITE_OK ){
+    if( p ) p->bResync = 0;
+    rc = unixSync(id, flags);
+  }
+  return rc;
+}
+
+/*
+** Truncate a file, once all outstanding writes have completed.
+*/
+static int uringTruncate(sqlite3_file *id, i64 nByte){
+  int rc = uringFlush((unixFile*)id);
+  if( rc==SQLITE_OK ){
+    rc = unixTruncate(id, nByte);
+  }
+  return rc;
+}
+
+/*
+** Determine the size of a file, once all outstanding writes have
+** completed.
+*/
+static int uringFileSize(sqlite3_file *id, i64 *pSize){
+  int rc = uringFlush((unixFile*)id);
+  if( rc==SQLITE_OK ){
+    rc = unixFileSize(id, pSize);
+  }
+  return rc;
+}
+
+/*
+** Outstanding writes must reach the file before a lock that protects
+** them is released.
+*/
+static int uringUnlock(sqlite3_file *id, int eFileLock){
+  int rc = uringFlush((unixFile*)id);
+  if( rc==SQLITE_OK ){
+    rc = unixUnlock(id, eFileLock);
+  }else{
+    unixUnlock(id, eFileLock);
+  }
+  return rc;
+}
+
+/*
+** Information and control of a file opened by the "unix-uring" VFS.
+*/
+static int uringFileControl(sqlite3_file *id, int op, void *pArg){
+  unixFile *pFile = (unixFile*)id;
+  int rc;
+  switch( op ){
+    case SQLITE_FCNTL_BEGIN_BATCH: {
+      if( uringInit(pFile) ) pFile->pUring->bBatch = 1;
+      break;
+    }
+    case SQLITE_FCNTL_END_BATCH: {
+      if( pFile->pUring ) pFile->pUring->bBatch = 0;
+      break;
+    }
+  }
+
+  /* The batch must end in unixFileControl() too, even after an error. */
+  rc = uringFlush(pFile);
+  if( rc==SQLITE_OK || op==SQLITE_FCNTL_END_BATCH ){
+    int rc2 = unixFileControl(id, op, pArg);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  return rc;
+}
+
+/*
+** Here ends the implementation of the io_uring I/O methods.
+**
+************************** End io_uring I/O methods **************************
+******************************************************************************/
+#endif /* SQLITE_UNIX_URING */
+
 /*
 ** Here ends the implementation of all sqlite3_file methods.
 **
@@ -4483,6 +5567,59 @@ IOMETHODS(
 )
 #endif
 
+#if SQLITE_UNIX_URING
+/*
+** The "unix-uring" VFS uses POSIX advisory locks, like "unix", but its
+** own read, write and sync methods.  The IOMETHODS macro cannot be used
+** because it always uses the "unix" versions of those.  Files opened
+** without locking, including all WAL files, use uringNolockIoMethods.
+*/
+static const sqlite3_io_methods uringIoMethods = {
+   2,                          /* iVersion */
+   uringClose,                 /* xClose */
+   uringRead,                  /* xRead */
+   uringWrite,                 /* xWrite */
+   uringTruncate,              /* xTruncate */
+   uringSync,                  /* xSync */
+   uringFileSize,              /* xFileSize */
+   unixLock,                   /* xLock */
+   uringUnlock,                /* xUnlock */
+   unixCheckReservedLock,      /* xCheckReservedLock */
+   uringFileControl,           /* xFileControl */
+   unixSectorSize,             /* xSectorSize */
+   unixDeviceCharacteristics,  /* xDeviceCapabilities */
+   unixShmMap,                 /* xShmMap */
+   unixShmLock,                /* xShmLock */
+   unixShmBarrier,             /* xShmBarrier */
+   unixShmUnmap                /* xShmUnmap */
+};
+static const sqlite3_io_methods uringNolockIoMethods = {
+   1,                          /* iVersion */
+   uringNolockClose,           /* xClose */
+   uringRead,                  /* xRead */
+   uringWrite,                 /* xWrite */
+   uringTruncate,              /* xTruncate */
+   uringSync,                  /* xSync */
+   uringFileSize,              /* xFileSize */
+   nolockLock,                 /* xLock */
+   nolockUnlock,               /* xUnlock */
+   nolockCheckReservedLock,    /* xCheckReservedLock */
+   uringFileControl,           /* xFileControl */
+   unixSectorSize,             /* xSectorSize */
+   unixDeviceCharacteristics,  /* xDeviceCapabilities */
+   0,                          /* xShmMap */
+   0,                          /* xShmLock */
+   0,                          /* xShmBarrier */
+   0                           /* xShmUnmap */
+};
+static const sqlite3_io_methods *uringIoFinderImpl(const char *z, unixFile *p){
+  UNUSED_PARAMETER(z); UNUSED_PARAMETER(p);
+  return &uringIoMethods;
+}
+static const sqlite3_io_methods *(*const uringIoFinder)(const char*,unixFile *p)
+    = uringIoFinderImpl;
+#endif /* SQLITE_UNIX_URING */
+
 #if defined(__APPLE__) && SQLITE_ENABLE_LOCKING_STYLE
 /* 
 ** This "finder" function attempts to determine the best locking strategy 
@@ -4653,6 +5790,11 @@ static int fillInUnixFile(
 
   if( ctrlFlags & UNIXFILE_NOLOCK ){
     pLockingStyle = &nolockIoMethods;
+#if SQLITE_UNIX_URING
+    if( pVfs->pAppData==(void*)&uringIoFinder ){
+      pLockingStyle = &uringNolockIoMethods;
+    }
+#endif
   }else{
     pLockingStyle = (**(finder_type*)pVfs->pAppData)(zFilename, pNew);
 #if SQLITE_ENABLE_LOCKING_STYLE
@@ -4666,6 +5808,9 @@ static int fillInUnixFile(
   if( pLockingStyle == &posixIoMethods
 #if defined(__APPLE__) && SQLITE_ENABLE_LOCKING_STYLE
     || pLockingStyle == &nfsIoMethods
+#endif
+#if SQLITE_UNIX_URING
+    || pLockingStyle == &uringIoMethods
 #endif
   ){
     unixEnterMutex();
@@ -5258,6 +6403,22 @@ static int unixOpen(
   
   rc = fillInUnixFile(pVfs, fd, pFile, zPath, ctrlFlags);
 
+#if SQLITE_DEFAULT_CHUNK_SIZE>0
+  if( rc==SQLITE_OK && eType==SQLITE_OPEN_MAIN_DB ){
+    p->szChunk = SQLITE_DEFAULT_CHUNK_SIZE;
+  }
+#endif
+
+#ifdef O_DIRECT
+  /* The "direct=1" URI parameter asks for the database file to bypass the
+  ** operating system cache.  The WAL file follows the database file. */
+  if( rc==SQLITE_OK && eType==SQLITE_OPEN_MAIN_DB
+   && sqlite3_uri_boolean(((flags & SQLITE_OPEN_URI) ? zName : 0), "direct", 0)
+  ){
+    unixDirectEnable(p);
+  }
+#endif
+
 open_finished:
   if( rc!=SQLITE_OK ){
     sqlite3_free(p->pUnused);
@@ -6861,6 +8022,9 @@ int sqlite3_os_init(void){
     UNIXVFS("unix-afp",      afpIoFinder ),
     UNIXVFS("unix-nfs",      nfsIoFinder ),
     UNIXVFS("unix-proxy",    proxyIoFinder ),
+#endif
+#if SQLITE_UNIX_URING
+    UNIXVFS("unix-uring",    uringIoFinder ),
 #endif
   };
   unsigned int i;          /* Loop counter */
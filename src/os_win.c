@@ -2635,6 +2635,10 @@ static int winFileControl(sqlite3_file *id, int op, void *pArg){
       pFile->szChunk = *(int *)pArg;
       return SQLITE_OK;
     }
+    case SQLITE_FCNTL_GET_CHUNK: {
+      *(int*)pArg = pFile->szChunk;
+      return SQLITE_OK;
+    }
     case SQLITE_FCNTL_SIZE_HINT: {
       if( pFile->szChunk>0 ){
         sqlite3_int64 oldSz;
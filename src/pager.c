@@ -657,6 +657,7 @@ struct Pager {
   PagerSavepoint *aSavepoint; /* Array of active savepoints */
   int nSavepoint;             /* Number of elements in aSavepoint[] */
   char dbFileVers[16];        /* Changes whenever database file changes */
+  u32 iDataVersion;           /* Changes whenever the page cache is reset */
   /*
   ** End of the routinely-changing class members
   ***************************************************************************/
@@ -668,6 +669,7 @@ struct Pager {
   int pageSize;               /* Number of bytes in a page */
   Pgno mxPgno;                /* Maximum allowed size of the database */
   i64 journalSizeLimit;       /* Size limit for persistent journal files */
+  int walSyncInterval;        /* PRAGMA wal_sync_interval, in milliseconds */
   char *zFilename;            /* Name of the database file */
   char *zJournal;             /* Name of the journal file */
   int (*xBusyHandler)(void*); /* Function to call when busy */
@@ -1673,6 +1675,7 @@ static PgHdr *pager_lookup(Pager *pPager, Pgno pgno){
 ** Discard the entire contents of the in-memory page-cache.
 */
 static void pager_reset(Pager *pPager){
+  pPager->iDataVersion++;
   sqlite3BackupRestart(pPager->pBackup);
   sqlite3PcacheClear(pPager->pPCache);
 }
@@ -4049,6 +4052,13 @@ static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
     pPager->dbHintSize = pPager->dbSize;
   }
 
+  /* Let the VFS know that a group of page writes follows.  A VFS may
+  ** defer the writes until SQLITE_FCNTL_END_BATCH, below.
+  */
+  if( rc==SQLITE_OK ){
+    sqlite3OsFileControlHint(pPager->fd, SQLITE_FCNTL_BEGIN_BATCH, 0);
+  }
+
   while( rc==SQLITE_OK && pList ){
     Pgno pgno = pList->pgno;
 
@@ -4068,7 +4078,8 @@ static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
       if( pList->pgno==1 ) pager_write_changecounter(pList);
 
       /* Encode the database */
-      CODEC2(pPager, pList->pData, pgno, 6, return SQLITE_NOMEM, pData);
+      CODEC2(pPager, pList->pData, pgno, 6, rc = SQLITE_NOMEM, pData);
+      if( rc!=SQLITE_OK ) break;
 
       /* Write out the page data. */
       rc = sqlite3OsWrite(pPager->fd, pData, pPager->pageSize, offset);
@@ -4099,6 +4110,12 @@ static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
     pList = pList->pDirty;
   }
 
+  /* Wait for any writes deferred by the VFS. */
+  if( isOpen(pPager->fd) ){
+    int rc2 = sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_END_BATCH, 0);
+    if( rc==SQLITE_OK && rc2!=SQLITE_NOTFOUND ) rc = rc2;
+  }
+
   return rc;
 }
 
@@ -6331,6 +6348,16 @@ sqlite3_file *sqlite3PagerFile(Pager *pPager){
   return pPager->fd;
 }
 
+/*
+** Return a value that changes each time the page cache is discarded, as
+** happens when another connection has modified the database file.  The
+** btree layer uses this to tell when information it has cached about the
+** content of the database, beyond the pages themselves, may be stale.
+*/
+u32 sqlite3PagerDataVersion(Pager *pPager){
+  return pPager->iDataVersion;
+}
+
 /*
 ** Return the full pathname of the journal file.
 */
@@ -6751,6 +6778,37 @@ int sqlite3PagerWalCallback(Pager *pPager){
   return sqlite3WalCallback(pPager->pWal);
 }
 
+/*
+** Get/set the "PRAGMA wal_sync_interval" setting, in milliseconds. While
+** this is greater than zero, a commit only syncs the WAL file if it has
+** not been synced within the interval. A negative argument is a no-op.
+** Nothing syncs the WAL once the interval has elapsed; see
+** sqlite3PagerWalSync().
+*/
+int sqlite3PagerWalSyncInterval(Pager *pPager, int nMs){
+  if( nMs>=0 ){
+    pPager->walSyncInterval = nMs;
+    if( pPager->pWal ) sqlite3WalSyncInterval(pPager->pWal, nMs);
+  }
+  return pPager->walSyncInterval;
+}
+
+/*
+** Sync any commits written to the WAL file that wal_sync_interval has
+** not yet made durable. This is a no-op if the pager is not in WAL mode.
+** The WAL is synced even with "PRAGMA synchronous=OFF", since the caller
+** asked for it explicitly.
+*/
+int sqlite3PagerWalSync(Pager *pPager){
+  int rc = SQLITE_OK;
+  if( pPager->pWal ){
+    int sync_flags = pPager->syncFlags;
+    if( sync_flags==0 ) sync_flags = SQLITE_SYNC_NORMAL;
+    rc = sqlite3WalSync(pPager->pWal, sync_flags);
+  }
+  return rc;
+}
+
 /*
 ** Return true if the underlying VFS for the given pager supports the
 ** primitives necessary for write-ahead logging.
@@ -6808,6 +6866,9 @@ static int pagerOpenWal(Pager *pPager){
         pPager->journalSizeLimit, &pPager->pWal
     );
   }
+  if( rc==SQLITE_OK ){
+    sqlite3WalSyncInterval(pPager->pWal, pPager->walSyncInterval);
+  }
 
   return rc;
 }
@@ -6917,6 +6978,35 @@ int sqlite3PagerWalFramesize(Pager *pPager){
 }
 #endif
 
+#ifdef SQLITE_ENABLE_SNAPSHOT
+/*
+** If this is a WAL database, obtain a snapshot handle for the snapshot
+** currently open. Otherwise, return an error.
+*/
+int sqlite3PagerSnapshotGet(Pager *pPager, sqlite3_snapshot **ppSnapshot){
+  int rc = SQLITE_ERROR;
+  if( pPager->pWal ){
+    rc = sqlite3WalSnapshotGet(pPager->pWal, ppSnapshot);
+  }
+  return rc;
+}
+
+/*
+** If this is a WAL database, store a pointer to pSnapshot. Next time a
+** read transaction is opened, attempt to read from the snapshot it
+** identifies. If this is not a WAL database, return an error.
+*/
+int sqlite3PagerSnapshotOpen(Pager *pPager, sqlite3_snapshot *pSnapshot){
+  int rc = SQLITE_OK;
+  if( pPager->pWal ){
+    sqlite3WalSnapshotOpen(pPager->pWal, pSnapshot);
+  }else{
+    rc = SQLITE_ERROR;
+  }
+  return rc;
+}
+#endif /* SQLITE_ENABLE_SNAPSHOT */
+
 #ifdef SQLITE_HAS_CODEC
 /*
 ** This function is called by the wal module when writing page content
@@ -1255,6 +1255,7 @@ void sqlite3Pragma(
         sqlite3VdbeAddOp2(v, OP_AddImm, 2, 1);   /* increment entry count */
         for(j=0, pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext, j++){
           int jmp2;
+          int jmp3 = 0;
           int r1;
           static const VdbeOpList idxErr[] = {
             { OP_AddImm,      1, -1,  0},
@@ -1269,14 +1270,43 @@ void sqlite3Pragma(
             { OP_IfPos,       1,  0,  0},    /* 9 */
             { OP_Halt,        0,  0,  0},
           };
-          r1 = sqlite3GenerateIndexKey(pParse, pIdx, 1, 3, 0);
-          jmp2 = sqlite3VdbeAddOp4Int(v, OP_Found, j+2, 0, r1, pIdx->nColumn+1);
+          if( IsBrinIndex(pIdx) ){
+            /* The entry for the block of the row must cover its value */
+            CollSeq *pColl = sqlite3LocateCollSeq(pParse, pIdx->azColl[0]);
+            int iCol = pIdx->aiColumn[0];
+            int jmp4, jmp5;
+            r1 = sqlite3GetTempRange(pParse, 5);
+            if( iCol==pTab->iPKey ){
+              sqlite3VdbeAddOp2(v, OP_Rowid, 1, r1);
+            }else{
+              sqlite3ExprCodeGetColumnOfTable(v, pTab, 1, iCol, r1);
+            }
+            jmp3 = sqlite3VdbeAddOp1(v, OP_IsNull, r1);
+            sqlite3VdbeAddOp2(v, OP_Rowid, 1, r1+1);
+            sqlite3VdbeAddOp2(v, OP_Integer, SQLITE_BRIN_SHIFT, r1+4);
+            sqlite3VdbeAddOp3(v, OP_ShiftRight, r1+4, r1+1, r1+1);
+            jmp4 = sqlite3VdbeAddOp3(v, OP_NotExists, j+2, 0, r1+1);
+            sqlite3VdbeAddOp3(v, OP_Column, j+2, 0, r1+2);
+            sqlite3VdbeAddOp3(v, OP_Column, j+2, 1, r1+3);
+            jmp5 = sqlite3VdbeAddOp4(v, OP_Lt, r1+2, 0, r1,
+                                     (char*)pColl, P4_COLLSEQ);
+            jmp2 = sqlite3VdbeAddOp4(v, OP_Le, r1+3, 0, r1,
+                                     (char*)pColl, P4_COLLSEQ);
+            sqlite3VdbeJumpHere(v, jmp4);
+            sqlite3VdbeJumpHere(v, jmp5);
+            sqlite3ReleaseTempRange(pParse, r1, 5);
+          }else{
+            r1 = sqlite3GenerateIndexKey(pParse, pIdx, 1, 3, 0);
+            jmp2 = sqlite3VdbeAddOp4Int(v, OP_Found, j+2, 0, r1,
+                                        pIdx->nColumn+1);
+          }
           addr = sqlite3VdbeAddOpList(v, ArraySize(idxErr), idxErr);
           sqlite3VdbeChangeP4(v, addr+1, "rowid ", P4_STATIC);
           sqlite3VdbeChangeP4(v, addr+3, " missing from index ", P4_STATIC);
           sqlite3VdbeChangeP4(v, addr+4, pIdx->zName, P4_TRANSIENT);
           sqlite3VdbeJumpHere(v, addr+9);
           sqlite3VdbeJumpHere(v, jmp2);
+          if( jmp3 ) sqlite3VdbeJumpHere(v, jmp3);
         }
         sqlite3VdbeAddOp2(v, OP_Next, 1, loopTop+1);
         sqlite3VdbeJumpHere(v, loopTop);
@@ -1293,6 +1323,7 @@ void sqlite3Pragma(
              { OP_Concat,       3,  2,  2},
              { OP_ResultRow,    2,  1,  0},
           };
+          if( IsBrinIndex(pIdx) ) continue;  /* One entry per block */
           addr = sqlite3VdbeAddOp1(v, OP_IfPos, 1);
           sqlite3VdbeAddOp2(v, OP_Halt, 0, 0);
           sqlite3VdbeJumpHere(v, addr);
@@ -1524,6 +1555,27 @@ void sqlite3Pragma(
        db->xWalCallback==sqlite3WalDefaultHook ? 
            SQLITE_PTR_TO_INT(db->pWalArg) : 0);
   }else
+
+  /*
+  **   PRAGMA [database.]wal_sync_interval
+  **   PRAGMA [database.]wal_sync_interval = N
+  **
+  ** With synchronous=FULL, let commits to a WAL mode database skip the
+  ** sync if the WAL was synced less than N milliseconds ago. Zero (the
+  ** default) syncs every commit. The interval is only checked when a
+  ** commit is made, so after the last commit of a burst, skipped syncs
+  ** stay pending until the next commit, close or sqlite3_wal_sync().
+  */
+  if( sqlite3StrICmp(zLeft, "wal_sync_interval")==0 ){
+    Pager *pPager = sqlite3BtreePager(pDb->pBt);
+    int nMs = -1;
+    if( zRight ){
+      nMs = sqlite3Atoi(zRight);
+      if( nMs<0 ) nMs = 0;
+    }
+    nMs = sqlite3PagerWalSyncInterval(pPager, nMs);
+    returnSingleInt(pParse, "wal_sync_interval", nMs);
+  }else
 #endif
 
   /*
@@ -292,12 +292,13 @@ static int sqlite3InitOne(sqlite3 *db, int iDb, char **pzErrMsg){
   ** file_format==2    Version 3.1.3.  // ALTER TABLE ADD COLUMN
   ** file_format==3    Version 3.1.4.  // ditto but with non-NULL defaults
   ** file_format==4    Version 3.3.0.  // DESC indices.  Boolean constants
+  ** file_format==5    SQLITE_ENABLE_BRIN builds only.  // BRIN indices
   */
   pDb->pSchema->file_format = (u8)meta[BTREE_FILE_FORMAT-1];
   if( pDb->pSchema->file_format==0 ){
     pDb->pSchema->file_format = 1;
   }
-  if( pDb->pSchema->file_format>SQLITE_MAX_FILE_FORMAT ){
+  if( pDb->pSchema->file_format>SQLITE_READ_FILE_FORMAT ){
     sqlite3SetString(pzErrMsg, db, "unsupported file format");
     rc = SQLITE_ERROR;
     goto initone_error_out;
@@ -312,6 +313,14 @@ static int sqlite3InitOne(sqlite3 *db, int iDb, char **pzErrMsg){
     db->flags &= ~SQLITE_LegacyFileFmt;
   }
 
+  /* If another connection has published this version of the schema, use
+  ** that instead of reading it from the database file.
+  */
+  if( sqlite3SchemaShareAttach(db, iDb) ){
+    assert( DbHasProperty(db, iDb, DB_SchemaLoaded) );
+    goto initone_error_out;
+  }
+
   /* Read the schema information out of the schema tables
   */
   assert( db->init.busy );
@@ -353,6 +362,9 @@ static int sqlite3InitOne(sqlite3 *db, int iDb, char **pzErrMsg){
     ** even when its contents have been corrupted.
     */
     DbSetProperty(db, iDb, DB_SchemaLoaded);
+    if( rc==SQLITE_OK ){
+      sqlite3SchemaSharePublish(db, iDb);
+    }
     rc = SQLITE_OK;
   }
 
@@ -392,6 +404,7 @@ int sqlite3Init(sqlite3 *db, char **pzErrMsg){
   db->init.busy = 1;
   for(i=0; rc==SQLITE_OK && i<db->nDb; i++){
     if( DbHasProperty(db, i, DB_SchemaLoaded) || i==1 ) continue;
+    sqlite3SchemaShareLeave(db);
     rc = sqlite3InitOne(db, i, pzErrMsg);
     if( rc ){
       sqlite3ResetOneSchema(db, i);
@@ -405,6 +418,7 @@ int sqlite3Init(sqlite3 *db, char **pzErrMsg){
 #ifndef SQLITE_OMIT_TEMPDB
   if( rc==SQLITE_OK && ALWAYS(db->nDb>1)
                     && !DbHasProperty(db, 1, DB_SchemaLoaded) ){
+    sqlite3SchemaShareLeave(db);
     rc = sqlite3InitOne(db, 1, pzErrMsg);
     if( rc ){
       sqlite3ResetOneSchema(db, 1);
@@ -423,6 +437,9 @@ int sqlite3Init(sqlite3 *db, char **pzErrMsg){
 /*
 ** This routine is a no-op if the database schema is already initialised.
 ** Otherwise, the schema is loaded. An error code is returned.
+**
+** On success, the mutexes of any shared schemas are held from here until
+** sqlite3Prepare() has finished running the parser.
 */
 int sqlite3ReadSchema(Parse *pParse){
   int rc = SQLITE_OK;
@@ -430,6 +447,7 @@ int sqlite3ReadSchema(Parse *pParse){
   assert( sqlite3_mutex_held(db->mutex) );
   if( !db->init.busy ){
     rc = sqlite3Init(db, &pParse->zErrMsg);
+    if( rc==SQLITE_OK ) sqlite3SchemaShareEnter(db);
   }
   if( rc!=SQLITE_OK ){
     pParse->rc = rc;
@@ -534,6 +552,7 @@ static int sqlite3Prepare(
   char *zErrMsg = 0;        /* Error message */
   int rc = SQLITE_OK;       /* Result code */
   int i;                    /* Loop counter */
+  u8 bSchemaShareHeld = db->bSchemaShareHeld;  /* True if a nested call */
 
   /* Allocate the parsing context */
   pParse = sqlite3StackAllocZero(db, sizeof(*pParse));
@@ -610,6 +629,11 @@ static int sqlite3Prepare(
   }
   assert( 1==(int)pParse->nQueryLoop );
 
+  /* The schemas are not used past this point.  Release the mutexes of any
+  ** shared ones before schemaIsValid() can wait on a database lock.  If
+  ** this is a nested call, the caller still needs them. */
+  if( !bSchemaShareHeld ) sqlite3SchemaShareLeave(db);
+
   if( db->mallocFailed ){
     pParse->rc = SQLITE_NOMEM;
   }
@@ -624,6 +648,13 @@ static int sqlite3Prepare(
     *pzTail = pParse->zTail;
   }
   rc = pParse->rc;
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+  if( rc==SQLITE_OK && pParse->schemaMask && sqlite3SchemaShareUnshare(pParse) ){
+    /* The statement was compiled against a shared schema that it is going
+    ** to modify.  Have the caller compile it again against a private copy. */
+    rc = SQLITE_SCHEMA;
+  }
+#endif
 
 #ifndef SQLITE_OMIT_EXPLAIN
   if( rc==SQLITE_OK && pParse->pVdbe && pParse->explain ){
@@ -34,10 +34,15 @@
 ** TEST checks to see if an element is already in the RowSet.  SMALLEST
 ** extracts the least value from the RowSet.
 **
-** The INSERT primitive might allocate additional memory.  Memory is
-** allocated in chunks so most INSERTs do no allocation.  There is an 
-** upper bound on the size of allocated memory.  No memory is freed
-** until DESTROY.
+** The INSERT primitive might allocate additional memory.  RowSetEntry
+** objects are allocated in chunks so most INSERTs do no allocation, and
+** no more than ROWSET_PENDING_MAX of them are in use at once.  Chunks
+** are recycled, not freed, once their entries have been folded into
+** the compressed set (see below).  The storage of a compressed block
+** is reallocated as the block grows, and freed when the block is
+** converted to a bitmap or merged into another block, so memory held
+** by the compressed set is released before DESTROY.  Everything else
+** is freed by DESTROY.
 **
 ** The TEST primitive includes a "batch" number.  The TEST primitive
 ** will only see elements that were inserted before the last change
@@ -52,13 +57,21 @@
 **
 ** The cost of an INSERT is roughly constant.  (Sometime new memory
 ** has to be allocated on an INSERT.)  The cost of a TEST with a new
-** batch number is O(NlogN) where N is the number of elements in the RowSet.
-** The cost of a TEST using the same batch number is O(logN).  The cost
-** of the first SMALLEST is O(NlogN).  Second and subsequent SMALLEST
-** primitives are constant time.  The cost of DESTROY is O(N).
+** batch number is proportional to the number of elements inserted since
+** the previous batch change.  The cost of a TEST using the same batch
+** number is constant.  The cost of the first SMALLEST is O(BlogB) where
+** B is the number of distinct 65536-value blocks that the RowSet spans.
+** Second and subsequent SMALLEST primitives are constant time.  The cost
+** of DESTROY is O(B).
 **
-** There is an added cost of O(N) when switching between TEST and
-** SMALLEST primitives.
+** Newly inserted rowids accumulate on a short linked list of RowSetEntry
+** objects.  Whenever that list grows too long, or when the batch number
+** changes, the list is sorted and folded into a compressed integer set.
+** The compressed set divides the 64-bit rowid space into blocks of 65536
+** consecutive values.  A block holding only a few values stores the low
+** 16 bits of each as a sorted array.  A block holding many values is
+** stored as a 65536-bit bitmap.  A dense range of rowids therefore costs
+** between one and sixteen bits per value rather than a full RowSetEntry.
 */
 #include "sqliteInt.h"
 
@@ -74,13 +87,35 @@
 #define ROWSET_ENTRY_PER_CHUNK  \
                        ((ROWSET_ALLOCATION_SIZE-8)/sizeof(struct RowSetEntry))
 
+/*
+** The maximum number of entries allowed to accumulate on the
+** RowSet.pEntry list before they are moved into the compressed set.
+*/
+#define ROWSET_PENDING_MAX  (4*ROWSET_ENTRY_PER_CHUNK)
+
+/*
+** Each block of the compressed set covers 65536 consecutive rowids that
+** share the same upper 48 bits.
+*/
+#define ROWSET_BLOCK_BITS   16
+#define ROWSET_LOW_MASK     0xffff
+
+/*
+** A block holding more than ROWSET_SPARSE_MAX values is converted from
+** a sorted array of 16-bit offsets into a bitmap of ROWSET_BITMAP_WORDS
+** 64-bit words.  Both representations are 8KiB at the crossover point.
+** Blocks of up to ROWSET_INLINE values keep their array inside the
+** RowSetBlock object itself so that sparse rowids need no extra
+** allocation.
+*/
+#define ROWSET_SPARSE_MAX   4096
+#define ROWSET_BITMAP_WORDS 1024
+#define ROWSET_INLINE       4
+
 /*
 ** Each entry in a RowSet is an instance of the following object.
-**
-** This same object is reused to store a linked list of trees of RowSetEntry
-** objects.  In that alternative use, pRight points to the next entry
-** in the list, pLeft points to the tree, and v is unused.  The
-** RowSet.pForest value points to the head of this forest list.
+** Entries are linked together on the RowSet.pEntry list using the
+** pRight pointer.  The pLeft pointer is unused except during sorting.
 */
 struct RowSetEntry {            
   i64 v;                        /* ROWID value for this entry */
@@ -99,6 +134,61 @@ struct RowSetChunk {
   struct RowSetEntry aEntry[ROWSET_ENTRY_PER_CHUNK]; /* Allocated entries */
 };
 
+/*
+** One block of a compressed integer set.  Every member of the block
+** has the value (iHi<<16)+X for some 16-bit X.
+**
+** If isBitmap is true, u.aBit[] is a bitmap with one bit for each
+** possible value of X.  Otherwise the X values are stored in increasing
+** order in u.aInline[] (if nAlloc==0) or in u.aLow[] (if nAlloc>0).
+*/
+struct RowSetBlock {
+  i64 iHi;                       /* Upper 48 bits of every member */
+  int nVal;                      /* Number of members */
+  u16 nAlloc;                    /* Allocated size of u.aLow[] */
+  u8 isBitmap;                   /* True if u.aBit[] is in use */
+  union {
+    u16 aInline[ROWSET_INLINE];  /* Members of a very small block */
+    u16 *aLow;                   /* Members of a sparse block */
+    u64 *aBit;                   /* Bitmap for a dense block */
+  } u;
+};
+
+/*
+** A compressed integer set is an array of RowSetBlock objects together
+** with an open-addressing hash table used to locate the block for a
+** particular value of RowSetBlock.iHi.  aHash[] holds one more than the
+** index of a block in aBlock[], or 0 for an empty slot.
+**
+** Once sqlite3RowSetNext() has been called, aBlock[] is sorted in order
+** of increasing iHi and aHash[] is no longer maintained.
+*/
+struct RowSetBlockList {
+  struct RowSetBlock *aBlock;    /* Array of blocks */
+  int nBlock;                    /* Number of blocks in use */
+  int nAlloc;                    /* Allocated size of aBlock[] */
+  int *aHash;                    /* Hash table mapping iHi to aBlock[] */
+  int nHash;                     /* Number of slots in aHash[] */
+};
+
+/*
+** The compressed part of a RowSet.  This is allocated the first time
+** that entries are moved off of the RowSet.pEntry list.
+**
+** Values that have been visible to sqlite3RowSetTest() since the most
+** recent batch change are stored in the "visible" set.  Values from the
+** current batch that had to be moved off of the RowSet.pEntry list
+** before the batch changed are held in the "stage" set until the next
+** batch change.
+*/
+struct RowSetStore {
+  struct RowSetBlockList visible;  /* Values visible to sqlite3RowSetTest() */
+  struct RowSetBlockList stage;    /* Older values from the current batch */
+  struct RowSetChunk *pReuse;      /* Next chunk to recycle for new entries */
+  int iBlock;                      /* Next block for sqlite3RowSetNext() */
+  int iPos;                        /* Next position within aBlock[iBlock] */
+};
+
 /*
 ** A RowSet in an instance of the following structure.
 **
@@ -110,8 +200,9 @@ struct RowSet {
   struct RowSetEntry *pEntry;    /* List of entries using pRight */
   struct RowSetEntry *pLast;     /* Last entry on the pEntry list */
   struct RowSetEntry *pFresh;    /* Source of new entry objects */
-  struct RowSetEntry *pForest;   /* List of binary trees of entries */
+  struct RowSetStore *pStore;    /* Compressed set of older entries */
   u16 nFresh;                    /* Number of objects on pFresh */
+  u16 nPending;                  /* Number of objects on pEntry */
   u8 rsFlags;                    /* Various flags */
   u8 iBatch;                     /* Current insert batch */
 };
@@ -142,14 +233,34 @@ RowSet *sqlite3RowSetInit(sqlite3 *db, void *pSpace, unsigned int N){
   p->db = db;
   p->pEntry = 0;
   p->pLast = 0;
-  p->pForest = 0;
+  p->pStore = 0;
   p->pFresh = (struct RowSetEntry*)(ROUND8(sizeof(*p)) + (char*)p);
   p->nFresh = (u16)((N - ROUND8(sizeof(*p)))/sizeof(struct RowSetEntry));
+  p->nPending = 0;
   p->rsFlags = ROWSET_SORTED;
   p->iBatch = 0;
   return p;
 }
 
+/*
+** Free all memory held by the blocks of a compressed set and by the
+** set itself, leaving the set empty.
+*/
+static void rowSetBlockListClear(sqlite3 *db, struct RowSetBlockList *pList){
+  int i;
+  for(i=0; i<pList->nBlock; i++){
+    struct RowSetBlock *pBlock = &pList->aBlock[i];
+    if( pBlock->isBitmap ){
+      sqlite3DbFree(db, pBlock->u.aBit);
+    }else if( pBlock->nAlloc ){
+      sqlite3DbFree(db, pBlock->u.aLow);
+    }
+  }
+  sqlite3DbFree(db, pList->aBlock);
+  sqlite3DbFree(db, pList->aHash);
+  memset(pList, 0, sizeof(*pList));
+}
+
 /*
 ** Deallocate all chunks from a RowSet.  This frees all memory that
 ** the RowSet has allocated over its lifetime.  This routine is
@@ -161,11 +272,17 @@ void sqlite3RowSetClear(RowSet *p){
     pNextChunk = pChunk->pNextChunk;
     sqlite3DbFree(p->db, pChunk);
   }
+  if( p->pStore ){
+    rowSetBlockListClear(p->db, &p->pStore->visible);
+    rowSetBlockListClear(p->db, &p->pStore->stage);
+    sqlite3DbFree(p->db, p->pStore);
+  }
   p->pChunk = 0;
   p->nFresh = 0;
   p->pEntry = 0;
   p->pLast = 0;
-  p->pForest = 0;
+  p->pStore = 0;
+  p->nPending = 0;
   p->rsFlags = ROWSET_SORTED;
 }
 
@@ -174,6 +291,9 @@ void sqlite3RowSetClear(RowSet *p){
 ** given RowSet.  Return a pointer to the new and completely uninitialized
 ** objected.
 **
+** Chunks whose entries have all been moved into the compressed set are
+** recycled before any new chunk is allocated.
+**
 ** In an OOM situation, the RowSet.db->mallocFailed flag is set and this
 ** routine returns NULL.
 */
@@ -181,12 +301,17 @@ static struct RowSetEntry *rowSetEntryAlloc(RowSet *p){
   assert( p!=0 );
   if( p->nFresh==0 ){
     struct RowSetChunk *pNew;
-    pNew = sqlite3DbMallocRaw(p->db, sizeof(*pNew));
-    if( pNew==0 ){
-      return 0;
+    if( p->pStore && p->pStore->pReuse ){
+      pNew = p->pStore->pReuse;
+      p->pStore->pReuse = pNew->pNextChunk;
+    }else{
+      pNew = sqlite3DbMallocRaw(p->db, sizeof(*pNew));
+      if( pNew==0 ){
+        return 0;
+      }
+      pNew->pNextChunk = p->pChunk;
+      p->pChunk = pNew;
     }
-    pNew->pNextChunk = p->pChunk;
-    p->pChunk = pNew;
     p->pFresh = pNew->aEntry;
     p->nFresh = ROWSET_ENTRY_PER_CHUNK;
   }
@@ -194,6 +319,8 @@ static struct RowSetEntry *rowSetEntryAlloc(RowSet *p){
   return p->pFresh++;
 }
 
+static void rowSetFlushPending(RowSet*);
+
 /*
 ** Insert a new value into a RowSet.
 **
@@ -207,6 +334,9 @@ void sqlite3RowSetInsert(RowSet *p, i64 rowid){
   /* This routine is never called after sqlite3RowSetNext() */
   assert( p!=0 && (p->rsFlags & ROWSET_NEXT)==0 );
 
+  if( p->nPending>=ROWSET_PENDING_MAX ){
+    rowSetFlushPending(p);
+  }
   pEntry = rowSetEntryAlloc(p);
   if( pEntry==0 ) return;
   pEntry->v = rowid;
@@ -221,6 +351,7 @@ void sqlite3RowSetInsert(RowSet *p, i64 rowid){
     p->pEntry = pEntry;
   }
   p->pLast = pEntry;
+  p->nPending++;
 }
 
 /*
@@ -288,127 +419,358 @@ static struct RowSetEntry *rowSetEntrySort(struct RowSetEntry *pIn){
   return pIn;
 }
 
+/*
+** Return a pointer to the sorted array of 16-bit offsets held by a block
+** that is not a bitmap.
+*/
+static u16 *rowSetBlockArray(struct RowSetBlock *pBlock){
+  assert( pBlock->isBitmap==0 );
+  return pBlock->nAlloc ? pBlock->u.aLow : pBlock->u.aInline;
+}
+
+/*
+** Return the aHash[] slot at which to begin searching for the block
+** with RowSetBlock.iHi==iHi.
+*/
+static int rowSetHash(struct RowSetBlockList *pList, i64 iHi){
+  u32 h = (u32)iHi ^ (u32)(iHi>>32);
+  return (int)((h*0x9e3779b1) & (pList->nHash-1));
+}
+
+/*
+** Locate the block of pList that holds values with upper bits iHi.
+** Return NULL if there is no such block.
+*/
+static struct RowSetBlock *rowSetBlockFind(
+  struct RowSetBlockList *pList,   /* Set to search */
+  i64 iHi                          /* Upper 48 bits of the value sought */
+){
+  int h;
+  if( pList->nHash==0 ) return 0;
+  for(h=rowSetHash(pList, iHi); pList->aHash[h]; h=(h+1)&(pList->nHash-1)){
+    struct RowSetBlock *pBlock = &pList->aBlock[pList->aHash[h]-1];
+    if( pBlock->iHi==iHi ) return pBlock;
+  }
+  return 0;
+}
 
 /*
-** The input, pIn, is a binary tree (or subtree) of RowSetEntry objects.
-** Convert this tree into a linked list connected by the pRight pointers
-** and return pointers to the first and last elements of the new list.
+** Add a new, empty block with upper bits iHi to pList and return a
+** pointer to it.  The caller must have already verified that no such
+** block exists.  Pointers to other blocks of pList are invalidated.
+**
+** Return NULL if a memory allocation fails.
 */
-static void rowSetTreeToList(
-  struct RowSetEntry *pIn,         /* Root of the input tree */
-  struct RowSetEntry **ppFirst,    /* Write head of the output list here */
-  struct RowSetEntry **ppLast      /* Write tail of the output list here */
+static struct RowSetBlock *rowSetBlockAppend(
+  sqlite3 *db,                     /* Database connection for allocations */
+  struct RowSetBlockList *pList,   /* Set to add the new block to */
+  i64 iHi                          /* Upper 48 bits of values in new block */
 ){
-  assert( pIn!=0 );
-  if( pIn->pLeft ){
-    struct RowSetEntry *p;
-    rowSetTreeToList(pIn->pLeft, ppFirst, &p);
-    p->pRight = pIn;
+  struct RowSetBlock *pBlock;
+  int h;
+
+  assert( rowSetBlockFind(pList, iHi)==0 );
+  if( pList->nBlock>=pList->nAlloc ){
+    int nNew = pList->nAlloc ? pList->nAlloc*2 : 8;
+    struct RowSetBlock *aNew;
+    aNew = sqlite3DbRealloc(db, pList->aBlock, nNew*sizeof(aNew[0]));
+    if( aNew==0 ) return 0;
+    pList->aBlock = aNew;
+    pList->nAlloc = nNew;
+  }
+  if( (pList->nBlock+1)*2>pList->nHash ){
+    int nHash = pList->nHash ? pList->nHash*2 : 16;
+    int *aHash;
+    int i;
+    aHash = sqlite3DbMallocZero(db, nHash*sizeof(int));
+    if( aHash==0 ) return 0;
+    sqlite3DbFree(db, pList->aHash);
+    pList->aHash = aHash;
+    pList->nHash = nHash;
+    for(i=0; i<pList->nBlock; i++){
+      h = rowSetHash(pList, pList->aBlock[i].iHi);
+      while( aHash[h] ) h = (h+1)&(nHash-1);
+      aHash[h] = i+1;
+    }
+  }
+  h = rowSetHash(pList, iHi);
+  while( pList->aHash[h] ) h = (h+1)&(pList->nHash-1);
+  pList->aHash[h] = pList->nBlock+1;
+  pBlock = &pList->aBlock[pList->nBlock++];
+  memset(pBlock, 0, sizeof(*pBlock));
+  pBlock->iHi = iHi;
+  return pBlock;
+}
+
+/*
+** Convert block pBlock to the bitmap representation, if it is not one
+** already.  Return SQLITE_OK on success or SQLITE_NOMEM if a memory
+** allocation fails, in which case pBlock is unchanged.
+*/
+static int rowSetBlockToBitmap(sqlite3 *db, struct RowSetBlock *pBlock){
+  u64 *aBit;
+  u16 *aLow;
+  int i;
+
+  if( pBlock->isBitmap ) return SQLITE_OK;
+  aBit = sqlite3DbMallocZero(db, ROWSET_BITMAP_WORDS*sizeof(u64));
+  if( aBit==0 ) return SQLITE_NOMEM;
+  aLow = rowSetBlockArray(pBlock);
+  for(i=0; i<pBlock->nVal; i++){
+    aBit[aLow[i]>>6] |= ((u64)1)<<(aLow[i]&63);
+  }
+  if( pBlock->nAlloc ) sqlite3DbFree(db, pBlock->u.aLow);
+  pBlock->u.aBit = aBit;
+  pBlock->nAlloc = 0;
+  pBlock->isBitmap = 1;
+  return SQLITE_OK;
+}
+
+/*
+** Add the nNew 16-bit offsets in aNew[] to block pBlock.  The values in
+** aNew[] must be in strictly increasing order.  Offsets that are already
+** members of the block are ignored.
+**
+** If a memory allocation fails, the mallocFailed flag of the database
+** connection is set and some or all of the new values may be lost.
+*/
+static void rowSetBlockAdd(
+  sqlite3 *db,                     /* Database connection for allocations */
+  struct RowSetBlock *pBlock,      /* Block to add values to */
+  const u16 *aNew,                 /* Sorted offsets to add */
+  int nNew                         /* Number of entries in aNew[] */
+){
+  int nMax = pBlock->nVal + nNew;  /* Upper bound on resulting size */
+
+  if( pBlock->isBitmap==0 && nMax>ROWSET_SPARSE_MAX ){
+    if( rowSetBlockToBitmap(db, pBlock) ) return;
+  }
+  if( pBlock->isBitmap ){
+    u64 *aBit = pBlock->u.aBit;
+    int i;
+    for(i=0; i<nNew; i++){
+      u64 mask = ((u64)1)<<(aNew[i]&63);
+      if( (aBit[aNew[i]>>6] & mask)==0 ){
+        aBit[aNew[i]>>6] |= mask;
+        pBlock->nVal++;
+      }
+    }
   }else{
-    *ppFirst = pIn;
+    int nCap = pBlock->nAlloc ? pBlock->nAlloc : ROWSET_INLINE;
+    int i, j, k;
+    u16 *a;
+
+    if( nMax>nCap ){
+      u16 *aLow;
+      nCap *= 2;
+      if( nCap<nMax ) nCap = nMax;
+      if( nCap>ROWSET_SPARSE_MAX ) nCap = ROWSET_SPARSE_MAX;
+      aLow = sqlite3DbMallocRaw(db, nCap*sizeof(u16));
+      if( aLow==0 ) return;
+      memcpy(aLow, rowSetBlockArray(pBlock), pBlock->nVal*sizeof(u16));
+      if( pBlock->nAlloc ) sqlite3DbFree(db, pBlock->u.aLow);
+      pBlock->u.aLow = aLow;
+      pBlock->nAlloc = (u16)nCap;
+    }
+
+    /* Merge from the back so that the existing members need not be
+    ** copied out of the way first.  Duplicates leave a gap at the front
+    ** of the array which is closed up afterwards. */
+    a = rowSetBlockArray(pBlock);
+    i = pBlock->nVal-1;
+    j = nNew-1;
+    k = nMax;
+    while( j>=0 ){
+      if( i>=0 && a[i]>aNew[j] ){
+        a[--k] = a[i--];
+      }else{
+        if( i>=0 && a[i]==aNew[j] ) i--;
+        a[--k] = aNew[j--];
+      }
+    }
+    while( i>=0 ) a[--k] = a[i--];
+    if( k>0 ) memmove(a, &a[k], (nMax-k)*sizeof(u16));
+    pBlock->nVal = nMax-k;
   }
-  if( pIn->pRight ){
-    rowSetTreeToList(pIn->pRight, &pIn->pRight, ppLast);
+}
+
+/*
+** Add every member of block pFrom to block pTo.  Both blocks must
+** have the same iHi.  pFrom is unchanged.
+*/
+static void rowSetBlockMerge(
+  sqlite3 *db,                     /* Database connection for allocations */
+  struct RowSetBlock *pTo,         /* Block to add values to */
+  struct RowSetBlock *pFrom        /* Block to copy values from */
+){
+  assert( pTo->iHi==pFrom->iHi );
+  if( pFrom->isBitmap ){
+    if( rowSetBlockToBitmap(db, pTo)==SQLITE_OK ){
+      int i;
+      int n = 0;
+      for(i=0; i<ROWSET_BITMAP_WORDS; i++){
+        u64 w = (pTo->u.aBit[i] |= pFrom->u.aBit[i]);
+        while( w ){
+          w &= w-1;
+          n++;
+        }
+      }
+      pTo->nVal = n;
+    }
   }else{
-    *ppLast = pIn;
+    rowSetBlockAdd(db, pTo, rowSetBlockArray(pFrom), pFrom->nVal);
   }
-  assert( (*ppLast)->pRight==0 );
 }
 
+/*
+** Free the storage owned by a single block.
+*/
+static void rowSetBlockFree(sqlite3 *db, struct RowSetBlock *pBlock){
+  if( pBlock->isBitmap ){
+    sqlite3DbFree(db, pBlock->u.aBit);
+  }else if( pBlock->nAlloc ){
+    sqlite3DbFree(db, pBlock->u.aLow);
+  }
+}
 
 /*
-** Convert a sorted list of elements (connected by pRight) into a binary
-** tree with depth of iDepth.  A depth of 1 means the tree contains a single
-** node taken from the head of *ppList.  A depth of 2 means a tree with
-** three nodes.  And so forth.
+** Move all entries on the RowSet.pEntry list into the staging set.
+** The entries are sorted first so that each run of values that fall
+** in the same block can be added with a single merge.  Afterwards, all
+** RowSetChunk allocations are free to be reused for new entries.
 **
-** Use as many entries from the input list as required and update the
-** *ppList to point to the unused elements of the list.  If the input
-** list contains too few elements, then construct an incomplete tree
-** and leave *ppList set to NULL.
-**
-** Return a pointer to the root of the constructed binary tree.
+** If a memory allocation fails, the mallocFailed flag of the database
+** connection is set and some or all of the entries may be lost.
 */
-static struct RowSetEntry *rowSetNDeepTree(
-  struct RowSetEntry **ppList,
-  int iDepth
-){
-  struct RowSetEntry *p;         /* Root of the new tree */
-  struct RowSetEntry *pLeft;     /* Left subtree */
-  if( *ppList==0 ){
-    return 0;
+static void rowSetFlushPending(RowSet *p){
+  struct RowSetStore *pStore;
+  struct RowSetEntry *pEntry;
+  u16 aLow[ROWSET_PENDING_MAX];
+
+  if( p->pEntry==0 ) return;
+  pStore = p->pStore;
+  if( pStore==0 ){
+    pStore = p->pStore = sqlite3DbMallocZero(p->db, sizeof(*pStore));
   }
-  if( iDepth==1 ){
-    p = *ppList;
-    *ppList = p->pRight;
-    p->pLeft = p->pRight = 0;
-    return p;
+  if( pStore ){
+    pEntry = p->pEntry;
+    if( (p->rsFlags & ROWSET_SORTED)==0 ){
+      pEntry = rowSetEntrySort(pEntry);
+    }
+    while( pEntry ){
+      i64 iHi = pEntry->v >> ROWSET_BLOCK_BITS;
+      struct RowSetBlock *pBlock;
+      int n = 0;
+      do{
+        assert( n<(int)ROWSET_PENDING_MAX );
+        aLow[n++] = (u16)(pEntry->v & ROWSET_LOW_MASK);
+        pEntry = pEntry->pRight;
+      }while( pEntry && (pEntry->v >> ROWSET_BLOCK_BITS)==iHi );
+      pBlock = rowSetBlockFind(&pStore->stage, iHi);
+      if( pBlock==0 ){
+        pBlock = rowSetBlockAppend(p->db, &pStore->stage, iHi);
+      }
+      if( pBlock ){
+        rowSetBlockAdd(p->db, pBlock, aLow, n);
+      }
+    }
+    pStore->pReuse = p->pChunk;
+  }
+  p->pEntry = 0;
+  p->pLast = 0;
+  p->nFresh = 0;
+  p->nPending = 0;
+  p->rsFlags |= ROWSET_SORTED;
+}
+
+/*
+** Make all values in the staging set visible to sqlite3RowSetTest() by
+** taking the union of the staging set and the visible set.  The
+** staging set is left empty.
+*/
+static void rowSetMergeStage(RowSet *p){
+  struct RowSetStore *pStore = p->pStore;
+  struct RowSetBlockList *pStage;
+  int i;
+
+  if( pStore==0 || pStore->stage.nBlock==0 ) return;
+  pStage = &pStore->stage;
+  if( pStore->visible.nBlock==0 ){
+    struct RowSetBlockList tmp = pStore->visible;
+    pStore->visible = *pStage;
+    *pStage = tmp;
+    return;
   }
-  pLeft = rowSetNDeepTree(ppList, iDepth-1);
-  p = *ppList;
-  if( p==0 ){
-    return pLeft;
+  for(i=0; i<pStage->nBlock; i++){
+    struct RowSetBlock *pFrom = &pStage->aBlock[i];
+    struct RowSetBlock *pTo = rowSetBlockFind(&pStore->visible, pFrom->iHi);
+    if( pTo ){
+      rowSetBlockMerge(p->db, pTo, pFrom);
+    }else{
+      pTo = rowSetBlockAppend(p->db, &pStore->visible, pFrom->iHi);
+      if( pTo ){
+        /* Transfer ownership of the block storage */
+        *pTo = *pFrom;
+        continue;
+      }
+    }
+    rowSetBlockFree(p->db, pFrom);
   }
-  p->pLeft = pLeft;
-  *ppList = p->pRight;
-  p->pRight = rowSetNDeepTree(ppList, iDepth-1);
-  return p;
+  pStage->nBlock = 0;
+  memset(pStage->aHash, 0, pStage->nHash*sizeof(int));
 }
 
 /*
-** Convert a sorted list of elements into a binary tree. Make the tree
-** as deep as it needs to be in order to contain the entire list.
-*/
-static struct RowSetEntry *rowSetListToTree(struct RowSetEntry *pList){
-  int iDepth;           /* Depth of the tree so far */
-  struct RowSetEntry *p;       /* Current tree root */
-  struct RowSetEntry *pLeft;   /* Left subtree */
-
-  assert( pList!=0 );
-  p = pList;
-  pList = p->pRight;
-  p->pLeft = p->pRight = 0;
-  for(iDepth=1; pList; iDepth++){
-    pLeft = p;
-    p = pList;
-    pList = p->pRight;
-    p->pLeft = pLeft;
-    p->pRight = rowSetNDeepTree(&pList, iDepth);
+** Sort an array of blocks into order of increasing iHi using heapsort.
+** Blocks are usually created in order already, so check for that first.
+*/
+static void rowSetBlockSort(struct RowSetBlock *a, int n){
+  struct RowSetBlock t;
+  int i, j, k;
+
+  for(i=1; i<n && a[i-1].iHi<a[i].iHi; i++){}
+  if( i>=n ) return;
+  for(i=n/2-1; i>=0; i--){
+    for(j=i; (k=2*j+1)<n; j=k){
+      if( k+1<n && a[k+1].iHi>a[k].iHi ) k++;
+      if( a[j].iHi>=a[k].iHi ) break;
+      t = a[j]; a[j] = a[k]; a[k] = t;
+    }
+  }
+  for(i=n-1; i>0; i--){
+    t = a[0]; a[0] = a[i]; a[i] = t;
+    for(j=0; (k=2*j+1)<i; j=k){
+      if( k+1<i && a[k+1].iHi>a[k].iHi ) k++;
+      if( a[j].iHi>=a[k].iHi ) break;
+      t = a[j]; a[j] = a[k]; a[k] = t;
+    }
   }
-  return p;
 }
 
 /*
-** Take all the entries on p->pEntry and on the trees in p->pForest and
-** sort them all together into one big ordered list on p->pEntry.
+** Move every value in the RowSet into the visible set and sort the
+** blocks of that set so that they can be read in order by
+** sqlite3RowSetNext().
 **
 ** This routine should only be called once in the life of a RowSet.
 */
 static void rowSetToList(RowSet *p){
+  struct RowSetStore *pStore;
 
   /* This routine is called only once */
   assert( p!=0 && (p->rsFlags & ROWSET_NEXT)==0 );
 
-  if( (p->rsFlags & ROWSET_SORTED)==0 ){
-    p->pEntry = rowSetEntrySort(p->pEntry);
-  }
-
-  /* While this module could theoretically support it, sqlite3RowSetNext()
-  ** is never called after sqlite3RowSetText() for the same RowSet.  So
-  ** there is never a forest to deal with.  Should this change, simply
-  ** remove the assert() and the #if 0. */
-  assert( p->pForest==0 );
-#if 0
-  while( p->pForest ){
-    struct RowSetEntry *pTree = p->pForest->pLeft;
-    if( pTree ){
-      struct RowSetEntry *pHead, *pTail;
-      rowSetTreeToList(pTree, &pHead, &pTail);
-      p->pEntry = rowSetEntryMerge(p->pEntry, pHead);
-    }
-    p->pForest = p->pForest->pRight;
+  rowSetFlushPending(p);
+  rowSetMergeStage(p);
+  pStore = p->pStore;
+  if( pStore ){
+    rowSetBlockSort(pStore->visible.aBlock, pStore->visible.nBlock);
+    sqlite3DbFree(p->db, pStore->visible.aHash);
+    pStore->visible.aHash = 0;
+    pStore->visible.nHash = 0;
+    pStore->iBlock = 0;
+    pStore->iPos = 0;
   }
-#endif
   p->rsFlags |= ROWSET_NEXT;  /* Verify this routine is never called again */
 }
 
@@ -421,84 +783,90 @@ static void rowSetToList(RowSet *p){
 ** routine may not be called again.  
 */
 int sqlite3RowSetNext(RowSet *p, i64 *pRowid){
+  struct RowSetStore *pStore;
   assert( p!=0 );
 
-  /* Merge the forest into a single sorted list on first call */
+  /* Merge everything into a single sorted set on first call */
   if( (p->rsFlags & ROWSET_NEXT)==0 ) rowSetToList(p);
 
-  /* Return the next entry on the list */
-  if( p->pEntry ){
-    *pRowid = p->pEntry->v;
-    p->pEntry = p->pEntry->pRight;
-    if( p->pEntry==0 ){
-      sqlite3RowSetClear(p);
+  /* Return the next member of the sorted set */
+  pStore = p->pStore;
+  while( pStore && pStore->iBlock<pStore->visible.nBlock ){
+    struct RowSetBlock *pBlock = &pStore->visible.aBlock[pStore->iBlock];
+    int iPos = pStore->iPos;
+    if( pBlock->isBitmap==0 ){
+      if( iPos<pBlock->nVal ){
+        pStore->iPos = iPos+1;
+        *pRowid = (i64)(((u64)pBlock->iHi<<ROWSET_BLOCK_BITS)
+                        | rowSetBlockArray(pBlock)[iPos]);
+        return 1;
+      }
+    }else{
+      while( iPos<=ROWSET_LOW_MASK ){
+        u64 w = pBlock->u.aBit[iPos>>6] >> (iPos&63);
+        if( w==0 ){
+          iPos = (iPos|63)+1;
+          continue;
+        }
+        while( (w&1)==0 ){
+          w >>= 1;
+          iPos++;
+        }
+        pStore->iPos = iPos+1;
+        *pRowid = (i64)(((u64)pBlock->iHi<<ROWSET_BLOCK_BITS) | iPos);
+        return 1;
+      }
     }
-    return 1;
-  }else{
-    return 0;
+    pStore->iBlock++;
+    pStore->iPos = 0;
   }
+  sqlite3RowSetClear(p);
+  return 0;
 }
 
 /*
 ** Check to see if element iRowid was inserted into the rowset as
 ** part of any insert batch prior to iBatch.  Return 1 or 0.
 **
-** If this is the first test of a new batch and if there exist entires
-** on pRowSet->pEntry, then sort those entires into the forest at
-** pRowSet->pForest so that they can be tested.
+** If this is the first test of a new batch, then move all entries
+** inserted so far into the visible set so that they can be tested.
 */
 int sqlite3RowSetTest(RowSet *pRowSet, u8 iBatch, sqlite3_int64 iRowid){
-  struct RowSetEntry *p, *pTree;
+  struct RowSetBlock *pBlock;
+  u16 x;
 
   /* This routine is never called after sqlite3RowSetNext() */
   assert( pRowSet!=0 && (pRowSet->rsFlags & ROWSET_NEXT)==0 );
 
-  /* Sort entries into the forest on the first test of a new batch 
+  /* Make entries from earlier batches visible on the first test of a
+  ** new batch
   */
   if( iBatch!=pRowSet->iBatch ){
-    p = pRowSet->pEntry;
-    if( p ){
-      struct RowSetEntry **ppPrevTree = &pRowSet->pForest;
-      if( (pRowSet->rsFlags & ROWSET_SORTED)==0 ){
-        p = rowSetEntrySort(p);
-      }
-      for(pTree = pRowSet->pForest; pTree; pTree=pTree->pRight){
-        ppPrevTree = &pTree->pRight;
-        if( pTree->pLeft==0 ){
-          pTree->pLeft = rowSetListToTree(p);
-          break;
-        }else{
-          struct RowSetEntry *pAux, *pTail;
-          rowSetTreeToList(pTree->pLeft, &pAux, &pTail);
-          pTree->pLeft = 0;
-          p = rowSetEntryMerge(pAux, p);
-        }
-      }
-      if( pTree==0 ){
-        *ppPrevTree = pTree = rowSetEntryAlloc(pRowSet);
-        if( pTree ){
-          pTree->v = 0;
-          pTree->pRight = 0;
-          pTree->pLeft = rowSetListToTree(p);
-        }
-      }
-      pRowSet->pEntry = 0;
-      pRowSet->pLast = 0;
-      pRowSet->rsFlags |= ROWSET_SORTED;
-    }
+    rowSetFlushPending(pRowSet);
+    rowSetMergeStage(pRowSet);
     pRowSet->iBatch = iBatch;
   }
 
-  /* Test to see if the iRowid value appears anywhere in the forest.
+  /* Test to see if the iRowid value appears in the visible set.
   ** Return 1 if it does and 0 if not.
   */
-  for(pTree = pRowSet->pForest; pTree; pTree=pTree->pRight){
-    p = pTree->pLeft;
-    while( p ){
-      if( p->v<iRowid ){
-        p = p->pRight;
-      }else if( p->v>iRowid ){
-        p = p->pLeft;
+  if( pRowSet->pStore==0 ) return 0;
+  pBlock = rowSetBlockFind(&pRowSet->pStore->visible,
+                           iRowid >> ROWSET_BLOCK_BITS);
+  if( pBlock==0 ) return 0;
+  x = (u16)(iRowid & ROWSET_LOW_MASK);
+  if( pBlock->isBitmap ){
+    return (int)((pBlock->u.aBit[x>>6] >> (x&63)) & 1);
+  }else{
+    u16 *a = rowSetBlockArray(pBlock);
+    int iLo = 0;
+    int iHi = pBlock->nVal-1;
+    while( iLo<=iHi ){
+      int iMid = (iLo+iHi)/2;
+      if( a[iMid]<x ){
+        iLo = iMid+1;
+      }else if( a[iMid]>x ){
+        iHi = iMid-1;
       }else{
         return 1;
       }
@@ -4788,7 +4788,8 @@ int sqlite3Select(
         **那么我们能够假设它在硬盘上占用更少的空间
         **并且确定查询结果将会使扫描更低成本
         **
-        ** (2011-04-15) Do not do a full scan of an unordered index.
+        ** (2011-04-15) Do not do a full scan of an unordered index.  Nor
+        ** of a BRIN index, which does not have an entry for each row.
         **
         ** In practice the KeyInfo structure will not be used. It is only 
         ** passed to keep OP_OpenRead happy.
@@ -4796,7 +4797,9 @@ int sqlite3Select(
         **在实践中KeyInfo结构不会被使用。
         */
         for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
-          if( pIdx->bUnordered==0 && (!pBest || pIdx->nColumn<pBest->nColumn) ){
+          if( pIdx->bUnordered==0 && IsBrinIndex(pIdx)==0
+           && (!pBest || pIdx->nColumn<pBest->nColumn)
+          ){
             pBest = pIdx;
           }
         }
@@ -373,6 +373,22 @@
 # define SQLITE_DEFAULT_FILE_FORMAT 4
 #endif
 
+/*
+** A database that holds a BRIN index (see the comments on the Index
+** object) is given file format 5 when the index is created, so that
+** builds without SQLITE_ENABLE_BRIN refuse to open it with "unsupported
+** file format" instead of failing to parse its schema.  New databases
+** are still created with file format SQLITE_MAX_FILE_FORMAT, and the
+** format is not lowered again when the last BRIN index is dropped.
+** SQLITE_READ_FILE_FORMAT is the largest file format this build reads.
+*/
+#ifdef SQLITE_ENABLE_BRIN
+# define SQLITE_BRIN_FILE_FORMAT 5
+# define SQLITE_READ_FILE_FORMAT SQLITE_BRIN_FILE_FORMAT
+#else
+# define SQLITE_READ_FILE_FORMAT SQLITE_MAX_FILE_FORMAT
+#endif
+
 /*
 ** Determine whether triggers are recursive by default.  This can be   取决于触发器是否是默认递归的。这是可以被改变的在运行时使用一个编译指示。
 ** changed at run-time using a pragma.
@@ -650,6 +666,7 @@ typedef struct FuncDestructor FuncDestructor;
 typedef struct FuncDef FuncDef;
 typedef struct FuncDefHash FuncDefHash;
 typedef struct IdList IdList;
+typedef struct IdxDefer IdxDefer;
 typedef struct Index Index;
 typedef struct IndexSample IndexSample;
 typedef struct KeyClass KeyClass;
@@ -704,6 +721,7 @@ struct Db {
   Btree *pBt;          /* The B*Tree structure for this database file */
   u8 inTrans;          /* 0: not writable.  1: Transaction.  2: Checkpoint */
   u8 safety_level;     /* How aggressive at syncing data to disk */
+  u8 bNoShare;         /* Never use a schema shared with other connections */
   Schema *pSchema;     /* Pointer to database schema (possibly shared) */
 };
 
@@ -760,6 +778,7 @@ struct Schema {
 #define DB_SchemaLoaded    0x0001  /* The schema has been loaded */
 #define DB_UnresetViews    0x0002  /* Some views have defined column names */
 #define DB_Empty           0x0004  /* The file is empty (length 0 bytes) */
+#define DB_Shared          0x0008  /* Schema is shared between connections */
 
 /*
 ** The number of different kinds of things that can be limited
@@ -833,6 +852,8 @@ struct sqlite3 {
   u8 dfltLockMode;              /* Default locking-mode for attached dbs */
   signed char nextAutovac;      /* Autovac setting after VACUUM if >=0 */
   u8 suppressErr;               /* Do not issue error messages if true */
+  u8 bSharedSchema;             /* Share schemas with other connections */
+  u8 bSchemaShareHeld;          /* Holds the mutexes of shared schemas */
   u8 vtabOnConflict;            /* Value to return for s3_vtab_on_conflict() */
   u8 isTransactionSavepoint;    /* True if the outermost savepoint is a TS */
   int nextPagesize;             /* Pagesize after VACUUM if >0 */
@@ -893,7 +914,7 @@ struct sqlite3 {
   VTable **aVTrans;             /* Virtual tables with open transactions */
   VTable *pDisconnect;    /* Disconnect these in next sqlite3_prepare() */
 #endif
-  FuncDefHash aFunc;            /* Hash table of connection functions */
+  Hash aFunc;                   /* Hash table of connection functions */
   Hash aCollSeq;                /* All collating sequences */
   BusyHandler busyHandler;      /* Busy callback */
   Db aDbStatic[2];              /* Static space for the 2 default backends */
@@ -902,6 +923,7 @@ struct sqlite3 {
   int nSavepoint;               /* Number of non-transaction savepoints */
   int nStatement;               /* Number of nested statement-transactions  */
   i64 nDeferredCons;            /* Net deferred constraints this transaction. */
+  IdxDefer *pIdxDefer;          /* Index entries not yet written to indices */
   int *pnBytesFreed;            /* If not NULL, increment this in DbFree() */
 
 #ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
@@ -1503,6 +1525,18 @@ struct UnpackedRecord {
 ** and the value of Index.onError indicate the which conflict resolution 
 ** algorithm to employ whenever an attempt is made to insert a non-unique
 ** element.
+**
+** A BRIN (block range) index, created by "CREATE INDEX ... USING brin"
+** in builds compiled with SQLITE_ENABLE_BRIN, has Index.bBrin set.  It
+** indexes a single column and is stored in a table b-tree.  The rows of
+** the table are divided into blocks of 2^SQLITE_BRIN_SHIFT consecutive
+** rowids, and for each block that holds a non-NULL value of the column
+** the index has an entry, keyed by the block number
+** (rowid>>SQLITE_BRIN_SHIFT), that records the smallest and largest value
+** of the column in the block.  Entries are widened as rows are inserted
+** or updated but never narrowed, so the range of an entry may be larger
+** than the values the block holds.  Creating a BRIN index raises the
+** file format of the database to SQLITE_BRIN_FILE_FORMAT.
 */
 struct Index {
   char *zName;     /* Name of this index */
@@ -1519,6 +1553,7 @@ struct Index {
   u8 onError;      /* OE_Abort, OE_Ignore, OE_Replace, or OE_None */
   u8 autoIndex;    /* True if is automatically created (ex: by UNIQUE) */
   u8 bUnordered;   /* Use this index for == or IN queries only */
+  u8 bBrin;        /* True for a block range (BRIN) index */
 #ifdef SQLITE_ENABLE_STAT3
   int nSample;             /* Number of elements in aSample[] */
   tRowcnt avgEq;           /* Average nEq value for key values not in aSample */
@@ -1526,6 +1561,26 @@ struct Index {
 #endif
 };
 
+/*
+** The IsBrinIndex() macro is true for a BRIN index.  It is always false,
+** so that the code that handles BRIN indices compiles away, unless
+** SQLITE_ENABLE_BRIN is defined.
+*/
+#ifdef SQLITE_ENABLE_BRIN
+# define IsBrinIndex(X)  ((X)->bBrin)
+#else
+# define IsBrinIndex(X)  0
+#endif
+
+/*
+** The number of bits of the rowid that are discarded to obtain the block
+** number of a row in a BRIN index.  Each block covers 2^SQLITE_BRIN_SHIFT
+** rowids.
+*/
+#ifndef SQLITE_BRIN_SHIFT
+# define SQLITE_BRIN_SHIFT 7
+#endif
+
 /*
 ** Each sample stored in the sqlite_stat3 table is represented in memory 
 ** using a structure of this type.  See documentation at the top of the
@@ -1922,7 +1977,8 @@ struct SrcList {
 ** is.  None of the fields in this object should be used outside of
 ** the where.c module.
 **
-** Within the union, pIdx is only used when wsFlags&WHERE_INDEXED is true.
+** Within the union, pIdx is only used when wsFlags&WHERE_INDEXED or
+** wsFlags&WHERE_BRIN is true.
 ** pTerm is only used when wsFlags&WHERE_MULTI_OR is true.  And pVtabIdx
 ** is only used when wsFlags&WHERE_VIRTUALTABLE is true.  It is never the
 ** case that more than one of these conditions is true.
@@ -1932,7 +1988,7 @@ struct WherePlan {
   u32 nEq;                       /* Number of == constraints */
   double nRow;                   /* Estimated number of rows (for EQP) */
   union {
-    Index *pIdx;                   /* Index when WHERE_INDEXED is true */
+    Index *pIdx;                   /* Index for WHERE_INDEXED, WHERE_BRIN */
     struct WhereTerm *pTerm;       /* WHERE clause term for OR-search */
     sqlite3_index_info *pVtabIdx;  /* Virtual table index to use */
   } u;
@@ -2259,6 +2315,9 @@ struct Parse {
   } aColCache[SQLITE_N_COLCACHE];  /* One for each column cache entry */
   yDbMask writeMask;   /* Start a write transaction on these databases */
   yDbMask cookieMask;  /* Bitmask of schema verified databases */
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+  yDbMask schemaMask;  /* Databases whose in-memory schema is modified */
+#endif
   int cookieGoto;      /* Address of OP_Goto to cookie verifier subroutine */
   int cookieValue[SQLITE_MAX_ATTACHED+2];  /* Values of cookies to verify */
   int regRowid;        /* Register holding rowid of CREATE TABLE entry */
@@ -2340,11 +2399,13 @@ struct AuthContext {
 #define OPFLAG_ISUPDATE      0x04    /* This OP_Insert is an sql UPDATE */
 #define OPFLAG_APPEND        0x08    /* This is likely to be an append */
 #define OPFLAG_USESEEKRESULT 0x10    /* Try to avoid a seek in BtreeInsert() */
+#define OPFLAG_DEFERRED      0x20    /* OP_IdxInsert may defer the entry */
 #define OPFLAG_CLEARCACHE    0x20    /* Clear pseudo-table cache in OP_Column */
 #define OPFLAG_LENGTHARG     0x40    /* OP_Column only used for length() */
 #define OPFLAG_TYPEOFARG     0x80    /* OP_Column only used for typeof() */
 #define OPFLAG_BULKCSR       0x01    /* OP_Open** used to open bulk cursor */
 #define OPFLAG_P2ISREG       0x02    /* P2 to OP_Open** is a register number */
+#define OPFLAG_SEEKORDERED   0x04    /* OP_Open** cursor seeks in key order */
 
 /*
  * Each trigger present in the database schema is stored as an instance of
@@ -2503,6 +2564,7 @@ struct Sqlite3Config {
   int nPage;                        /* Number of pages in pPage[] */
   int mxParserStack;                /* maximum depth of the parser stack */
   int sharedCacheEnabled;           /* true if shared-cache mode enabled */
+  int bSharedSchema;                /* True to share schemas (see callback.c) */
   /* The above might be initialized to non-zero.  The following need to always
   ** initially be zero, however. */
   int isInit;                       /* True after initialization has finished */
@@ -2820,7 +2882,7 @@ void sqlite3SrcListAssignCursors(Parse*, SrcList*);
 void sqlite3IdListDelete(sqlite3*, IdList*);
 void sqlite3SrcListDelete(sqlite3*, SrcList*);
 Index *sqlite3CreateIndex(Parse*,Token*,Token*,SrcList*,ExprList*,int,Token*,
-                        Token*, int, int);
+                        Token*, int, int, Token*);
 void sqlite3DropIndex(Parse*, SrcList*, int);
 int sqlite3Select(Parse*, Select*, SelectDest*);
 Select *sqlite3SelectNew(Parse*,ExprList*,SrcList*,Expr*,ExprList*,
@@ -2829,6 +2891,7 @@ void sqlite3SelectDelete(sqlite3*, Select*);
 Table *sqlite3SrcListLookup(Parse*, SrcList*);
 int sqlite3IsReadOnly(Parse*, Table*, int);
 void sqlite3OpenTable(Parse*, int iCur, int iDb, Table*, int);
+void sqlite3OpenIndex(Parse*, int iCur, int iDb, Index*, int);
 #if defined(SQLITE_ENABLE_UPDATE_DELETE_LIMIT) && !defined(SQLITE_OMIT_SUBQUERY)
 Expr *sqlite3LimitWhere(Parse *, SrcList *, Expr *, ExprList *, Expr *, Expr *, char *);
 #endif
@@ -2880,6 +2943,13 @@ void sqlite3CommitTransaction(Parse*);
 void sqlite3RollbackTransaction(Parse*);
 void sqlite3Savepoint(Parse*, int, Token*);
 void sqlite3CloseSavepoints(sqlite3 *);
+#ifdef SQLITE_OMIT_MERGE_SORT
+# define sqlite3VdbeIdxDeferFlush(X)   SQLITE_OK
+# define sqlite3VdbeIdxDeferDiscard(X)
+#else
+int sqlite3VdbeIdxDeferFlush(sqlite3*);
+void sqlite3VdbeIdxDeferDiscard(sqlite3*);
+#endif
 void sqlite3LeaveMutexAndCloseZombie(sqlite3*);
 int sqlite3ExprIsConstant(Expr*);
 int sqlite3ExprIsConstantNotJoin(Expr*);
@@ -2892,9 +2962,11 @@ int sqlite3IsRowid(const char*);
 void sqlite3GenerateRowDelete(Parse*, Table*, int, int, int, Trigger *, int);
 void sqlite3GenerateRowIndexDelete(Parse*, Table*, int, int*);
 int sqlite3GenerateIndexKey(Parse*, Index*, int, int, int);
+void sqlite3GenerateBrinUpdate(Parse*, Index*, int, int, int);
 void sqlite3GenerateConstraintChecks(Parse*,Table*,int,int,
                                      int*,int,int,int,int,int*);
-void sqlite3CompleteInsertion(Parse*, Table*, int, int, int*, int, int, int);
+void sqlite3CompleteInsertion(Parse*, Table*, int, int, int*, int*,
+                              int, int, int, int);
 int sqlite3OpenTableAndIndices(Parse*, Table*, int, int);
 void sqlite3BeginWriteOperation(Parse*, int, int);
 void sqlite3MultiWrite(Parse*);
@@ -3102,6 +3174,20 @@ void sqlite3MinimumFileFormat(Parse*, int, int);
 void sqlite3SchemaClear(void *);
 Schema *sqlite3SchemaGet(sqlite3 *, Btree *);
 int sqlite3SchemaToIndex(sqlite3 *db, Schema *);
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+  void sqlite3SchemaShareEnter(sqlite3*);
+  void sqlite3SchemaShareLeave(sqlite3*);
+  int sqlite3SchemaShareAttach(sqlite3*, int);
+  void sqlite3SchemaSharePublish(sqlite3*, int);
+  void sqlite3SchemaShareRelease(sqlite3*, int);
+  int sqlite3SchemaShareUnshare(Parse*);
+#else
+# define sqlite3SchemaShareEnter(X)
+# define sqlite3SchemaShareLeave(X)
+# define sqlite3SchemaShareAttach(X,Y)    0
+# define sqlite3SchemaSharePublish(X,Y)
+# define sqlite3SchemaShareRelease(X,Y)
+#endif
 KeyInfo *sqlite3IndexKeyinfo(Parse *, Index *);
 int sqlite3CreateFunc(sqlite3 *, const char *, int, int, void *, 
   void (*)(sqlite3_context*,int,sqlite3_value **),
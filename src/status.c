@@ -164,6 +164,7 @@ int sqlite3_db_status(
       int nByte = 0;              /* Used to accumulate return value */
 
       sqlite3BtreeEnterAll(db);
+      sqlite3SchemaShareEnter(db);
       db->pnBytesFreed = &nByte;
       for(i=0; i<db->nDb; i++){
         Schema *pSchema = db->aDb[i].pSchema;
@@ -190,6 +191,7 @@ int sqlite3_db_status(
         }
       }
       db->pnBytesFreed = 0;
+      sqlite3SchemaShareLeave(db);
       sqlite3BtreeLeaveAll(db);
 
       *pHighwater = 0;
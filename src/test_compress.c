@@ -0,0 +1,97 @@
+/*
+** 2026 October 18
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains a binding of the "compress" VFS shim (defined in
+** ext/compress/sqlite3compress.h) to Tcl.
+*/
+#include <tcl.h>
+
+#ifdef SQLITE_ENABLE_COMPRESS
+
+#include "sqlite3compress.h"
+#include "sqlite3.h"
+
+/* From test1.c */
+const char *sqlite3TestErrorName(int);
+
+/*
+** sqlite3_compress_initialize PARENT-VFS ISDEFAULT
+*/
+static int testCompressInit(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  const char *zParent;
+  int isDefault;
+  int rc;
+
+  if( objc!=3 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "PARENT-VFS ISDEFAULT");
+    return TCL_ERROR;
+  }
+  zParent = Tcl_GetString(objv[1]);
+  if( !*zParent ){
+    zParent = 0;
+  }
+  if( Tcl_GetBooleanFromObj(interp, objv[2], &isDefault) ){
+    return TCL_ERROR;
+  }
+
+  rc = sqlite3_compress_initialize(zParent, isDefault);
+  if( rc!=SQLITE_OK ){
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(sqlite3TestErrorName(rc), -1));
+    return TCL_ERROR;
+  }
+  return TCL_OK;
+}
+
+/*
+** sqlite3_compress_shutdown
+*/
+static int testCompressShutdown(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  int rc;
+
+  if( objc!=1 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "");
+    return TCL_ERROR;
+  }
+  rc = sqlite3_compress_shutdown();
+  if( rc!=SQLITE_OK ){
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(sqlite3TestErrorName(rc), -1));
+    return TCL_ERROR;
+  }
+  return TCL_OK;
+}
+
+#endif  /* SQLITE_ENABLE_COMPRESS */
+
+/*
+** This routine registers the custom TCL commands defined in this
+** module.  This should be the only procedure visible from outside
+** of this module.
+*/
+int Sqlitetestcompress_Init(Tcl_Interp *interp){
+#ifdef SQLITE_ENABLE_COMPRESS
+  Tcl_CreateObjCommand(interp, "sqlite3_compress_initialize",
+      testCompressInit, 0, 0);
+  Tcl_CreateObjCommand(interp, "sqlite3_compress_shutdown",
+      testCompressShutdown, 0, 0);
+#endif  /* SQLITE_ENABLE_COMPRESS */
+  return TCL_OK;
+}
@@ -623,6 +623,376 @@ static int blocking_prepare_v2_proc(
 ** End of implementation of [sqlite3_blocking_step].
 ************************************************************************/
 
+/*************************************************************************
+** Begin implementation of [sqlite3_shared_schema_test].
+**
+** This command runs several threads, each with its own database
+** connection, against a single database file.  It is used to check that
+** connections that share a schema (see SQLITE_CONFIG_SHARED_SCHEMA) may
+** compile statements concurrently while another connection changes the
+** schema, and that a connection waiting on the busy-handler does not
+** stall the others.
+*/
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+
+/*
+** One of these is allocated for each thread started by
+** [sqlite3_shared_schema_test].
+*/
+typedef struct SchemaShareThread SchemaShareThread;
+struct SchemaShareThread {
+  const char *zFile;        /* Database file to open */
+  int nIter;                /* Number of iterations to run */
+  void (*xTask)(SchemaShareThread*);  /* Function run by the thread */
+  volatile int bBusy;       /* Set when the busy-handler is first invoked */
+  volatile int bDone;       /* Set after xTask has returned */
+  int nRow;                 /* Value returned by the last query */
+  char *zErr;               /* Error message from sqlite3_mprintf() */
+};
+
+/*
+** Record an error for statement zSql of connection db in p->zErr, unless
+** an error has already been recorded.
+*/
+static void schemaShareError(
+  SchemaShareThread *p,
+  sqlite3 *db,
+  const char *zSql
+){
+  if( p->zErr==0 ){
+    p->zErr = sqlite3_mprintf("%s: %s", zSql, sqlite3_errmsg(db));
+  }
+}
+
+/*
+** Run the SQL script zSql using connection db.  Return SQLITE_OK if
+** successful, or record an error and return an error code otherwise.
+*/
+static int schemaShareExec(
+  SchemaShareThread *p,
+  sqlite3 *db,
+  const char *zSql
+){
+  int rc = sqlite3_exec(db, zSql, 0, 0, 0);
+  if( rc!=SQLITE_OK ){
+    schemaShareError(p, db, zSql);
+    sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+  }
+  return rc;
+}
+
+/*
+** Open connection *pDb on database file p->zFile with a busy-timeout of
+** five seconds.
+*/
+static int schemaShareOpen(SchemaShareThread *p, sqlite3 **pDb){
+  int rc = sqlite3_open(p->zFile, pDb);
+  if( rc!=SQLITE_OK ){
+    schemaShareError(p, *pDb, "sqlite3_open");
+    return rc;
+  }
+  sqlite3_busy_timeout(*pDb, 5000);
+  return SQLITE_OK;
+}
+
+/*
+** Compile and run the query zSql.  Check that each row has either two
+** columns or three, and that in the latter case the third is the sum of
+** the first two.  Set p->nRow to the number of rows returned.
+**
+** If the schema keeps changing between compiling the statement and running
+** it, sqlite3_step() eventually gives up and returns SQLITE_SCHEMA.  The
+** query is simply run again in that case.
+*/
+static int schemaShareQuery(
+  SchemaShareThread *p,
+  sqlite3 *db,
+  const char *zSql
+){
+  sqlite3_stmt *pStmt;
+  int rc;
+
+  do{
+    p->nRow = 0;
+    pStmt = 0;
+    rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+    while( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
+      int nCol = sqlite3_column_count(pStmt);
+      if( nCol<2 || nCol>3 || (nCol==3 && sqlite3_column_int(pStmt, 2)
+            !=sqlite3_column_int(pStmt, 0)+sqlite3_column_int(pStmt, 1))
+      ){
+        if( p->zErr==0 ){
+          p->zErr = sqlite3_mprintf("%s: unexpected row", zSql);
+        }
+        rc = SQLITE_ERROR;
+      }
+      p->nRow++;
+    }
+    if( rc==SQLITE_OK ) rc = sqlite3_finalize(pStmt);
+    else sqlite3_finalize(pStmt);
+  }while( rc==SQLITE_SCHEMA );
+  if( rc!=SQLITE_OK ) schemaShareError(p, db, zSql);
+  return rc;
+}
+
+/*
+** Task run by reader threads.  Compile and run queries against a view
+** and an indexed column of table t1 p->nIter times.
+*/
+static void schemaShareReader(SchemaShareThread *p){
+  sqlite3 *db = 0;
+  int rc;
+  int i;
+
+  rc = schemaShareOpen(p, &db);
+  for(i=0; rc==SQLITE_OK && i<p->nIter; i++){
+    rc = schemaShareQuery(p, db, "SELECT * FROM v1");
+    if( rc==SQLITE_OK ){
+      rc = schemaShareQuery(p, db, "SELECT a, b FROM t1 WHERE b>='5'");
+    }
+  }
+  sqlite3_close(db);
+}
+
+/*
+** Task run by the writer thread.  Redefine view v1 and create or drop an
+** index on table t1 p->nIter times.
+*/
+static void schemaShareWriter(SchemaShareThread *p){
+  sqlite3 *db = 0;
+  int rc;
+  int i;
+
+  rc = schemaShareOpen(p, &db);
+  for(i=0; rc==SQLITE_OK && i<p->nIter; i++){
+    if( i%2 ){
+      rc = schemaShareExec(p, db,
+          "BEGIN; DROP VIEW v1; CREATE VIEW v1 AS SELECT a, b FROM t1;"
+          "DROP INDEX i2; COMMIT;"
+      );
+    }else{
+      rc = schemaShareExec(p, db,
+          "BEGIN; DROP VIEW v1; CREATE VIEW v1 AS SELECT a, b, a+b FROM t1;"
+          "CREATE INDEX i2 ON t1(a, b); COMMIT;"
+      );
+    }
+  }
+  sqlite3_close(db);
+}
+
+/*
+** Busy-handler used by schemaShareBusy().  Wait for up to five seconds.
+*/
+static int schemaShareBusyHandler(void *pArg, int nPrior){
+  SchemaShareThread *p = (SchemaShareThread*)pArg;
+  p->bBusy = 1;
+  sqlite3_sleep(10);
+  return nPrior<500;
+}
+
+/*
+** Task run by a thread that opens a new connection and counts the rows
+** of table t1 while another connection holds an exclusive lock.  Loading
+** the schema waits on the busy-handler until the lock is released.
+*/
+static void schemaShareBusy(SchemaShareThread *p){
+  sqlite3 *db = 0;
+  if( schemaShareOpen(p, &db)==SQLITE_OK ){
+    sqlite3_busy_handler(db, schemaShareBusyHandler, (void*)p);
+    schemaShareQuery(p, db, "SELECT a, b FROM t1");
+  }
+  sqlite3_close(db);
+}
+
+/*
+** The main function for threads started by [sqlite3_shared_schema_test].
+*/
+static Tcl_ThreadCreateType schemaShareThreadMain(ClientData pArg){
+  SchemaShareThread *p = (SchemaShareThread*)pArg;
+  p->xTask(p);
+  p->bDone = 1;
+  Tcl_ExitThread(0);
+  TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+** Start a thread to run p->xTask.  Return non-zero if it cannot be
+** started.
+*/
+static int schemaShareStart(SchemaShareThread *p, Tcl_ThreadId *pId){
+  return Tcl_CreateThread(pId, schemaShareThreadMain, (ClientData)p,
+      TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE
+  )!=TCL_OK;
+}
+
+/*
+** Return non-zero if the main database of db uses a shared schema.
+*/
+static int schemaShareIsShared(sqlite3 *db){
+  Schema *pSchema = db->aDb[0].pSchema;
+  return pSchema && (pSchema->flags & DB_Shared)!=0;
+}
+
+/*
+** Usage: sqlite3_shared_schema_test FILENAME ?NREADER? ?NITER?
+**
+** The library must have been configured using
+** [sqlite3_config_shared_schema 1].  Database FILENAME is overwritten.
+**
+** First, two connections are opened and it is checked that they share
+** the schema of FILENAME.  Then one of them takes an exclusive lock and
+** a new connection is started in another thread, which must wait on its
+** busy-handler to load the schema.  Both existing connections must be
+** able to compile statements while it waits.
+**
+** Finally, NREADER threads (default 4) compile and run queries against
+** the database NITER times (default 200) each while another thread
+** changes the schema NITER/4 times.  No errors may occur.
+**
+** An empty string is returned if the tests pass.  Otherwise an error is
+** thrown.
+*/
+static int shared_schema_test_proc(
+  ClientData clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  SchemaShareThread aThread[9];    /* aThread[0] is the writer */
+  Tcl_ThreadId aId[9];
+  SchemaShareThread s;
+  sqlite3 *db1 = 0;
+  sqlite3 *db2 = 0;
+  const char *zFile;
+  int nReader = 4;
+  int nIter = 200;
+  int nStarted = 0;
+  int i;
+
+  if( objc<2 || objc>4 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "FILENAME ?NREADER? ?NITER?");
+    return TCL_ERROR;
+  }
+  if( (objc>2 && Tcl_GetIntFromObj(interp, objv[2], &nReader))
+   || (objc>3 && Tcl_GetIntFromObj(interp, objv[3], &nIter))
+  ){
+    return TCL_ERROR;
+  }
+  if( nReader<1 || nReader>ArraySize(aThread)-1 || nIter<4 ){
+    Tcl_AppendResult(interp, "NREADER or NITER out of range", (char*)0);
+    return TCL_ERROR;
+  }
+  zFile = Tcl_GetString(objv[1]);
+  memset(&s, 0, sizeof(s));
+  memset(aThread, 0, sizeof(aThread));
+  s.zFile = zFile;
+
+  /* Create the database, then check that two new connections share its
+  ** schema. */
+  if( schemaShareOpen(&s, &db1)==SQLITE_OK
+   && schemaShareExec(&s, db1,
+        "PRAGMA journal_mode = DELETE;"
+        "DROP VIEW IF EXISTS v1; DROP TABLE IF EXISTS t1;"
+        "CREATE TABLE t1(a INTEGER PRIMARY KEY, b TEXT);"
+        "CREATE INDEX i1 ON t1(b);"
+        "CREATE VIEW v1 AS SELECT a, b FROM t1;"
+        "INSERT INTO t1 VALUES(1, 1); INSERT INTO t1 VALUES(2, 7);"
+        "INSERT INTO t1 SELECT a+2, b+3 FROM t1;"
+      )==SQLITE_OK
+  ){
+    sqlite3_close(db1);
+    db1 = 0;
+    if( schemaShareOpen(&s, &db1)==SQLITE_OK
+     && schemaShareOpen(&s, &db2)==SQLITE_OK
+     && schemaShareQuery(&s, db1, "SELECT * FROM v1")==SQLITE_OK
+     && schemaShareQuery(&s, db2, "SELECT * FROM v1")==SQLITE_OK
+     && (!schemaShareIsShared(db1)
+          || db1->aDb[0].pSchema!=db2->aDb[0].pSchema)
+    ){
+      s.zErr = sqlite3_mprintf("schema is not shared");
+    }
+  }
+
+  /* While db1 holds an exclusive lock, start a thread with a connection
+  ** that must wait for it.  Check that db1 and db2 can still compile
+  ** statements before that thread gives up. */
+  if( s.zErr==0
+   && schemaShareExec(&s, db1, "BEGIN EXCLUSIVE")==SQLITE_OK
+  ){
+    sqlite3_stmt *pStmt = 0;
+    sqlite3_stmt *pCommit = 0;
+    aThread[0].zFile = zFile;
+    aThread[0].xTask = schemaShareBusy;
+    if( schemaShareStart(&aThread[0], &aId[0]) ){
+      s.zErr = sqlite3_mprintf("cannot start thread");
+    }else{
+      int nWait;
+      int rc;
+      for(nWait=0; aThread[0].bBusy==0 && nWait<2000; nWait++){
+        sqlite3_sleep(1);
+      }
+      if( aThread[0].bBusy
+       && sqlite3_prepare_v2(db2, "SELECT * FROM v1", -1, &pStmt, 0)==SQLITE_OK
+       && sqlite3_prepare_v2(db1, "COMMIT", -1, &pCommit, 0)==SQLITE_OK
+       && aThread[0].bDone
+      ){
+        s.zErr = sqlite3_mprintf("prepare waited on the busy-handler");
+      }
+      sqlite3_finalize(pStmt);
+      if( pCommit ) sqlite3_step(pCommit);
+      rc = sqlite3_finalize(pCommit);
+      if( rc!=SQLITE_OK ) schemaShareError(&s, db1, "COMMIT");
+      Tcl_JoinThread(aId[0], &rc);
+      if( s.zErr==0 && aThread[0].zErr ){
+        s.zErr = aThread[0].zErr;
+        aThread[0].zErr = 0;
+      }
+      if( s.zErr==0 && aThread[0].nRow!=4 ){
+        s.zErr = sqlite3_mprintf("expected 4 rows, got %d", aThread[0].nRow);
+      }
+      sqlite3_free(aThread[0].zErr);
+    }
+  }
+  sqlite3_close(db1);
+  sqlite3_close(db2);
+
+  /* Compile statements in nReader threads while the schema is changed in
+  ** another. */
+  if( s.zErr==0 ){
+    memset(aThread, 0, sizeof(aThread));
+    for(i=0; i<=nReader; i++){
+      aThread[i].zFile = zFile;
+      aThread[i].nIter = i ? nIter : nIter/4;
+      aThread[i].xTask = i ? schemaShareReader : schemaShareWriter;
+      if( schemaShareStart(&aThread[i], &aId[i]) ){
+        s.zErr = sqlite3_mprintf("cannot start thread");
+        break;
+      }
+      nStarted++;
+    }
+    for(i=0; i<nStarted; i++){
+      int rc;
+      Tcl_JoinThread(aId[i], &rc);
+      if( s.zErr==0 && aThread[i].zErr ){
+        s.zErr = aThread[i].zErr;
+        aThread[i].zErr = 0;
+      }
+      sqlite3_free(aThread[i].zErr);
+    }
+  }
+
+  if( s.zErr ){
+    Tcl_AppendResult(interp, s.zErr, (char*)0);
+    sqlite3_free(s.zErr);
+    return TCL_ERROR;
+  }
+  return TCL_OK;
+}
+#endif /* SQLITE_ENABLE_SHARED_SCHEMA */
+/*
+** End of implementation of [sqlite3_shared_schema_test].
+************************************************************************/
+
 /*
 ** Register commands with the TCL interpreter.
 */
@@ -635,6 +1005,10 @@ int SqlitetestThread_Init(Tcl_Interp *interp){
       "sqlite3_blocking_prepare_v2", blocking_prepare_v2_proc, (void *)1, 0);
   Tcl_CreateObjCommand(interp, 
       "sqlite3_nonblocking_prepare_v2", blocking_prepare_v2_proc, 0, 0);
+#endif
+#ifdef SQLITE_ENABLE_SHARED_SCHEMA
+  Tcl_CreateObjCommand(interp,
+      "sqlite3_shared_schema_test", shared_schema_test_proc, 0, 0);
 #endif
   return TCL_OK;
 }
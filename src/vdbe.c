@@ -3513,7 +3513,9 @@ case OP_VerifyCookie: {
 ** It is an error for P1 to be negative.
 **
 ** If P5!=0 then use the content of register P2 as the root page, not
-** the value of P2 itself.
+** the value of P2 itself.  The OPFLAG_SEEKORDERED bit of P5 is an
+** exception: it is a hint that the cursor will mostly be moved by seeks
+** made in ascending key order, as when it is driven by an IN operator.
 **
 ** There will be a read lock on the database whenever there is an
 ** open cursor.  If the database was unlocked prior to this instruction
@@ -3536,7 +3538,8 @@ case OP_VerifyCookie: {
 **
 ** Open a read/write cursor named P1 on the table or index whose root
 ** page is P2.  Or if P5!=0 use the content of register P2 to find the
-** root page.
+** root page.  P5 may also contain the OPFLAG_SEEKORDERED hint described
+** under OpenRead.
 **
 ** The P4 value may be either an integer (P4_INT32) or a pointer to
 ** a KeyInfo structure (P4_KEYINFO). If it is a pointer to a KeyInfo
@@ -3562,8 +3565,9 @@ case OP_OpenWrite: {
   VdbeCursor *pCur;
   Db *pDb;
 
-  assert( (pOp->p5&(OPFLAG_P2ISREG|OPFLAG_BULKCSR))==pOp->p5 );
-  assert( pOp->opcode==OP_OpenWrite || pOp->p5==0 );
+  assert( (pOp->p5&(OPFLAG_P2ISREG|OPFLAG_BULKCSR|OPFLAG_SEEKORDERED))
+              ==pOp->p5 );
+  assert( pOp->opcode==OP_OpenWrite || (pOp->p5&~OPFLAG_SEEKORDERED)==0 );
 
   if( p->expired ){
     rc = SQLITE_ABORT;
@@ -3620,7 +3624,9 @@ case OP_OpenWrite: {
   rc = sqlite3BtreeCursor(pX, p2, wrFlag, pKeyInfo, pCur->pCursor);
   pCur->pKeyInfo = pKeyInfo;
   assert( OPFLAG_BULKCSR==BTREE_BULKLOAD );
-  sqlite3BtreeCursorHints(pCur->pCursor, (pOp->p5 & OPFLAG_BULKCSR));
+  assert( OPFLAG_SEEKORDERED==BTREE_SEEK_ORDERED );
+  sqlite3BtreeCursorHints(pCur->pCursor,
+                          (pOp->p5 & (OPFLAG_BULKCSR|OPFLAG_SEEKORDERED)));
 
   /* Since it performs no memory allocation or IO, the only value that
   ** sqlite3BtreeCursor() may return is SQLITE_OK. */
@@ -4951,6 +4957,13 @@ case OP_Next: {        /* jump */
 ** P3 is a flag that provides a hint to the b-tree layer that this
 ** insert is likely to be an append.
 **
+** If P5 has the OPFLAG_DEFERRED bit set, then P4 is the root page of
+** the index.  In that case, if this is the only statement running and
+** the connection is inside an explicit transaction, the key is handed to
+** sqlite3VdbeIdxDeferWrite() instead of being inserted into the index
+** right away.  It is written to the index, in key order together with
+** the keys of later statements, before anything can read the index.
+**
 ** This instruction only works for indices.  The equivalent instruction
 ** for tables is OP_Insert.
 */
@@ -4977,6 +4990,14 @@ case OP_IdxInsert: {        /* in2 */
     if( rc==SQLITE_OK ){
       if( isSorter(pC) ){
         rc = sqlite3VdbeSorterWrite(db, pC, pIn2);
+#ifndef SQLITE_OMIT_MERGE_SORT
+      }else if( (pOp->p5 & OPFLAG_DEFERRED)!=0
+             && db->autoCommit==0 && db->activeVdbeCnt==1
+             && !sqlite3BtreeSharable(db->aDb[pC->iDb].pBt)
+      ){
+        assert( pOp->p4type==P4_INT32 );
+        rc = sqlite3VdbeIdxDeferWrite(db, pC, pOp->p4.i, pIn2);
+#endif
       }else{
         nKey = pIn2->n;
         zKey = pIn2->z;
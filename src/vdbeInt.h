@@ -368,6 +368,7 @@ struct Vdbe {
   u8 inVtabMethod;        /* See comments above */
   u8 usesStmtJournal;     /* True if uses a statement journal */
   u8 readOnly;            /* True for read-only statements */
+  u8 deferIdx;            /* True if OP_IdxInsert may defer index entries */
   u8 isPrepareV2;         /* True if prepared with prepare_v2() */
   int nChange;            /* Number of db changes made since last reset */
   yDbMask btreeMask;      /* Bitmask of db->aDb[] entries referenced */
@@ -476,6 +477,10 @@ int sqlite3VdbeTransferError(Vdbe *p);
 # define sqlite3VdbeSorterRewind(X,Y,Z)  SQLITE_OK
 # define sqlite3VdbeSorterNext(X,Y,Z)    SQLITE_OK
 # define sqlite3VdbeSorterCompare(X,Y,Z) SQLITE_OK
+# define sqlite3VdbeIdxDeferWrite(W,X,Y,Z) SQLITE_OK
+# define sqlite3VdbeIdxDeferFull(X)      0
+# define sqlite3VdbeIdxDeferMark(X)
+# define sqlite3VdbeIdxDeferRevert(X)
 #else
 int sqlite3VdbeSorterInit(sqlite3 *, VdbeCursor *);
 void sqlite3VdbeSorterClose(sqlite3 *, VdbeCursor *);
@@ -484,6 +489,10 @@ int sqlite3VdbeSorterNext(sqlite3 *, const VdbeCursor *, int *);
 int sqlite3VdbeSorterRewind(sqlite3 *, const VdbeCursor *, int *);
 int sqlite3VdbeSorterWrite(sqlite3 *, const VdbeCursor *, Mem *);
 int sqlite3VdbeSorterCompare(const VdbeCursor *, Mem *, int *);
+int sqlite3VdbeIdxDeferWrite(sqlite3 *, const VdbeCursor *, int, Mem *);
+int sqlite3VdbeIdxDeferFull(sqlite3 *);
+void sqlite3VdbeIdxDeferMark(sqlite3 *);
+void sqlite3VdbeIdxDeferRevert(sqlite3 *);
 #endif
 
 #if !defined(SQLITE_OMIT_SHARED_CACHE) && SQLITE_THREADSAFE>0
@@ -388,6 +388,24 @@ static int sqlite3Step(Vdbe *p){
 
     assert( db->writeVdbeCnt>0 || db->autoCommit==0 || db->nDeferredCons==0 );
 
+    /* Write out the index entries deferred by earlier INSERT statements
+    ** before this statement gets a chance to read the indices.  Only a
+    ** statement that can defer more entries itself may leave them in
+    ** place, and only until they outgrow the page cache.
+    */
+    if( db->pIdxDefer ){
+      assert( db->autoCommit==0 );
+      if( p->deferIdx==0 || sqlite3VdbeIdxDeferFull(db) ){
+        rc = sqlite3VdbeIdxDeferFlush(db);
+        if( rc!=SQLITE_OK ){
+          p->rc = rc;
+          rc = SQLITE_ERROR;
+          goto end_of_step;
+        }
+      }
+      sqlite3VdbeIdxDeferMark(db);
+    }
+
 #ifndef SQLITE_OMIT_TRACE
     if( db->xProfile && !db->init.busy ){
       sqlite3OsCurrentTimeInt64(db->pVfs, &p->startTime);
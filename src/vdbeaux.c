@@ -413,6 +413,7 @@ static void resolveP2Values(Vdbe *p, int *pMaxFuncArgs){
   Op *pOp;
   int *aLabel = p->aLabel;
   p->readOnly = 1;
+  p->deferIdx = 0;
   for(pOp=p->aOp, i=p->nOp-1; i>=0; i--, pOp++){
     u8 opcode = pOp->opcode;
 
@@ -421,6 +422,8 @@ static void resolveP2Values(Vdbe *p, int *pMaxFuncArgs){
       if( pOp->p5>nMaxArgs ) nMaxArgs = pOp->p5;
     }else if( (opcode==OP_Transaction && pOp->p2!=0) || opcode==OP_Vacuum ){
       p->readOnly = 0;
+    }else if( opcode==OP_IdxInsert && (pOp->p5 & OPFLAG_DEFERRED)!=0 ){
+      p->deferIdx = 1;
 #ifndef SQLITE_OMIT_VIRTUALTABLE
     }else if( opcode==OP_VUpdate ){
       if( pOp->p2>nMaxArgs ) nMaxArgs = pOp->p2;
@@ -2152,6 +2155,12 @@ int sqlite3VdbeHalt(Vdbe *p){
 	*/
     sqlite3VdbeEnter(p);
 
+    /* If the statement failed, take back the index entries it deferred.
+    ** The statement or transaction rollback below does not see them. */
+    if( p->deferIdx && p->rc!=SQLITE_OK ){
+      sqlite3VdbeIdxDeferRevert(db);
+    }
+
     /* Check for one of the special errors 
 	检查是否存在special errors
 	*/
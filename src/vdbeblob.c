@@ -191,6 +191,7 @@ int sqlite3_blob_open(
         pParse->zErrMsg = 0;
       }
       rc = SQLITE_ERROR;
+      sqlite3SchemaShareLeave(db);
       sqlite3BtreeLeaveAll(db);
       goto blob_open_out;
     }
@@ -205,6 +206,7 @@ int sqlite3_blob_open(
       sqlite3DbFree(db, zErr);
       zErr = sqlite3MPrintf(db, "no such column: \"%s\"", zColumn);
       rc = SQLITE_ERROR;
+      sqlite3SchemaShareLeave(db);
       sqlite3BtreeLeaveAll(db);
       goto blob_open_out;
     }
@@ -245,6 +247,7 @@ int sqlite3_blob_open(
         sqlite3DbFree(db, zErr);
         zErr = sqlite3MPrintf(db, "cannot open %s column for writing", zFault);
         rc = SQLITE_ERROR;
+        sqlite3SchemaShareLeave(db);
         sqlite3BtreeLeaveAll(db);
         goto blob_open_out;
       }
@@ -307,6 +310,7 @@ int sqlite3_blob_open(
     pBlob->flags = flags;
     pBlob->iCol = iCol;
     pBlob->db = db;
+    sqlite3SchemaShareLeave(db);
     sqlite3BtreeLeaveAll(db);
     if( db->mallocFailed ){
       goto blob_open_out;
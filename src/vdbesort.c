@@ -1035,4 +1035,219 @@ int sqlite3VdbeSorterCompare(
   return SQLITE_OK;
 }
 
+/*
+** An IdxDefer object holds the entries that single-row INSERT statements
+** run inside an explicit transaction have made for one index without a
+** uniqueness constraint, but not yet written to that index.  The entries
+** are kept in the in-memory list of a sorter.  They are written to the
+** index, in key order, by sqlite3VdbeIdxDeferFlush() before the
+** connection runs any statement that might read the index, before the
+** transaction commits and whenever the lists grow larger than the page
+** cache.  Each index page is then modified once per batch of rows rather
+** than once per row.
+**
+** All IdxDefer objects for a connection are linked together in a list
+** headed at sqlite3.pIdxDefer.
+*/
+struct IdxDefer {
+  Btree *pBt;                     /* Btree holding the index */
+  int iRoot;                      /* Root page of the index */
+  int nRecord;                    /* Number of entries held */
+  int nMark;                      /* Value of nRecord when statement began */
+  VdbeCursor csr;                 /* Sorter cursor holding the entries */
+  IdxDefer *pNext;                /* Next object for the same connection */
+};
+
+/*
+** Free an IdxDefer object and the entries it holds.
+*/
+static void vdbeIdxDeferFree(sqlite3 *db, IdxDefer *p){
+  sqlite3VdbeSorterClose(db, &p->csr);
+  sqlite3DbFree(db, p);
+}
+
+/*
+** Add the index key in pVal to the entries held for the index with root
+** page iRoot that write cursor pC is open on.  The entry is written to
+** the index by the next call to sqlite3VdbeIdxDeferFlush().
+*/
+int sqlite3VdbeIdxDeferWrite(
+  sqlite3 *db,                    /* Database handle */
+  const VdbeCursor *pC,           /* Write cursor open on the index */
+  int iRoot,                      /* Root page of the index */
+  Mem *pVal                       /* Memory cell containing index key */
+){
+  Btree *pBt = db->aDb[pC->iDb].pBt;
+  IdxDefer *p;
+  int rc;
+
+  for(p=db->pIdxDefer; p; p=p->pNext){
+    if( p->pBt==pBt && p->iRoot==iRoot ) break;
+  }
+  if( p==0 ){
+    KeyInfo *pKeyInfo = pC->pKeyInfo;
+    KeyInfo *pCopy;
+    int nField = pKeyInfo->nField;
+    int nKeyInfo = sizeof(KeyInfo) + (nField-1)*sizeof(CollSeq*);
+
+    /* The KeyInfo belongs to the statement, which may be finalized
+    ** before the entries are written out.  So take a copy of it. */
+    p = (IdxDefer *)sqlite3DbMallocZero(db,
+        sizeof(IdxDefer) + nKeyInfo + nField
+    );
+    if( p==0 ) return SQLITE_NOMEM;
+    pCopy = (KeyInfo *)&p[1];
+    memcpy(pCopy, pKeyInfo, nKeyInfo);
+    if( pKeyInfo->aSortOrder ){
+      pCopy->aSortOrder = &((u8 *)pCopy)[nKeyInfo];
+      memcpy(pCopy->aSortOrder, pKeyInfo->aSortOrder, nField);
+    }
+    p->pBt = pBt;
+    p->iRoot = iRoot;
+    p->csr.pKeyInfo = pCopy;
+    rc = sqlite3VdbeSorterInit(db, &p->csr);
+    if( rc!=SQLITE_OK ){
+      vdbeIdxDeferFree(db, p);
+      return rc;
+    }
+
+    /* Never spill the entries to a PMA.  They must stay in the in-memory
+    ** list so that sqlite3VdbeIdxDeferRevert() can remove them again. */
+    p->csr.pSorter->mxPmaSize = 0;
+    p->pNext = db->pIdxDefer;
+    db->pIdxDefer = p;
+  }
+
+  rc = sqlite3VdbeSorterWrite(db, &p->csr, pVal);
+  if( rc==SQLITE_OK ) p->nRecord++;
+  return rc;
+}
+
+/*
+** Return true if the index entries held by connection db use more memory
+** than the page cache of the main database, and so should be written out
+** before any more are added.
+*/
+int sqlite3VdbeIdxDeferFull(sqlite3 *db){
+  IdxDefer *p;
+  i64 nByte = 0;
+  int mxCache;
+
+  for(p=db->pIdxDefer; p; p=p->pNext){
+    nByte += p->csr.pSorter->nInMemory;
+  }
+  mxCache = db->aDb[0].pSchema->cache_size;
+  if( mxCache<SORTER_MIN_WORKING ) mxCache = SORTER_MIN_WORKING;
+  return nByte>(i64)mxCache*sqlite3BtreeGetPageSize(db->aDb[0].pBt);
+}
+
+/*
+** Record the number of entries held for each index when a statement that
+** may defer index entries starts, so that they can be restored by
+** sqlite3VdbeIdxDeferRevert() if the statement fails.
+*/
+void sqlite3VdbeIdxDeferMark(sqlite3 *db){
+  IdxDefer *p;
+  for(p=db->pIdxDefer; p; p=p->pNext){
+    p->nMark = p->nRecord;
+  }
+}
+
+/*
+** Remove the entries added since the last call to
+** sqlite3VdbeIdxDeferMark().  This is called when a statement that may
+** have deferred index entries fails, as the statement transaction that
+** rolls back its other changes does not know about them.
+*/
+void sqlite3VdbeIdxDeferRevert(sqlite3 *db){
+  IdxDefer **pp = &db->pIdxDefer;
+  IdxDefer *p;
+
+  while( (p = *pp)!=0 ){
+    VdbeSorter *pSorter = p->csr.pSorter;
+    while( p->nRecord>p->nMark ){
+      SorterRecord *pRecord = pSorter->pRecord;
+      assert( pRecord );
+      pSorter->pRecord = pRecord->pNext;
+      pSorter->nInMemory -= sqlite3VarintLen(pRecord->nVal) + pRecord->nVal;
+      sqlite3DbFree(db, pRecord);
+      p->nRecord--;
+    }
+    if( p->nRecord==0 ){
+      *pp = p->pNext;
+      vdbeIdxDeferFree(db, p);
+    }else{
+      pp = &p->pNext;
+    }
+  }
+}
+
+/*
+** Discard all index entries held by connection db without writing them.
+** This is called when the transaction that made them is rolled back.
+*/
+void sqlite3VdbeIdxDeferDiscard(sqlite3 *db){
+  IdxDefer *p;
+  while( (p = db->pIdxDefer)!=0 ){
+    db->pIdxDefer = p->pNext;
+    vdbeIdxDeferFree(db, p);
+  }
+}
+
+/*
+** Sort the entries held by p and insert them into their index.
+*/
+static int vdbeIdxDeferWriteIndex(sqlite3 *db, IdxDefer *p){
+  BtCursor *pCur;                 /* Write cursor on the index */
+  int bEof = 0;                   /* True once all entries are written */
+  int rc;                         /* Return code */
+
+  pCur = (BtCursor *)sqlite3DbMallocZero(db, sqlite3BtreeCursorSize());
+  if( pCur==0 ) return SQLITE_NOMEM;
+  sqlite3BtreeEnter(p->pBt);
+  rc = sqlite3VdbeSorterRewind(db, &p->csr, &bEof);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeCursor(p->pBt, p->iRoot, 1, p->csr.pKeyInfo, pCur);
+  }
+  while( rc==SQLITE_OK && bEof==0 ){
+    int nKey;
+    void *pKey = vdbeSorterRowkey(p->csr.pSorter, &nKey);
+    rc = sqlite3BtreeInsert(pCur, pKey, nKey, "", 0, 0, 0, 0);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3VdbeSorterNext(db, &p->csr, &bEof);
+    }
+  }
+  sqlite3BtreeCloseCursor(pCur);
+  sqlite3BtreeLeave(p->pBt);
+  sqlite3DbFree(db, pCur);
+  return rc;
+}
+
+/*
+** Write all index entries held by connection db to their indices.
+**
+** If an error occurs the indices may have been left holding only some of
+** the entries, so the whole transaction is rolled back and the error code
+** returned.
+*/
+int sqlite3VdbeIdxDeferFlush(sqlite3 *db){
+  int rc = SQLITE_OK;
+  IdxDefer *p;
+
+  assert( sqlite3_mutex_held(db->mutex) );
+  while( (p = db->pIdxDefer)!=0 ){
+    db->pIdxDefer = p->pNext;
+    if( rc==SQLITE_OK ){
+      rc = vdbeIdxDeferWriteIndex(db, p);
+    }
+    vdbeIdxDeferFree(db, p);
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3RollbackAll(db, SQLITE_ABORT_ROLLBACK);
+    sqlite3CloseSavepoints(db);
+    db->autoCommit = 1;
+  }
+  return rc;
+}
+
 #endif /* #ifndef SQLITE_OMIT_MERGE_SORT */
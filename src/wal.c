@@ -286,6 +286,7 @@ int sqlite3WalTrace = 0;
 typedef struct WalIndexHdr WalIndexHdr;
 typedef struct WalIterator WalIterator;
 typedef struct WalCkptInfo WalCkptInfo;
+typedef struct WalPgnoMap WalPgnoMap;
 
 
 /*
@@ -360,22 +361,34 @@ struct WalIndexHdr {
 **
 ** We assume that 32-bit loads are atomic and so no locks are needed in
 ** order to read from any aReadMark[] entries.
+**
+** nBackfillAttempted is set by a checkpointer to the last frame it intends
+** to backfill before it starts writing to the database file, and is reset
+** along with nBackfill when the WAL is restarted. Frames up to this value
+** may already be in the database, even if the checkpoint has not finished.
+** It is used to check whether a snapshot saved by sqlite3_snapshot_get()
+** can still be opened. The field occupies space that was previously
+** reserved, so the wal-index layout is unchanged and older versions
+** simply ignore it.
 */
 struct WalCkptInfo {
   u32 nBackfill;                  /* Number of WAL frames backfilled into DB */
   u32 aReadMark[WAL_NREADER];     /* Reader marks */
+  u8 aLock[SQLITE_SHM_NLOCK];     /* Reserved space for locks */
+  u32 nBackfillAttempted;         /* WAL frames perhaps written, or maybe not */
+  u32 notUsed0;                   /* Available for future enhancements */
 };
 #define READMARK_NOT_USED  0xffffffff
 
 
-/* A block of WALINDEX_LOCK_RESERVED bytes beginning at
-** WALINDEX_LOCK_OFFSET is reserved for locks. Since some systems
-** only support mandatory file-locks, we do not read or write data
-** from the region of the file on which locks are applied.
+/* The SQLITE_SHM_NLOCK bytes of aLock[], beginning at WALINDEX_LOCK_OFFSET,
+** are reserved for locks. Since some systems only support mandatory
+** file-locks, we do not read or write data from the region of the file
+** on which locks are applied.
 */
-#define WALINDEX_LOCK_OFFSET   (sizeof(WalIndexHdr)*2 + sizeof(WalCkptInfo))
-#define WALINDEX_LOCK_RESERVED 16
-#define WALINDEX_HDR_SIZE      (WALINDEX_LOCK_OFFSET+WALINDEX_LOCK_RESERVED)
+#define WALINDEX_LOCK_OFFSET \
+    (sizeof(WalIndexHdr)*2 + offsetof(WalCkptInfo, aLock))
+#define WALINDEX_HDR_SIZE      (sizeof(WalIndexHdr)*2 + sizeof(WalCkptInfo))
 
 /* Size of header before each frame in wal */
 #define WAL_FRAME_HDRSIZE 24
@@ -404,6 +417,59 @@ struct WalCkptInfo {
   WAL_HDRSIZE + ((iFrame)-1)*(i64)((szPage)+WAL_FRAME_HDRSIZE)         \
 )
 
+/*
+** Recovery reads the WAL file in chunks of up to this many bytes.
+*/
+#ifndef SQLITE_WAL_RECOVER_NBYTE
+# define SQLITE_WAL_RECOVER_NBYTE (256*1024)
+#endif
+
+#ifdef SQLITE_ENABLE_WALIDX_FILE
+/*
+** If SQLITE_ENABLE_WALIDX_FILE is defined, a copy of the hash tables and
+** page-number arrays of the wal-index is saved to the file
+** "<database>-walidx" every SQLITE_WALIDX_SAVE_INTERVAL frames, once the
+** WAL content they describe has been synced.  When the wal-index has to
+** be rebuilt (for example after a reboot, since the -shm file is not
+** persistent), recovery loads the saved copy and only reads and checksums
+** the frames that were written after it.
+**
+** The file begins with a header of WALIDX_HDRSIZE bytes that contains
+** the following 32-bit big-endian integers:
+**
+**     0: Magic number.  0x57414c49 ("WALI")
+**     4: File format version number.  Currently 3007014.
+**     8: SQLITE_BIGENDIAN of the writer.  The index pages are native order.
+**    12: Database page size.
+**    16: WAL Salt-1 value.
+**    20: WAL Salt-2 value.
+**    24: Last WAL frame described by the saved index (a commit frame).
+**    28: Database size in pages after that commit.
+**    32: Checksum-1 of that frame, copied from its frame header.
+**    36: Checksum-2 of that frame.
+**    40: Checksum-1 of bytes 0 to 39 and the saved index pages.
+**    44: Checksum-2 of the same.
+**
+** Wal-index page I is stored at offset WALIDX_HDRSIZE+I*WALINDEX_PGSZ.
+** The first WALINDEX_HDR_SIZE bytes of page 0 (the wal-index header and
+** locks) are neither stored nor checksummed.
+**
+** The saved copy is only used if its salts match the WAL header and the
+** header of its last frame is present in the WAL with the recorded page
+** number, database size and checksum.  Frames up to that point were
+** synced before the copy was written, so this proves that the
+** saved index describes the current WAL.  The file itself is never
+** synced.  A torn or stale write fails the checksum or the frame test,
+** and recovery then falls back to reading the entire WAL.
+*/
+#ifndef SQLITE_WALIDX_SAVE_INTERVAL
+# define SQLITE_WALIDX_SAVE_INTERVAL 16384
+#endif
+#define WALIDX_MAGIC    0x57414c49
+#define WALIDX_VERSION  3007014
+#define WALIDX_HDRSIZE  64
+#endif /* SQLITE_ENABLE_WALIDX_FILE */
+
 /*
 ** An open write-ahead log file is represented by an instance of the
 ** following object.
@@ -414,6 +480,11 @@ struct Wal {
   sqlite3_file *pWalFd;      /* File handle for WAL file */
   u32 iCallback;             /* Value to pass to log callback (or 0) */
   i64 mxWalSize;             /* Truncate WAL to this size upon reset */
+  int nSyncInterval;         /* PRAGMA wal_sync_interval, in milliseconds */
+  i64 iLastSync;             /* Time of the last commit sync, in ms */
+  u8 syncPending;            /* Sync flags for unsynced commits, or 0 */
+  int szChunk;               /* Chunk size of the WAL file, or 0 */
+  i64 iPrealloc;             /* WAL file space known to be allocated */
   int nWiData;               /* Size of array apWiData */
   int szFirstBlock;          /* Size of first block written to WAL file */
   volatile u32 **apWiData;   /* Pointer to wal-index content in memory */
@@ -430,9 +501,18 @@ struct Wal {
   WalIndexHdr hdr;           /* Wal-index header for current transaction */
   const char *zWalName;      /* Name of WAL file */
   u32 nCkpt;                 /* Checkpoint sequence counter in the wal-header */
+  WalPgnoMap *pMap;          /* Private page number to frame map, or NULL */
+  u32 nMapProbe;             /* Hash tables searched while pMap==0 */
+#ifdef SQLITE_ENABLE_WALIDX_FILE
+  u32 iIdxSaved;             /* mxFrame when the wal-index was last saved */
+  u32 aIdxSalt[2];           /* WAL salts when the wal-index was last saved */
+#endif
 #ifdef SQLITE_DEBUG
   u8 lockError;              /* True if a locking error has occurred */
 #endif
+#ifdef SQLITE_ENABLE_SNAPSHOT
+  WalIndexHdr *pSnapshot;    /* Start transaction here if not NULL */
+#endif
 };
 
 /*
@@ -482,6 +562,34 @@ struct WalIterator {
   } aSegment[1];                  /* One for every 32KB page in the wal-index */
 };
 
+/*
+** When the WAL grows long, looking up a page in the wal-index means
+** searching many hash tables. A connection that does a lot of such
+** searching builds a private map from page number to the most recent
+** frame containing that page, and uses it instead. The map describes
+** frames 1 to iMax of the WAL identified by aSalt[]. It is an
+** open-addressing hash table of (pgno, frame) pairs stored in aSlot[].
+** An unused slot has a page number of zero.
+**
+** The map is extended as the connection's snapshot grows, and discarded
+** if the WAL is restarted or if frames are removed from it by a rollback.
+*/
+struct WalPgnoMap {
+  u32 iMax;                       /* Map describes frames 1..iMax */
+  u32 aSalt[2];                   /* Salt values of the WAL described */
+  u32 nSlot;                      /* Number of slots. A power of two */
+  u32 nEntry;                     /* Number of slots in use */
+  u32 *aSlot;                     /* 2*nSlot entries. Page and frame number */
+};
+
+/*
+** A page number map is only built once the snapshot contains at least
+** this many hash tables.
+*/
+#ifndef SQLITE_WAL_PGNOMAP_MINHASH
+# define SQLITE_WAL_PGNOMAP_MINHASH 4
+#endif
+
 /*
 ** Define the parameters of the hash tables in the wal-index file. There
 ** is a hash-table following every HASHTABLE_NPAGE page numbers in the
@@ -582,6 +690,126 @@ static volatile WalIndexHdr *walIndexHdr(Wal *pWal){
   + (((x)&0x00FF0000)>>8)  + (((x)&0xFF000000)>>24) \
 )
 
+/*
+** On x86 builds made with GCC 5 or later or with clang, checksums of
+** database pages are computed using SSE4.1 or AVX2 instructions if the
+** CPU supports them, as determined at runtime. Define SQLITE_DISABLE_SIMD
+** to omit this.
+*/
+#if !defined(SQLITE_DISABLE_SIMD) && (defined(__x86_64__) || defined(__i386__))
+# if defined(__clang__) || (defined(__GNUC__) && __GNUC__>=5)
+#  define WAL_CKSUM_SIMD 1
+# endif
+#endif
+
+#ifdef WAL_CKSUM_SIMD
+/*
+** The checksum computed by walChecksumBytes() is linear in its inputs.
+** Each step of the main loop maps (s1, s2) to (s1+x0+s2, s2+x1+s1'), so
+** the state after a block of N 32-bit words x[0..N-1] is (all arithmetic
+** modulo 2^32, F(i) being the i-th Fibonacci number):
+**
+**     s1' = F(N-1)*s1 + F(N)*s2   + sum( F(N-1-j)*x[j] )
+**     s2' = F(N)*s1   + F(N+1)*s2 + sum( F(N-j)*x[j] )
+**
+** The sums have no loop-carried dependency other than the accumulator,
+** so they can be evaluated several words at a time using 32-bit vector
+** multiplies (first available in SSE4.1). walChecksumBlocks() does this
+** for blocks of WAL_CKSUM_NWORD words. The result is identical to that
+** of the word-at-a-time loop. Without vector multiplies it is slower, so
+** the block method is only used when SSE4.1 or AVX2 is available.
+**
+** aWalCksumCoef[j] is F(WAL_CKSUM_NWORD-j) modulo 2^32.
+*/
+#define WAL_CKSUM_NWORD 64
+static const u32 aWalCksumCoef[WAL_CKSUM_NWORD+1] = {
+  0x61ca20bb, 0xc7b064e2, 0x9a19bbd9, 0x2d96a909,
+  0x6c8312d0, 0xc1139639, 0xab6f7c97, 0x15a419a2,
+  0x95cb62f5, 0x7fd8b6ad, 0x15f2ac48, 0x69e60a65,
+  0xac0ca1e3, 0xbdd96882, 0xee333961, 0xcfa62f21,
+  0x1e8d0a40, 0xb11924e1, 0x6d73e55f, 0x43a53f82,
+  0x29cea5dd, 0x19d699a5, 0x0ff80c38, 0x09de8d6d,
+  0x06197ecb, 0x03c50ea2, 0x02547029, 0x01709e79,
+  0x00e3d1b0, 0x008cccc9, 0x005704e7, 0x0035c7e2,
+  0x00213d05, 0x00148add, 0x000cb228, 0x0007d8b5,
+  0x0004d973, 0x0002ff42, 0x0001da31, 0x00012511,
+  0x0000b520, 0x00006ff1, 0x0000452f, 0x00002ac2,
+  0x00001a6d, 0x00001055, 0x00000a18, 0x0000063d,
+  0x000003db, 0x00000262, 0x00000179, 0x000000e9,
+  0x00000090, 0x00000059, 0x00000037, 0x00000022,
+  0x00000015, 0x0000000d, 0x00000008, 0x00000005,
+  0x00000003, 0x00000002, 0x00000001, 0x00000001,
+  0x00000000
+};
+
+/*
+** Extend the checksum in aSum[] over nBlock blocks of WAL_CKSUM_NWORD
+** words each, starting at aData[]. This function is always inlined so
+** that the copies in walChecksumBlocksSse41() and walChecksumBlocksAvx2()
+** below are compiled for those instruction sets.
+*/
+__attribute__((always_inline)) static __inline__ void walChecksumBlocksInline(
+  int nativeCksum,
+  u32 *aData,
+  int nBlock,
+  u32 *aSum
+){
+  const u32 *aCoef = aWalCksumCoef;
+  u32 s1 = aSum[0];
+  u32 s2 = aSum[1];
+  while( nBlock-- ){
+    u32 t1 = 0;
+    u32 t2 = 0;
+    u32 n1;
+    int i;
+    if( nativeCksum ){
+      for(i=0; i<WAL_CKSUM_NWORD; i++){
+        t1 += aCoef[i+1]*aData[i];
+        t2 += aCoef[i]*aData[i];
+      }
+    }else{
+      for(i=0; i<WAL_CKSUM_NWORD; i++){
+        u32 x = BYTESWAP32(aData[i]);
+        t1 += aCoef[i+1]*x;
+        t2 += aCoef[i]*x;
+      }
+    }
+    n1 = aCoef[1]*s1 + aCoef[0]*s2 + t1;
+    s2 = aCoef[0]*s1 + (aCoef[0]+aCoef[1])*s2 + t2;
+    s1 = n1;
+    aData += WAL_CKSUM_NWORD;
+  }
+  aSum[0] = s1;
+  aSum[1] = s2;
+}
+
+__attribute__((target("avx2")))
+static void walChecksumBlocksAvx2(int bNative, u32 *a, int nBlock, u32 *aSum){
+  walChecksumBlocksInline(bNative, a, nBlock, aSum);
+}
+__attribute__((target("sse4.1")))
+static void walChecksumBlocksSse41(int bNative, u32 *a, int nBlock, u32 *aSum){
+  walChecksumBlocksInline(bNative, a, nBlock, aSum);
+}
+
+/*
+** If the CPU supports SSE4.1 or AVX2, extend the checksum in aSum[] over
+** the nBlock blocks at a[] and return nBlock. Otherwise, leave aSum[]
+** unchanged and return zero.
+*/
+static int walChecksumBlocks(int bNative, u32 *a, int nBlock, u32 *aSum){
+  if( __builtin_cpu_supports("avx2") ){
+    walChecksumBlocksAvx2(bNative, a, nBlock, aSum);
+    return nBlock;
+  }
+  if( __builtin_cpu_supports("sse4.1") ){
+    walChecksumBlocksSse41(bNative, a, nBlock, aSum);
+    return nBlock;
+  }
+  return 0;
+}
+#endif /* WAL_CKSUM_SIMD */
+
 /*
 ** Generate or extend an 8 byte checksum based on the data in 
 ** array aByte[] and the initial values of aIn[0] and aIn[1] (or
@@ -612,17 +840,34 @@ static void walChecksumBytes(
   assert( nByte>=8 );
   assert( (nByte&0x00000007)==0 );
 
-  if( nativeCksum ){
-    do {
-      s1 += *aData++ + s2;
-      s2 += *aData++ + s1;
-    }while( aData<aEnd );
-  }else{
-    do {
-      s1 += BYTESWAP32(aData[0]) + s2;
-      s2 += BYTESWAP32(aData[1]) + s1;
-      aData += 2;
-    }while( aData<aEnd );
+#ifdef WAL_CKSUM_SIMD
+  /* If possible, checksum whole blocks (all of a database page) using
+  ** vector instructions. The loops below finish any remainder.  */
+  if( nByte>=WAL_CKSUM_NWORD*4 ){
+    u32 aSum[2];
+    int nBlock = nByte/(WAL_CKSUM_NWORD*4);
+    aSum[0] = s1;
+    aSum[1] = s2;
+    nBlock = walChecksumBlocks(nativeCksum, aData, nBlock, aSum);
+    s1 = aSum[0];
+    s2 = aSum[1];
+    aData += nBlock*WAL_CKSUM_NWORD;
+  }
+#endif
+
+  if( aData<aEnd ){
+    if( nativeCksum ){
+      do {
+        s1 += *aData++ + s2;
+        s2 += *aData++ + s1;
+      }while( aData<aEnd );
+    }else{
+      do {
+        s1 += BYTESWAP32(aData[0]) + s2;
+        s2 += BYTESWAP32(aData[1]) + s1;
+        aData += 2;
+      }while( aData<aEnd );
+    }
   }
 
   aOut[0] = s1;
@@ -1046,6 +1291,384 @@ static int walIndexAppend(Wal *pWal, u32 iFrame, u32 iPage){
   return rc;
 }
 
+/*
+** Free the page number map belonging to pWal, if any.
+*/
+static void walPgnoMapFree(Wal *pWal){
+  if( pWal->pMap ){
+    sqlite3_free(pWal->pMap->aSlot);
+    sqlite3_free(pWal->pMap);
+    pWal->pMap = 0;
+  }
+  pWal->nMapProbe = 0;
+}
+
+/*
+** Insert an entry mapping page pgno to frame iFrame into map p. If the
+** map already contains an entry for pgno, overwrite it. The map must
+** have at least one free slot.
+*/
+static void walPgnoMapInsert(WalPgnoMap *p, u32 pgno, u32 iFrame){
+  u32 mask = p->nSlot-1;
+  u32 i;
+  for(i=(pgno*HASHTABLE_HASH_1)&mask; p->aSlot[i*2]; i=(i+1)&mask){
+    if( p->aSlot[i*2]==pgno ) break;
+  }
+  if( p->aSlot[i*2]==0 ){
+    p->aSlot[i*2] = pgno;
+    p->nEntry++;
+  }
+  p->aSlot[i*2+1] = iFrame;
+}
+
+/*
+** Add the frames between pWal->pMap->iMax and pWal->hdr.mxFrame to the
+** page number map. Return SQLITE_OK if successful, or an error code if
+** a wal-index page cannot be mapped or memory cannot be allocated.
+*/
+static int walPgnoMapExtend(Wal *pWal){
+  WalPgnoMap *p = pWal->pMap;
+  u32 iFrame;
+  for(iFrame=p->iMax+1; iFrame<=pWal->hdr.mxFrame; iFrame++){
+    volatile u32 *aPage;
+    int rc;
+    if( p->nEntry*2>=p->nSlot ){
+      u32 *aOld = p->aSlot;
+      u32 nOld = p->nSlot;
+      u32 i;
+      p->aSlot = (u32 *)sqlite3MallocZero(nOld*4*sizeof(u32));
+      if( p->aSlot==0 ){
+        p->aSlot = aOld;
+        return SQLITE_NOMEM;
+      }
+      p->nSlot = nOld*2;
+      p->nEntry = 0;
+      for(i=0; i<nOld; i++){
+        if( aOld[i*2] ) walPgnoMapInsert(p, aOld[i*2], aOld[i*2+1]);
+      }
+      sqlite3_free(aOld);
+    }
+    rc = walIndexPage(pWal, walFramePage(iFrame), &aPage);
+    if( rc!=SQLITE_OK ) return rc;
+    walPgnoMapInsert(p, walFramePgno(pWal, iFrame), iFrame);
+    p->iMax = iFrame;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Attempt to use the page number map to find the most recent frame in
+** the current snapshot that contains page pgno. If successful, set *piRead
+** to the frame number (or to zero if the page is not in the WAL) and
+** return non-zero. Return zero if the caller should search the wal-index
+** hash tables instead.
+**
+** The map is built once the connection has searched at least as many
+** hash tables as there are frames in the snapshot, so that the cost of
+** building it is no more than what the searches have already cost.
+*/
+static int walPgnoMapFind(Wal *pWal, u32 pgno, u32 *piRead){
+  WalPgnoMap *p = pWal->pMap;
+  u32 iLast = pWal->hdr.mxFrame;
+  u32 mask;
+  u32 i;
+
+  if( p && (p->iMax>iLast || memcmp(p->aSalt, pWal->hdr.aSalt, 8)) ){
+    walPgnoMapFree(pWal);
+    p = 0;
+  }
+  if( p==0 ){
+    if( walFramePage(iLast)<SQLITE_WAL_PGNOMAP_MINHASH
+     || pWal->nMapProbe<iLast
+    ){
+      return 0;
+    }
+    sqlite3BeginBenignMalloc();
+    p = (WalPgnoMap *)sqlite3MallocZero(sizeof(WalPgnoMap));
+    if( p ){
+      p->nSlot = HASHTABLE_NSLOT;
+      p->aSlot = (u32 *)sqlite3MallocZero(p->nSlot*2*sizeof(u32));
+      if( p->aSlot==0 ){
+        sqlite3_free(p);
+        p = 0;
+      }
+    }
+    sqlite3EndBenignMalloc();
+    if( p==0 ){
+      pWal->nMapProbe = 0;
+      return 0;
+    }
+    memcpy(p->aSalt, pWal->hdr.aSalt, 8);
+    pWal->pMap = p;
+  }
+  if( p->iMax<iLast ){
+    int rc;
+    sqlite3BeginBenignMalloc();
+    rc = walPgnoMapExtend(pWal);
+    sqlite3EndBenignMalloc();
+    if( rc!=SQLITE_OK ){
+      walPgnoMapFree(pWal);
+      return 0;
+    }
+  }
+
+  mask = p->nSlot-1;
+  for(i=(pgno*HASHTABLE_HASH_1)&mask; p->aSlot[i*2]; i=(i+1)&mask){
+    if( p->aSlot[i*2]==pgno ){
+      *piRead = p->aSlot[i*2+1];
+      return 1;
+    }
+  }
+  *piRead = 0;
+  return 1;
+}
+
+#ifdef SQLITE_ENABLE_WALIDX_FILE
+/*
+** Map wal-index page iPage and set *pa to point to the part of it that is
+** saved in the -walidx file. Set *piOff to the offset of that part within
+** the page and *pnByte to its size in bytes.
+**
+** SQLITE_OK is returned if successful, or the error code returned by
+** walIndexPage() if the page cannot be mapped.
+*/
+static int walIndexSavedRegion(
+  Wal *pWal,                      /* WAL handle */
+  int iPage,                      /* Wal-index page number */
+  u8 **pa,                        /* OUT: Saved part of the page */
+  int *piOff,                     /* OUT: Offset of saved part in page */
+  int *pnByte                     /* OUT: Size of saved part in bytes */
+){
+  volatile u32 *aPage;
+  int iOff = (iPage==0 ? WALINDEX_HDR_SIZE : 0);
+  int rc;
+
+  rc = walIndexPage(pWal, iPage, &aPage);
+  if( rc!=SQLITE_OK ) return rc;
+  assert( aPage!=0 );
+  *pa = &((u8 *)aPage)[iOff];
+  *piOff = iOff;
+  *pnByte = WALINDEX_PGSZ - iOff;
+  return SQLITE_OK;
+}
+
+/*
+** Compute the checksum stored at byte offset 40 of a -walidx file header.
+** aHdr[] contains the first 40 bytes of the header. The checksum covers
+** those bytes and the saved part of wal-index pages 0 through iLast.
+** Return SQLITE_OK, or an error code if a page cannot be mapped.
+*/
+static int walIndexSavedCksum(Wal *pWal, u8 *aHdr, int iLast, u32 *aCksum){
+  int i;
+  walChecksumBytes(1, aHdr, 40, 0, aCksum);
+  for(i=0; i<=iLast; i++){
+    int iOff, nByte;
+    u8 *a;
+    int rc = walIndexSavedRegion(pWal, i, &a, &iOff, &nByte);
+    if( rc!=SQLITE_OK ) return rc;
+    walChecksumBytes(1, a, nByte, aCksum, aCksum);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** This function is called by the writer after a transaction has been
+** committed to the WAL and the wal-index header updated. If at least
+** SQLITE_WALIDX_SAVE_INTERVAL frames have been appended to the WAL since
+** this connection last saved the wal-index, sync the WAL file and save
+** the wal-index pages that have changed to the -walidx file.
+**
+** Nothing is saved if syncing is disabled, as in that case there is no
+** way to be sure that the frames described by the saved index will
+** survive a crash. If a wal-index page cannot be mapped, or any other
+** error occurs, the save is abandoned and the error ignored: the -walidx
+** file is only an optimization, and recovery does not trust it unless it
+** checks out.
+*/
+static void walIndexSave(Wal *pWal, int sync_flags){
+  u32 mxFrame = pWal->hdr.mxFrame;
+  u8 aHdr[WALIDX_HDRSIZE];        /* Header of the -walidx file */
+  u32 aCksum[2];                  /* Checksum of header and index pages */
+  sqlite3_file *pFd = 0;          /* Open -walidx file */
+  char *zIdx;                     /* Name of -walidx file */
+  int iFirst;                     /* First wal-index page to write */
+  int iLast;                      /* Last wal-index page to write */
+  int i;
+  int rc;
+
+  assert( pWal->writeLock );
+  if( sync_flags==0 ) return;
+  if( memcmp(pWal->aIdxSalt, pWal->hdr.aSalt, 8)!=0 ){
+    pWal->iIdxSaved = 0;
+  }
+  if( mxFrame<pWal->iIdxSaved+SQLITE_WALIDX_SAVE_INTERVAL ) return;
+
+  /* The saved index may only describe frames that are already durable.
+  ** Sync the WAL even if it was just synced by a synchronous=FULL commit,
+  ** as the padding frames written past the final sector boundary of that
+  ** commit are not covered by its sync.
+  */
+  rc = sqlite3OsSync(pWal->pWalFd, sync_flags & SQLITE_SYNC_MASK);
+  if( rc!=SQLITE_OK ) return;
+
+  /* Pages before the one containing frame iIdxSaved have not changed
+  ** since they were last saved by this connection.
+  */
+  iFirst = (pWal->iIdxSaved ? walFramePage(pWal->iIdxSaved) : 0);
+  iLast = walFramePage(mxFrame);
+
+  memset(aHdr, 0, sizeof(aHdr));
+  sqlite3Put4byte(&aHdr[0], WALIDX_MAGIC);
+  sqlite3Put4byte(&aHdr[4], WALIDX_VERSION);
+  sqlite3Put4byte(&aHdr[8], SQLITE_BIGENDIAN);
+  sqlite3Put4byte(&aHdr[12], pWal->szPage);
+  memcpy(&aHdr[16], pWal->hdr.aSalt, 8);
+  sqlite3Put4byte(&aHdr[24], mxFrame);
+  sqlite3Put4byte(&aHdr[28], pWal->hdr.nPage);
+  sqlite3Put4byte(&aHdr[32], pWal->hdr.aFrameCksum[0]);
+  sqlite3Put4byte(&aHdr[36], pWal->hdr.aFrameCksum[1]);
+  rc = walIndexSavedCksum(pWal, aHdr, iLast, aCksum);
+  if( rc!=SQLITE_OK ) return;
+  sqlite3Put4byte(&aHdr[40], aCksum[0]);
+  sqlite3Put4byte(&aHdr[44], aCksum[1]);
+
+  sqlite3BeginBenignMalloc();
+  zIdx = sqlite3_mprintf("%sidx", pWal->zWalName);
+  if( zIdx ){
+    rc = sqlite3OsOpenMalloc(pWal->pVfs, zIdx, &pFd,
+        SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_WAL, 0
+    );
+    for(i=iFirst; rc==SQLITE_OK && i<=iLast; i++){
+      int iOff, nByte;
+      u8 *a;
+      rc = walIndexSavedRegion(pWal, i, &a, &iOff, &nByte);
+      if( rc==SQLITE_OK ){
+        i64 iOffset = WALIDX_HDRSIZE + i*(i64)WALINDEX_PGSZ + iOff;
+        rc = sqlite3OsWrite(pFd, a, nByte, iOffset);
+      }
+    }
+    if( rc==SQLITE_OK ){
+      rc = sqlite3OsWrite(pFd, aHdr, sizeof(aHdr), 0);
+    }
+    if( rc==SQLITE_OK ){
+      pWal->iIdxSaved = mxFrame;
+      memcpy(pWal->aIdxSalt, pWal->hdr.aSalt, 8);
+    }
+    if( pFd ) sqlite3OsCloseFree(pFd);
+    sqlite3_free(zIdx);
+  }
+  sqlite3EndBenignMalloc();
+}
+
+/*
+** This function is called during recovery, after the WAL header has been
+** read into pWal->hdr and verified. nSize is the size of the WAL file in
+** bytes. If the -walidx file contains a saved copy of the wal-index that
+** describes a prefix of the current WAL, load it into the wal-index and
+** set pWal->hdr.mxFrame, nPage, szPage and aFrameCksum to describe the
+** last frame it covers. Recovery then only needs to scan the frames that
+** follow that one.
+**
+** If there is no usable saved copy, pWal->hdr.mxFrame is left set to
+** zero. Any wal-index pages that were overwritten while loading an
+** unusable copy are zeroed by walIndexAppend() as recovery reaches them.
+**
+** SQLITE_OK is returned unless an error occurs while mapping a wal-index
+** page.
+*/
+static int walIndexLoadSaved(Wal *pWal, i64 nSize){
+  int rc = SQLITE_OK;             /* Return code */
+  int bExists = 0;                /* True if the -walidx file exists */
+  sqlite3_file *pFd = 0;          /* Open -walidx file */
+  char *zIdx;                     /* Name of -walidx file */
+  u8 aHdr[WALIDX_HDRSIZE];        /* Header of the -walidx file */
+  u8 aFrame[WAL_FRAME_HDRSIZE];   /* Header of last frame covered */
+  u32 aCksum[2];                  /* Checksum of header and index pages */
+  u32 mxFrame;                    /* Last frame covered by saved index */
+  int iLast;                      /* Last wal-index page saved */
+  int i;
+
+  assert( pWal->writeLock );
+  assert( pWal->hdr.mxFrame==0 );
+
+  sqlite3BeginBenignMalloc();
+  zIdx = sqlite3_mprintf("%sidx", pWal->zWalName);
+  if( zIdx==0 ) goto load_done;
+  if( sqlite3OsAccess(pWal->pVfs, zIdx, SQLITE_ACCESS_EXISTS, &bExists)
+   || bExists==0
+   || sqlite3OsOpenMalloc(pWal->pVfs, zIdx, &pFd,
+                          SQLITE_OPEN_READONLY|SQLITE_OPEN_WAL, 0)
+   || sqlite3OsRead(pFd, aHdr, sizeof(aHdr), 0)
+  ){
+    goto load_done;
+  }
+
+  /* Check that the saved index was written by a compatible writer and
+  ** that it belongs to this WAL file. */
+  mxFrame = sqlite3Get4byte(&aHdr[24]);
+  if( sqlite3Get4byte(&aHdr[0])!=WALIDX_MAGIC
+   || sqlite3Get4byte(&aHdr[4])!=WALIDX_VERSION
+   || sqlite3Get4byte(&aHdr[8])!=SQLITE_BIGENDIAN
+   || sqlite3Get4byte(&aHdr[12])!=pWal->szPage
+   || memcmp(&aHdr[16], pWal->hdr.aSalt, 8)!=0
+   || mxFrame==0
+   || walFrameOffset(mxFrame+1, pWal->szPage)>nSize
+  ){
+    goto load_done;
+  }
+
+  /* Read the saved pages directly into the wal-index. */
+  iLast = walFramePage(mxFrame);
+  for(i=0; i<=iLast; i++){
+    int iOff, nByte;
+    u8 *a;
+    rc = walIndexSavedRegion(pWal, i, &a, &iOff, &nByte);
+    if( rc!=SQLITE_OK ) goto load_done;
+    if( sqlite3OsRead(pFd, a, nByte,
+                      WALIDX_HDRSIZE + i*(i64)WALINDEX_PGSZ + iOff) ){
+      goto load_done;
+    }
+  }
+  rc = walIndexSavedCksum(pWal, aHdr, iLast, aCksum);
+  if( rc!=SQLITE_OK ) goto load_done;
+  if( aCksum[0]!=sqlite3Get4byte(&aHdr[40])
+   || aCksum[1]!=sqlite3Get4byte(&aHdr[44])
+  ){
+    goto load_done;
+  }
+
+  /* Check that frame mxFrame of the WAL is the commit frame the saved
+  ** index claims it is. Since the chained checksum of that frame covers
+  ** all earlier frames, this also confirms that they are unchanged.
+  */
+  if( sqlite3OsRead(pWal->pWalFd, aFrame, WAL_FRAME_HDRSIZE,
+                    walFrameOffset(mxFrame, pWal->szPage))
+   || sqlite3Get4byte(&aFrame[0])!=walFramePgno(pWal, mxFrame)
+   || sqlite3Get4byte(&aFrame[4])!=sqlite3Get4byte(&aHdr[28])
+   || memcmp(&aFrame[8], pWal->hdr.aSalt, 8)!=0
+   || memcmp(&aFrame[16], &aHdr[32], 8)!=0
+  ){
+    goto load_done;
+  }
+
+  pWal->hdr.mxFrame = mxFrame;
+  walCleanupHash(pWal);
+  pWal->hdr.nPage = sqlite3Get4byte(&aHdr[28]);
+  pWal->hdr.szPage = (u16)((pWal->szPage&0xff00) | (pWal->szPage>>16));
+  pWal->hdr.aFrameCksum[0] = sqlite3Get4byte(&aHdr[32]);
+  pWal->hdr.aFrameCksum[1] = sqlite3Get4byte(&aHdr[36]);
+  pWal->iIdxSaved = mxFrame;
+  memcpy(pWal->aIdxSalt, pWal->hdr.aSalt, 8);
+  WALTRACE(("WAL%p: loaded %d frames from %s\n", pWal, mxFrame, zIdx));
+
+load_done:
+  if( pFd ) sqlite3OsCloseFree(pFd);
+  sqlite3_free(zIdx);
+  sqlite3EndBenignMalloc();
+  return rc;
+}
+#endif /* SQLITE_ENABLE_WALIDX_FILE */
+
 
 /*
 ** Recover the wal-index by reading the write-ahead log file. 
@@ -1091,9 +1714,9 @@ static int walIndexRecover(Wal *pWal){
 
   if( nSize>WAL_HDRSIZE ){
     u8 aBuf[WAL_HDRSIZE];         /* Buffer to load WAL header into */
-    u8 *aFrame = 0;               /* Malloc'd buffer to load entire frame */
-    int szFrame;                  /* Number of bytes in buffer aFrame[] */
-    u8 *aData;                    /* Pointer to data part of aFrame buffer */
+    u8 *aFrame = 0;               /* Malloc'd buffer to load frames into */
+    int szFrame;                  /* Size of a single frame in bytes */
+    int nChunk;                   /* Number of frames aFrame[] can hold */
     int iFrame;                   /* Index of last frame read */
     i64 iOffset;                  /* Next offset to read from log file */
     int szPage;                   /* Page size according to the log */
@@ -1144,40 +1767,82 @@ static int walIndexRecover(Wal *pWal){
       goto finished;
     }
 
-    /* Malloc a buffer to read frames into. */
-    szFrame = szPage + WAL_FRAME_HDRSIZE;
-    aFrame = (u8 *)sqlite3_malloc(szFrame);
-    if( !aFrame ){
-      rc = SQLITE_NOMEM;
+#ifdef SQLITE_ENABLE_WALIDX_FILE
+    /* If a saved copy of the wal-index covers a prefix of the log, start
+    ** from there instead of from the first frame. */
+    rc = walIndexLoadSaved(pWal, nSize);
+    if( rc!=SQLITE_OK ){
       goto recovery_error;
     }
-    aData = &aFrame[WAL_FRAME_HDRSIZE];
+    if( pWal->hdr.mxFrame ){
+      aFrameCksum[0] = pWal->hdr.aFrameCksum[0];
+      aFrameCksum[1] = pWal->hdr.aFrameCksum[1];
+    }
+#endif
 
-    /* Read all frames from the log file. */
-    iFrame = 0;
-    for(iOffset=WAL_HDRSIZE; (iOffset+szFrame)<=nSize; iOffset+=szFrame){
-      u32 pgno;                   /* Database page number for frame */
-      u32 nTruncate;              /* dbsize field from frame header */
+    /* Malloc a buffer to read frames into. Try for one large enough to
+    ** hold SQLITE_WAL_RECOVER_NBYTE bytes of frames, so that a long log
+    ** is read with few system calls. If that fails, fall back to a buffer
+    ** large enough for a single frame.
+    */
+    szFrame = szPage + WAL_FRAME_HDRSIZE;
+    nChunk = SQLITE_WAL_RECOVER_NBYTE / szFrame;
+    if( nChunk>1 ){
+      sqlite3BeginBenignMalloc();
+      aFrame = (u8 *)sqlite3_malloc(nChunk*szFrame);
+      sqlite3EndBenignMalloc();
+    }
+    if( !aFrame ){
+      nChunk = 1;
+      aFrame = (u8 *)sqlite3_malloc(szFrame);
+      if( !aFrame ){
+        rc = SQLITE_NOMEM;
+        goto recovery_error;
+      }
+    }
 
-      /* Read and decode the next log frame. */
-      iFrame++;
-      rc = sqlite3OsRead(pWal->pWalFd, aFrame, szFrame, iOffset);
-      if( rc!=SQLITE_OK ) break;
-      isValid = walDecodeFrame(pWal, &pgno, &nTruncate, aData, aFrame);
-      if( !isValid ) break;
-      rc = walIndexAppend(pWal, iFrame, pgno);
+    /* Read all frames from the log file. Each frame checksum depends on
+    ** all prior frames, so frames are decoded strictly in order.
+    */
+    iFrame = pWal->hdr.mxFrame;
+    iOffset = walFrameOffset(iFrame+1, szPage);
+    isValid = 1;
+    while( isValid && (iOffset+szFrame)<=nSize ){
+      int nRead;                  /* Number of frames read into aFrame[] */
+      int i;                      /* Index of frame within aFrame[] */
+
+      nRead = nChunk;
+      if( (nSize-iOffset)/szFrame<nRead ){
+        nRead = (int)((nSize-iOffset)/szFrame);
+      }
+      rc = sqlite3OsRead(pWal->pWalFd, aFrame, nRead*szFrame, iOffset);
       if( rc!=SQLITE_OK ) break;
-
-      /* If nTruncate is non-zero, this is a commit record. */
-      if( nTruncate ){
-        pWal->hdr.mxFrame = iFrame;
-        pWal->hdr.nPage = nTruncate;
-        pWal->hdr.szPage = (u16)((szPage&0xff00) | (szPage>>16));
-        testcase( szPage<=32768 );
-        testcase( szPage>=65536 );
-        aFrameCksum[0] = pWal->hdr.aFrameCksum[0];
-        aFrameCksum[1] = pWal->hdr.aFrameCksum[1];
+      for(i=0; i<nRead; i++){
+        u8 *a = &aFrame[i*szFrame];
+        u32 pgno;                 /* Database page number for frame */
+        u32 nTruncate;            /* dbsize field from frame header */
+
+        /* Decode the next log frame. */
+        iFrame++;
+        isValid = walDecodeFrame(pWal, &pgno, &nTruncate,
+                                 &a[WAL_FRAME_HDRSIZE], a);
+        if( !isValid ) break;
+        rc = walIndexAppend(pWal, iFrame, pgno);
+        if( rc!=SQLITE_OK ) break;
+
+        /* If nTruncate is non-zero, this is a commit record. */
+        if( nTruncate ){
+          pWal->hdr.mxFrame = iFrame;
+          pWal->hdr.nPage = nTruncate;
+          pWal->hdr.szPage = (u16)((szPage&0xff00) | (szPage>>16));
+          testcase( szPage<=32768 );
+          testcase( szPage>=65536 );
+          aFrameCksum[0] = pWal->hdr.aFrameCksum[0];
+          aFrameCksum[1] = pWal->hdr.aFrameCksum[1];
+        }
       }
+      if( rc!=SQLITE_OK ) break;
+      iOffset += nRead*szFrame;
     }
 
     sqlite3_free(aFrame);
@@ -1197,6 +1862,7 @@ finished:
     */
     pInfo = walCkptInfo(pWal);
     pInfo->nBackfill = 0;
+    pInfo->nBackfillAttempted = pWal->hdr.mxFrame;
     pInfo->aReadMark[0] = 0;
     for(i=1; i<WAL_NREADER; i++) pInfo->aReadMark[i] = READMARK_NOT_USED;
     if( pWal->hdr.mxFrame ) pInfo->aReadMark[1] = pWal->hdr.mxFrame;
@@ -1274,6 +1940,7 @@ int sqlite3WalOpen(
 #ifdef UNIX_SHM_BASE
   assert( UNIX_SHM_BASE==WALINDEX_LOCK_OFFSET );
 #endif
+  assert( WALINDEX_LOCK_OFFSET==120 && WALINDEX_HDR_SIZE==136 );
 
 
   /* Allocate an instance of struct Wal to return. */
@@ -1306,6 +1973,14 @@ int sqlite3WalOpen(
     sqlite3_free(pRet);
   }else{
     int iDC = sqlite3OsDeviceCharacteristics(pRet->pWalFd);
+    int bDirect = -1;
+
+    /* If the database file bypasses the operating system cache (the
+    ** "direct=1" URI parameter on unix), so does the WAL file. */
+    sqlite3OsFileControlHint(pDbFd, SQLITE_FCNTL_DIRECT_IO, &bDirect);
+    if( bDirect>0 ){
+      sqlite3OsFileControlHint(pRet->pWalFd, SQLITE_FCNTL_DIRECT_IO, &bDirect);
+    }
     if( iDC & SQLITE_IOCAP_SEQUENTIAL ){ pRet->syncHeader = 0; }
     if( iDC & SQLITE_IOCAP_POWERSAFE_OVERWRITE ){
       pRet->padToSectorBoundary = 0;
@@ -1323,6 +1998,37 @@ void sqlite3WalLimit(Wal *pWal, i64 iLimit){
   if( pWal ) pWal->mxWalSize = iLimit;
 }
 
+/*
+** Set the "PRAGMA wal_sync_interval" value, in milliseconds.
+**
+** If this is greater than zero and the pager would otherwise sync the WAL
+** at the end of each transaction (synchronous=FULL), a commit only syncs
+** the WAL if it has not been synced in the last nMs milliseconds. Commits
+** in between are durable once the next sync happens; if power is lost
+** first, the checksums on each frame ensure recovery discards them whole,
+** exactly as with synchronous=NORMAL. The database is never corrupted.
+*/
+void sqlite3WalSyncInterval(Wal *pWal, int nMs){
+  if( pWal ) pWal->nSyncInterval = nMs;
+}
+
+/*
+** Sync the WAL file if any commits written to it since the last sync
+** were left unsynced by wal_sync_interval. Once this returns SQLITE_OK,
+** every transaction this connection has committed is durable.
+*/
+int sqlite3WalSync(Wal *pWal, int sync_flags){
+  int rc = SQLITE_OK;
+  if( pWal->syncPending ){
+    rc = sqlite3OsSync(pWal->pWalFd, sync_flags & SQLITE_SYNC_MASK);
+    if( rc==SQLITE_OK ){
+      sqlite3OsCurrentTimeInt64(pWal->pVfs, &pWal->iLastSync);
+      pWal->syncPending = 0;
+    }
+  }
+  return rc;
+}
+
 /*
 ** Find the smallest page number out of all pages held in the WAL that
 ** has not been returned by any prior invocation of this method on the
@@ -1717,6 +2423,8 @@ static int walCheckpoint(
     i64 nSize;                    /* Current size of database file */
     u32 nBackfill = pInfo->nBackfill;
 
+    pInfo->nBackfillAttempted = mxSafeFrame;
+
     /* Sync the WAL to disk */
     if( sync_flags ){
       rc = sqlite3OsSync(pWal->pWalFd, sync_flags);
@@ -1808,6 +2516,7 @@ static void walLimitSize(Wal *pWal, i64 nMax){
   if( rx==SQLITE_OK && (sz > nMax ) ){
     rx = sqlite3OsTruncate(pWal->pWalFd, nMax);
   }
+  pWal->iPrealloc = 0;
   sqlite3EndBenignMalloc();
   if( rx ){
     sqlite3_log(rx, "cannot limit WAL size: %s", pWal->zWalName);
@@ -1865,11 +2574,27 @@ int sqlite3WalClose(
       }
     }
 
+    /* Do not let commits deferred by wal_sync_interval outlive the
+    ** connection unsynced. */
+    if( pWal->syncPending && !isDelete ){
+      sqlite3OsSync(pWal->pWalFd, pWal->syncPending);
+    }
+
+    walPgnoMapFree(pWal);
     walIndexClose(pWal, isDelete);
     sqlite3OsClose(pWal->pWalFd);
     if( isDelete ){
       sqlite3BeginBenignMalloc();
       sqlite3OsDelete(pWal->pVfs, pWal->zWalName, 0);
+#ifdef SQLITE_ENABLE_WALIDX_FILE
+      {
+        char *zIdx = sqlite3_mprintf("%sidx", pWal->zWalName);
+        if( zIdx ){
+          sqlite3OsDelete(pWal->pVfs, zIdx, 0);
+          sqlite3_free(zIdx);
+        }
+      }
+#endif
       sqlite3EndBenignMalloc();
     }
     WALTRACE(("WAL%p: closed\n", pWal));
@@ -2077,6 +2802,7 @@ static int walTryBeginRead(Wal *pWal, int *pChanged, int useWal, int cnt){
   int mxI;                        /* Index of largest aReadMark[] value */
   int i;                          /* Loop counter */
   int rc = SQLITE_OK;             /* Return code  */
+  u32 mxFrame;                    /* Wal frame to lock to */
 
   assert( pWal->readLock<0 );     /* Not currently locked */
 
@@ -2140,7 +2866,11 @@ static int walTryBeginRead(Wal *pWal, int *pChanged, int useWal, int cnt){
   }
 
   pInfo = walCkptInfo(pWal);
-  if( !useWal && pInfo->nBackfill==pWal->hdr.mxFrame ){
+  if( !useWal && pInfo->nBackfill==pWal->hdr.mxFrame
+#ifdef SQLITE_ENABLE_SNAPSHOT
+   && (pWal->pSnapshot==0 || pWal->hdr.mxFrame==0)
+#endif
+  ){
     /* The WAL has been completely backfilled (or it is empty).
     ** and can be safely ignored.
     */
@@ -2174,13 +2904,21 @@ static int walTryBeginRead(Wal *pWal, int *pChanged, int useWal, int cnt){
   /* If we get this far, it means that the reader will want to use
   ** the WAL to get at content from recent commits.  The job now is
   ** to select one of the aReadMark[] entries that is closest to
-  ** but not exceeding pWal->hdr.mxFrame and lock that entry.
+  ** but not exceeding pWal->hdr.mxFrame and lock that entry. If the
+  ** reader is opening a snapshot, the entry must not exceed the
+  ** mxFrame of the snapshot instead.
   */
   mxReadMark = 0;
   mxI = 0;
+  mxFrame = pWal->hdr.mxFrame;
+#ifdef SQLITE_ENABLE_SNAPSHOT
+  if( pWal->pSnapshot && pWal->pSnapshot->mxFrame<mxFrame ){
+    mxFrame = pWal->pSnapshot->mxFrame;
+  }
+#endif
   for(i=1; i<WAL_NREADER; i++){
     u32 thisMark = pInfo->aReadMark[i];
-    if( mxReadMark<=thisMark && thisMark<=pWal->hdr.mxFrame ){
+    if( mxReadMark<=thisMark && thisMark<=mxFrame ){
       assert( thisMark!=READMARK_NOT_USED );
       mxReadMark = thisMark;
       mxI = i;
@@ -2189,12 +2927,12 @@ static int walTryBeginRead(Wal *pWal, int *pChanged, int useWal, int cnt){
   /* There was once an "if" here. The extra "{" is to preserve indentation. */
   {
     if( (pWal->readOnly & WAL_SHM_RDONLY)==0
-     && (mxReadMark<pWal->hdr.mxFrame || mxI==0)
+     && (mxReadMark<mxFrame || mxI==0)
     ){
       for(i=1; i<WAL_NREADER; i++){
         rc = walLockExclusive(pWal, WAL_READ_LOCK(i), 1);
         if( rc==SQLITE_OK ){
-          mxReadMark = pInfo->aReadMark[i] = pWal->hdr.mxFrame;
+          mxReadMark = pInfo->aReadMark[i] = mxFrame;
           mxI = i;
           walUnlockExclusive(pWal, WAL_READ_LOCK(i), 1);
           break;
@@ -2231,10 +2969,25 @@ static int walTryBeginRead(Wal *pWal, int *pChanged, int useWal, int cnt){
     ** blocking writers. It only guarantees that a dangerous checkpoint or 
     ** log-wrap (either of which would require an exclusive lock on
     ** WAL_READ_LOCK(mxI)) has not occurred since the snapshot was valid.
+    **
+    ** If aReadMark[mxI] is unchanged but the header is not, the usual
+    ** cause is a writer committing a transaction in the meantime. With
+    ** many concurrent readers and a busy writer this happens often, and
+    ** each time the reader would go back around the retry loop (and
+    ** eventually start sleeping). Instead, if a consistent copy of the
+    ** current header can be read, the reader adopts it as its snapshot.
+    ** This is safe because the header is read after the lock was taken:
+    ** from that point, no checkpointer can backfill past aReadMark[mxI]
+    ** and no writer can wrap the log until the lock is released. Since
+    ** aReadMark[mxI] was unchanged when the lock was obtained, no
+    ** checkpointer got past it earlier either, so the database file
+    ** holds nothing newer than the adopted snapshot.
     */
     walShmBarrier(pWal);
     if( pInfo->aReadMark[mxI]!=mxReadMark
-     || memcmp((void *)walIndexHdr(pWal), &pWal->hdr, sizeof(WalIndexHdr))
+     || (memcmp((void *)walIndexHdr(pWal), &pWal->hdr, sizeof(WalIndexHdr))
+         && (useWal || walIndexTryHdr(pWal, pChanged)
+                    || pWal->hdr.mxFrame<mxReadMark))
     ){
       walUnlockShared(pWal, WAL_READ_LOCK(mxI));
       return WAL_RETRY;
@@ -2263,6 +3016,13 @@ static int walTryBeginRead(Wal *pWal, int *pChanged, int useWal, int cnt){
 int sqlite3WalBeginReadTransaction(Wal *pWal, int *pChanged){
   int rc;                         /* Return code */
   int cnt = 0;                    /* Number of TryBeginRead attempts */
+#ifdef SQLITE_ENABLE_SNAPSHOT
+  int bChanged = 0;
+  WalIndexHdr *pSnapshot = pWal->pSnapshot;
+  if( pSnapshot && memcmp(pSnapshot, &pWal->hdr, sizeof(WalIndexHdr))!=0 ){
+    bChanged = 1;
+  }
+#endif
 
   do{
     rc = walTryBeginRead(pWal, pChanged, 0, ++cnt);
@@ -2271,9 +3031,109 @@ int sqlite3WalBeginReadTransaction(Wal *pWal, int *pChanged){
   testcase( (rc&0xff)==SQLITE_IOERR );
   testcase( rc==SQLITE_PROTOCOL );
   testcase( rc==SQLITE_OK );
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+  if( rc==SQLITE_OK
+   && pSnapshot && memcmp(pSnapshot, &pWal->hdr, sizeof(WalIndexHdr))!=0
+  ){
+    /* At this point the client has a lock on an aReadMark[] slot holding
+    ** a value equal to or smaller than pSnapshot->mxFrame, but pWal->hdr
+    ** is populated with the wal-index header corresponding to the head
+    ** of the wal file. Verify that pSnapshot is still valid before
+    ** continuing. It is not if either:
+    **
+    **    (1)  the WAL file has been restarted since the snapshot was taken,
+    **         in which case the salt values will have changed, or
+    **
+    **    (2)  a checkpoint has been attempted that wrote frames past
+    **         pSnapshot->mxFrame into the database file. The checkpoint
+    **         need not have completed for this to be a problem.
+    **
+    ** A checkpointer running concurrently with this code may already
+    ** have decided to backfill past the snapshot without yet having set
+    ** nBackfillAttempted. Taking a shared CKPT lock before reading
+    ** nBackfillAttempted ensures that no checkpointer is running.
+    */
+    volatile WalCkptInfo *pInfo = walCkptInfo(pWal);
+
+    assert( pWal->readLock>0 || pWal->hdr.mxFrame==0 );
+    rc = walLockShared(pWal, WAL_CKPT_LOCK);
+    if( rc==SQLITE_OK ){
+      if( pWal->readLock>0
+       && memcmp(pSnapshot->aSalt, pWal->hdr.aSalt, sizeof(pWal->hdr.aSalt))==0
+       && pSnapshot->mxFrame>=pInfo->nBackfillAttempted
+       && pSnapshot->mxFrame>=pInfo->nBackfill
+      ){
+        assert( pInfo->aReadMark[pWal->readLock]<=pSnapshot->mxFrame );
+        memcpy(&pWal->hdr, pSnapshot, sizeof(WalIndexHdr));
+        *pChanged = bChanged;
+      }else{
+        rc = SQLITE_BUSY_SNAPSHOT;
+      }
+      walUnlockShared(pWal, WAL_CKPT_LOCK);
+    }
+    if( rc!=SQLITE_OK ){
+      sqlite3WalEndReadTransaction(pWal);
+    }
+  }
+#endif
   return rc;
 }
 
+/*
+** This function is called by a connection that holds a shared lock on
+** aReadMark[] slot pWal->readLock. If its snapshot is still the most
+** recent one (no frames have been appended to the WAL since) and every
+** frame has been backfilled into the database file, take a shared lock
+** on WAL_READ_LOCK(0), release the slot and return non-zero. The snapshot
+** does not change: the database file holds all of it, and no checkpoint
+** can write to the database file while WAL_READ_LOCK(0) is held. From
+** then on the connection reads pages from the database file only.
+**
+** Unlike aReadMark[] slots, WAL_READ_LOCK(0) does not prevent a writer
+** from restarting the log. Without this, a reader that started before
+** the log was completely backfilled would prevent the log from being
+** restarted for as long as its read transaction lasted, and so would
+** an SQLITE_CHECKPOINT_RESTART checkpoint waiting for such readers.
+**
+** It is not enough for nBackfill to match the snapshot: a checkpoint
+** does not copy a page into the database file if the page has a more
+** recent frame beyond the last frame it may backfill, so the database
+** file only matches the snapshot if the whole log was backfilled.
+**
+** Zero is returned, and nothing changes, if the conditions above are
+** not met or if WAL_READ_LOCK(0) cannot be obtained (because a checkpoint
+** is running).
+**
+** This is called each time sqlite3WalRead() looks for a page in the WAL,
+** so the conditions are first tested without taking any lock. Once the
+** log has grown past the snapshot, the test fails for the rest of the
+** read transaction: frames are never removed from the log while the
+** aReadMark[] slot is held.
+*/
+static int walDropReadMark(Wal *pWal){
+  volatile WalCkptInfo *pInfo = walCkptInfo(pWal);
+  u32 mxFrame = pWal->hdr.mxFrame;
+
+  assert( pWal->readLock>0 );
+  if( mxFrame>0 && pInfo->nBackfill==mxFrame
+   && walIndexHdr(pWal)->mxFrame==mxFrame
+   && walLockShared(pWal, WAL_READ_LOCK(0))==SQLITE_OK
+  ){
+    /* Check again now that no checkpoint can be running. The log cannot
+    ** have been restarted while the aReadMark[] slot is locked, so if
+    ** the wal-index header still ends at mxFrame, the checkpoint that
+    ** set nBackfill saw no frames beyond it. */
+    if( pInfo->nBackfill==mxFrame && walIndexHdr(pWal)->mxFrame==mxFrame ){
+      walUnlockShared(pWal, WAL_READ_LOCK(pWal->readLock));
+      pWal->readLock = 0;
+      return 1;
+    }
+    walUnlockShared(pWal, WAL_READ_LOCK(0));
+  }
+  return 0;
+}
+
 /*
 ** Finish with a read transaction.  All this does is release the
 ** read-lock.
@@ -2308,6 +3168,15 @@ int sqlite3WalRead(
   /* This routine is only be called from within a read transaction. */
   assert( pWal->readLock>=0 || pWal->lockError );
 
+  /* Before looking for the page in the WAL, stop using the WAL if the
+  ** part of it this reader depends on has been checkpointed, so that the
+  ** log can be restarted. A writer must keep its aReadMark[] slot, as it
+  ** reads back the frames it has written.
+  */
+  if( pWal->readLock>0 && pWal->writeLock==0 ){
+    walDropReadMark(pWal);
+  }
+
   /* If the "last page" field of the wal-index header snapshot is 0, then
   ** no data will be read from the wal under any circumstances. Return early
   ** in this case as an optimization.  Likewise, if pWal->readLock==0, 
@@ -2344,7 +3213,13 @@ int sqlite3WalRead(
   **     This condition filters out entries that were added to the hash
   **     table after the current read-transaction had started.
   */
-  for(iHash=walFramePage(iLast); iHash>=0 && iRead==0; iHash--){
+  if( walPgnoMapFind(pWal, pgno, &iRead) ){
+    iHash = -1;
+  }else{
+    iHash = walFramePage(iLast);
+    if( iHash>=SQLITE_WAL_PGNOMAP_MINHASH ) pWal->nMapProbe += iHash+1;
+  }
+  for(; iHash>=0 && iRead==0; iHash--){
     volatile ht_slot *aHash;      /* Pointer to hash table */
     volatile u32 *aPgno;          /* Pointer to array of page numbers */
     u32 iZero;                    /* Frame number corresponding to aPgno[0] */
@@ -2519,6 +3394,9 @@ int sqlite3WalUndo(Wal *pWal, int (*xUndo)(void *, Pgno), void *pUndoCtx){
       rc = xUndo(pUndoCtx, walFramePgno(pWal, iFrame));
     }
     walCleanupHash(pWal);
+    if( pWal->pMap && pWal->pMap->iMax>pWal->hdr.mxFrame ){
+      walPgnoMapFree(pWal);
+    }
   }
   assert( rc==SQLITE_OK );
   return rc;
@@ -2564,6 +3442,9 @@ int sqlite3WalSavepointUndo(Wal *pWal, u32 *aWalData){
     pWal->hdr.aFrameCksum[0] = aWalData[1];
     pWal->hdr.aFrameCksum[1] = aWalData[2];
     walCleanupHash(pWal);
+    if( pWal->pMap && pWal->pMap->iMax>pWal->hdr.mxFrame ){
+      walPgnoMapFree(pWal);
+    }
   }
 
   return rc;
@@ -2586,6 +3467,16 @@ static int walRestartLog(Wal *pWal){
   int rc = SQLITE_OK;
   int cnt;
 
+  /* If the WAL has been completely backfilled since the read transaction
+  ** started (typically by a checkpoint run by some other connection),
+  ** stop using it. This is equivalent to having started the read
+  ** transaction after the checkpoint, and allows the log to be restarted
+  ** below. No frames can be appended while the WRITER lock is held.
+  */
+  if( pWal->readLock>0 ){
+    walDropReadMark(pWal);
+  }
+
   if( pWal->readLock==0 ){
     volatile WalCkptInfo *pInfo = walCkptInfo(pWal);
     assert( pInfo->nBackfill==pWal->hdr.mxFrame );
@@ -2613,6 +3504,7 @@ static int walRestartLog(Wal *pWal){
         aSalt[1] = salt1;
         walIndexWriteHdr(pWal);
         pInfo->nBackfill = 0;
+        pInfo->nBackfillAttempted = 0;
         pInfo->aReadMark[1] = 0;
         for(i=2; i<WAL_NREADER; i++) pInfo->aReadMark[i] = READMARK_NOT_USED;
         assert( pInfo->aReadMark[0]==0 );
@@ -2704,6 +3596,34 @@ static int walWriteOneFrame(
   return rc;
 }
 
+/*
+** Make sure space is allocated in the WAL file for everything up to
+** offset iEnd.  This is a no-op unless the database file has a chunk
+** size (SQLITE_FCNTL_CHUNK_SIZE, or SQLITE_DEFAULT_CHUNK_SIZE on unix).
+** If it does, the WAL file is given the same chunk size and extended a
+** chunk at a time ahead of the frames written to it, so that appending
+** to the WAL overwrites space that is already allocated instead of
+** extending the file, and its metadata, on every commit.  Once the WAL
+** is restarted, new frames reuse that space for as long as the file is
+** not truncated by PRAGMA journal_size_limit.
+**
+** Errors are ignored.  If the space cannot be allocated, writing the
+** frames will report the problem.
+*/
+static void walPreallocate(Wal *pWal, i64 iEnd){
+  int szChunk = 0;
+  sqlite3OsFileControlHint(pWal->pDbFd, SQLITE_FCNTL_GET_CHUNK, &szChunk);
+  if( szChunk!=pWal->szChunk ){
+    pWal->szChunk = szChunk;
+    pWal->iPrealloc = 0;
+    sqlite3OsFileControlHint(pWal->pWalFd, SQLITE_FCNTL_CHUNK_SIZE, &szChunk);
+  }
+  if( szChunk>0 && iEnd>pWal->iPrealloc ){
+    sqlite3OsFileControlHint(pWal->pWalFd, SQLITE_FCNTL_SIZE_HINT, &iEnd);
+    pWal->iPrealloc = ((iEnd+szChunk-1)/szChunk)*szChunk;
+  }
+}
+
 /* 
 ** Write a set of frames to the log. The caller must hold the write-lock
 ** on the log file (obtained using sqlite3WalBeginWriteTransaction()).
@@ -2723,6 +3643,7 @@ int sqlite3WalFrames(
   int nExtra = 0;                 /* Number of extra copies of last page */
   int szFrame;                    /* The size of a single frame */
   i64 iOffset;                    /* Next byte to write in WAL file */
+  int nFrame = 0;                 /* Number of frames in pList */
   WalWriter w;                    /* The writer */
 
   assert( pList );
@@ -2800,14 +3721,19 @@ int sqlite3WalFrames(
   iOffset = walFrameOffset(iFrame+1, szPage);
   szFrame = szPage + WAL_FRAME_HDRSIZE;
 
-  /* Write all frames into the log file exactly once */
+  for(p=pList; p; p=p->pDirty) nFrame++;
+  walPreallocate(pWal, iOffset + (i64)nFrame*szFrame);
+
+  /* Write all frames into the log file exactly once. The VFS may defer
+  ** the writes, and the sync below, until SQLITE_FCNTL_END_BATCH. */
+  sqlite3OsFileControlHint(w.pFd, SQLITE_FCNTL_BEGIN_BATCH, 0);
   for(p=pList; p; p=p->pDirty){
     int nDbSize;   /* 0 normally.  Positive == commit flag */
     iFrame++;
     assert( iOffset==walFrameOffset(iFrame, szPage) );
     nDbSize = (isCommit && p->pDirty==0) ? nTruncate : 0;
     rc = walWriteOneFrame(&w, p, nDbSize, iOffset);
-    if( rc ) return rc;
+    if( rc ) break;
     pLast = p;
     iOffset += szFrame;
   }
@@ -2825,14 +3751,30 @@ int sqlite3WalFrames(
   ** boundary is crossed.  Only the part of the WAL prior to the last
   ** sector boundary is synced; the part of the last frame that extends
   ** past the sector boundary is written after the sync.
+  **
+  ** If PRAGMA wal_sync_interval is set and the WAL was synced recently
+  ** enough, skip both and leave the commit to be synced later.
   */
-  if( isCommit && (sync_flags & WAL_SYNC_TRANSACTIONS)!=0 ){
+  if( rc==SQLITE_OK && isCommit && (sync_flags & WAL_SYNC_TRANSACTIONS)!=0
+   && pWal->nSyncInterval>0
+  ){
+    sqlite3_int64 iNow = 0;
+    sqlite3OsCurrentTimeInt64(pWal->pVfs, &iNow);
+    if( iNow>=pWal->iLastSync && iNow<pWal->iLastSync+pWal->nSyncInterval ){
+      pWal->syncPending = (u8)(sync_flags & SQLITE_SYNC_MASK);
+      sync_flags &= ~WAL_SYNC_TRANSACTIONS;
+    }else{
+      pWal->iLastSync = iNow;
+      pWal->syncPending = 0;
+    }
+  }
+  if( rc==SQLITE_OK && isCommit && (sync_flags & WAL_SYNC_TRANSACTIONS)!=0 ){
     if( pWal->padToSectorBoundary ){
       int sectorSize = sqlite3OsSectorSize(pWal->pWalFd);
       w.iSyncPoint = ((iOffset+sectorSize-1)/sectorSize)*sectorSize;
       while( iOffset<w.iSyncPoint ){
         rc = walWriteOneFrame(&w, pLast, nTruncate, iOffset);
-        if( rc ) return rc;
+        if( rc ) break;
         iOffset += szFrame;
         nExtra++;
       }
@@ -2841,6 +3783,14 @@ int sqlite3WalFrames(
     }
   }
 
+  /* The frames must be in the WAL file before the wal-index is updated
+  ** to point readers at them. */
+  {
+    int rc2 = sqlite3OsFileControl(w.pFd, SQLITE_FCNTL_END_BATCH, 0);
+    if( rc==SQLITE_OK && rc2!=SQLITE_NOTFOUND ) rc = rc2;
+  }
+  if( rc ) return rc;
+
   /* If this frame set completes the first transaction in the WAL and
   ** if PRAGMA journal_size_limit is set, then truncate the WAL to the
   ** journal size limit, if possible.
@@ -2884,6 +3834,9 @@ int sqlite3WalFrames(
     if( isCommit ){
       walIndexWriteHdr(pWal);
       pWal->iCallback = iFrame;
+#ifdef SQLITE_ENABLE_WALIDX_FILE
+      walIndexSave(pWal, sync_flags);
+#endif
     }
   }
 
@@ -3071,6 +4024,34 @@ int sqlite3WalHeapMemory(Wal *pWal){
   return (pWal && pWal->exclusiveMode==WAL_HEAPMEMORY_MODE );
 }
 
+#ifdef SQLITE_ENABLE_SNAPSHOT
+/*
+** Allocate a copy of the wal-index header for the current read
+** transaction and return it as a snapshot handle in *ppSnapshot.
+** Return SQLITE_OK if successful, or SQLITE_NOMEM otherwise.
+*/
+int sqlite3WalSnapshotGet(Wal *pWal, sqlite3_snapshot **ppSnapshot){
+  WalIndexHdr *pRet;
+
+  assert( pWal->readLock>=0 && pWal->writeLock==0 );
+  pRet = (WalIndexHdr *)sqlite3_malloc(sizeof(WalIndexHdr));
+  if( pRet==0 ){
+    return SQLITE_NOMEM;
+  }
+  memcpy(pRet, &pWal->hdr, sizeof(WalIndexHdr));
+  *ppSnapshot = (sqlite3_snapshot *)pRet;
+  return SQLITE_OK;
+}
+
+/*
+** Cause the next read transaction opened by pWal to read from snapshot
+** pSnapshot, or from the current head of the WAL if pSnapshot is NULL.
+*/
+void sqlite3WalSnapshotOpen(Wal *pWal, sqlite3_snapshot *pSnapshot){
+  pWal->pSnapshot = (WalIndexHdr *)pSnapshot;
+}
+#endif /* SQLITE_ENABLE_SNAPSHOT */
+
 #ifdef SQLITE_ENABLE_ZIPVFS
 /*
 ** If the argument is not NULL, it points to a Wal object that holds a
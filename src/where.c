@@ -243,13 +243,14 @@ struct WhereCost {
 */
 #define WHERE_ROWID_EQ     0x00001000  /* rowid=EXPR or rowid IN (...) */
 #define WHERE_ROWID_RANGE  0x00002000  /* rowid<EXPR and/or rowid>EXPR */
+#define WHERE_BRIN         0x00004000  /* Skip rowid blocks using a BRIN */
 #define WHERE_COLUMN_EQ    0x00010000  /* x=EXPR or x IN (...) or x IS NULL */
 #define WHERE_COLUMN_RANGE 0x00020000  /* x<EXPR and/or x>EXPR */
 #define WHERE_COLUMN_IN    0x00040000  /* x IN (...) */
 #define WHERE_COLUMN_NULL  0x00080000  /* x IS NULL */
 #define WHERE_INDEXED      0x000f0000  /* Anything that uses an index */
-#define WHERE_NOT_FULLSCAN 0x100f3000  /* Does not do a full table scan */
-#define WHERE_IN_ABLE      0x000f1000  /* Able to support an IN operator */
+#define WHERE_NOT_FULLSCAN 0x100f7000  /* Does not do a full table scan */
+#define WHERE_IN_ABLE      0x000f5000  /* Able to support an IN operator */
 #define WHERE_TOP_LIMIT    0x00100000  /* x<EXPR or x<=EXPR constraint */
 #define WHERE_BTM_LIMIT    0x00200000  /* x>EXPR or x>=EXPR constraint */
 #define WHERE_BOTH_LIMIT   0x00300000  /* Both x>EXPR and x<EXPR */
@@ -2862,6 +2863,80 @@ static int whereInScanEst(
 #endif /* defined(SQLITE_ENABLE_STAT3) */
 
 
+/*
+** Consider using the block range (BRIN) index pProbe to access table pSrc.
+** If the WHERE clause holds an ==, <, <=, > or >= constraint on the
+** column of the index, and the plan is cheaper than the one in *pCost,
+** overwrite *pCost with a WHERE_BRIN plan.
+**
+** A BRIN plan reads every entry of the index and visits only those blocks
+** of 2^SQLITE_BRIN_SHIFT rowids whose range of values might satisfy the
+** constraints.  The cost assumes that values are correlated with rowids,
+** so that the rows that match are held by few blocks:
+**
+**     one step for each entry of the index
+**   + a table search and 2^SQLITE_BRIN_SHIFT steps for each block visited
+*/
+static void bestBrinIndex(
+  Parse *pParse,              /* The parsing context */
+  WhereClause *pWC,           /* The WHERE clause */
+  struct SrcList_item *pSrc,  /* The FROM clause term to search */
+  Bitmask notReady,           /* Mask of cursors not available for indexing */
+  ExprList *pOrderBy,         /* The ORDER BY clause */
+  ExprList *pDistinct,        /* The select-list if query is DISTINCT */
+  Index *pProbe,              /* The BRIN index */
+  WhereCost *pCost            /* Lowest cost query plan */
+){
+  int iCur = pSrc->iCursor;   /* The cursor of the table to be accessed */
+  int iCol = pProbe->aiColumn[0];
+  double nTabRow = (double)pSrc->pTab->nRowEst;
+  double nBlock = (double)(1<<SQLITE_BRIN_SHIFT);
+  double rangeDiv = (double)1;
+  double nRow;                /* Estimated number of rows in result set */
+  double cost;                /* Cost of using pProbe */
+  Bitmask used = 0;
+  WhereTerm *pEq, *pBtm, *pTop;
+
+  assert( IsBrinIndex(pProbe) && pProbe->nColumn==1 );
+  pEq = findTerm(pWC, iCur, iCol, notReady, WO_EQ, pProbe);
+  pBtm = findTerm(pWC, iCur, iCol, notReady, WO_GT|WO_GE, pProbe);
+  pTop = findTerm(pWC, iCur, iCol, notReady, WO_LT|WO_LE, pProbe);
+  if( pEq==0 && pBtm==0 && pTop==0 ) return;
+
+  if( pEq ){
+    nRow = (double)pProbe->aiRowEst[1];
+    used |= pEq->prereqRight;
+  }else{
+    whereRangeScanEst(pParse, pProbe, 0, pBtm, pTop, &rangeDiv);
+    nRow = nTabRow/rangeDiv;
+  }
+  if( pBtm ) used |= pBtm->prereqRight;
+  if( pTop ) used |= pTop->prereqRight;
+  if( nRow<1 ) nRow = 1;
+
+  cost = nTabRow/nBlock + (nRow/nBlock + 1)*(nBlock + estLog(nTabRow));
+  if( pOrderBy ){
+    cost += nRow*estLog(nRow)*3;
+  }
+  if( pDistinct ){
+    cost += nRow*estLog(nRow)*3;
+  }
+
+  WHERETRACE((
+    "%s(%s): brin rangeDiv=%d nRow=%.1f cost=%.1f used=0x%llx\n",
+    pSrc->pTab->zName, pProbe->zName, (int)rangeDiv, nRow, cost, used
+  ));
+
+  if( cost<pCost->rCost ){
+    pCost->rCost = cost;
+    pCost->used = used;
+    pCost->plan.nRow = nRow;
+    pCost->plan.wsFlags = WHERE_BRIN;
+    pCost->plan.nEq = 0;
+    pCost->plan.u.pIdx = pProbe;
+  }
+}
+
 /*
 ** Find the best query plan for accessing a particular table.  Write the
 ** best query plan and its cost into the WhereCost object supplied as the
@@ -3044,6 +3119,14 @@ static void bestBtreeIndex(
     WhereTerm *pFirstTerm = 0;    /* First term matching the index */
 #endif
 
+    if( IsBrinIndex(pProbe) ){
+      bestBrinIndex(
+          pParse, pWC, pSrc, notReady, pOrderBy, pDistinct, pProbe, pCost
+      );
+      if( pSrc->pIndex ) break;
+      continue;
+    }
+
     /* Determine the values of nEq and nInMul */
     for(nEq=0; nEq<pProbe->nColumn; nEq++){
       int j = pProbe->aiColumn[nEq];
@@ -3756,7 +3839,7 @@ static void explainOneScan(
     if( (flags&WHERE_MULTI_OR) || (wctrlFlags&WHERE_ONETABLE_ONLY) ) return;
 
     isSearch = (pLevel->plan.nEq>0)
-             || (flags&(WHERE_BTM_LIMIT|WHERE_TOP_LIMIT))!=0
+             || (flags&(WHERE_BTM_LIMIT|WHERE_TOP_LIMIT|WHERE_BRIN))!=0
              || (wctrlFlags&(WHERE_ORDERBY_MIN|WHERE_ORDERBY_MAX));
 
     zMsg = sqlite3MPrintf(db, "%s", isSearch?"SEARCH":"SCAN");
@@ -3779,6 +3862,10 @@ static void explainOneScan(
           zWhere
       );
       sqlite3DbFree(db, zWhere);
+    }else if( flags & WHERE_BRIN ){
+      zMsg = sqlite3MAppendf(db, zMsg, "%s USING BRIN INDEX %s", zMsg,
+          pLevel->plan.u.pIdx->zName
+      );
     }else if( flags & (WHERE_ROWID_EQ|WHERE_ROWID_RANGE) ){
       zMsg = sqlite3MAppendf(db, zMsg, "%s USING INTEGER PRIMARY KEY", zMsg);
 
@@ -3937,6 +4024,105 @@ static Bitmask codeOneLoopStart(
     sqlite3ExprCacheStore(pParse, iCur, -1, iRowidReg);
     VdbeComment((v, "pk"));
     pLevel->op = OP_Noop;
+  }else if( pLevel->plan.wsFlags & WHERE_BRIN ){
+    /* Case 2b:  A scan using a block range (BRIN) index.
+    **
+    **         Each entry of the index holds the smallest and largest value
+    **         of the indexed column within a block of 2^SQLITE_BRIN_SHIFT
+    **         rowids.  The entries are read in order, and the rows of each
+    **         block whose range of values might satisfy the constraints
+    **         are visited by seeking to the first rowid of the block.
+    **         The loop over index entries is coded in the same way as the
+    **         loop over the values of an IN operator, so that
+    **         sqlite3WhereEnd() closes it.
+    **
+    **         The constraints are not disabled, as they must still be
+    **         tested against each row of the blocks visited.
+    */
+    static const u8 aSkipOp[] = {
+      /* TK_GT */  OP_Ge,          /* Skip the block if the value>=max */
+      /* TK_LE */  OP_Lt,          /* Skip the block if the value<min */
+      /* TK_LT */  OP_Le,          /* Skip the block if the value<=min */
+      /* TK_GE */  OP_Gt           /* Skip the block if the value>max */
+    };
+    Index *pIdx = pLevel->plan.u.pIdx;
+    int iIdxCur = pLevel->iIdxCur;
+    int iCol = pIdx->aiColumn[0];
+    CollSeq *pColl = sqlite3LocateCollSeq(pParse, pIdx->azColl[0]);
+    WhereTerm *apTerm[3];    /* The ==, > or >= and < or <= constraints */
+    int aReg[3];             /* Registers holding the constraint values */
+    int regMin;              /* Min value.  Then max, first and last rowid */
+    int addrTop;             /* Top of the loop over index entries */
+    int start;               /* Top of the loop over the rows of a block */
+    struct InLoop *pIn;
+
+    assert( omitTable==0 );
+    assert( TK_LE==TK_GT+1 && TK_LT==TK_GT+2 && TK_GE==TK_GT+3 );
+    apTerm[0] = findTerm(pWC, iCur, iCol, notReady, WO_EQ, pIdx);
+    apTerm[1] = findTerm(pWC, iCur, iCol, notReady, WO_GT|WO_GE, pIdx);
+    apTerm[2] = findTerm(pWC, iCur, iCol, notReady, WO_LT|WO_LE, pIdx);
+    for(j=0; j<3; j++){
+      if( apTerm[j] ){
+        testcase( apTerm[j]->wtFlags & TERM_VIRTUAL );
+        aReg[j] = ++pParse->nMem;
+        sqlite3ExprCode(pParse, apTerm[j]->pExpr->pRight, aReg[j]);
+      }
+    }
+    regMin = pParse->nMem+1;
+    pParse->nMem += 4;
+
+    addrNxt = pLevel->addrNxt = sqlite3VdbeMakeLabel(v);
+    sqlite3VdbeAddOp2(v, OP_Rewind, iIdxCur, 0);
+    addrTop = sqlite3VdbeAddOp3(v, OP_Column, iIdxCur, 0, regMin);
+    sqlite3VdbeAddOp1(v, OP_IsNull, regMin);
+    VdbeComment((v, "%s", pIdx->zName));
+    sqlite3VdbeAddOp3(v, OP_Column, iIdxCur, 1, regMin+1);
+    for(j=0; j<3; j++){
+      Expr *pX;
+      int p5;
+      if( apTerm[j]==0 ) continue;
+      pX = apTerm[j]->pExpr;
+      p5 = sqlite3CompareAffinity(pX->pRight, sqlite3ExprAffinity(pX->pLeft));
+      if( pX->op==TK_EQ ){
+        sqlite3VdbeAddOp4(v, OP_Lt, regMin, addrNxt, aReg[j],
+                          (char*)pColl, P4_COLLSEQ);
+        sqlite3VdbeChangeP5(v, p5 | SQLITE_JUMPIFNULL);
+        sqlite3VdbeAddOp4(v, OP_Gt, regMin+1, addrNxt, aReg[j],
+                          (char*)pColl, P4_COLLSEQ);
+      }else{
+        int iBound = (pX->op==TK_GT || pX->op==TK_GE) ? regMin+1 : regMin;
+        sqlite3VdbeAddOp4(v, aSkipOp[pX->op-TK_GT], iBound, addrNxt, aReg[j],
+                          (char*)pColl, P4_COLLSEQ);
+      }
+      sqlite3VdbeChangeP5(v, p5 | SQLITE_JUMPIFNULL);
+    }
+
+    /* Seek to the first rowid of the block.  Registers regMin+2 and
+    ** regMin+3 hold the first and last rowid of the block. */
+    sqlite3VdbeAddOp2(v, OP_Rowid, iIdxCur, regMin+2);
+    sqlite3VdbeAddOp2(v, OP_Integer, SQLITE_BRIN_SHIFT, regMin+3);
+    sqlite3VdbeAddOp3(v, OP_ShiftLeft, regMin+3, regMin+2, regMin+2);
+    sqlite3VdbeAddOp2(v, OP_SCopy, regMin+2, regMin+3);
+    sqlite3VdbeAddOp2(v, OP_AddImm, regMin+3, (1<<SQLITE_BRIN_SHIFT)-1);
+    sqlite3VdbeAddOp3(v, OP_SeekGe, iCur, addrBrk, regMin+2);
+    VdbeComment((v, "pk"));
+    iRowidReg = iReleaseReg = sqlite3GetTempReg(pParse);
+    start = sqlite3VdbeAddOp2(v, OP_Rowid, iCur, iRowidReg);
+    sqlite3VdbeAddOp3(v, OP_Gt, regMin+3, addrNxt, iRowidReg);
+    sqlite3ExprCacheStore(pParse, iCur, -1, iRowidReg);
+    pLevel->op = OP_Next;
+    pLevel->p1 = iCur;
+    pLevel->p2 = start;
+
+    pLevel->u.in.nIn = 1;
+    pLevel->u.in.aInLoop = pIn =
+        sqlite3DbMallocRaw(pParse->db, sizeof(pLevel->u.in.aInLoop[0]));
+    if( pIn ){
+      pIn->iCur = iIdxCur;
+      pIn->addrInTop = addrTop;
+    }else{
+      pLevel->u.in.nIn = 0;
+    }
   }else if( pLevel->plan.wsFlags & WHERE_ROWID_RANGE ){
     /* Case 2:  We have an inequality comparison against the ROWID field.
     */
@@ -4996,7 +5182,7 @@ WhereInfo *sqlite3WhereBegin(
     pLevel->plan = bestPlan.plan;
     testcase( bestPlan.plan.wsFlags & WHERE_INDEXED );
     testcase( bestPlan.plan.wsFlags & WHERE_TEMP_INDEX );
-    if( bestPlan.plan.wsFlags & (WHERE_INDEXED|WHERE_TEMP_INDEX) ){
+    if( bestPlan.plan.wsFlags & (WHERE_INDEXED|WHERE_TEMP_INDEX|WHERE_BRIN) ){
       if( (wctrlFlags & WHERE_ONETABLE_ONLY) 
        && (bestPlan.plan.wsFlags & WHERE_TEMP_INDEX)==0 
       ){
@@ -5020,7 +5206,7 @@ WhereInfo *sqlite3WhereBegin(
     */
     pIdx = pTabList->a[bestJ].pIndex;
     if( pIdx ){
-      if( (bestPlan.plan.wsFlags & WHERE_INDEXED)==0 ){
+      if( (bestPlan.plan.wsFlags & (WHERE_INDEXED|WHERE_BRIN))==0 ){
         sqlite3ErrorMsg(pParse, "cannot use index: %s", pIdx->zName);
         goto whereBeginError;
       }else{
@@ -5093,6 +5279,15 @@ WhereInfo *sqlite3WhereBegin(
                             SQLITE_INT_TO_PTR(n), P4_INT32);
         assert( n<=pTab->nCol );
       }
+      if( pLevel->plan.wsFlags & WHERE_ROWID_EQ ){
+        /* A "rowid IN (...)" loop seeks the table in ascending rowid
+        ** order.  Let the b-tree layer know. */
+        WhereTerm *pTerm;
+        pTerm = findTerm(pWC, pTabItem->iCursor, -1, notReady, WO_EQ|WO_IN, 0);
+        if( pTerm && (pTerm->eOperator & WO_IN)!=0 ){
+          sqlite3VdbeChangeP5(v, OPFLAG_SEEKORDERED);
+        }
+      }
     }else{
       sqlite3TableLock(pParse, iDb, pTab->tnum, 0, pTab->zName);
     }
@@ -5109,7 +5304,17 @@ WhereInfo *sqlite3WhereBegin(
       assert( iIndexCur>=0 );
       sqlite3VdbeAddOp4(v, OP_OpenRead, iIndexCur, pIx->tnum, iDb,
                         (char*)pKey, P4_KEYINFO_HANDOFF);
+      if( pLevel->plan.wsFlags & WHERE_COLUMN_IN ){
+        /* The values of an IN operator are read from an index b-tree or
+        ** a sorted ephemeral table, so the seeks made on the index are
+        ** in ascending key order. */
+        sqlite3VdbeChangeP5(v, OPFLAG_SEEKORDERED);
+      }
       VdbeComment((v, "%s", pIx->zName));
+    }else if( (pLevel->plan.wsFlags & WHERE_BRIN)!=0 ){
+      Index *pIx = pLevel->plan.u.pIdx;
+      assert( pIx->pSchema==pTab->pSchema );
+      sqlite3OpenIndex(pParse, pLevel->iIdxCur, iDb, pIx, OP_OpenRead);
     }
     sqlite3CodeVerifySchema(pParse, iDb);
     notReady &= ~getMask(pWC->pMaskSet, pTabItem->iCursor);
@@ -5267,7 +5472,9 @@ void sqlite3WhereEnd(WhereInfo *pWInfo){
       if( !pWInfo->okOnePass && (ws & WHERE_IDX_ONLY)==0 ){
         sqlite3VdbeAddOp1(v, OP_Close, pTabItem->iCursor);
       }
-      if( (ws & WHERE_INDEXED)!=0 && (ws & WHERE_TEMP_INDEX)==0 ){
+      if( (ws & (WHERE_INDEXED|WHERE_BRIN))!=0
+       && (ws & WHERE_TEMP_INDEX)==0
+      ){
         sqlite3VdbeAddOp1(v, OP_Close, pLevel->iIdxCur);
       }
     }
@@ -0,0 +1,126 @@
+#!/usr/bin/tclsh
+#
+# Compare the speed of the "unix-uring" VFS with that of the "unix" VFS.
+#
+# Usage:
+#
+#     tclsh uring_perf.tcl ?DIRECTORY? ?NTRANS? ?NROW?
+#
+# The script must be run by a tclsh that can load an SQLite Tcl interface
+# built with SQLITE_ENABLE_IO_URING.  Test databases are created in
+# DIRECTORY, which defaults to the current directory.  Results are only
+# meaningful if DIRECTORY is on the storage device of interest, not on a
+# tmpfs.
+#
+# Each test runs NTRANS transactions (default 20) of NROW statements
+# (default 500) against a database with 4096 byte pages, once with each
+# VFS, and reports the best of three runs.  The tests are:
+#
+#    insert    Append rows of about 3000 bytes, so every page written
+#              extends the file.
+#
+#    update    Overwrite randomly chosen rows of a 20000 row table, so
+#              that each commit writes pages scattered through the file.
+#
+# Each test is run in rollback (journal_mode=DELETE) and WAL mode with
+# synchronous=FULL, with ordinary buffered I/O and with "direct=1"
+# (O_DIRECT) on the database file.
+#
+package require sqlite3
+
+set DIR    [expr {[llength $argv]>0 ? [lindex $argv 0] : "."}]
+set NTRANS [expr {[llength $argv]>1 ? [lindex $argv 1] : 20}]
+set NROW   [expr {[llength $argv]>2 ? [lindex $argv 2] : 500}]
+set NBASE  20000
+
+set base [file join $DIR uring_perf_base.db]
+set test [file join $DIR uring_perf.db]
+
+if {[catch {sqlite3 db $test -vfs unix-uring}]} {
+  puts "The unix-uring VFS is not available in this build"
+  exit 1
+}
+db close
+
+proc delete_db {zFile} {
+  foreach suffix {"" -journal -wal -shm} {
+    file delete -force $zFile$suffix
+  }
+}
+
+# Create the database that the "update" test starts from.
+#
+delete_db $base
+sqlite3 db $base
+db eval {
+  PRAGMA page_size = 4096;
+  CREATE TABLE t1(a INTEGER PRIMARY KEY, b);
+}
+db transaction {
+  for {set ii 0} {$ii < $NBASE} {incr ii} {
+    db eval {INSERT INTO t1(b) VALUES(randomblob(3000))}
+  }
+}
+db close
+
+# Run test $zTest once using VFS $zVfs.  Return the time taken in
+# milliseconds.
+#
+proc run_test {zTest zVfs zMode bDirect} {
+  global base test NTRANS NROW NBASE
+
+  delete_db $test
+  if {$zTest=="update"} {
+    file copy $base $test
+  }
+  set uri "file:$test"
+  if {$bDirect} { append uri "?direct=1" }
+  sqlite3 db $uri -vfs $zVfs -uri 1
+  db eval "
+    PRAGMA page_size = 4096;
+    PRAGMA journal_mode = $zMode;
+    PRAGMA synchronous = FULL;
+    CREATE TABLE IF NOT EXISTS t1(a INTEGER PRIMARY KEY, b);
+  "
+
+  expr {srand(1)}
+  set us [lindex [time {
+    for {set ii 0} {$ii < $NTRANS} {incr ii} {
+      db transaction {
+        for {set jj 0} {$jj < $NROW} {incr jj} {
+          if {$zTest=="insert"} {
+            db eval {INSERT INTO t1(b) VALUES(randomblob(3000))}
+          } else {
+            set r [expr {int(rand()*$NBASE)+1}]
+            db eval {UPDATE t1 SET b = zeroblob(3000) WHERE a = $r}
+          }
+        }
+      }
+    }
+  }] 0]
+  db close
+  return [expr {$us/1000}]
+}
+
+puts [format "%-8s %-7s %-6s %10s %12s %7s" \
+    test mode direct "unix ms" "uring ms" change]
+foreach zTest {insert update} {
+  foreach zMode {delete wal} {
+    foreach bDirect {0 1} {
+      set best(unix) 0
+      set best(unix-uring) 0
+      for {set iRun 0} {$iRun < 3} {incr iRun} {
+        foreach zVfs {unix unix-uring} {
+          set ms [run_test $zTest $zVfs $zMode $bDirect]
+          if {$best($zVfs)==0 || $ms<$best($zVfs)} { set best($zVfs) $ms }
+        }
+      }
+      set change [expr {100.0*($best(unix-uring)-$best(unix))/$best(unix)}]
+      puts [format "%-8s %-7s %-6s %10d %12d %+6.1f%%" \
+          $zTest $zMode $bDirect $best(unix) $best(unix-uring) $change]
+    }
+  }
+}
+
+delete_db $test
+delete_db $base